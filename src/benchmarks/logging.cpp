@@ -0,0 +1,124 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+// Measures the cost of log messages: disabled messages, which are skipped without evaluating their
+// arguments, and enabled ones, emitted by one or several threads, which are copied to the logger
+// and read back by another thread (optionally formatting them, as the text logging thread does).
+// For reference, the cost of formatting the messages with snprintf on the emitting thread is also
+// measured.
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/profiler.h"
+#include "common/logging/backend.h"
+#include "common/logging/filter.h"
+#include "common/logging/log.h"
+
+namespace {
+
+const unsigned int NUM_MESSAGES = 10000000;
+
+/// Reads and optionally formats NUM_MESSAGES entries from the logger
+void DrainLogger(Log::Logger* logger, bool format) {
+    std::vector<Log::Entry> entries(64);
+    char text[256];
+
+    for (unsigned int count = 0; count < NUM_MESSAGES;) {
+        size_t num_entries = logger->GetEntries(entries.data(), entries.size());
+        if (num_entries == Log::Logger::QUEUE_CLOSED)
+            return;
+
+        if (format) {
+            for (size_t i = 0; i < num_entries; ++i)
+                Log::FormatEntryMessage(entries[i], text, sizeof(text));
+        }
+        count += (unsigned int)num_entries;
+    }
+}
+
+/**
+ * Emits debug messages with a few arguments
+ * @param num_messages Number of messages to emit
+ * @return Average time per message, in nanoseconds
+ */
+double EmitMessages(unsigned int num_messages = NUM_MESSAGES) {
+    auto start = Common::Profiling::Clock::now();
+
+    for (unsigned int i = 0; i < num_messages; ++i)
+        LOG_DEBUG(Debug, "message %u of %s: value=%f", i, "logging benchmark", i * 0.5);
+
+    auto elapsed = Common::Profiling::Clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / num_messages;
+}
+
+/**
+ * Formats the same messages as EmitMessages with snprintf
+ * @return Average time per message, in nanoseconds
+ */
+double FormatMessages() {
+    char text[256];
+    u64 checksum = 0;
+    auto start = Common::Profiling::Clock::now();
+
+    for (unsigned int i = 0; i < NUM_MESSAGES; ++i) {
+        checksum += std::snprintf(text, sizeof(text), "message %u of %s: value=%f", i,
+                                  "logging benchmark", i * 0.5);
+    }
+
+    auto elapsed = Common::Profiling::Clock::now() - start;
+
+    // Keeps the compiler from dropping the loop
+    if (checksum == 1)
+        std::printf(" ");
+
+    return std::chrono::duration<double, std::nano>(elapsed).count() / NUM_MESSAGES;
+}
+
+/**
+ * Emits NUM_MESSAGES messages with a new logger drained by another thread
+ * @param format Whether the reader formats the messages
+ * @param num_threads Number of threads emitting the messages, which each emit an equal share
+ * @return Average time per message until all were read, in nanoseconds
+ */
+double EmitEnabledMessages(bool format, unsigned int num_threads = 1) {
+    std::shared_ptr<Log::Logger> logger = Log::InitGlobalLogger();
+
+    auto start = Common::Profiling::Clock::now();
+    std::thread reader(DrainLogger, logger.get(), format);
+    std::vector<std::thread> emitters;
+    for (unsigned int i = 0; i < num_threads; ++i)
+        emitters.emplace_back(EmitMessages, NUM_MESSAGES / num_threads);
+    for (auto& emitter : emitters)
+        emitter.join();
+    reader.join();
+    auto elapsed = Common::Profiling::Clock::now() - start;
+
+    logger->Close();
+    return std::chrono::duration<double, std::nano>(elapsed).count() / NUM_MESSAGES;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Log::Filter filter(Log::Level::Info);
+    Log::SetFilter(&filter);
+
+    std::printf("%u messages\n", NUM_MESSAGES);
+    std::printf("%-32s %16s\n", "", "ns per message");
+    std::printf("%-32s %16.1f\n", "disabled", EmitMessages());
+
+    filter.ResetAll(Log::Level::Debug);
+    Log::OnFilterChanged(&filter);
+    std::printf("%-32s %16.1f\n", "enabled", EmitEnabledMessages(false));
+    std::printf("%-32s %16.1f\n", "enabled, formatted by reader", EmitEnabledMessages(true));
+    std::printf("%-32s %16.1f\n", "enabled, 4 emitting threads", EmitEnabledMessages(false, 4));
+    std::printf("%-32s %16.1f\n", "snprintf on the emitting thread", FormatMessages());
+
+    return 0;
+}
@@ -0,0 +1,131 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+// Synthetic benchmark of the kernel's ready queue with hundreds of guest threads. The threads go
+// through the same ThreadQueueList operations as in Kernel::Reschedule: the best thread is picked
+// to run, then it either yields, waits or gets preempted, waiting threads are woken up, priorities
+// change and starved threads are boosted.
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/profiler.h"
+#include "common/thread_queue_list.h"
+
+namespace {
+
+/// Same number of priority levels as the kernel (THREADPRIO_LOWEST + 1)
+const unsigned int NUM_PRIORITIES = 64;
+
+enum class Status { Running, Ready, Waiting };
+
+struct GuestThread {
+    Common::ThreadQueueListHook<GuestThread> ready_queue_hook;
+    unsigned int priority;
+    Status status;
+};
+
+typedef Common::ThreadQueueList<GuestThread, NUM_PRIORITIES, &GuestThread::ready_queue_hook> ReadyQueue;
+
+/**
+ * Runs num_switches scheduling decisions over num_threads threads.
+ * @return Average time per scheduling decision, in nanoseconds
+ */
+double Run(unsigned int num_threads, unsigned int num_switches) {
+    std::mt19937 rng(num_threads);
+    std::uniform_int_distribution<unsigned int> random_priority(0x18, NUM_PRIORITIES - 1);
+    std::uniform_int_distribution<unsigned int> random_thread(0, num_threads - 1);
+    std::uniform_int_distribution<unsigned int> random_event(0, 99);
+
+    std::vector<GuestThread> threads(num_threads);
+    ReadyQueue ready_queue;
+    for (GuestThread& thread : threads) {
+        thread.priority = random_priority(rng);
+        thread.status = Status::Ready;
+        ready_queue.push_back(thread.priority, &thread);
+    }
+
+    // The random numbers are drawn up front, so that only the queue operations are timed
+    std::vector<unsigned int> events(num_switches * 3);
+    for (unsigned int& event : events)
+        event = random_event(rng) << 16 | random_thread(rng);
+
+    u64 checksum = 0;
+    auto start = Common::Profiling::Clock::now();
+
+    GuestThread* current = nullptr;
+    for (unsigned int i = 0; i < num_switches; ++i) {
+        const unsigned int* event = &events[i * 3];
+
+        // Wake up a waiting thread, or change the priority of a ready one
+        GuestThread& other = threads[event[0] & 0xFFFF];
+        if (other.status == Status::Waiting) {
+            other.status = Status::Ready;
+            ready_queue.push_back(other.priority, &other);
+        } else if (other.status == Status::Ready && (event[0] >> 16) < 10) {
+            unsigned int new_priority = 0x18 + (event[1] & 0x1F);
+            ready_queue.move(&other, other.priority, new_priority);
+            other.priority = new_priority;
+        }
+
+        // Boost a starved thread above the best ready thread
+        GuestThread& starved = threads[event[1] & 0xFFFF];
+        if (starved.status == Status::Ready && (event[1] >> 16) < 2) {
+            unsigned int boosted = ready_queue.get_first()->priority;
+            boosted = boosted > 0 ? boosted - 1 : 0;
+            ready_queue.move(&starved, starved.priority, boosted);
+            starved.priority = boosted;
+        }
+
+        // The running thread yields, waits or is preempted by a better thread
+        unsigned int outcome = event[2] >> 16;
+        if (current != nullptr) {
+            if (outcome < 40) {
+                current->status = Status::Waiting;
+            } else if (outcome < 70) {
+                current->status = Status::Ready;
+                ready_queue.push_back(current->priority, current);
+            } else {
+                GuestThread* better = ready_queue.pop_first_better(current->priority);
+                if (better == nullptr)
+                    continue;
+                current->status = Status::Ready;
+                ready_queue.push_front(current->priority, current);
+                current = better;
+                current->status = Status::Running;
+                checksum += current->priority;
+                continue;
+            }
+        }
+
+        current = ready_queue.pop_first();
+        if (current != nullptr) {
+            current->status = Status::Running;
+            checksum += current->priority;
+        }
+    }
+
+    auto elapsed = Common::Profiling::Clock::now() - start;
+
+    // Keeps the compiler from dropping the loop
+    if (checksum == 1)
+        std::printf(" ");
+
+    return std::chrono::duration<double, std::nano>(elapsed).count() / num_switches;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const unsigned int num_switches = 10000000;
+
+    std::printf("%8s %16s\n", "threads", "ns per switch");
+    for (unsigned int num_threads : { 16, 64, 128, 256, 512, 1024 })
+        std::printf("%8u %16.1f\n", num_threads, Run(num_threads, num_switches));
+
+    return 0;
+}
@@ -0,0 +1,385 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+// Measures the time each vertex shader backend takes per vertex. Shaders captured from games (in
+// the shbin format written by DebugUtils::DumpShader) can be passed on the command line. Without
+// arguments, a few hand-written shaders representative of common workloads are used: a
+// model-view-projection transform, the same with per-vertex diffuse lighting, and four-bone
+// skinning in a loop.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <nihstro/shader_binary.h>
+
+#include "common/common_types.h"
+#include "common/file_util.h"
+#include "common/profiler.h"
+
+#include "core/settings.h"
+
+#include "video_core/pica.h"
+#include "video_core/vertex_shader.h"
+
+using nihstro::DVLBHeader;
+using nihstro::DVLEHeader;
+using nihstro::DVLPHeader;
+
+namespace {
+
+using Pica::float24;
+using Pica::Regs;
+
+const unsigned int NUM_VERTICES = 200000;
+/// Each measurement is repeated, and the fastest run is reported, to filter out noise
+const int NUM_RUNS = 3;
+
+struct Shader {
+    std::string name;
+    std::vector<u32> program_code;
+    std::vector<u32> swizzle_data;
+    u32 main_offset;
+    std::array<Regs::VSOutputAttributes, 7> output_attributes;
+};
+
+struct Backend {
+    const char* name;
+    int setting;
+    Pica::VertexShader::ShaderBackend backend;
+};
+
+const Backend backends[] = {
+    { "interpreter", 0, Pica::VertexShader::ShaderBackend::Interpreter },
+    { "decoded", 4, Pica::VertexShader::ShaderBackend::DecodedInterpreter },
+    { "jit", 1, Pica::VertexShader::ShaderBackend::Jit },
+    { "simd", 3, Pica::VertexShader::ShaderBackend::SimdInterpreter },
+    { "simd avx", 5, Pica::VertexShader::ShaderBackend::AvxInterpreter },
+};
+
+// Encoding of the instructions used by the built-in shaders
+enum : u32 {
+    ADD = 0x00, DP3 = 0x01, DP4 = 0x02, MUL = 0x08, MAX = 0x0C, RSQ = 0x0F, MOV = 0x13,
+    NOP = 0x21, END = 0x22, LOOP = 0x29,
+};
+
+u32 Arithmetic(u32 opcode, u32 dest, u32 src1, u32 src2, u32 operand_desc, u32 address_register = 0) {
+    return (opcode << 26) | (dest << 21) | (address_register << 19) | (src1 << 12) | (src2 << 7) | operand_desc;
+}
+
+u32 Loop(u32 last_instruction, u32 int_uniform) {
+    return (LOOP << 26) | (int_uniform << 22) | (last_instruction << 10);
+}
+
+u32 FlowControl(u32 opcode) {
+    return opcode << 26;
+}
+
+/// Operand descriptor writing the components in `dest_mask` (x = 8, y = 4, z = 2, w = 1)
+u32 OperandDesc(u32 dest_mask, u32 src1_selector = 0x1B, u32 src2_selector = 0x1B) {
+    return dest_mask | (src1_selector << 5) | (src2_selector << 14) | (0x1B << 23);
+}
+
+const u32 SELECT_XXXX = 0x00;
+
+// Register indices
+const u32 V0 = 0x00, V1 = 0x01, V2 = 0x02, V3 = 0x03, V4 = 0x04;
+const u32 R0 = 0x10, R1 = 0x11, R2 = 0x12, R3 = 0x13;
+const u32 O0 = 0x00, O1 = 0x01, O2 = 0x02;
+u32 C(u32 index) {
+    return 0x20 + index;
+}
+
+/// Sets output register `index` to the given semantics, or to nothing if `semantic_x` is INVALID
+void SetOutput(Shader& shader, int index, Regs::VSOutputAttributes::Semantic semantic_x, int num_components) {
+    Regs::VSOutputAttributes& output = shader.output_attributes[index];
+    output.map_x = (num_components > 0) ? semantic_x : Regs::VSOutputAttributes::INVALID;
+    output.map_y = (num_components > 1) ? (Regs::VSOutputAttributes::Semantic)(semantic_x + 1) : Regs::VSOutputAttributes::INVALID;
+    output.map_z = (num_components > 2) ? (Regs::VSOutputAttributes::Semantic)(semantic_x + 2) : Regs::VSOutputAttributes::INVALID;
+    output.map_w = (num_components > 3) ? (Regs::VSOutputAttributes::Semantic)(semantic_x + 3) : Regs::VSOutputAttributes::INVALID;
+}
+
+Shader MakeShader(const char* name) {
+    Shader shader;
+    shader.name = name;
+    shader.main_offset = 0;
+    // Descriptor 0 writes all components, 1-4 write x, y, z and w respectively
+    shader.swizzle_data = { OperandDesc(0xF), OperandDesc(0x8), OperandDesc(0x4), OperandDesc(0x2),
+                            OperandDesc(0x1) };
+    for (int i = 0; i < 7; ++i)
+        SetOutput(shader, i, Regs::VSOutputAttributes::INVALID, 0);
+    SetOutput(shader, 0, Regs::VSOutputAttributes::POSITION_X, 4);
+    SetOutput(shader, 1, Regs::VSOutputAttributes::COLOR_R, 4);
+    SetOutput(shader, 2, Regs::VSOutputAttributes::TEXCOORD0_U, 2);
+    return shader;
+}
+
+/// Appends dest = matrix * src, for the 4x4 matrix stored in the rows c[matrix] to c[matrix + 3]
+void AppendTransform(Shader& shader, u32 dest, u32 matrix, u32 src, u32 address_register = 0) {
+    for (u32 row = 0; row < 4; ++row)
+        shader.program_code.push_back(Arithmetic(DP4, dest, C(matrix + row), src, 1 + row, address_register));
+}
+
+/// Model-view transform (c0-c3) followed by the projection (c4-c7), passing color and texcoord
+Shader MakeTransformShader() {
+    Shader shader = MakeShader("transform");
+    AppendTransform(shader, R0, 0, V0);
+    AppendTransform(shader, O0, 4, R0);
+    shader.program_code.push_back(Arithmetic(MOV, O1, V1, 0, 0));
+    shader.program_code.push_back(Arithmetic(MOV, O2, V2, 0, 0));
+    shader.program_code.push_back(FlowControl(END));
+    return shader;
+}
+
+/// Transform, with a diffuse color computed from the normal (v3), light direction (c8), light
+/// color (c9) and ambient color (c10)
+Shader MakeLightingShader() {
+    Shader shader = MakeShader("lighting");
+    u32 normalize_desc = (u32)shader.swizzle_data.size();
+    shader.swizzle_data.push_back(OperandDesc(0xF, 0x1B, SELECT_XXXX));
+    u32 splat_desc = (u32)shader.swizzle_data.size();
+    shader.swizzle_data.push_back(OperandDesc(0xF, SELECT_XXXX, SELECT_XXXX));
+
+    AppendTransform(shader, R0, 0, V0);
+    AppendTransform(shader, O0, 4, R0);
+    shader.program_code.push_back(Arithmetic(DP3, R1, V3, V3, 1));
+    shader.program_code.push_back(Arithmetic(RSQ, R1, R1, 0, splat_desc));
+    shader.program_code.push_back(Arithmetic(MUL, R2, V3, R1, normalize_desc));
+    shader.program_code.push_back(Arithmetic(DP3, R1, C(8), R2, 1));
+    shader.program_code.push_back(Arithmetic(MAX, R1, C(11), R1, 0));
+    shader.program_code.push_back(Arithmetic(MUL, R3, C(9), R1, normalize_desc));
+    shader.program_code.push_back(Arithmetic(ADD, O1, C(10), R3, 0));
+    shader.program_code.push_back(Arithmetic(MOV, O2, V2, 0, 0));
+    shader.program_code.push_back(FlowControl(END));
+    return shader;
+}
+
+/// Blends the position transformed by four bone matrices (c20-c35) with the weights in v4, in a
+/// loop configured by int uniform i0, then applies the projection
+Shader MakeSkinningShader() {
+    Shader shader = MakeShader("skinning");
+    u32 weight_desc = (u32)shader.swizzle_data.size();
+    shader.swizzle_data.push_back(OperandDesc(0xF, 0x1B, SELECT_XXXX));
+
+    // The bone weights are rotated by one component per iteration, so that x is the current one
+    u32 rotate_desc = (u32)shader.swizzle_data.size();
+    shader.swizzle_data.push_back(OperandDesc(0xF, 0x39));
+
+    shader.program_code.push_back(Arithmetic(MOV, R0, C(11), 0, 0));
+    shader.program_code.push_back(Arithmetic(MOV, R3, V4, 0, 0));
+    u32 loop_offset = (u32)shader.program_code.size();
+    shader.program_code.push_back(0);
+    AppendTransform(shader, R1, 20, V0, 3);
+    shader.program_code.push_back(Arithmetic(MUL, R2, R1, R3, weight_desc));
+    shader.program_code.push_back(Arithmetic(ADD, R0, R0, R2, 0));
+    shader.program_code.push_back(Arithmetic(MOV, R3, R3, 0, rotate_desc));
+    shader.program_code[loop_offset] = Loop((u32)shader.program_code.size() - 1, 0);
+    shader.program_code.push_back(FlowControl(NOP));
+    AppendTransform(shader, O0, 4, R0);
+    shader.program_code.push_back(Arithmetic(MOV, O1, V1, 0, 0));
+    shader.program_code.push_back(FlowControl(END));
+    return shader;
+}
+
+/// Reads the first program of a shbin file
+bool LoadShader(const std::string& path, Shader& shader) {
+    FileUtil::IOFile file(path, "rb");
+    std::vector<u8> data(file.IsOpen() ? (size_t)file.GetSize() : 0);
+    if (data.empty() || file.ReadBytes(data.data(), data.size()) != data.size())
+        return false;
+
+    auto Read = [&data](size_t offset, void* out, size_t size) {
+        if (offset > data.size() || size > data.size() - offset)
+            return false;
+        std::memcpy(out, &data[offset], size);
+        return true;
+    };
+
+    DVLBHeader dvlb;
+    u32 dvle_offset;
+    if (!Read(0, &dvlb, sizeof(dvlb)) || dvlb.magic_word != DVLBHeader::MAGIC_WORD ||
+        !Read(sizeof(dvlb), &dvle_offset, sizeof(dvle_offset))) {
+        return false;
+    }
+
+    // The program (DVLP) follows the offsets of the entry points (DVLE)
+    size_t dvlp_offset = sizeof(dvlb) + dvlb.num_programs * sizeof(u32);
+    DVLPHeader dvlp;
+    DVLEHeader dvle;
+    if (!Read(dvlp_offset, &dvlp, sizeof(dvlp)) || dvlp.magic_word != DVLPHeader::MAGIC_WORD ||
+        !Read(dvle_offset, &dvle, sizeof(dvle)) || dvle.magic_word != DVLEHeader::MAGIC_WORD) {
+        return false;
+    }
+
+    shader.program_code.resize(std::min<u32>(dvlp.binary_size_words, 1024));
+    if (!Read(dvlp_offset + dvlp.binary_offset, shader.program_code.data(), shader.program_code.size() * sizeof(u32)))
+        return false;
+
+    // Each swizzle pattern is followed by an unused word
+    shader.swizzle_data.resize(std::min<u32>(dvlp.swizzle_info_num_entries, 1024));
+    for (size_t i = 0; i < shader.swizzle_data.size(); ++i) {
+        if (!Read(dvlp_offset + dvlp.swizzle_info_offset + i * 8, &shader.swizzle_data[i], sizeof(u32)))
+            return false;
+    }
+
+    shader.name = path;
+    shader.main_offset = dvle.main_offset_words;
+
+    // Output registers: type in bits 0-15, register in bits 16-31, component mask (x = 1) in bits 32-35
+    for (int i = 0; i < 7; ++i)
+        SetOutput(shader, i, Regs::VSOutputAttributes::INVALID, 0);
+    for (u32 i = 0; i < dvle.output_register_table_size; ++i) {
+        u64 info;
+        if (!Read(dvle_offset + dvle.output_register_table_offset + i * sizeof(info), &info, sizeof(info)))
+            return false;
+
+        u32 index = (info >> 16) & 0xFFFF;
+        u32 component_mask = (info >> 32) & 0xF;
+        Regs::VSOutputAttributes::Semantic semantic_x;
+        switch (info & 0xFFFF) {
+        case 0: semantic_x = Regs::VSOutputAttributes::POSITION_X; break;
+        case 2: semantic_x = Regs::VSOutputAttributes::COLOR_R; break;
+        case 3: semantic_x = Regs::VSOutputAttributes::TEXCOORD0_U; component_mask &= 3; break;
+        case 5: semantic_x = Regs::VSOutputAttributes::TEXCOORD1_U; component_mask &= 3; break;
+        case 6: semantic_x = Regs::VSOutputAttributes::TEXCOORD2_U; component_mask &= 3; break;
+        default: continue;
+        }
+        if (index >= 7)
+            continue;
+
+        Regs::VSOutputAttributes& output = shader.output_attributes[index];
+        if (component_mask & 1)
+            output.map_x = semantic_x;
+        if (component_mask & 2)
+            output.map_y = (Regs::VSOutputAttributes::Semantic)(semantic_x + 1);
+        if (component_mask & 4)
+            output.map_z = (Regs::VSOutputAttributes::Semantic)(semantic_x + 2);
+        if (component_mask & 8)
+            output.map_w = (Regs::VSOutputAttributes::Semantic)(semantic_x + 3);
+    }
+    return true;
+}
+
+/// Loads the shader and random uniforms into the Pica state
+void SetupShader(const Shader& shader) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> random_value(-1.0f, 1.0f);
+
+    for (u32 i = 0; i < 1024; ++i) {
+        Pica::VertexShader::SubmitShaderMemoryChange(i, i < shader.program_code.size() ? shader.program_code[i] : 0);
+        Pica::VertexShader::SubmitSwizzleDataChange(i, i < shader.swizzle_data.size() ? shader.swizzle_data[i] : 0);
+    }
+
+    for (u32 i = 0; i < 96; ++i) {
+        Pica::VertexShader::GetFloatUniform(i) = {
+            float24::FromFloat32(random_value(rng)), float24::FromFloat32(random_value(rng)),
+            float24::FromFloat32(random_value(rng)), float24::FromFloat32(random_value(rng)) };
+    }
+    // c11 is used as zero by the built-in shaders
+    Pica::VertexShader::GetFloatUniform(11) = Math::Vec4<float24>::AssignToAll(float24::FromFloat32(0.0f));
+    for (u32 i = 0; i < 16; ++i)
+        Pica::VertexShader::GetBoolUniform(i) = false;
+    // i0: four iterations, over the bone matrices starting at c20
+    Pica::VertexShader::GetIntUniform(0) = { 3, 0, 4, 0 };
+
+    u64 input_register_map = 0;
+    for (u64 i = 0; i < 16; ++i)
+        input_register_map |= i << (4 * i);
+    std::memcpy(&Pica::registers.vs_input_register_map, &input_register_map, sizeof(input_register_map));
+    std::memcpy(Pica::registers.vs_output_attributes, shader.output_attributes.data(), sizeof(shader.output_attributes));
+    Pica::registers.vs_main_offset = shader.main_offset;
+}
+
+/**
+ * Runs the current shader for NUM_VERTICES vertices with the given backend, NUM_RUNS times
+ * @return Average time per vertex of the fastest run, in nanoseconds, or a negative value if the
+ *         backend isn't supported by the host
+ */
+double Run(const Backend& backend, const std::vector<Pica::VertexShader::InputVertex>& inputs) {
+    Settings::values.vertex_shader_backend = backend.setting;
+
+    Pica::VertexShader::ShaderSetup setup;
+    Pica::VertexShader::CaptureShaderSetup(setup);
+    if (setup.backend != backend.backend)
+        return -1.0;
+
+    const int batch_size = Pica::VertexShader::MAX_SHADER_BATCH_SIZE;
+    Pica::VertexShader::OutputVertex outputs[batch_size];
+    float checksum = 0.0f;
+    double best_time = 0.0;
+
+    for (int run = 0; run < NUM_RUNS; ++run) {
+        auto start = Common::Profiling::Clock::now();
+
+        for (unsigned int i = 0; i < NUM_VERTICES; i += batch_size) {
+            Pica::VertexShader::RunShaderBatch(setup, &inputs[i % inputs.size()], batch_size, 16, outputs);
+            checksum += outputs[0].pos.x.ToFloat32();
+        }
+
+        double time = std::chrono::duration<double, std::nano>(Common::Profiling::Clock::now() - start).count();
+        if (run == 0 || time < best_time)
+            best_time = time;
+    }
+
+    // Keeps the compiler from dropping the loop
+    if (checksum == 1.0f)
+        std::printf(" ");
+
+    return best_time / NUM_VERTICES;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::vector<Shader> shaders;
+    if (argc > 1) {
+        for (int i = 1; i < argc; ++i) {
+            Shader shader;
+            if (!LoadShader(argv[i], shader)) {
+                std::fprintf(stderr, "Failed to load shader %s\n", argv[i]);
+                return 1;
+            }
+            shaders.push_back(std::move(shader));
+        }
+    } else {
+        shaders.push_back(MakeTransformShader());
+        shaders.push_back(MakeLightingShader());
+        shaders.push_back(MakeSkinningShader());
+    }
+
+    // The inputs are a multiple of the batch size, so that batches don't wrap around
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> random_value(0.0f, 1.0f);
+    std::vector<Pica::VertexShader::InputVertex> inputs(1024);
+    for (auto& input : inputs) {
+        for (auto& attribute : input.attr) {
+            for (int i = 0; i < 4; ++i)
+                attribute[i] = float24::FromFloat32(random_value(rng));
+        }
+    }
+
+    std::printf("%u vertices, ns per vertex (fastest of %d runs)\n", NUM_VERTICES, NUM_RUNS);
+    std::printf("%-16s", "");
+    for (const Backend& backend : backends)
+        std::printf(" %12s", backend.name);
+    std::printf("\n");
+
+    for (const Shader& shader : shaders) {
+        SetupShader(shader);
+        std::printf("%-16s", shader.name.c_str());
+        for (const Backend& backend : backends) {
+            double time = Run(backend, inputs);
+            if (time < 0.0)
+                std::printf(" %12s", "n/a");
+            else
+                std::printf(" %12.1f", time);
+        }
+        std::printf("\n");
+    }
+
+    return 0;
+}
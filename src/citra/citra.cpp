@@ -7,6 +7,7 @@
 #include "common/logging/log.h"
 #include "common/logging/text_formatter.h"
 #include "common/logging/backend.h"
+#include "common/logging/binary_log.h"
 #include "common/logging/filter.h"
 #include "common/scope_exit.h"
 
@@ -27,6 +28,7 @@ int main(int argc, char **argv) {
     SCOPE_EXIT({
         logger->Close();
         logging_thread.join();
+        Log::BinaryLog::StopGlobalLog();
     });
 
     if (argc < 2) {
@@ -36,6 +38,11 @@ int main(int argc, char **argv) {
 
     Config config;
     log_filter.ParseFilterString(Settings::values.log_filter);
+    logger->SetOverflowPolicy(static_cast<Log::OverflowPolicy>(Settings::values.log_overflow_policy));
+    if (!Settings::values.binary_log_path.empty() &&
+        !Log::BinaryLog::StartGlobalLog(Settings::values.binary_log_path)) {
+        LOG_ERROR(Frontend, "Failed to open binary log %s", Settings::values.binary_log_path.c_str());
+    }
 
     std::string boot_filename = argv[1];
     EmuWindow_GLFW* emu_window = new EmuWindow_GLFW;
@@ -73,6 +73,9 @@ void Config::ReadValues() {
     Settings::values.bg_red   = (float)glfw_config->GetReal("Renderer", "bg_red",   1.0);
     Settings::values.bg_green = (float)glfw_config->GetReal("Renderer", "bg_green", 1.0);
     Settings::values.bg_blue  = (float)glfw_config->GetReal("Renderer", "bg_blue",  1.0);
+    Settings::values.vertex_processing_threads = glfw_config->GetInteger("Renderer", "vertex_processing_threads", 1);
+    Settings::values.vertex_shader_backend = glfw_config->GetInteger("Renderer", "vertex_shader_backend", 0);
+    Settings::values.rasterizer_threads = glfw_config->GetInteger("Renderer", "rasterizer_threads", 1);
 
     // Data Storage
     Settings::values.use_virtual_sd = glfw_config->GetBoolean("Data Storage", "use_virtual_sd", true);
@@ -82,6 +85,11 @@ void Config::ReadValues() {
 
     // Miscellaneous
     Settings::values.log_filter = glfw_config->Get("Miscellaneous", "log_filter", "*:Info");
+    Settings::values.log_overflow_policy = glfw_config->GetInteger("Miscellaneous", "log_overflow_policy", 2);
+    Settings::values.binary_log_path = glfw_config->Get("Miscellaneous", "binary_log_path", "");
+    Settings::values.ipc_trace_path = glfw_config->Get("Miscellaneous", "ipc_trace_path", "");
+    Settings::values.metrics_path = glfw_config->Get("Miscellaneous", "metrics_path", "");
+    Settings::values.metrics_socket_path = glfw_config->Get("Miscellaneous", "metrics_socket_path", "");
 }
 
 void Config::Reload() {
@@ -48,6 +48,22 @@ bg_red =
 bg_blue =
 bg_green =
 
+# Number of host threads processing the vertices of large draws
+# 1 (default): Only the emulation thread, 0: One thread per host CPU core, N: N threads
+vertex_processing_threads =
+
+# How vertex shaders are run
+# 0 (default): Interpreter, 1: Compiled to native code where supported,
+# 2: Compiled and checked against the interpreter (slow, for debugging),
+# 3: Interpreter running four vertices at once with SIMD instructions,
+# 4: Interpreter running a pre-decoded version of the program,
+# 5: Like 3, with eight vertices at once on CPUs supporting AVX
+vertex_shader_backend =
+
+# Number of host threads rasterizing triangles, which then happens in the background
+# 1 (default): Only the emulation thread, 0: One thread per host CPU core, N: N threads
+rasterizer_threads =
+
 [Data Storage]
 # Whether to create a virtual SD card.
 # 1 (default): Yes, 0: No
@@ -62,6 +78,26 @@ region_value =
 # A filter which removes logs below a certain logging level.
 # Examples: *:Debug Kernel.SVC:Trace Service.*:Critical
 log_filter = *:Info
+
+# What to do with log messages when they are emitted faster than they can be printed
+# 0: Wait for them to be printed, 1: Drop them, 2: Buffer them (default), dropping them if too many
+log_overflow_policy =
+
+# If set, log messages are written to this file in a binary format instead of the console, except
+# for errors. The log can be decoded with citra-logdump.
+binary_log_path =
+
+# If set, records all the service requests made by the application to this file.
+# The trace can be replayed with citra-ipc-replay.
+ipc_trace_path =
+
+# If set, a snapshot of the performance counters (frame rate, emulation speed, instructions, SVCs,
+# draw calls, triangles, ...) is written to this file every second, in plain text
+metrics_path =
+
+# If set, the same snapshots are streamed to the clients of a Unix domain socket created at this
+# path (not supported on Windows)
+metrics_socket_path =
 )";
 
 }
@@ -0,0 +1,220 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+// Replays an IPC trace recorded by the emulator against the HLE services, without running the
+// emulated CPU, and reports how long each command took.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "common/file_util.h"
+#include "common/logging/log.h"
+#include "common/logging/text_formatter.h"
+#include "common/logging/backend.h"
+#include "common/logging/filter.h"
+#include "common/scope_exit.h"
+
+#include "core/core.h"
+#include "core/core_timing.h"
+#include "core/mem_map.h"
+#include "core/settings.h"
+#include "core/hw/hw.h"
+#include "core/hle/hle.h"
+#include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/process.h"
+#include "core/hle/kernel/session.h"
+#include "core/hle/kernel/thread.h"
+#include "core/hle/service/ipc_trace.h"
+#include "core/hle/service/service.h"
+
+using namespace Service::IPCTrace;
+
+/// Timing statistics of all the replayed requests of a command
+struct CommandStats {
+    unsigned int count = 0;
+    unsigned int mismatches = 0;  ///< Number of replies that differ from the recorded ones
+    u64 total_ns = 0;
+    u64 min_ns = UINT64_MAX;
+    u64 max_ns = 0;
+    u64 recorded_total_ns = 0;
+};
+
+static Kernel::SharedPtr<Kernel::Session> FindPort(const std::string& name) {
+    auto itr = Service::g_srv_services.find(name);
+    if (itr != Service::g_srv_services.end())
+        return itr->second;
+
+    itr = Service::g_kernel_named_ports.find(name);
+    if (itr != Service::g_kernel_named_ports.end())
+        return itr->second;
+
+    return nullptr;
+}
+
+/// Waits until the reply to a request handled on a worker thread has been delivered
+static void WaitForAsyncReply(Kernel::Thread* thread) {
+    while (thread->status == THREADSTATUS_WAIT_IPC) {
+        std::this_thread::yield();
+        CoreTiming::Advance();
+    }
+
+    // The thread was put back into the ready queue when it was resumed, make it run again
+    if (HLE::g_reschedule)
+        Kernel::Reschedule();
+}
+
+/// Returns whether the reply of a replayed request matches the recorded one
+static bool ReplyMatches(const Record& record, const u32* cmd_buff) {
+    for (size_t i = 0; i < record.reply.size(); ++i) {
+        // Handles aren't expected to have the same values as when recording
+        bool is_handle = std::any_of(record.handles.begin(), record.handles.end(),
+                [i](const ReplyHandle& handle) { return handle.reply_word_index == i; });
+        if (!is_handle && cmd_buff[i] != record.reply[i])
+            return false;
+    }
+
+    for (const Record::BufferData& buffer : record.buffers) {
+        const u8* data = Memory::GetPointer(buffer.buffer.address);
+        if (!buffer.output_data.empty() &&
+            (data == nullptr || std::memcmp(data, buffer.output_data.data(), buffer.output_data.size()) != 0)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// Application entry point
+int main(int argc, char** argv) {
+    std::shared_ptr<Log::Logger> logger = Log::InitGlobalLogger();
+    Log::Filter log_filter(Log::Level::Info);
+    Log::SetFilter(&log_filter);
+    std::thread logging_thread(Log::TextLoggingLoop, logger);
+    SCOPE_EXIT({
+        logger->Close();
+        logging_thread.join();
+    });
+
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s <trace file> [port name...]\n"
+                     "Only requests to the given ports (and to the sessions they open) are replayed,"
+                     " all of them if none are given.\n", argv[0]);
+        return -1;
+    }
+
+    std::set<std::string> ports(argv + 2, argv + argc);
+
+    FileUtil::IOFile file(argv[1], "rb");
+    FileHeader header;
+    if (!file.IsOpen() || file.ReadBytes(&header, sizeof(header)) != sizeof(header) ||
+        header.magic != FILE_MAGIC || header.version != FILE_VERSION) {
+        LOG_CRITICAL(Frontend, "%s is not a valid IPC trace", argv[1]);
+        return -1;
+    }
+
+    Settings::values.use_virtual_sd = true;
+    Settings::values.region_value = 1;
+    Settings::values.gpu_refresh_rate = 30;
+
+    // Everything but the video core is set up, the CPU core is created but never run
+    Core::Init();
+    CoreTiming::Init();
+    Memory::Init();
+    HW::Init();
+    Kernel::Init();
+    HLE::Init();
+
+    Kernel::g_current_process = Kernel::Process::Create("ipc-replay", header.program_id);
+    Kernel::g_current_process->svc_access_mask.set();
+    Kernel::g_current_process->Run(Memory::PROCESS_IMAGE_VADDR, THREADPRIO_DEFAULT,
+                                   Kernel::DEFAULT_STACK_SIZE);
+    Kernel::Thread* thread = Kernel::GetCurrentThread();
+
+    // Sessions opened while replaying, indexed by the object id they had when recording
+    std::unordered_map<u32, Kernel::SharedPtr<Kernel::Session>> sessions;
+    std::map<std::string, CommandStats> stats;
+    unsigned int skipped = 0;
+
+    Record record;
+    while (ReadRecord(file, record)) {
+        Kernel::SharedPtr<Kernel::Session> session;
+        if (record.header.session_kind == SessionKind::Port) {
+            if (ports.empty() || ports.count(record.session_name) != 0)
+                session = FindPort(record.session_name);
+        } else {
+            auto itr = sessions.find(record.header.session_object_id);
+            if (itr != sessions.end())
+                session = itr->second;
+        }
+
+        if (session == nullptr || record.request.empty()) {
+            ++skipped;
+            continue;
+        }
+
+        u32* cmd_buff = Kernel::GetCommandBuffer();
+        std::copy(record.request.begin(), record.request.end(), cmd_buff);
+        for (const Record::BufferData& buffer : record.buffers) {
+            u8* data = Memory::GetPointer(buffer.buffer.address);
+            if (data != nullptr)
+                std::memcpy(data, buffer.input_data.data(), buffer.input_data.size());
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        session->SyncRequest();
+        WaitForAsyncReply(thread);
+        u64 duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+
+        for (const ReplyHandle& handle : record.handles) {
+            auto new_session = Kernel::g_handle_table.Get<Kernel::Session>(cmd_buff[handle.reply_word_index]);
+            if (new_session != nullptr)
+                sessions[handle.object_id] = new_session;
+        }
+
+        char command_name[128];
+        std::snprintf(command_name, sizeof(command_name), "%s 0x%08X",
+                      record.header.session_kind == SessionKind::Port ? record.session_name.c_str() : "(session)",
+                      record.request[0]);
+
+        CommandStats& command_stats = stats[command_name];
+        ++command_stats.count;
+        if (!ReplyMatches(record, cmd_buff))
+            ++command_stats.mismatches;
+        command_stats.total_ns += duration_ns;
+        command_stats.min_ns = std::min(command_stats.min_ns, duration_ns);
+        command_stats.max_ns = std::max(command_stats.max_ns, duration_ns);
+        command_stats.recorded_total_ns += record.header.duration_ns;
+    }
+
+    std::printf("%-32s %8s %10s %10s %10s %13s %10s\n", "Command", "Calls", "Avg (us)", "Min (us)",
+                "Max (us)", "Traced (us)", "Mismatches");
+    for (const auto& entry : stats) {
+        const CommandStats& command_stats = entry.second;
+        std::printf("%-32s %8u %10.2f %10.2f %10.2f %13.2f %10u\n", entry.first.c_str(),
+                    command_stats.count, command_stats.total_ns / 1000.0 / command_stats.count,
+                    command_stats.min_ns / 1000.0, command_stats.max_ns / 1000.0,
+                    command_stats.recorded_total_ns / 1000.0 / command_stats.count,
+                    command_stats.mismatches);
+    }
+    if (skipped != 0)
+        std::printf("%u requests were skipped\n", skipped);
+
+    sessions.clear();
+    HLE::Shutdown();
+    Kernel::Shutdown();
+    HW::Shutdown();
+    Memory::Shutdown();
+    CoreTiming::Shutdown();
+    Core::Shutdown();
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+// Decodes a binary log written by the emulator (see the binary_log_path setting) and prints its
+// messages as text.
+
+#include <array>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/logging/backend.h"
+#include "common/logging/binary_log.h"
+#include "common/logging/filter.h"
+#include "common/logging/text_formatter.h"
+
+using namespace Log::BinaryLog;
+
+/// Application entry point
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s <log file> [filter rule...]\n"
+                     "Filter rules have the same format as the log_filter setting, e.g. "
+                     "Service.FS:Trace. All messages are printed if none are given.\n", argv[0]);
+        return -1;
+    }
+
+    const std::string path = argv[1];
+
+    std::string filter_string;
+    for (int i = 2; i < argc; ++i)
+        filter_string += std::string(argv[i]) + " ";
+
+    Log::Filter filter(Log::Level::Trace);
+    filter.ParseFilterString(filter_string);
+
+    std::vector<std::unique_ptr<Site>> sites;
+    if (!ReadSites(path + ".sites", sites)) {
+        std::fprintf(stderr, "%s.sites is not a valid log sites file\n", path.c_str());
+        return -1;
+    }
+
+    std::vector<u8> records;
+    if (!ReadRecords(path, records)) {
+        std::fprintf(stderr, "%s is not a valid binary log\n", path.c_str());
+        return -1;
+    }
+
+    std::array<char, 4 * 1024> text;
+
+    Log::Entry entry;
+    size_t offset = 0;
+    while (offset < records.size()) {
+        size_t record_size = DecodeRecord(&records[offset], records.size() - offset, sites, entry);
+        if (record_size == 0) {
+            std::fprintf(stderr, "Corrupted record at offset %u, stopping\n", static_cast<unsigned int>(offset));
+            break;
+        }
+        offset += record_size;
+
+        // Padding, or a message whose call site wasn't written before the emulator exited
+        if (entry.call_site == nullptr)
+            continue;
+        if (!filter.CheckMessage(entry.log_class, entry.log_level))
+            continue;
+
+        Log::FormatLogMessage(entry, text.data(), text.size());
+        std::puts(text.data());
+    }
+
+    return 0;
+}
@@ -57,6 +57,9 @@ void Config::ReadValues() {
     Settings::values.bg_red   = qt_config->value("bg_red",   1.0).toFloat();
     Settings::values.bg_green = qt_config->value("bg_green", 1.0).toFloat();
     Settings::values.bg_blue  = qt_config->value("bg_blue",  1.0).toFloat();
+    Settings::values.vertex_processing_threads = qt_config->value("vertex_processing_threads", 1).toInt();
+    Settings::values.vertex_shader_backend = qt_config->value("vertex_shader_backend", 0).toInt();
+    Settings::values.rasterizer_threads = qt_config->value("rasterizer_threads", 1).toInt();
     qt_config->endGroup();
 
     qt_config->beginGroup("Data Storage");
@@ -69,6 +72,11 @@ void Config::ReadValues() {
 
     qt_config->beginGroup("Miscellaneous");
     Settings::values.log_filter = qt_config->value("log_filter", "*:Info").toString().toStdString();
+    Settings::values.log_overflow_policy = qt_config->value("log_overflow_policy", 2).toInt();
+    Settings::values.binary_log_path = qt_config->value("binary_log_path", "").toString().toStdString();
+    Settings::values.ipc_trace_path = qt_config->value("ipc_trace_path", "").toString().toStdString();
+    Settings::values.metrics_path = qt_config->value("metrics_path", "").toString().toStdString();
+    Settings::values.metrics_socket_path = qt_config->value("metrics_socket_path", "").toString().toStdString();
     qt_config->endGroup();
 }
 
@@ -109,6 +117,9 @@ void Config::SaveValues() {
     qt_config->setValue("bg_red",   (double)Settings::values.bg_red);
     qt_config->setValue("bg_green", (double)Settings::values.bg_green);
     qt_config->setValue("bg_blue",  (double)Settings::values.bg_blue);
+    qt_config->setValue("vertex_processing_threads", Settings::values.vertex_processing_threads);
+    qt_config->setValue("vertex_shader_backend", Settings::values.vertex_shader_backend);
+    qt_config->setValue("rasterizer_threads", Settings::values.rasterizer_threads);
     qt_config->endGroup();
 
     qt_config->beginGroup("Data Storage");
@@ -121,6 +132,11 @@ void Config::SaveValues() {
 
     qt_config->beginGroup("Miscellaneous");
     qt_config->setValue("log_filter", QString::fromStdString(Settings::values.log_filter));
+    qt_config->setValue("log_overflow_policy", Settings::values.log_overflow_policy);
+    qt_config->setValue("binary_log_path", QString::fromStdString(Settings::values.binary_log_path));
+    qt_config->setValue("ipc_trace_path", QString::fromStdString(Settings::values.ipc_trace_path));
+    qt_config->setValue("metrics_path", QString::fromStdString(Settings::values.metrics_path));
+    qt_config->setValue("metrics_socket_path", QString::fromStdString(Settings::values.metrics_socket_path));
     qt_config->endGroup();
 }
 
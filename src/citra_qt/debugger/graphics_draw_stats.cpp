@@ -0,0 +1,190 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <map>
+
+#include <QBoxLayout>
+#include <QLabel>
+#include <QPushButton>
+#include <QSortFilterProxyModel>
+#include <QTreeView>
+
+#include "graphics_draw_stats.h"
+
+enum DrawStatsColumn {
+    COLUMN_INDEX,
+    COLUMN_COLOR_BUFFER,
+    COLUMN_VERTICES_LOADED,
+    COLUMN_VERTICES_SHADED,
+    COLUMN_VERTEX_CACHE_HIT_RATE,
+    COLUMN_TRIANGLES_IN,
+    COLUMN_TRIANGLES_CLIPPED,
+    COLUMN_TRIANGLES_CULLED,
+    COLUMN_TRIANGLES_RASTERIZED,
+    COLUMN_BOUNDING_BOX_UTILIZATION,
+    COLUMN_FRAGMENTS_TESTED,
+    COLUMN_ALPHA_TEST_REJECTS,
+    COLUMN_DEPTH_TEST_REJECTS,
+    COLUMN_EARLY_DEPTH_TEST_REJECTS,
+    COLUMN_FRAGMENTS_PASSED,
+    COLUMN_OVERDRAW,
+    COLUMN_TEXTURE0_LOOKUPS,
+    COLUMN_TEXTURE1_LOOKUPS,
+    COLUMN_TEXTURE2_LOOKUPS,
+
+    NUM_COLUMNS
+};
+
+GraphicsDrawStatsModel::GraphicsDrawStatsModel(QObject* parent) : QAbstractTableModel(parent) {
+}
+
+int GraphicsDrawStatsModel::columnCount(const QModelIndex& parent) const {
+    return NUM_COLUMNS;
+}
+
+int GraphicsDrawStatsModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : (int)draws.size();
+}
+
+QVariant GraphicsDrawStatsModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QVariant();
+
+    switch (section) {
+    case COLUMN_INDEX: return tr("Draw");
+    case COLUMN_COLOR_BUFFER: return tr("Color buffer");
+    case COLUMN_VERTICES_LOADED: return tr("Vertices");
+    case COLUMN_VERTICES_SHADED: return tr("Shaded");
+    case COLUMN_VERTEX_CACHE_HIT_RATE: return tr("Cache hits (%)");
+    case COLUMN_TRIANGLES_IN: return tr("Triangles");
+    case COLUMN_TRIANGLES_CLIPPED: return tr("Clipped");
+    case COLUMN_TRIANGLES_CULLED: return tr("Culled");
+    case COLUMN_TRIANGLES_RASTERIZED: return tr("Rasterized");
+    case COLUMN_BOUNDING_BOX_UTILIZATION: return tr("BBox use (%)");
+    case COLUMN_FRAGMENTS_TESTED: return tr("Fragments");
+    case COLUMN_ALPHA_TEST_REJECTS: return tr("Alpha rejects");
+    case COLUMN_DEPTH_TEST_REJECTS: return tr("Depth rejects");
+    case COLUMN_EARLY_DEPTH_TEST_REJECTS: return tr("Early depth rejects");
+    case COLUMN_FRAGMENTS_PASSED: return tr("Written");
+    case COLUMN_OVERDRAW: return tr("Overdraw");
+    case COLUMN_TEXTURE0_LOOKUPS: return tr("Tex0 lookups");
+    case COLUMN_TEXTURE1_LOOKUPS: return tr("Tex1 lookups");
+    case COLUMN_TEXTURE2_LOOKUPS: return tr("Tex2 lookups");
+    }
+
+    return QVariant();
+}
+
+QVariant GraphicsDrawStatsModel::data(const QModelIndex& index, int role) const {
+    if (role != Qt::DisplayRole || index.row() >= (int)draws.size())
+        return QVariant();
+
+    // Numbers are returned as such (not as strings) so that the columns sort properly
+    const Pica::DrawStatistics& draw = draws[index.row()];
+    switch (index.column()) {
+    case COLUMN_INDEX: return draw.draw_index;
+    case COLUMN_COLOR_BUFFER: return QString("0x%1").arg(draw.color_buffer_address, 8, 16, QLatin1Char('0'));
+    case COLUMN_VERTICES_LOADED: return draw.vertices_loaded;
+    case COLUMN_VERTICES_SHADED: return draw.vertices_shaded;
+    case COLUMN_VERTEX_CACHE_HIT_RATE: return draw.GetVertexCacheHitRate() * 100.0f;
+    case COLUMN_TRIANGLES_IN: return draw.triangles_in;
+    case COLUMN_TRIANGLES_CLIPPED: return draw.triangles_clipped;
+    case COLUMN_TRIANGLES_CULLED: return draw.triangles_culled;
+    case COLUMN_TRIANGLES_RASTERIZED: return draw.triangles_rasterized;
+    case COLUMN_BOUNDING_BOX_UTILIZATION: return draw.GetBoundingBoxUtilization() * 100.0f;
+    case COLUMN_FRAGMENTS_TESTED: return (qulonglong)draw.fragments_tested;
+    case COLUMN_ALPHA_TEST_REJECTS: return (qulonglong)draw.alpha_test_rejects;
+    case COLUMN_DEPTH_TEST_REJECTS: return (qulonglong)draw.depth_test_rejects;
+    case COLUMN_EARLY_DEPTH_TEST_REJECTS: return (qulonglong)draw.early_depth_test_rejects;
+    case COLUMN_FRAGMENTS_PASSED: return (qulonglong)draw.fragments_passed;
+    case COLUMN_OVERDRAW: return draw.GetOverdraw();
+    case COLUMN_TEXTURE0_LOOKUPS: return (qulonglong)draw.texture_lookups[0];
+    case COLUMN_TEXTURE1_LOOKUPS: return (qulonglong)draw.texture_lookups[1];
+    case COLUMN_TEXTURE2_LOOKUPS: return (qulonglong)draw.texture_lookups[2];
+    }
+
+    return QVariant();
+}
+
+void GraphicsDrawStatsModel::SetDraws(std::vector<Pica::DrawStatistics> new_draws) {
+    beginResetModel();
+    draws = std::move(new_draws);
+    endResetModel();
+}
+
+GraphicsDrawStatsWidget::GraphicsDrawStatsWidget(std::shared_ptr<Pica::DebugContext> debug_context,
+                                                 QWidget* parent)
+        : BreakPointObserverDock(debug_context, tr("Pica Draw Statistics"), parent) {
+    setObjectName("PicaDrawStatistics");
+
+    model = new GraphicsDrawStatsModel(this);
+
+    auto sort_model = new QSortFilterProxyModel(this);
+    sort_model->setSourceModel(model);
+
+    auto draw_list = new QTreeView;
+    draw_list->setModel(sort_model);
+    draw_list->setRootIsDecorated(false);
+    draw_list->setAlternatingRowColors(true);
+    draw_list->setSortingEnabled(true);
+    draw_list->sortByColumn(COLUMN_INDEX, Qt::AscendingOrder);
+
+    summary_label = new QLabel;
+
+    auto refresh_button = new QPushButton(tr("Refresh"));
+    connect(refresh_button, SIGNAL(clicked()), this, SLOT(OnRefresh()));
+
+    auto main_widget = new QWidget;
+    auto main_layout = new QVBoxLayout;
+    {
+        auto sub_layout = new QHBoxLayout;
+        sub_layout->addWidget(summary_label, 1);
+        sub_layout->addWidget(refresh_button);
+        main_layout->addLayout(sub_layout);
+    }
+    main_layout->addWidget(draw_list);
+    main_widget->setLayout(main_layout);
+    setWidget(main_widget);
+}
+
+void GraphicsDrawStatsWidget::SetDraws(std::vector<Pica::DrawStatistics> draws,
+                                       const QString& description) {
+    // The overdraw of the frame is the number of written fragments per pixel of the render targets
+    std::map<PAddr, u32> framebuffer_pixels;
+    qulonglong fragments_passed = 0;
+    qulonglong fragments_tested = 0;
+    for (const Pica::DrawStatistics& draw : draws) {
+        framebuffer_pixels[draw.color_buffer_address] = draw.framebuffer_pixels;
+        fragments_passed += draw.fragments_passed;
+        fragments_tested += draw.fragments_tested;
+    }
+
+    qulonglong total_pixels = 0;
+    for (const auto& entry : framebuffer_pixels)
+        total_pixels += entry.second;
+
+    summary_label->setText(tr("%1: %2 draws, %3 fragments, %4 written, overdraw %5")
+            .arg(description).arg((int)draws.size()).arg(fragments_tested).arg(fragments_passed)
+            .arg(total_pixels != 0 ? (double)fragments_passed / total_pixels : 0.0, 0, 'f', 2));
+
+    model->SetDraws(std::move(draws));
+}
+
+void GraphicsDrawStatsWidget::OnRefresh() {
+    if (at_breakpoint) {
+        // The current frame can be looked at safely since the GPU thread is paused
+        SetDraws(Pica::DrawStats::GetCurrentFrameDraws(), tr("Current frame"));
+    } else {
+        SetDraws(Pica::DrawStats::GetPreviousFrameDraws(), tr("Previous frame"));
+    }
+}
+
+void GraphicsDrawStatsWidget::OnBreakPointHit(Pica::DebugContext::Event event, void* data) {
+    at_breakpoint = true;
+    OnRefresh();
+}
+
+void GraphicsDrawStatsWidget::OnResumed() {
+    at_breakpoint = false;
+}
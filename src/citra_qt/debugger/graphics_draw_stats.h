@@ -0,0 +1,59 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <vector>
+
+#include <QAbstractTableModel>
+
+#include "video_core/draw_stats.h"
+
+#include "graphics_breakpoint_observer.h"
+
+class QLabel;
+
+class GraphicsDrawStatsModel : public QAbstractTableModel {
+    Q_OBJECT
+
+public:
+    GraphicsDrawStatsModel(QObject* parent);
+
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    void SetDraws(std::vector<Pica::DrawStatistics> new_draws);
+
+private:
+    std::vector<Pica::DrawStatistics> draws;
+};
+
+/**
+ * Lists the statistics of each draw call of a frame, to find out which draws are expensive. Shows
+ * the last finished frame, or the draws processed so far while stopped at a Pica breakpoint.
+ */
+class GraphicsDrawStatsWidget : public BreakPointObserverDock {
+    Q_OBJECT
+
+public:
+    GraphicsDrawStatsWidget(std::shared_ptr<Pica::DebugContext> debug_context,
+                            QWidget* parent = nullptr);
+
+private slots:
+    void OnBreakPointHit(Pica::DebugContext::Event event, void* data) override;
+    void OnResumed() override;
+
+    void OnRefresh();
+
+private:
+    void SetDraws(std::vector<Pica::DrawStatistics> draws, const QString& description);
+
+    GraphicsDrawStatsModel* model;
+    QLabel* summary_label;
+
+    /// Whether the GPU thread is paused at a breakpoint, in which case the current frame is shown
+    bool at_breakpoint = false;
+};
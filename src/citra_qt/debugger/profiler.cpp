@@ -2,6 +2,9 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <QFileDialog>
+#include <QInputDialog>
+
 #include "profiler.h"
 
 #include "common/profiler_reporting.h"
@@ -116,6 +119,200 @@ void ProfilerModel::updateProfilingInfo()
     emit dataChanged(createIndex(0, 1), createIndex(rowCount() - 1, 3));
 }
 
+ProfilerEventModel::ProfilerEventModel(QObject* parent) : QAbstractItemModel(parent)
+{
+    updateProfilingInfo();
+}
+
+QVariant ProfilerEventModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+        switch (section) {
+        case 0: return tr("Event");
+        case 1: return tr("Fires/frame");
+        case 2: return tr("Avg");
+        case 3: return tr("Min");
+        case 4: return tr("Max");
+        case 5: return tr("Avg late (cycles)");
+        }
+    }
+
+    return QVariant();
+}
+
+QModelIndex ProfilerEventModel::index(int row, int column, const QModelIndex& parent) const
+{
+    return createIndex(row, column);
+}
+
+QModelIndex ProfilerEventModel::parent(const QModelIndex& child) const
+{
+    return QModelIndex();
+}
+
+int ProfilerEventModel::columnCount(const QModelIndex& parent) const
+{
+    return 6;
+}
+
+int ProfilerEventModel::rowCount(const QModelIndex& parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    } else {
+        return categories.size();
+    }
+}
+
+QVariant ProfilerEventModel::data(const QModelIndex& index, int role) const
+{
+    if (role != Qt::DisplayRole || index.row() >= (int)categories.size())
+        return QVariant();
+
+    if (index.column() == 0)
+        return QString(categories[index.row()].name);
+
+    if (index.row() >= (int)results.size())
+        return QVariant();
+
+    const AggregatedEventResult& result = results[index.row()];
+    switch (index.column()) {
+    case 1: return result.fires_per_frame;
+    case 2: case 3: case 4: return GetDataForColumn(index.column() - 1, result.callback_time);
+    case 5: return result.avg_cycles_late;
+    default: return QVariant();
+    }
+}
+
+void ProfilerEventModel::updateProfilingInfo()
+{
+    auto new_categories = GetProfilingManager().GetEventCategoriesInfo();
+    if (new_categories.size() != categories.size()) {
+        beginResetModel();
+        categories = std::move(new_categories);
+        results = GetTimingResultsAggregator()->GetAggregatedResults().stats_per_event;
+        endResetModel();
+        return;
+    }
+
+    results = GetTimingResultsAggregator()->GetAggregatedResults().stats_per_event;
+    if (rowCount() != 0)
+        emit dataChanged(createIndex(0, 1), createIndex(rowCount() - 1, 5));
+}
+
+/**
+ * Returns the time under which the given fraction of the calls in the histogram completed, rounded
+ * up to the end of the histogram bucket, in microseconds.
+ */
+static QVariant GetHistogramPercentile(const CallCategory::Histogram& histogram, float fraction)
+{
+    u64 total = 0;
+    for (u64 count : histogram)
+        total += count;
+
+    if (total == 0)
+        return QVariant();
+
+    u64 target = (u64)(total * fraction);
+    u64 seen = 0;
+    for (unsigned int i = 0; i < histogram.size(); ++i) {
+        seen += histogram[i];
+        if (seen > target || i == histogram.size() - 1)
+            return (double)(2ULL << i) / 1000.0;
+    }
+
+    return QVariant();
+}
+
+ProfilerCallModel::ProfilerCallModel(QObject* parent) : QAbstractItemModel(parent)
+{
+    updateProfilingInfo();
+}
+
+QVariant ProfilerCallModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+        switch (section) {
+        case 0: return tr("Call");
+        case 1: return tr("Calls/frame");
+        case 2: return tr("Avg");
+        case 3: return tr("Min");
+        case 4: return tr("Max");
+        case 5: return tr("Median (us)");
+        case 6: return tr("99% (us)");
+        }
+    }
+
+    return QVariant();
+}
+
+QModelIndex ProfilerCallModel::index(int row, int column, const QModelIndex& parent) const
+{
+    return createIndex(row, column);
+}
+
+QModelIndex ProfilerCallModel::parent(const QModelIndex& child) const
+{
+    return QModelIndex();
+}
+
+int ProfilerCallModel::columnCount(const QModelIndex& parent) const
+{
+    return 7;
+}
+
+int ProfilerCallModel::rowCount(const QModelIndex& parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    } else {
+        return categories.size();
+    }
+}
+
+QVariant ProfilerCallModel::data(const QModelIndex& index, int role) const
+{
+    if (role != Qt::DisplayRole || index.row() >= (int)categories.size())
+        return QVariant();
+
+    if (index.column() == 0)
+        return QString::fromStdString(categories[index.row()].name);
+
+    if (index.column() >= 5) {
+        const CallCategory::Histogram& histogram = histograms[index.row()];
+        return GetHistogramPercentile(histogram, index.column() == 5 ? 0.5f : 0.99f);
+    }
+
+    if (index.row() >= (int)results.size())
+        return QVariant();
+
+    const AggregatedCallResult& result = results[index.row()];
+    switch (index.column()) {
+    case 1: return result.calls_per_frame;
+    case 2: case 3: case 4: return GetDataForColumn(index.column() - 1, result.call_time);
+    default: return QVariant();
+    }
+}
+
+void ProfilerCallModel::updateProfilingInfo()
+{
+    auto new_categories = GetProfilingManager().GetCallCategoriesInfo();
+    bool reset = new_categories.size() != categories.size();
+    if (reset)
+        beginResetModel();
+
+    categories = std::move(new_categories);
+    results = GetTimingResultsAggregator()->GetAggregatedResults().stats_per_call;
+    histograms.resize(categories.size());
+    for (size_t i = 0; i < categories.size(); ++i)
+        histograms[i] = categories[i].category->GetHistogram();
+
+    if (reset)
+        endResetModel();
+    else if (rowCount() != 0)
+        emit dataChanged(createIndex(0, 1), createIndex(rowCount() - 1, 6));
+}
+
 ProfilerWidget::ProfilerWidget(QWidget* parent) : QDockWidget(parent)
 {
     ui.setupUi(this);
@@ -123,8 +320,17 @@ ProfilerWidget::ProfilerWidget(QWidget* parent) : QDockWidget(parent)
     model = new ProfilerModel(this);
     ui.treeView->setModel(model);
 
+    event_model = new ProfilerEventModel(this);
+    ui.eventTreeView->setModel(event_model);
+
+    call_model = new ProfilerCallModel(this);
+    ui.callTreeView->setModel(call_model);
+
     connect(this, SIGNAL(visibilityChanged(bool)), SLOT(setProfilingInfoUpdateEnabled(bool)));
     connect(&update_timer, SIGNAL(timeout()), model, SLOT(updateProfilingInfo()));
+    connect(&update_timer, SIGNAL(timeout()), event_model, SLOT(updateProfilingInfo()));
+    connect(&update_timer, SIGNAL(timeout()), call_model, SLOT(updateProfilingInfo()));
+    connect(ui.captureTraceButton, SIGNAL(clicked()), SLOT(captureTrace()));
 }
 
 void ProfilerWidget::setProfilingInfoUpdateEnabled(bool enable)
@@ -132,7 +338,29 @@ void ProfilerWidget::setProfilingInfoUpdateEnabled(bool enable)
     if (enable) {
         update_timer.start(100);
         model->updateProfilingInfo();
+        event_model->updateProfilingInfo();
+        call_model->updateProfilingInfo();
     } else {
         update_timer.stop();
     }
 }
+
+void ProfilerWidget::captureTrace()
+{
+    auto& profiler = GetProfilingManager();
+    if (profiler.IsTraceCaptureRunning())
+        return;
+
+    bool ok;
+    int num_frames = QInputDialog::getInt(this, tr("Capture Trace"), tr("Number of frames to capture:"),
+                                          60, 1, 3600, 1, &ok);
+    if (!ok)
+        return;
+
+    QString path = QFileDialog::getSaveFileName(this, tr("Save Trace"), QString(),
+                                                tr("Chrome trace (*.json)"));
+    if (path.isEmpty())
+        return;
+
+    profiler.StartTraceCapture(num_frames, path.toStdString());
+}
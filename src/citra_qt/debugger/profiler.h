@@ -32,6 +32,51 @@ private:
     Common::Profiling::AggregatedFrameResult results;
 };
 
+class ProfilerEventModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    ProfilerEventModel(QObject* parent);
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex& child) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+public slots:
+    void updateProfilingInfo();
+
+private:
+    std::vector<Common::Profiling::EventCategoryInfo> categories;
+    std::vector<Common::Profiling::AggregatedEventResult> results;
+};
+
+class ProfilerCallModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    ProfilerCallModel(QObject* parent);
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex& child) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+public slots:
+    void updateProfilingInfo();
+
+private:
+    std::vector<Common::Profiling::CallCategoryInfo> categories;
+    std::vector<Common::Profiling::AggregatedCallResult> results;
+    std::vector<Common::Profiling::CallCategory::Histogram> histograms;
+};
+
 class ProfilerWidget : public QDockWidget
 {
     Q_OBJECT
@@ -41,10 +86,13 @@ public:
 
 private slots:
     void setProfilingInfoUpdateEnabled(bool enable);
+    void captureTrace();
 
 private:
     Ui::Profiler ui;
     ProfilerModel* model;
+    ProfilerEventModel* event_model;
+    ProfilerCallModel* call_model;
 
     QTimer update_timer;
 };
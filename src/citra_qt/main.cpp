@@ -13,6 +13,7 @@
 #include "common/logging/text_formatter.h"
 #include "common/logging/log.h"
 #include "common/logging/backend.h"
+#include "common/logging/binary_log.h"
 #include "common/logging/filter.h"
 #include "common/make_unique.h"
 #include "common/platform.h"
@@ -33,6 +34,7 @@
 #include "debugger/graphics.h"
 #include "debugger/graphics_breakpoints.h"
 #include "debugger/graphics_cmdlists.h"
+#include "debugger/graphics_draw_stats.h"
 #include "debugger/graphics_framebuffer.h"
 #include "debugger/graphics_vertex_shader.h"
 #include "debugger/profiler.h"
@@ -94,6 +96,10 @@ GMainWindow::GMainWindow() : emu_thread(nullptr)
     addDockWidget(Qt::RightDockWidgetArea, graphicsVertexShaderWidget);
     graphicsVertexShaderWidget->hide();
 
+    auto graphicsDrawStatsWidget = new GraphicsDrawStatsWidget(Pica::g_debug_context, this);
+    addDockWidget(Qt::RightDockWidgetArea, graphicsDrawStatsWidget);
+    graphicsDrawStatsWidget->hide();
+
     QMenu* debug_menu = ui.menu_View->addMenu(tr("Debugging"));
     debug_menu->addAction(profilerWidget->toggleViewAction());
     debug_menu->addAction(disasmWidget->toggleViewAction());
@@ -104,6 +110,7 @@ GMainWindow::GMainWindow() : emu_thread(nullptr)
     debug_menu->addAction(graphicsBreakpointsWidget->toggleViewAction());
     debug_menu->addAction(graphicsFramebufferWidget->toggleViewAction());
     debug_menu->addAction(graphicsVertexShaderWidget->toggleViewAction());
+    debug_menu->addAction(graphicsDrawStatsWidget->toggleViewAction());
 
     // Set default UI state
     // geometry: 55% of the window contents are in the upper screen half, 45% in the lower half
@@ -357,6 +364,7 @@ int main(int argc, char* argv[])
     SCOPE_EXIT({
         logger->Close();
         logging_thread.join();
+        Log::BinaryLog::StopGlobalLog();
     });
 
     QApplication::setAttribute(Qt::AA_X11InitThreads);
@@ -365,6 +373,11 @@ int main(int argc, char* argv[])
     GMainWindow main_window;
     // After settings have been loaded by GMainWindow, apply the filter
     log_filter.ParseFilterString(Settings::values.log_filter);
+    logger->SetOverflowPolicy(static_cast<Log::OverflowPolicy>(Settings::values.log_overflow_policy));
+    if (!Settings::values.binary_log_path.empty() &&
+        !Log::BinaryLog::StartGlobalLog(Settings::values.binary_log_path)) {
+        LOG_ERROR(Frontend, "Failed to open binary log %s", Settings::values.binary_log_path.c_str());
+    }
 
     main_window.show();
     return app.exec();
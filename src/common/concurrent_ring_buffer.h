@@ -58,6 +58,32 @@ public:
         reader.notify_one();
     }
 
+    /**
+     * Pushes a value to the queue if there is room for it, without blocking. Does nothing if the
+     * queue is closed.
+     *
+     * @return False if the queue was full, in which case the value isn't pushed.
+     */
+    bool TryPush(T val) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (closed) {
+            return true;
+        }
+
+        if ((writer_index + 1) % ArraySize == reader_index) {
+            return false;
+        }
+
+        T* item = &Data()[writer_index];
+        new (item) T(std::move(val));
+        writer_index = (writer_index + 1) % ArraySize;
+
+        // Wake up waiting readers
+        lock.unlock();
+        reader.notify_one();
+        return true;
+    }
+
     /**
      * Pops up to `dest_len` items from the queue, storing them in `dest`. This function will not
      * block, and might return 0 values if there are no elements in the queue when it is called.
@@ -87,6 +113,10 @@ public:
         }
 
         while (!CanRead()) {
+            if (reader_woken) {
+                reader_woken = false;
+                return 0;
+            }
             reader.wait(lock);
             if (closed && !CanRead()) {
                 return QUEUE_CLOSED;
@@ -96,6 +126,18 @@ public:
         return PopInternal(dest, dest_len);
     }
 
+    /**
+     * Makes a reader blocked in `BlockingPop` return 0, e.g. to let it check for items stored
+     * elsewhere. If no reader is blocked, the next call to `BlockingPop` which would block returns
+     * 0 instead, so that the wakeup isn't lost.
+     */
+    void WakeReader() {
+        std::unique_lock<std::mutex> lock(mutex);
+        reader_woken = true;
+        lock.unlock();
+        reader.notify_one();
+    }
+
     /**
      * Closes the queue. After calling this method, `Push` operations won't have any effect, and
      * `PopMany` and `PopManyBlock` will start returning `QUEUE_CLOSED`. This is intended to allow
@@ -151,6 +193,8 @@ private:
     size_t writer_index = 0, reader_index = 0;
     // True if the queue has been closed.
     bool closed = false;
+    // True if `WakeReader()` was called and no reader has returned because of it yet.
+    bool reader_woken = false;
 
     /// Mutex that protects the entire data structure.
     std::mutex mutex;
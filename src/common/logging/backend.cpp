@@ -3,8 +3,16 @@
 // Refer to the license.txt file included.
 
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
 
 #include "common/assert.h"
+#include "common/profiler.h"
 
 #include "common/logging/backend.h"
 #include "common/logging/log.h"
@@ -14,6 +22,8 @@ namespace Log {
 
 static std::shared_ptr<Logger> global_logger;
 
+static Common::Profiling::Counter counter_dropped_entries("log_dropped_entries");
+
 /// Macro listing all log classes. Code should define CLS and SUB as desired before invoking this.
 #define ALL_LOG_CLASSES() \
         CLS(Log) \
@@ -55,7 +65,53 @@ static std::shared_ptr<Logger> global_logger;
         SUB(Render, OpenGL) \
         CLS(Loader)
 
-Logger::Logger() {
+/**
+ * Buffer of the messages logged by a single thread. Its mutex is only shared by that thread and the
+ * log outputter, so that threads logging messages don't wait for each other.
+ */
+struct Logger::ProducerBuffer {
+    /// Number of entries the buffer holds before spilling (or blocking, or dropping new ones)
+    static const size_t CAPACITY = 64;
+
+    /// Value of `in_flight_sequence` while the thread isn't logging a message
+    static const u64 NOT_IN_FLIGHT = std::numeric_limits<u64>::max();
+
+    std::mutex mutex;
+    /// Signaled when the log outputter makes room in the buffer, for the Block policy
+    std::condition_variable space_available;
+
+    std::array<Entry, CAPACITY> entries;
+    size_t first_entry = 0;
+    size_t num_entries = 0;
+
+    /**
+     * Entries which didn't fit in `entries`. While it isn't empty, new entries are also added to it
+     * so that they stay in order.
+     */
+    std::deque<Entry> spilled_entries;
+
+    /**
+     * While the thread is logging a message, a lower bound of its sequence number. The log
+     * outputter doesn't return entries numbered past it, as this message would have to come first.
+     */
+    std::atomic<u64> in_flight_sequence;
+
+    /// Set when the thread exits, the buffer is destroyed once its entries have been read
+    std::atomic<bool> exited;
+
+    /// Entries taken from the buffer, which the log outputter hasn't returned yet. Reader only.
+    std::deque<Entry> pending;
+
+    ProducerBuffer() : in_flight_sequence(NOT_IN_FLIGHT), exited(false) {}
+
+    bool IsEmpty() const {
+        return num_entries == 0 && spilled_entries.empty();
+    }
+};
+
+Logger::Logger()
+        : overflow_policy(OverflowPolicy::Block), dropped_entries(0), num_spilled_entries(0),
+          closed(false), next_sequence(0), producer_key(OnProducerThreadExit), reader_waiting(false) {
     // Register logging classes so that they can be queried at runtime
     size_t parent_class;
     all_classes.reserve((size_t)Class::Count);
@@ -101,12 +157,188 @@ const char* Logger::GetLevelName(Level log_level) {
 #undef LVL
 }
 
-void Logger::LogMessage(Entry entry) {
-    ring_buffer.Push(std::move(entry));
+Logger::~Logger() {
+}
+
+void Logger::OnProducerThreadExit(void* producer) {
+    // The entries it holds are still output, after which the logger destroys it
+    static_cast<ProducerBuffer*>(producer)->exited = true;
+}
+
+Logger::ProducerBuffer& Logger::GetProducerBuffer() {
+    ProducerBuffer* producer = static_cast<ProducerBuffer*>(producer_key.Get());
+    if (producer == nullptr) {
+        producer = new ProducerBuffer;
+        {
+            std::lock_guard<std::mutex> lock(producers_mutex);
+            producers.emplace_back(producer);
+        }
+        producer_key.Set(producer);
+    }
+    return *producer;
+}
+
+void Logger::LogMessage(Entry& entry) {
+    ProducerBuffer& producer = GetProducerBuffer();
+
+    // Publish a lower bound of the sequence number before taking it, so that the reader either
+    // sees it, or reads a next_sequence not past this message.
+    producer.in_flight_sequence = next_sequence.load();
+    entry.sequence = next_sequence++;
+
+    {
+        std::unique_lock<std::mutex> lock(producer.mutex);
+        bool full = producer.num_entries == ProducerBuffer::CAPACITY;
+        bool dropped = false;
+
+        switch (overflow_policy.load(std::memory_order_relaxed)) {
+        case OverflowPolicy::Block:
+        default:
+            producer.space_available.wait(lock, [&] {
+                return producer.num_entries != ProducerBuffer::CAPACITY || closed;
+            });
+            full = producer.num_entries == ProducerBuffer::CAPACITY;
+            dropped = full;
+            break;
+
+        case OverflowPolicy::DropNewest:
+            dropped = full;
+            break;
+
+        case OverflowPolicy::Spill:
+            if (full || !producer.spilled_entries.empty()) {
+                if (num_spilled_entries++ < MAX_SPILLED_ENTRIES) {
+                    producer.spilled_entries.push_back(entry);
+                } else {
+                    --num_spilled_entries;
+                    dropped = true;
+                }
+                full = true;
+            }
+            break;
+        }
+
+        if (dropped) {
+            ++dropped_entries;
+            counter_dropped_entries.Add();
+        } else if (!full) {
+            producer.entries[(producer.first_entry + producer.num_entries) % ProducerBuffer::CAPACITY] = entry;
+            ++producer.num_entries;
+        }
+    }
+
+    producer.in_flight_sequence = ProducerBuffer::NOT_IN_FLIGHT;
+
+    // The reader sets reader_waiting before checking the buffers a last time and waiting, so
+    // either it sees this entry, or this sees it waiting.
+    if (reader_waiting) {
+        std::lock_guard<std::mutex> lock(reader_mutex);
+        reader_cv.notify_one();
+    }
+}
+
+bool Logger::CollectEntries() {
+    bool any_pending = false;
+
+    std::lock_guard<std::mutex> producers_lock(producers_mutex);
+    for (auto it = producers.begin(); it != producers.end();) {
+        ProducerBuffer& producer = **it;
+
+        // Checked before taking the entries, so that none can be added after they are taken
+        bool exited = producer.exited;
+        {
+            std::lock_guard<std::mutex> lock(producer.mutex);
+            bool was_full = producer.num_entries == ProducerBuffer::CAPACITY;
+            for (; producer.num_entries != 0; --producer.num_entries) {
+                producer.pending.push_back(producer.entries[producer.first_entry]);
+                producer.first_entry = (producer.first_entry + 1) % ProducerBuffer::CAPACITY;
+            }
+            if (!producer.spilled_entries.empty()) {
+                num_spilled_entries -= producer.spilled_entries.size();
+                producer.pending.insert(producer.pending.end(), producer.spilled_entries.begin(),
+                                        producer.spilled_entries.end());
+                producer.spilled_entries.clear();
+            }
+            if (was_full)
+                producer.space_available.notify_one();
+        }
+
+        if (exited && producer.pending.empty()) {
+            it = producers.erase(it);
+            continue;
+        }
+        any_pending |= !producer.pending.empty();
+        ++it;
+    }
+    return any_pending;
 }
 
 size_t Logger::GetEntries(Entry* out_buffer, size_t buffer_len) {
-    return ring_buffer.BlockingPop(out_buffer, buffer_len);
+    while (true) {
+        bool was_closed = closed;
+
+        // Entries numbered from the watermark on can't be returned yet, as the message of a thread
+        // which is still being logged might come before them. next_sequence is read first, so that
+        // any message numbered below it is either in its buffer or still in flight.
+        u64 watermark = next_sequence.load();
+        {
+            std::lock_guard<std::mutex> lock(producers_mutex);
+            for (const auto& producer : producers)
+                watermark = std::min<u64>(watermark, producer->in_flight_sequence.load());
+        }
+
+        bool any_pending = CollectEntries();
+
+        // Merge the entries of all threads in order
+        size_t num_entries = 0;
+        if (any_pending) {
+            std::lock_guard<std::mutex> lock(producers_mutex);
+            while (num_entries < buffer_len) {
+                std::deque<Entry>* next = nullptr;
+                for (const auto& producer : producers) {
+                    if (!producer->pending.empty() &&
+                        (next == nullptr || producer->pending.front().sequence < next->front().sequence))
+                        next = &producer->pending;
+                }
+                // Once closed, no message is in flight anymore (LogMessage prints them instead)
+                if (next == nullptr || (next->front().sequence >= watermark && !was_closed))
+                    break;
+                out_buffer[num_entries++] = next->front();
+                next->pop_front();
+            }
+        }
+        if (num_entries != 0)
+            return num_entries;
+
+        if (any_pending) {
+            // Waiting for a thread to finish logging a message, which doesn't take long
+            std::this_thread::yield();
+            continue;
+        }
+        if (was_closed)
+            return QUEUE_CLOSED;
+
+        std::unique_lock<std::mutex> lock(reader_mutex);
+        reader_waiting = true;
+        if (!CollectEntries() && !closed)
+            reader_cv.wait(lock);
+        reader_waiting = false;
+    }
+}
+
+void Logger::Close() {
+    closed = true;
+    {
+        std::lock_guard<std::mutex> lock(reader_mutex);
+        reader_cv.notify_one();
+    }
+
+    // Wake the threads waiting for room in their buffer, their messages are dropped
+    std::lock_guard<std::mutex> producers_lock(producers_mutex);
+    for (const auto& producer : producers) {
+        std::lock_guard<std::mutex> lock(producer->mutex);
+        producer->space_available.notify_all();
+    }
 }
 
 std::shared_ptr<Logger> InitGlobalLogger() {
@@ -114,50 +346,206 @@ std::shared_ptr<Logger> InitGlobalLogger() {
     return global_logger;
 }
 
-Entry CreateEntry(Class log_class, Level log_level,
-                        const char* filename, unsigned int line_nr, const char* function,
-                        const char* format, va_list args) {
-    using std::chrono::steady_clock;
-    using std::chrono::duration_cast;
-
-    static steady_clock::time_point time_origin = steady_clock::now();
+static Filter* filter;
 
-    std::array<char, 4 * 1024> formatting_buffer;
+// Registry of all the call sites that have been reached, as a linked list through CallSite::next
+static std::mutex call_sites_mutex;
+static CallSite* call_sites;
 
-    Entry entry;
-    entry.timestamp = duration_cast<std::chrono::microseconds>(steady_clock::now() - time_origin);
-    entry.log_class = log_class;
-    entry.log_level = log_level;
+static CallSite::State GetCallSiteState(const CallSite& call_site) {
+    if (filter == nullptr || filter->CheckMessage(call_site.log_class, call_site.log_level))
+        return CallSite::Enabled;
+    return CallSite::Disabled;
+}
 
-    snprintf(formatting_buffer.data(), formatting_buffer.size(), "%s:%s:%u", filename, function, line_nr);
-    entry.location = std::string(formatting_buffer.data());
+/// Recomputes the state of all registered call sites, to be called when the active filter changes.
+static void UpdateCallSites() {
+    std::lock_guard<std::mutex> lock(call_sites_mutex);
+    for (CallSite* call_site = call_sites; call_site != nullptr; call_site = call_site->next) {
+        call_site->state.store(GetCallSiteState(*call_site), std::memory_order_relaxed);
+    }
+}
 
-    vsnprintf(formatting_buffer.data(), formatting_buffer.size(), format, args);
-    entry.message = std::string(formatting_buffer.data());
+bool CallSite::Register() {
+    std::lock_guard<std::mutex> lock(call_sites_mutex);
 
-    return std::move(entry);
+    // Another thread may have registered this call site while we were waiting for the lock
+    if (state.load(std::memory_order_relaxed) == Unregistered) {
+        next = call_sites;
+        call_sites = this;
+        state.store(GetCallSiteState(*this), std::memory_order_relaxed);
+    }
+    return state.load(std::memory_order_relaxed) == Enabled;
 }
 
-static Filter* filter;
-
 void SetFilter(Filter* new_filter) {
     filter = new_filter;
+    UpdateCallSites();
+}
+
+void OnFilterChanged(const Filter* changed_filter) {
+    if (changed_filter == filter)
+        UpdateCallSites();
+}
+
+bool IsMessageEnabled(Class log_class, Level log_level) {
+    return filter == nullptr || filter->CheckMessage(log_class, log_level);
+}
+
+void SetEntryArguments(Entry& entry, const Argument* arguments, size_t num_arguments) {
+    size_t string_data_used = 0;
+
+    entry.num_arguments = num_arguments;
+    for (size_t i = 0; i < num_arguments; ++i) {
+        Argument& stored = entry.arguments[i];
+        stored = arguments[i];
+        if (stored.type != Argument::Type::String)
+            continue;
+
+        const char* string = arguments[i].string != nullptr ? arguments[i].string : "(null)";
+        size_t length = std::strlen(string);
+
+        // Strings that don't fit are truncated, each one is always null-terminated
+        if (string_data_used == entry.string_data.size()) {
+            stored.integer = string_data_used - 1;
+            continue;
+        }
+        length = std::min(length, entry.string_data.size() - string_data_used - 1);
+        std::memcpy(&entry.string_data[string_data_used], string, length);
+        entry.string_data[string_data_used + length] = '\0';
+        stored.integer = string_data_used;
+        string_data_used += length + 1;
+    }
+}
+
+/// Formats a single argument, `stars` holding the values of the `*` width and precision, if any
+template <typename T>
+static int FormatArgument(char* out, size_t space, const char* spec,
+                          const int* stars, size_t num_stars, T value) {
+    switch (num_stars) {
+    case 0:
+        return std::snprintf(out, space, spec, value);
+    case 1:
+        return std::snprintf(out, space, spec, stars[0], value);
+    default:
+        return std::snprintf(out, space, spec, stars[0], stars[1], value);
+    }
 }
 
-void LogMessage(Class log_class, Level log_level,
-                const char* filename, unsigned int line_nr, const char* function,
-                const char* format, ...) {
-    if (!filter->CheckMessage(log_class, log_level))
+void FormatEntryMessage(const Entry& entry, char* out_text, size_t text_len) {
+    if (text_len == 0)
         return;
 
-    va_list args;
-    va_start(args, format);
-    Entry entry = CreateEntry(log_class, log_level,
-            filename, line_nr, function, format, args);
-    va_end(args);
+    char* out = out_text;
+    char* const out_end = out_text + text_len - 1;
+    size_t next_argument = 0;
+
+    const char* format = entry.format;
+    while (*format != '\0' && out < out_end) {
+        if (*format != '%') {
+            *out++ = *format++;
+            continue;
+        }
+
+        // Extract a single conversion specification ('%', flags, width, precision, length, type)
+        const char* spec_begin = format++;
+        size_t num_stars = 0;
+        while (*format != '\0' && std::strchr("-+ #0123456789.*", *format) != nullptr) {
+            if (*format == '*')
+                ++num_stars;
+            ++format;
+        }
+        const char* length_begin = format;
+        while (*format != '\0' && std::strchr("hljztL", *format) != nullptr)
+            ++format;
+        size_t length_size = format - length_begin;
+        char conversion = *format;
+        if (conversion == '\0')
+            break;
+        ++format;
+
+        if (conversion == '%') {
+            *out++ = '%';
+            continue;
+        }
+        if (next_argument + std::min<size_t>(num_stars, 2) >= entry.num_arguments) {
+            // Missing argument, print the specification as-is
+            size_t copy_size = std::min<size_t>(format - spec_begin, out_end - out);
+            std::memcpy(out, spec_begin, copy_size);
+            out += copy_size;
+            continue;
+        }
+
+        std::array<char, 32> spec;
+        size_t spec_size = std::min<size_t>(format - spec_begin, spec.size() - 1);
+        std::memcpy(spec.data(), spec_begin, spec_size);
+        spec[spec_size] = '\0';
+
+        std::array<int, 2> stars;
+        num_stars = std::min<size_t>(num_stars, stars.size());
+        for (size_t i = 0; i < num_stars; ++i)
+            stars[i] = static_cast<int>(entry.arguments[next_argument++].integer);
+
+        const Argument& argument = entry.arguments[next_argument++];
+        const std::string length(length_begin, length_size);
+        size_t space = out_end - out + 1;
+        int written;
+        switch (conversion) {
+        case 's': {
+            const char* string = argument.type == Argument::Type::String ?
+                    &entry.string_data[argument.integer] : "(invalid)";
+            written = FormatArgument(out, space, spec.data(), stars.data(), num_stars, string);
+            break;
+        }
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+            double value = argument.type == Argument::Type::Floating ? argument.floating : 0.0;
+            written = FormatArgument(out, space, spec.data(), stars.data(), num_stars, value);
+            break;
+        }
+        case 'p':
+            written = FormatArgument(out, space, spec.data(), stars.data(), num_stars,
+                                     reinterpret_cast<void*>(argument.integer));
+            break;
+        default:
+            // Integer conversions: pass the value with the type given by the length modifier
+            if (length == "ll" || length == "j") {
+                written = FormatArgument(out, space, spec.data(), stars.data(), num_stars,
+                                         static_cast<long long>(argument.integer));
+            } else if (length == "l") {
+                written = FormatArgument(out, space, spec.data(), stars.data(), num_stars,
+                                         static_cast<long>(argument.integer));
+            } else if (length == "z" || length == "t") {
+                written = FormatArgument(out, space, spec.data(), stars.data(), num_stars,
+                                         static_cast<size_t>(argument.integer));
+            } else {
+                written = FormatArgument(out, space, spec.data(), stars.data(), num_stars,
+                                         static_cast<int>(argument.integer));
+            }
+            break;
+        }
+        if (written > 0)
+            out += std::min<size_t>(written, out_end - out);
+    }
+    *out = '\0';
+}
+
+void LogMessage(const CallSite& call_site, const char* format,
+                const Argument* arguments, size_t num_arguments) {
+    using std::chrono::steady_clock;
+    using std::chrono::duration_cast;
+
+    static steady_clock::time_point time_origin = steady_clock::now();
+
+    Entry entry;
+    entry.timestamp = duration_cast<std::chrono::microseconds>(steady_clock::now() - time_origin);
+    entry.log_class = call_site.log_class;
+    entry.log_level = call_site.log_level;
+    entry.call_site = &call_site;
+    entry.format = format;
+    SetEntryArguments(entry, arguments, num_arguments);
 
     if (global_logger != nullptr && !global_logger->IsClosed()) {
-        global_logger->LogMessage(std::move(entry));
+        global_logger->LogMessage(entry);
     } else {
         // Fall back to directly printing to stderr
         PrintMessage(entry);
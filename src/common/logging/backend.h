@@ -4,11 +4,15 @@
 
 #pragma once
 
-#include <cstdarg>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <vector>
 
-#include "common/concurrent_ring_buffer.h"
+#include "common/thread.h"
 
 #include "common/logging/filter.h"
 #include "common/logging/log.h"
@@ -18,34 +22,30 @@ namespace Log {
 /**
  * A log entry. Log entries are store in a structured format to permit more varied output
  * formatting on different frontends, as well as facilitating filtering and aggregation.
+ *
+ * Entries hold the unformatted message (its format string and arguments) so that the cost of
+ * formatting is paid by the logging thread instead of the thread emitting the message. They have a
+ * fixed size and are trivially copyable.
  */
 struct Entry {
+    /// Size of the buffer holding copies of the string arguments of the message
+    static const size_t STRING_DATA_SIZE = 512;
+
+    /// Position of the entry in the log, entries from all threads are output in this order
+    u64 sequence;
     std::chrono::microseconds timestamp;
     Class log_class;
     Level log_level;
-    std::string location;
-    std::string message;
-
-    Entry() = default;
-
-    // TODO(yuriks) Use defaulted move constructors once MSVC supports them
-#define MOVE(member) member(std::move(o.member))
-    Entry(Entry&& o)
-        : MOVE(timestamp), MOVE(log_class), MOVE(log_level),
-        MOVE(location), MOVE(message)
-    {}
-#undef MOVE
-
-    Entry& operator=(const Entry&& o) {
-#define MOVE(member) member = std::move(o.member)
-        MOVE(timestamp);
-        MOVE(log_class);
-        MOVE(log_level);
-        MOVE(location);
-        MOVE(message);
-#undef MOVE
-        return *this;
-    }
+    const CallSite* call_site;
+    const char* format;
+    size_t num_arguments;
+    /**
+     * Arguments of the message. For string arguments, `integer` holds the offset of the copy of the
+     * string in `string_data`, as the original might not exist anymore by the time the entry is
+     * formatted.
+     */
+    std::array<Argument, MAX_LOG_ARGUMENTS> arguments;
+    std::array<char, STRING_DATA_SIZE> string_data;
 };
 
 struct ClassInfo {
@@ -60,19 +60,29 @@ struct ClassInfo {
     ClassInfo(Class log_class) : log_class(log_class) {}
 };
 
+/// What the logger does with new messages when its buffer is full.
+enum class OverflowPolicy : u8 {
+    Block,      ///< Wait until the log outputter makes room for them
+    DropNewest, ///< Drop them, only counting how many were dropped
+    Spill,      ///< Store them in a growable (but bounded) spill buffer, dropping them once it's full
+};
+
 /**
  * Logging management class. This class has the dual purpose of acting as an exchange point between
  * the logging clients and the log outputter, as well as containing reflection info about available
  * log classes.
+ *
+ * Each thread logging messages gets its own buffer, so that threads don't contend with each other
+ * to append them. Messages are numbered when they are logged, and the log outputter merges the
+ * buffers back in that order.
  */
 class Logger {
-private:
-    using Buffer = Common::ConcurrentRingBuffer<Entry, 16 * 1024 / sizeof(Entry)>;
-
 public:
-    static const size_t QUEUE_CLOSED = Buffer::QUEUE_CLOSED;
+    /// Value returned by GetEntries when the logger has been closed.
+    static const size_t QUEUE_CLOSED = -1;
 
     Logger();
+    ~Logger();
 
     /**
      * Returns a list of all vector classes and subclasses. The sequence returned is a pre-order of
@@ -93,14 +103,22 @@ public:
     static const char* GetLevelName(Level log_level);
 
     /**
-     * Appends a messages to the log buffer.
+     * Appends a messages to the buffer of the calling thread, setting its sequence number. Unless
+     * the overflow policy is Block, this never waits for the log outputter.
      * @note This function is thread safe.
      */
-    void LogMessage(Entry entry);
+    void LogMessage(Entry& entry);
+
+    /// Sets what happens to new messages while the log buffer is full.
+    void SetOverflowPolicy(OverflowPolicy policy) { overflow_policy = policy; }
+
+    /// Returns the number of messages dropped because the log buffer (and spill buffer) was full.
+    u64 GetDroppedEntries() const { return dropped_entries; }
 
     /**
-     * Retrieves a batch of messages from the log buffer, blocking until they are available.
-     * @note This function is thread safe.
+     * Retrieves a batch of messages from the log buffers, in the order they were logged, blocking
+     * until they are available.
+     * @note Only one thread may read the entries at a time.
      *
      * @param out_buffer Destination buffer that will receive the log entries.
      * @param buffer_len The maximum size of `out_buffer`.
@@ -111,27 +129,76 @@ public:
 
     /**
      * Initiates a shutdown of the logger. This will indicate to log output clients that they
-     * should shutdown.
+     * should shutdown, once they have read the remaining entries.
      */
-    void Close() { ring_buffer.Close(); }
+    void Close();
 
     /**
      * Returns true if Close() has already been called on the Logger.
      */
-    bool IsClosed() const { return ring_buffer.IsClosed(); }
+    bool IsClosed() const { return closed; }
 
 private:
-    Buffer ring_buffer;
+    struct ProducerBuffer;
+
+    /// Maximum number of spilled entries across all threads, which hold up to about 7.5MiB.
+    static const size_t MAX_SPILLED_ENTRIES = 8 * 1024;
+
+    /// Returns the buffer of the calling thread, creating it on its first message.
+    ProducerBuffer& GetProducerBuffer();
+
+    /// Marks the buffer of an exiting thread as exited, see `producer_key`.
+    static void OnProducerThreadExit(void* producer);
+
+    /**
+     * Moves the entries of all buffers to their reader side queue, and forgets the buffers of the
+     * threads which exited once they are empty.
+     * @return True if any entry is waiting to be returned by GetEntries.
+     */
+    bool CollectEntries();
+
     std::vector<ClassInfo> all_classes;
+
+    std::atomic<OverflowPolicy> overflow_policy;
+    std::atomic<u64> dropped_entries;
+    std::atomic<size_t> num_spilled_entries;
+    std::atomic<bool> closed;
+
+    /// Sequence number of the next message
+    std::atomic<u64> next_sequence;
+
+    /// Buffers of the threads which logged messages, guarded by producers_mutex
+    std::vector<std::unique_ptr<ProducerBuffer>> producers;
+    std::mutex producers_mutex;
+
+    /// Key holding the buffer of each thread, which marks it as exited when the thread exits.
+    /// Declared after `producers`, so that it doesn't outlive them.
+    Common::ThreadExitKey producer_key;
+
+    /// Used by the reader to wait for new entries, while `reader_waiting` is set
+    std::mutex reader_mutex;
+    std::condition_variable reader_cv;
+    std::atomic<bool> reader_waiting;
 };
 
-/// Creates a log entry by formatting the given source location, and message.
-Entry CreateEntry(Class log_class, Level log_level,
-                        const char* filename, unsigned int line_nr, const char* function,
-                        const char* format, va_list args);
+/// Copies the arguments of a message into an entry, along with the strings they point to.
+void SetEntryArguments(Entry& entry, const Argument* arguments, size_t num_arguments);
+
+/**
+ * Formats the message of an entry, substituting its arguments in its format string.
+ * @param entry The entry to format
+ * @param out_text Destination buffer, the message is truncated if it doesn't fit
+ * @param text_len Size of `out_text`
+ */
+void FormatEntryMessage(const Entry& entry, char* out_text, size_t text_len);
+
 /// Initializes the default Logger.
 std::shared_ptr<Logger> InitGlobalLogger();
 
+/// Sets the active filter, which can be null to let all messages through.
 void SetFilter(Filter* filter);
 
+/// Notifies the logging backend that a filter was changed, to update the call sites it affects.
+void OnFilterChanged(const Filter* filter);
+
 }
@@ -0,0 +1,375 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <mutex>
+
+#ifdef _WIN32
+#   define WIN32_LEAN_AND_MEAN
+#   include <Windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <unistd.h>
+#endif
+
+#include "common/string_util.h"
+
+#include "common/logging/backend.h"
+#include "common/logging/binary_log.h"
+
+namespace Log {
+namespace BinaryLog {
+
+static u64 AlignUp(u64 value) {
+    return (value + 7) & ~u64(7);
+}
+
+Writer::~Writer() {
+    Close();
+}
+
+bool Writer::Open(const std::string& path, u64 capacity) {
+    Close();
+
+    capacity = AlignUp(std::max<u64>(capacity, 4096));
+    mapped_size = static_cast<size_t>(sizeof(FileHeader) + capacity);
+
+    void* mapping = nullptr;
+#ifdef _WIN32
+    file_handle = CreateFileW(Common::UTF8ToUTF16W(path).c_str(), GENERIC_READ | GENERIC_WRITE,
+                              FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        file_handle = nullptr;
+        return false;
+    }
+    mapping_handle = CreateFileMappingW(file_handle, nullptr, PAGE_READWRITE,
+                                        static_cast<DWORD>(u64(mapped_size) >> 32),
+                                        static_cast<DWORD>(mapped_size), nullptr);
+    if (mapping_handle != nullptr)
+        mapping = MapViewOfFile(mapping_handle, FILE_MAP_WRITE, 0, 0, mapped_size);
+#else
+    file_descriptor = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (file_descriptor == -1)
+        return false;
+    if (ftruncate(file_descriptor, mapped_size) == 0) {
+        mapping = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor, 0);
+        if (mapping == MAP_FAILED)
+            mapping = nullptr;
+    }
+#endif
+
+    if (mapping == nullptr || !sites_file.Open(path + ".sites", "wb")) {
+        header = static_cast<FileHeader*>(mapping);
+        Close();
+        return false;
+    }
+
+    header = static_cast<FileHeader*>(mapping);
+    ring = static_cast<u8*>(mapping) + sizeof(FileHeader);
+    header->magic = FILE_MAGIC;
+    header->version = FILE_VERSION;
+    header->capacity = capacity;
+    header->head = 0;
+    header->tail = 0;
+
+    SitesFileHeader sites_header;
+    sites_header.magic = SITES_FILE_MAGIC;
+    sites_header.version = FILE_VERSION;
+    sites_file.WriteBytes(&sites_header, sizeof(sites_header));
+    site_ids.clear();
+
+    return true;
+}
+
+void Writer::Close() {
+#ifdef _WIN32
+    if (header != nullptr)
+        UnmapViewOfFile(header);
+    if (mapping_handle != nullptr)
+        CloseHandle(mapping_handle);
+    if (file_handle != nullptr)
+        CloseHandle(file_handle);
+    mapping_handle = nullptr;
+    file_handle = nullptr;
+#else
+    if (header != nullptr)
+        munmap(header, mapped_size);
+    if (file_descriptor != -1)
+        close(file_descriptor);
+    file_descriptor = -1;
+#endif
+
+    header = nullptr;
+    ring = nullptr;
+    sites_file.Close();
+}
+
+u32 Writer::GetSiteId(const Entry& entry) {
+    auto itr = site_ids.find(entry.call_site);
+    if (itr != site_ids.end())
+        return itr->second;
+
+    const CallSite& call_site = *entry.call_site;
+    u32 site_id = static_cast<u32>(site_ids.size());
+    site_ids.emplace(entry.call_site, site_id);
+
+    SiteRecord site;
+    site.site_id = site_id;
+    site.log_class = static_cast<u8>(call_site.log_class);
+    site.log_level = static_cast<u8>(call_site.log_level);
+    site.filename_length = static_cast<u16>(std::min<size_t>(std::strlen(call_site.filename), 0xFFFF));
+    site.line_nr = call_site.line_nr;
+    site.function_length = static_cast<u16>(std::min<size_t>(std::strlen(call_site.function), 0xFFFF));
+    site.format_length = static_cast<u16>(std::min<size_t>(std::strlen(entry.format), 0xFFFF));
+
+    sites_file.WriteBytes(&site, sizeof(site));
+    sites_file.WriteBytes(call_site.filename, site.filename_length);
+    sites_file.WriteBytes(call_site.function, site.function_length);
+    sites_file.WriteBytes(entry.format, site.format_length);
+    // Sites are rare, flush them right away so that they're not lost if the emulator crashes
+    sites_file.Flush();
+
+    return site_id;
+}
+
+u64 Writer::GetRecordSize(u64 position) const {
+    u32 size;
+    std::memcpy(&size, ring + position % header->capacity, sizeof(size));
+    return size;
+}
+
+void Writer::Write(const Entry& entry) {
+    if (!IsOpen())
+        return;
+
+    const u64 capacity = header->capacity;
+    const size_t num_arguments = entry.num_arguments;
+
+    u64 size = sizeof(RecordHeader) + AlignUp(num_arguments) + num_arguments * sizeof(u64);
+    for (size_t i = 0; i < num_arguments; ++i) {
+        if (entry.arguments[i].type == Argument::Type::String)
+            size += std::strlen(&entry.string_data[entry.arguments[i].integer]) + 1;
+    }
+    size = AlignUp(size);
+    if (size > capacity)
+        return;
+
+    // Drops the oldest records until there are `space` bytes free after the head
+    auto reserve = [&](u64 space) {
+        while (header->head + space - header->tail > capacity)
+            header->tail += GetRecordSize(header->tail);
+    };
+
+    // Records never wrap around the end of the ring, the space left there is skipped
+    u64 space_left = capacity - header->head % capacity;
+    if (space_left < size) {
+        reserve(space_left);
+        u8* padding = ring + header->head % capacity;
+        u32 padding_size = static_cast<u32>(space_left);
+        RecordType padding_type = RecordType::Padding;
+        std::memcpy(padding, &padding_size, sizeof(padding_size));
+        std::memcpy(padding + sizeof(padding_size), &padding_type, sizeof(padding_type));
+        header->head += space_left;
+    }
+
+    reserve(size);
+    u8* out = ring + header->head % capacity;
+
+    RecordHeader record_header = {};
+    record_header.size = static_cast<u32>(size);
+    record_header.type = RecordType::Message;
+    record_header.log_class = static_cast<u8>(entry.log_class);
+    record_header.log_level = static_cast<u8>(entry.log_level);
+    record_header.num_arguments = static_cast<u8>(num_arguments);
+    record_header.site_id = GetSiteId(entry);
+    record_header.timestamp_us = entry.timestamp.count();
+    std::memcpy(out, &record_header, sizeof(record_header));
+
+    u8* types = out + sizeof(RecordHeader);
+    u8* values = types + AlignUp(num_arguments);
+    u8* strings = values + num_arguments * sizeof(u64);
+    for (size_t i = 0; i < num_arguments; ++i) {
+        const Argument& argument = entry.arguments[i];
+        u64 value;
+        if (argument.type == Argument::Type::String) {
+            const char* string = &entry.string_data[argument.integer];
+            value = std::strlen(string) + 1;
+            std::memcpy(strings, string, static_cast<size_t>(value));
+            strings += value;
+        } else if (argument.type == Argument::Type::Floating) {
+            std::memcpy(&value, &argument.floating, sizeof(value));
+        } else {
+            value = argument.integer;
+        }
+        types[i] = static_cast<u8>(argument.type);
+        std::memcpy(values + i * sizeof(u64), &value, sizeof(value));
+    }
+
+    header->head += size;
+}
+
+bool ReadSites(const std::string& path, std::vector<std::unique_ptr<Site>>& sites) {
+    FileUtil::IOFile file(path, "rb");
+    SitesFileHeader sites_header;
+    if (file.ReadBytes(&sites_header, sizeof(sites_header)) != sizeof(sites_header) ||
+        sites_header.magic != SITES_FILE_MAGIC || sites_header.version != FILE_VERSION) {
+        return false;
+    }
+
+    SiteRecord record;
+    while (file.ReadBytes(&record, sizeof(record)) == sizeof(record)) {
+        if (record.site_id >= 0x100000 || record.log_class >= static_cast<u8>(Class::Count) ||
+            record.log_level >= static_cast<u8>(Level::Count)) {
+            return false;
+        }
+
+        std::unique_ptr<Site> site(new Site());
+        site->filename.resize(record.filename_length);
+        site->function.resize(record.function_length);
+        site->format.resize(record.format_length);
+        if (file.ReadBytes(&site->filename[0], record.filename_length) != record.filename_length ||
+            file.ReadBytes(&site->function[0], record.function_length) != record.function_length ||
+            file.ReadBytes(&site->format[0], record.format_length) != record.format_length) {
+            // The emulator might have been killed while writing the last site
+            break;
+        }
+
+        CallSite& call_site = site->call_site;
+        call_site.log_class = static_cast<Class>(record.log_class);
+        call_site.log_level = static_cast<Level>(record.log_level);
+        call_site.filename = site->filename.c_str();
+        call_site.line_nr = record.line_nr;
+        call_site.function = site->function.c_str();
+
+        if (sites.size() <= record.site_id)
+            sites.resize(record.site_id + 1);
+        sites[record.site_id] = std::move(site);
+    }
+
+    return true;
+}
+
+bool ReadRecords(const std::string& path, std::vector<u8>& records) {
+    FileUtil::IOFile file(path, "rb");
+    FileHeader file_header;
+    if (file.ReadBytes(&file_header, sizeof(file_header)) != sizeof(file_header) ||
+        file_header.magic != FILE_MAGIC || file_header.version != FILE_VERSION ||
+        file_header.head < file_header.tail || file_header.head - file_header.tail > file_header.capacity ||
+        file_header.capacity % 8 != 0 || file_header.capacity != file.GetSize() - sizeof(FileHeader)) {
+        return false;
+    }
+
+    std::vector<u8> ring(static_cast<size_t>(file_header.capacity));
+    if (file.ReadBytes(ring.data(), ring.size()) != ring.size())
+        return false;
+
+    // Unwrap the ring, starting from the oldest record
+    size_t begin = static_cast<size_t>(file_header.tail % file_header.capacity);
+    size_t length = static_cast<size_t>(file_header.head - file_header.tail);
+    size_t first_part = std::min(length, ring.size() - begin);
+    records.assign(ring.begin() + begin, ring.begin() + begin + first_part);
+    records.insert(records.end(), ring.begin(), ring.begin() + (length - first_part));
+
+    return true;
+}
+
+size_t DecodeRecord(const u8* record, size_t size, const std::vector<std::unique_ptr<Site>>& sites,
+                    Entry& entry) {
+    entry.call_site = nullptr;
+
+    u32 record_size;
+    RecordType type;
+    if (size < sizeof(record_size) + sizeof(type))
+        return 0;
+    std::memcpy(&record_size, record, sizeof(record_size));
+    std::memcpy(&type, record + sizeof(record_size), sizeof(type));
+    if (record_size > size || record_size % 8 != 0 || record_size < sizeof(record_size) + sizeof(type))
+        return 0;
+
+    if (type == RecordType::Padding)
+        return record_size;
+
+    RecordHeader record_header;
+    if (type != RecordType::Message || record_size < sizeof(record_header))
+        return 0;
+    std::memcpy(&record_header, record, sizeof(record_header));
+
+    const size_t num_arguments = record_header.num_arguments;
+    const u8* types = record + sizeof(RecordHeader);
+    const u8* values = types + AlignUp(num_arguments);
+    const u8* strings = values + num_arguments * sizeof(u64);
+    const u8* record_end = record + record_size;
+    if (num_arguments > MAX_LOG_ARGUMENTS || strings > record_end ||
+        record_header.log_class >= static_cast<u8>(Class::Count) ||
+        record_header.log_level >= static_cast<u8>(Level::Count)) {
+        return 0;
+    }
+
+    if (record_header.site_id >= sites.size() || sites[record_header.site_id] == nullptr)
+        return record_size;
+    const Site& site = *sites[record_header.site_id];
+
+    std::array<Argument, MAX_LOG_ARGUMENTS> arguments;
+    for (size_t i = 0; i < num_arguments; ++i) {
+        Argument& argument = arguments[i];
+        u64 value;
+        std::memcpy(&value, values + i * sizeof(u64), sizeof(value));
+
+        argument.type = static_cast<Argument::Type>(types[i]);
+        switch (argument.type) {
+        case Argument::Type::Integer:
+            argument.integer = value;
+            break;
+        case Argument::Type::Floating:
+            std::memcpy(&argument.floating, &value, sizeof(value));
+            break;
+        case Argument::Type::String:
+            if (value == 0 || value > static_cast<u64>(record_end - strings) || strings[value - 1] != '\0')
+                return 0;
+            argument.string = reinterpret_cast<const char*>(strings);
+            strings += value;
+            break;
+        default:
+            return 0;
+        }
+    }
+
+    entry.timestamp = std::chrono::microseconds(record_header.timestamp_us);
+    entry.log_class = static_cast<Class>(record_header.log_class);
+    entry.log_level = static_cast<Level>(record_header.log_level);
+    entry.call_site = &site.call_site;
+    entry.format = site.format.c_str();
+    SetEntryArguments(entry, arguments.data(), num_arguments);
+
+    return record_size;
+}
+
+static std::mutex global_writer_mutex;
+static Writer global_writer;
+
+bool StartGlobalLog(const std::string& path, u64 capacity) {
+    std::lock_guard<std::mutex> lock(global_writer_mutex);
+    return global_writer.Open(path, capacity);
+}
+
+void StopGlobalLog() {
+    std::lock_guard<std::mutex> lock(global_writer_mutex);
+    global_writer.Close();
+}
+
+bool WriteToGlobalLog(const Entry* entries, size_t num_entries) {
+    std::lock_guard<std::mutex> lock(global_writer_mutex);
+    if (!global_writer.IsOpen())
+        return false;
+
+    for (size_t i = 0; i < num_entries; ++i)
+        global_writer.Write(entries[i]);
+    return true;
+}
+
+} // namespace BinaryLog
+} // namespace Log
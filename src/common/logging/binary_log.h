@@ -0,0 +1,183 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/file_util.h"
+
+#include "common/logging/log.h"
+
+namespace Log {
+
+struct Entry;
+
+/**
+ * The binary log stores log entries without formatting them, so that verbose logging can be kept
+ * enabled without paying for console output. It can be decoded afterwards with citra-logdump.
+ *
+ * A binary log is made of two files. The log file is memory-mapped and starts with a FileHeader,
+ * followed by a ring of records which overwrites the oldest records once it's full. Each record is
+ * a RecordHeader followed by one type byte per argument (padded to 8 bytes), one 64-bit value per
+ * argument and the null-terminated string arguments, whose value is their size. Records are
+ * 8-byte aligned and never wrap around the end of the ring, a padding record fills the space left
+ * at the end instead.
+ *
+ * Records refer to their call site by an id. The call sites are described in the sites file (the
+ * log file path with ".sites" appended), which starts with a SitesFileHeader and is followed by a
+ * SiteRecord and the filename, function name and format string of each call site.
+ */
+namespace BinaryLog {
+
+const u32 FILE_MAGIC = 0x474F4C43; // "CLOG"
+const u32 SITES_FILE_MAGIC = 0x53474F4C; // "LOGS"
+const u32 FILE_VERSION = 1;
+
+/// Default size of the record ring
+const u64 DEFAULT_CAPACITY = 64 * 1024 * 1024;
+
+struct FileHeader {
+    u32 magic;
+    u32 version;
+    u64 capacity; ///< Size of the record ring following the header
+    u64 head;     ///< Position where the next record will be written
+    u64 tail;     ///< Position of the oldest record
+};
+static_assert(sizeof(FileHeader) == 32, "FileHeader has incorrect size");
+
+// Positions are counted from the start of the log and never wrap, the offset of a record in the
+// ring is its position modulo the capacity.
+
+enum class RecordType : u8 {
+    Message = 0,
+    Padding = 1, ///< Unused space at the end of the ring
+};
+
+struct RecordHeader {
+    u32 size; ///< Size of the whole record, including this header
+    RecordType type;
+    u8 log_class;
+    u8 log_level;
+    u8 num_arguments;
+    u32 site_id;
+    u32 padding;
+    u64 timestamp_us;
+};
+static_assert(sizeof(RecordHeader) == 24, "RecordHeader has incorrect size");
+
+struct SitesFileHeader {
+    u32 magic;
+    u32 version;
+};
+static_assert(sizeof(SitesFileHeader) == 8, "SitesFileHeader has incorrect size");
+
+struct SiteRecord {
+    u32 site_id;
+    u8 log_class;
+    u8 log_level;
+    u16 filename_length; ///< Length of the filename which follows, not null-terminated
+    u32 line_nr;
+    u16 function_length;
+    u16 format_length;
+};
+static_assert(sizeof(SiteRecord) == 16, "SiteRecord has incorrect size");
+
+/// Writes log entries to a binary log. Only used from the logging thread.
+class Writer : NonCopyable {
+public:
+    Writer() = default;
+    ~Writer();
+
+    /**
+     * Creates a binary log, overwriting any existing one
+     * @param path Path of the log file
+     * @param capacity Size of the record ring, rounded up to a multiple of 8 bytes
+     * @return True on success
+     */
+    bool Open(const std::string& path, u64 capacity = DEFAULT_CAPACITY);
+    void Close();
+    bool IsOpen() const { return header != nullptr; }
+
+    /// Appends an entry to the log, possibly overwriting the oldest ones.
+    void Write(const Entry& entry);
+
+private:
+    u32 GetSiteId(const Entry& entry);
+    u64 GetRecordSize(u64 position) const;
+
+    FileHeader* header = nullptr;
+    u8* ring = nullptr;
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#else
+    int file_descriptor = -1;
+#endif
+    size_t mapped_size = 0;
+
+    FileUtil::IOFile sites_file;
+    std::unordered_map<const CallSite*, u32> site_ids;
+};
+
+/// A call site read back from a sites file
+struct Site : NonCopyable {
+    CallSite call_site; ///< Points to the strings below
+    std::string filename;
+    std::string function;
+    std::string format;
+};
+
+/**
+ * Reads the call sites described in a sites file
+ * @param path Path of the sites file
+ * @param sites Where to store the sites, indexed by id. Ids that aren't described are left null.
+ * @return True on success
+ */
+bool ReadSites(const std::string& path, std::vector<std::unique_ptr<Site>>& sites);
+
+/**
+ * Reads the contents of a log file, unwrapping the record ring so that the records are in order
+ * @param path Path of the log file
+ * @param records Where to store the records, from the oldest to the newest
+ * @return True on success
+ */
+bool ReadRecords(const std::string& path, std::vector<u8>& records);
+
+/**
+ * Decodes a message record into an entry, which can then be printed as usual
+ * @param record Record to decode, followed by the rest of the records
+ * @param size Number of bytes available at `record`
+ * @param sites Call sites of the log, which must outlive the entry
+ * @param entry Where to store the entry
+ * @return Size of the record, or 0 if it's corrupted. Padding records and records with an unknown
+ *         call site are skipped but not decoded, leaving `entry.call_site` null.
+ */
+size_t DecodeRecord(const u8* record, size_t size, const std::vector<std::unique_ptr<Site>>& sites,
+                    Entry& entry);
+
+/**
+ * Starts writing the entries printed by TextLoggingLoop to a binary log instead. Only messages of
+ * the Error level and above are still printed to the console.
+ * @param path Path of the log file
+ * @param capacity Size of the record ring
+ * @return True on success
+ */
+bool StartGlobalLog(const std::string& path, u64 capacity = DEFAULT_CAPACITY);
+
+/// Closes the binary log opened by StartGlobalLog, if any.
+void StopGlobalLog();
+
+/**
+ * Writes entries to the binary log opened by StartGlobalLog
+ * @return False if there is no binary log open, in which case nothing is written
+ */
+bool WriteToGlobalLog(const Entry* entries, size_t num_entries);
+
+} // namespace BinaryLog
+} // namespace Log
@@ -16,10 +16,12 @@ Filter::Filter(Level default_level) {
 
 void Filter::ResetAll(Level level) {
     class_levels.fill(level);
+    OnFilterChanged(this);
 }
 
 void Filter::SetClassLevel(Class log_class, Level level) {
     class_levels[static_cast<size_t>(log_class)] = level;
+    OnFilterChanged(this);
 }
 
 void Filter::SetSubclassesLevel(const ClassInfo& log_class, Level level) {
@@ -27,9 +29,10 @@ void Filter::SetSubclassesLevel(const ClassInfo& log_class, Level level) {
 
     const size_t begin = log_class_i + 1;
     const size_t end = begin + log_class.num_children;
-    for (size_t i = begin; begin < end; ++i) {
+    for (size_t i = begin; i < end; ++i) {
         class_levels[i] = level;
     }
+    OnFilterChanged(this);
 }
 
 void Filter::ParseFilterString(const std::string& filter_str) {
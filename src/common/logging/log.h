@@ -4,9 +4,12 @@
 
 #pragma once
 
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cstdint>
 #include <string>
+#include <type_traits>
 
 #include "common/common_types.h"
 
@@ -79,27 +82,161 @@ enum class Class : ClassType {
     Count ///< Total number of logging classes
 };
 
+/**
+ * Returns whether a message with the given class and level would pass the active filter. Callers
+ * that need to do expensive work to build the arguments of a message can use this to skip it.
+ */
+bool IsMessageEnabled(Class log_class, Level log_level);
+
+/**
+ * A logging statement in the source code. Each LOG_* macro expands to a static CallSite which caches
+ * whether its class and level pass the active filter, so that a disabled message costs a single
+ * load and branch. The cached state is refreshed whenever the active filter changes.
+ *
+ * CallSites are aggregates so that they are initialized statically (without a guard variable or a
+ * constructor call). A call site registers itself the first time it is reached.
+ */
+struct CallSite {
+    enum State : u8 {
+        Unregistered = 0,
+        Disabled,
+        Enabled,
+    };
+
+    Class log_class;
+    Level log_level;
+    const char* filename;
+    unsigned int line_nr;
+    const char* function;
+
+    std::atomic<u8> state; ///< One of State, zero-initialized to Unregistered
+    CallSite* next;        ///< Next registered call site, guarded by the call site registry lock
+
+    bool IsEnabled() {
+        u8 current_state = state.load(std::memory_order_relaxed);
+        if (current_state == Enabled)
+            return true;
+        if (current_state == Disabled)
+            return false;
+        return Register();
+    }
+
+private:
+    /// Adds this call site to the registry and computes its state, returns whether it's enabled.
+    bool Register();
+};
+
+/// Maximum number of arguments a log message can have
+const size_t MAX_LOG_ARGUMENTS = 24;
+
+/**
+ * An argument of a log message, captured as-is at the call site. Messages are only formatted later
+ * on by the logging thread.
+ */
+struct Argument {
+    enum class Type : u8 {
+        Integer,  ///< Any integer, enum or pointer, sign extended to 64 bits
+        Floating, ///< A float or a double
+        String,   ///< A C string
+    };
+
+    Type type;
+    union {
+        u64 integer;
+        double floating;
+        const char* string;
+    };
+};
+
+// Conversions from the types that can be passed to a log message to Arguments. They mirror the
+// default argument promotions that would be applied to printf arguments.
+
+inline Argument MakeArgument(const char* value) {
+    Argument argument;
+    argument.type = Argument::Type::String;
+    argument.string = value;
+    return argument;
+}
+
+inline Argument MakeArgument(double value) {
+    Argument argument;
+    argument.type = Argument::Type::Floating;
+    argument.floating = value;
+    return argument;
+}
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value, Argument>::type MakeArgument(T value) {
+    Argument argument;
+    argument.type = Argument::Type::Integer;
+    argument.integer = static_cast<u64>(value);
+    return argument;
+}
+
+template <typename T>
+typename std::enable_if<std::is_enum<T>::value, Argument>::type MakeArgument(T value) {
+    return MakeArgument(static_cast<typename std::underlying_type<T>::type>(value));
+}
+
+template <typename T>
+Argument MakeArgument(const T* value) {
+    return MakeArgument(reinterpret_cast<uintptr_t>(value));
+}
+
+/// Class types (e.g. BitFields) are converted to their underlying arithmetic type
+template <typename T>
+typename std::enable_if<std::is_class<T>::value, Argument>::type MakeArgument(const T& value) {
+    return MakeArgument(+value);
+}
+
 /**
  * Logs a message to the global logger. This proxy exists to avoid exposing the details of the
- * Logger class, including the ConcurrentRingBuffer template, to all files that desire to log
+ * Logger class, including its buffers, to all files that desire to log
  * messages, reducing unecessary recompilations.
+ * @param call_site Call site of the message
+ * @param format printf format string of the message, which must be a string literal
+ * @param arguments Arguments of the message. String arguments are copied, the rest is stored
+ *                  as-is and only formatted when the message is printed.
+ * @param num_arguments Number of arguments
+ */
+void LogMessage(const CallSite& call_site, const char* format,
+                const Argument* arguments, size_t num_arguments);
+
+template <typename... Args>
+void LogMessage(const CallSite& call_site, const char* format, const Args&... args) {
+    static_assert(sizeof...(Args) <= MAX_LOG_ARGUMENTS, "Too many arguments for a log message");
+
+    // The extra element avoids declaring an empty array for messages without arguments
+    const Argument arguments[] = { MakeArgument(args)..., Argument() };
+    LogMessage(call_site, format, arguments, sizeof...(Args));
+}
+
+/**
+ * Never called, only used to let the compiler check the arguments of log messages against their
+ * format strings.
  */
-void LogMessage(Class log_class, Level log_level,
-    const char* filename, unsigned int line_nr, const char* function,
+inline void CheckFormat(
 #ifdef _MSC_VER
     _Printf_format_string_
 #endif
     const char* format, ...)
 #ifdef __GNUC__
-    __attribute__((format(printf, 6, 7)))
+    __attribute__((format(printf, 1, 2)))
 #endif
     ;
+inline void CheckFormat(const char* format, ...) {}
 
 } // namespace Log
 
 #define LOG_GENERIC(log_class, log_level, ...) \
-    ::Log::LogMessage(::Log::Class::log_class, ::Log::Level::log_level, \
-        __FILE__, __LINE__, __func__, __VA_ARGS__)
+    do { \
+        static ::Log::CallSite log_call_site = { ::Log::Class::log_class, ::Log::Level::log_level, \
+            __FILE__, __LINE__, __func__ }; \
+        if (log_call_site.IsEnabled()) \
+            ::Log::LogMessage(log_call_site, __VA_ARGS__); \
+        if (false) \
+            ::Log::CheckFormat(__VA_ARGS__); \
+    } while (0)
 
 #ifdef _DEBUG
 #define LOG_TRACE(   log_class, ...) LOG_GENERIC(log_class, Trace,    __VA_ARGS__)
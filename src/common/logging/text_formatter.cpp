@@ -11,6 +11,7 @@
 #endif
 
 #include "common/logging/backend.h"
+#include "common/logging/binary_log.h"
 #include "common/logging/log.h"
 #include "common/logging/text_formatter.h"
 
@@ -49,9 +50,13 @@ void FormatLogMessage(const Entry& entry, char* out_text, size_t text_len) {
     const char* class_name = Logger::GetLogClassName(entry.log_class);
     const char* level_name = Logger::GetLevelName(entry.log_level);
 
-    snprintf(out_text, text_len, "[%4u.%06u] %s <%s> %s: %s",
+    std::array<char, 4 * 1024> message;
+    FormatEntryMessage(entry, message.data(), message.size());
+
+    const CallSite& call_site = *entry.call_site;
+    snprintf(out_text, text_len, "[%4u.%06u] %s <%s> %s:%s:%u: %s",
         time_seconds, time_fractional, class_name, level_name,
-        TrimSourcePath(entry.location.c_str()), entry.message.c_str());
+        TrimSourcePath(call_site.filename), call_site.function, call_site.line_nr, message.data());
 }
 
 void PrintMessage(const Entry& entry) {
@@ -117,18 +122,27 @@ void PrintColoredMessage(const Entry& entry) {
 }
 
 void TextLoggingLoop(std::shared_ptr<Logger> logger) {
-    std::array<Entry, 256> entry_buffer;
+    std::array<Entry, 32> entry_buffer;
 
     while (true) {
         size_t num_entries = logger->GetEntries(entry_buffer.data(), entry_buffer.size());
         if (num_entries == Logger::QUEUE_CLOSED) {
             break;
         }
+
+        // When a binary log is open, only the most important messages are printed
+        bool binary_log_open = BinaryLog::WriteToGlobalLog(entry_buffer.data(), num_entries);
         for (size_t i = 0; i < num_entries; ++i) {
             const Entry& entry = entry_buffer[i];
-            PrintColoredMessage(entry);
+            if (!binary_log_open || entry.log_level >= Level::Error)
+                PrintColoredMessage(entry);
         }
     }
+
+    u64 dropped_entries = logger->GetDroppedEntries();
+    if (dropped_entries != 0)
+        LOG_WARNING(Log, "%llu log messages were dropped because the log buffer was full",
+                    (unsigned long long)dropped_entries);
 }
 
 }
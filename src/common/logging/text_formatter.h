@@ -33,7 +33,9 @@ void PrintColoredMessage(const Entry& entry);
 
 /**
  * Logging loop that repeatedly reads messages from the provided logger and prints them to the
- * console. It is the baseline barebones log outputter.
+ * console. It is the baseline barebones log outputter. If a binary log has been started with
+ * BinaryLog::StartGlobalLog, messages are written to it instead and only errors are printed. The
+ * number of messages the logger had to drop is reported once it's closed.
  */
 void TextLoggingLoop(std::shared_ptr<Logger> logger);
 
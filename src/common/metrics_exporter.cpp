@@ -0,0 +1,235 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "common/common_funcs.h"
+#include "common/file_util.h"
+#include "common/logging/log.h"
+#include "common/metrics_exporter.h"
+#include "common/profiler.h"
+#include "common/profiler_reporting.h"
+#include "common/thread.h"
+
+namespace Common {
+namespace Profiling {
+
+static std::thread exporter_thread;
+static std::mutex exporter_mutex;
+static std::condition_variable exporter_stop_requested;
+static bool stop_requested;
+
+static std::string metrics_file_path;
+
+#ifndef _WIN32
+static int listening_socket = -1;
+/// Connected clients, only accessed by the exporter thread while it's running
+static std::vector<int> client_sockets;
+static std::string metrics_socket_path;
+#endif
+
+static void AppendMetric(std::string& text, const char* name, const char* suffix, double value) {
+    std::array<char, 256> line;
+    std::snprintf(line.data(), line.size(), "citra_%s%s %.3f\n", name, suffix, value);
+    text += line.data();
+}
+
+static void AppendMetric(std::string& text, const char* name, const char* suffix, u64 value) {
+    std::array<char, 256> line;
+    std::snprintf(line.data(), line.size(), "citra_%s%s %llu\n", name, suffix,
+                  (unsigned long long)value);
+    text += line.data();
+}
+
+std::string FormatMetrics() {
+    AggregatedFrameResult results = GetTimingResultsAggregator()->GetAggregatedResults();
+    const ProfilingManager& manager = GetProfilingManager();
+
+    using FloatMs = std::chrono::duration<double, std::milli>;
+
+    std::string text;
+    AppendMetric(text, "fps", "", (double)results.fps);
+    AppendMetric(text, "frame_time_ms", "",
+                 std::chrono::duration_cast<FloatMs>(results.frame_time.avg).count());
+
+    for (const GaugeInfo& info : manager.GetGaugesInfo())
+        AppendMetric(text, info.name, "", info.gauge->GetValue());
+
+    for (const CounterInfo& info : manager.GetCountersInfo()) {
+        unsigned int id = info.counter->GetCounterId();
+        AppendMetric(text, info.name, "_total", info.counter->GetValue());
+        AppendMetric(text, info.name, "_per_second",
+                     id < results.stats_per_counter.size() ? (double)results.stats_per_counter[id].per_second : 0.0);
+    }
+
+    return text;
+}
+
+static void WriteMetricsFile(const std::string& text) {
+    // Written to a temporary file first so that readers never see a partial snapshot
+    std::string temp_path = metrics_file_path + ".tmp";
+    {
+        FileUtil::IOFile file(temp_path, "w");
+        if (!file.IsOpen() || file.WriteBytes(text.data(), text.size()) != text.size())
+            return;
+    }
+
+#ifdef _WIN32
+    // rename doesn't replace existing files on Windows
+    if (FileUtil::Exists(metrics_file_path))
+        FileUtil::Delete(metrics_file_path);
+#endif
+    FileUtil::Rename(temp_path, metrics_file_path);
+}
+
+#ifndef _WIN32
+static bool OpenMetricsSocket(const std::string& path) {
+    sockaddr_un address = {};
+    if (path.size() >= sizeof(address.sun_path)) {
+        LOG_ERROR(Common, "Metrics socket path %s is too long", path.c_str());
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, path.c_str());
+
+    listening_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listening_socket == -1) {
+        LOG_ERROR(Common, "Failed to create the metrics socket: %s", GetLastErrorMsg());
+        return false;
+    }
+
+    // Remove the socket left behind by a previous run, if any
+    unlink(path.c_str());
+
+    if (bind(listening_socket, (sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(listening_socket, 4) != 0) {
+        LOG_ERROR(Common, "Failed to listen on %s: %s", path.c_str(), GetLastErrorMsg());
+        close(listening_socket);
+        listening_socket = -1;
+        return false;
+    }
+
+    fcntl(listening_socket, F_SETFL, fcntl(listening_socket, F_GETFL) | O_NONBLOCK);
+    metrics_socket_path = path;
+    return true;
+}
+
+static void CloseMetricsSocket() {
+    for (int client : client_sockets)
+        close(client);
+    client_sockets.clear();
+
+    if (listening_socket != -1) {
+        close(listening_socket);
+        listening_socket = -1;
+        unlink(metrics_socket_path.c_str());
+    }
+}
+
+static void SendToMetricsClients(const std::string& text) {
+    while (true) {
+        int client = accept(listening_socket, nullptr, nullptr);
+        if (client == -1)
+            break;
+
+        fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        client_sockets.push_back(client);
+    }
+
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+
+    // Snapshots are separated by an empty line. Clients which disconnected, or which are too slow
+    // to keep up, are dropped.
+    std::string message = text + "\n";
+    for (auto it = client_sockets.begin(); it != client_sockets.end();) {
+        ssize_t sent = send(*it, message.data(), message.size(), flags);
+        if (sent != (ssize_t)message.size()) {
+            close(*it);
+            it = client_sockets.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+#endif
+
+static void ExporterLoop() {
+    Common::SetCurrentThreadName("MetricsExporter");
+
+    std::unique_lock<std::mutex> lock(exporter_mutex);
+    while (!exporter_stop_requested.wait_for(lock, std::chrono::seconds(1),
+                                             [] { return stop_requested; })) {
+        std::string text = FormatMetrics();
+
+        if (!metrics_file_path.empty())
+            WriteMetricsFile(text);
+#ifndef _WIN32
+        if (listening_socket != -1)
+            SendToMetricsClients(text);
+#endif
+    }
+}
+
+bool StartMetricsExporter(const std::string& file_path, const std::string& socket_path) {
+    StopMetricsExporter();
+
+    if (file_path.empty() && socket_path.empty())
+        return true;
+
+    if (!socket_path.empty()) {
+#ifdef _WIN32
+        LOG_ERROR(Common, "The metrics socket isn't supported on Windows");
+        return false;
+#else
+        if (!OpenMetricsSocket(socket_path))
+            return false;
+#endif
+    }
+
+    metrics_file_path = file_path;
+    stop_requested = false;
+    exporter_thread = std::thread(ExporterLoop);
+    return true;
+}
+
+void StopMetricsExporter() {
+    if (!exporter_thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(exporter_mutex);
+        stop_requested = true;
+    }
+    exporter_stop_requested.notify_one();
+    exporter_thread.join();
+
+#ifndef _WIN32
+    CloseMetricsSocket();
+#endif
+}
+
+} // namespace Profiling
+} // namespace Common
@@ -0,0 +1,33 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+namespace Common {
+namespace Profiling {
+
+/**
+ * Returns a plain-text snapshot of the performance counters, one "name value" line per metric:
+ * the frame rate and frame time, the total and per-second rate of every Counter and the value of
+ * every Gauge. Rates are averaged over the frames kept by the TimingResultsAggregator.
+ */
+std::string FormatMetrics();
+
+/**
+ * Starts a thread which publishes a snapshot of the performance counters every second.
+ * @param file_path If not empty, the snapshot is written to this file, which is replaced atomically
+ * @param socket_path If not empty, a Unix domain socket is created at this path and the snapshots
+ *        are streamed to every client connected to it, separated by an empty line. Not supported
+ *        on Windows.
+ * @return False if an endpoint couldn't be opened, in which case nothing is started
+ */
+bool StartMetricsExporter(const std::string& file_path, const std::string& socket_path);
+
+/// Stops the thread started by StartMetricsExporter, if any, and closes its endpoints.
+void StopMetricsExporter();
+
+} // namespace Profiling
+} // namespace Common
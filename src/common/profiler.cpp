@@ -2,6 +2,12 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <cstdio>
+#include <cstring>
+#include <deque>
+
+#include "common/file_util.h"
+#include "common/logging/log.h"
 #include "common/profiler.h"
 #include "common/profiler_reporting.h"
 #include "common/assert.h"
@@ -18,6 +24,140 @@ namespace Profiling {
 thread_local Timer* Timer::current_timer = nullptr;
 #endif
 
+static const unsigned int NO_NODE = -1;
+
+/// A node of the scope tree of a thread
+struct ScopeNode {
+    ScopeNode(const ScopeCategory* category, unsigned int parent) : category(category),
+            parent(parent), first_child(NO_NODE), next_sibling(NO_NODE),
+            call_count(0), accumulated_duration(0) {
+    }
+
+    const ScopeCategory* category;
+    unsigned int parent;
+    unsigned int first_child;
+    unsigned int next_sibling;
+
+    std::atomic<unsigned int> call_count;
+    std::atomic<Duration::rep> accumulated_duration;
+};
+
+/// Entering (or leaving, if `category` is null) a scope during a trace capture
+struct TraceEvent {
+    const ScopeCategory* category;
+    Clock::time_point time;
+};
+
+struct ThreadScopeState {
+    struct OpenScope {
+        unsigned int node;
+        Clock::time_point start;
+    };
+
+    unsigned int thread_index;
+
+    /**
+     * Nodes of the scope tree, in creation order so that parents come before their children. Only
+     * the owning thread adds nodes, with `nodes_mutex` held, so it can read them without the lock.
+     */
+    std::deque<ScopeNode> nodes;
+    unsigned int first_root = NO_NODE;
+    std::mutex nodes_mutex;
+
+    /// Scopes the thread is currently in, only accessed by the owning thread
+    std::vector<OpenScope> stack;
+
+    /// Events recorded during the trace capture with id `capture_id`
+    std::vector<TraceEvent> events;
+    unsigned int capture_id = 0;
+    std::mutex events_mutex;
+
+    /// Set when the thread exits, the state is destroyed once FinishFrame reported its nodes
+    std::atomic<bool> exited{ false };
+};
+
+/// A finished trace capture, handed to the trace writer thread
+struct TraceCapture {
+    std::string path;
+    Clock::time_point start;
+    std::vector<std::pair<Clock::time_point, Clock::time_point>> frames;
+    /// Events of each thread, along with its index
+    std::vector<std::pair<unsigned int, std::vector<TraceEvent>>> thread_events;
+};
+
+static thread_local ThreadScopeState* current_scope_state = nullptr;
+
+// The trace capture currently running, if any. Events are only recorded while this is set.
+static std::atomic<bool> trace_capture_running(false);
+static std::atomic<unsigned int> trace_capture_id(0);
+
+static unsigned int FindOrAddScopeNode(ThreadScopeState& state, unsigned int parent,
+                                       const ScopeCategory& category) {
+    unsigned int* link = (parent == NO_NODE) ? &state.first_root : &state.nodes[parent].first_child;
+    while (*link != NO_NODE) {
+        if (state.nodes[*link].category == &category)
+            return *link;
+        link = &state.nodes[*link].next_sibling;
+    }
+
+    std::lock_guard<std::mutex> lock(state.nodes_mutex);
+    unsigned int node = (unsigned int)state.nodes.size();
+    state.nodes.emplace_back(&category, parent);
+    *link = node;
+    return node;
+}
+
+static void RecordTraceEvent(ThreadScopeState& state, const ScopeCategory* category,
+                             Clock::time_point time) {
+    std::lock_guard<std::mutex> lock(state.events_mutex);
+
+    // The first event of a capture: also record entering the scopes the thread was already in
+    unsigned int capture_id = trace_capture_id.load(std::memory_order_relaxed);
+    if (state.capture_id != capture_id) {
+        state.capture_id = capture_id;
+        state.events.clear();
+        for (const ThreadScopeState::OpenScope& scope : state.stack)
+            state.events.push_back({ state.nodes[scope.node].category, scope.start });
+    }
+
+    state.events.push_back({ category, time });
+}
+
+void EnterScope(const ScopeCategory& category) {
+#if ENABLE_PROFILING
+    ThreadScopeState* state = current_scope_state;
+    if (state == nullptr)
+        state = current_scope_state = &GetProfilingManager().GetThreadScopeState();
+
+    unsigned int parent = state->stack.empty() ? NO_NODE : state->stack.back().node;
+    unsigned int node = FindOrAddScopeNode(*state, parent, category);
+
+    Clock::time_point now = Clock::now();
+    if (trace_capture_running.load(std::memory_order_relaxed))
+        RecordTraceEvent(*state, &category, now);
+    state->stack.push_back({ node, now });
+#endif
+}
+
+void LeaveScope() {
+#if ENABLE_PROFILING
+    ThreadScopeState* state = current_scope_state;
+    ASSERT(state != nullptr && !state->stack.empty());
+
+    Clock::time_point now = Clock::now();
+    if (trace_capture_running.load(std::memory_order_relaxed))
+        RecordTraceEvent(*state, nullptr, now);
+
+    const ThreadScopeState::OpenScope& scope = state->stack.back();
+    ScopeNode& node = state->nodes[scope.node];
+    std::atomic_fetch_add_explicit(&node.call_count, 1u, std::memory_order_relaxed);
+    std::atomic_fetch_add_explicit(&node.accumulated_duration,
+            std::chrono::duration_cast<Duration>(now - scope.start).count(),
+            std::memory_order_relaxed);
+    state->stack.pop_back();
+#endif
+}
+
 #if defined(_MSC_VER) && _MSC_VER <= 1800 // MSVC 2013
 QPCClock::time_point QPCClock::now() {
     static LARGE_INTEGER freq;
@@ -44,8 +184,53 @@ TimingCategory::TimingCategory(const char* name, TimingCategory* parent)
         manager.SetTimingCategoryParent(category_id, parent->category_id);
 }
 
+Counter::Counter(const char* name) : value(0) {
+    counter_id = GetProfilingManager().RegisterCounter(this, name);
+}
+
+Gauge::Gauge(const char* name) : value(0.0) {
+    GetProfilingManager().RegisterGauge(this, name);
+}
+
+CallCategory::CallCategory(unsigned int category_id)
+        : category_id(category_id), call_count(0), accumulated_duration(0) {
+
+    for (auto& bucket : histogram)
+        bucket = 0;
+}
+
+CallCategory::Histogram CallCategory::GetHistogram() const {
+    Histogram result;
+    for (unsigned int i = 0; i < NUM_HISTOGRAM_BUCKETS; ++i)
+        result[i] = histogram[i].load(std::memory_order_relaxed);
+    return result;
+}
+
+unsigned int CallCategory::GetHistogramBucket(Duration time) {
+    u64 ns = (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+
+    unsigned int bucket = 0;
+    while (ns > 1 && bucket < NUM_HISTOGRAM_BUCKETS - 1) {
+        ns >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+static void OnScopeThreadExit(void* state) {
+    static_cast<ThreadScopeState*>(state)->exited = true;
+    // Scopes entered later on while the thread exits get a new state
+    current_scope_state = nullptr;
+}
+
 ProfilingManager::ProfilingManager()
-        : last_frame_end(Clock::now()), this_frame_start(Clock::now()) {
+        : thread_scope_state_key(OnScopeThreadExit),
+          last_frame_end(Clock::now()), this_frame_start(Clock::now()) {
+}
+
+ProfilingManager::~ProfilingManager() {
+    if (trace_writer.joinable())
+        trace_writer.join();
 }
 
 unsigned int ProfilingManager::RegisterTimingCategory(TimingCategory* category, const char* name) {
@@ -67,8 +252,165 @@ void ProfilingManager::SetTimingCategoryParent(unsigned int category, unsigned i
     timing_categories[category].parent = parent;
 }
 
+EventCategory* ProfilingManager::RegisterEventCategory(const char* name) {
+    std::lock_guard<std::mutex> lock(event_categories_mutex);
+
+    for (const EventCategoryInfo& info : event_categories_info) {
+        if (std::strcmp(info.name, name) == 0)
+            return info.category;
+    }
+
+    unsigned int id = (unsigned int)event_categories.size();
+    event_categories.emplace_back(new EventCategory(id));
+
+    EventCategoryInfo info;
+    info.category = event_categories.back().get();
+    info.name = name;
+    event_categories_info.push_back(info);
+
+    return info.category;
+}
+
+std::vector<EventCategoryInfo> ProfilingManager::GetEventCategoriesInfo() const {
+    std::lock_guard<std::mutex> lock(event_categories_mutex);
+    return event_categories_info;
+}
+
+CallCategory* ProfilingManager::RegisterCallCategory(std::string name) {
+    std::lock_guard<std::mutex> lock(call_categories_mutex);
+
+    for (const CallCategoryInfo& info : call_categories_info) {
+        if (info.name == name)
+            return info.category;
+    }
+
+    unsigned int id = (unsigned int)call_categories.size();
+    call_categories.emplace_back(new CallCategory(id));
+
+    CallCategoryInfo info;
+    info.category = call_categories.back().get();
+    info.name = std::move(name);
+    call_categories_info.push_back(std::move(info));
+
+    return call_categories.back().get();
+}
+
+std::vector<CallCategoryInfo> ProfilingManager::GetCallCategoriesInfo() const {
+    std::lock_guard<std::mutex> lock(call_categories_mutex);
+    return call_categories_info;
+}
+
+unsigned int ProfilingManager::RegisterCounter(Counter* counter, const char* name) {
+    CounterInfo info;
+    info.counter = counter;
+    info.name = name;
+
+    unsigned int id = (unsigned int)counters.size();
+    counters.push_back(info);
+
+    return id;
+}
+
+void ProfilingManager::RegisterGauge(Gauge* gauge, const char* name) {
+    GaugeInfo info;
+    info.gauge = gauge;
+    info.name = name;
+    gauges.push_back(info);
+}
+
+ThreadScopeState& ProfilingManager::GetThreadScopeState() {
+    ThreadScopeState* state = new ThreadScopeState;
+    {
+        std::lock_guard<std::mutex> lock(thread_scope_states_mutex);
+        thread_scope_states.emplace_back(state);
+        state->thread_index = next_thread_index++;
+    }
+    thread_scope_state_key.Set(state);
+    return *state;
+}
+
+void ProfilingManager::StartTraceCapture(unsigned int num_frames, std::string path) {
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    if (trace_frames_left != 0 || num_frames == 0)
+        return;
+
+    trace_frames_left = num_frames;
+    trace_path = std::move(path);
+}
+
+bool ProfilingManager::IsTraceCaptureRunning() const {
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    return trace_frames_left != 0;
+}
+
+/// Escapes a string to be used in a JSON string literal
+static std::string EscapeJSONString(const char* string) {
+    std::string result;
+    for (; *string != '\0'; ++string) {
+        if (*string == '"' || *string == '\\')
+            result += '\\';
+        result += *string;
+    }
+    return result;
+}
+
+/// Writes a finished trace capture to its file, on the trace writer thread
+static void WriteTraceCapture(std::unique_ptr<TraceCapture> capture) {
+    std::string json = "{\"traceEvents\":[\n";
+    std::array<char, 256> buffer;
+
+    auto to_us = [&capture](Clock::time_point time) {
+        using FloatUs = std::chrono::duration<double, std::micro>;
+        return std::max(0.0, std::chrono::duration_cast<FloatUs>(time - capture->start).count());
+    };
+
+    // Frames are shown as a separate thread, with id 0
+    json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Frames\"}}";
+    for (size_t i = 0; i < capture->frames.size(); ++i) {
+        double start = to_us(capture->frames[i].first);
+        std::snprintf(buffer.data(), buffer.size(),
+                ",\n{\"name\":\"Frame %u\",\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f}",
+                (unsigned int)i, start, to_us(capture->frames[i].second) - start);
+        json += buffer.data();
+    }
+
+    for (const auto& thread_events : capture->thread_events) {
+        unsigned int tid = thread_events.first + 1;
+        for (const TraceEvent& event : thread_events.second) {
+            if (event.category != nullptr) {
+                std::snprintf(buffer.data(), buffer.size(),
+                        ",\n{\"name\":\"%s\",\"ph\":\"B\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}",
+                        EscapeJSONString(event.category->GetName()).c_str(), tid, to_us(event.time));
+            } else {
+                std::snprintf(buffer.data(), buffer.size(),
+                        ",\n{\"ph\":\"E\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}",
+                        tid, to_us(event.time));
+            }
+            json += buffer.data();
+        }
+    }
+
+    json += "\n]}\n";
+
+    FileUtil::IOFile file(capture->path, "w");
+    if (!file.IsOpen() || file.WriteBytes(json.data(), json.size()) != json.size()) {
+        LOG_ERROR(Common, "Failed to write the trace capture to %s", capture->path.c_str());
+        return;
+    }
+    LOG_INFO(Common, "Wrote a trace capture of %u frames to %s", (unsigned int)capture->frames.size(),
+             capture->path.c_str());
+}
+
 void ProfilingManager::BeginFrame() {
     this_frame_start = Clock::now();
+
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    if (trace_frames_left != 0 && !trace_capture_running) {
+        trace_start = this_frame_start;
+        trace_frames.clear();
+        ++trace_capture_id;
+        trace_capture_running = true;
+    }
 }
 
 void ProfilingManager::FinishFrame() {
@@ -82,6 +424,109 @@ void ProfilingManager::FinishFrame() {
         results.time_per_category[i] = timing_categories[i].category->GetAccumulatedTime();
     }
 
+    {
+        std::lock_guard<std::mutex> lock(event_categories_mutex);
+        results.stats_per_event.resize(event_categories.size());
+        for (size_t i = 0; i < event_categories.size(); ++i) {
+            EventCategory& category = *event_categories[i];
+            EventFrameResult& stats = results.stats_per_event[i];
+            stats.fire_count = category.GetAccumulatedFireCount();
+            stats.callback_time = category.GetAccumulatedTime();
+            stats.cycles_late = category.GetAccumulatedCyclesLate();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(call_categories_mutex);
+        results.stats_per_call.resize(call_categories.size());
+        for (size_t i = 0; i < call_categories.size(); ++i) {
+            CallCategory& category = *call_categories[i];
+            CallFrameResult& stats = results.stats_per_call[i];
+            stats.call_count = category.GetAccumulatedCallCount();
+            stats.call_time = category.GetAccumulatedTime();
+        }
+    }
+
+    last_counter_values.resize(counters.size(), 0);
+    results.count_per_counter.resize(counters.size());
+    for (size_t i = 0; i < counters.size(); ++i) {
+        u64 value = counters[i].counter->GetValue();
+        results.count_per_counter[i] = value - last_counter_values[i];
+        last_counter_values[i] = value;
+    }
+
+    results.scope_nodes.clear();
+    {
+        std::lock_guard<std::mutex> lock(thread_scope_states_mutex);
+        for (auto it = thread_scope_states.begin(); it != thread_scope_states.end();) {
+            ThreadScopeState& state = **it;
+
+            // Checked first, so that the thread can't have added nodes after they are reported
+            bool exited = state.exited;
+            {
+                std::lock_guard<std::mutex> nodes_lock(state.nodes_mutex);
+
+                unsigned int first_index = (unsigned int)results.scope_nodes.size();
+                for (ScopeNode& node : state.nodes) {
+                    ScopeFrameResult stats;
+                    stats.thread_index = state.thread_index;
+                    stats.category = node.category;
+                    stats.parent = (node.parent == NO_NODE) ? ScopeFrameResult::NO_PARENT : first_index + node.parent;
+                    stats.call_count = std::atomic_exchange_explicit(&node.call_count, 0u,
+                            std::memory_order_relaxed);
+                    stats.time = Duration(std::atomic_exchange_explicit(&node.accumulated_duration,
+                            (Duration::rep)0, std::memory_order_relaxed));
+                    results.scope_nodes.push_back(stats);
+                }
+            }
+
+            // The events of a trace capture which is still running are kept until it finishes
+            if (exited) {
+                std::lock_guard<std::mutex> events_lock(state.events_mutex);
+                if (state.events.empty() || !trace_capture_running) {
+                    it = thread_scope_states.erase(it);
+                    continue;
+                }
+            }
+            ++it;
+        }
+    }
+
+    // The capture is formatted and written on another thread, only its events are taken here
+    std::unique_ptr<TraceCapture> finished_capture;
+    {
+        std::lock_guard<std::mutex> lock(trace_mutex);
+        if (trace_capture_running) {
+            trace_frames.emplace_back(this_frame_start, now);
+            if (--trace_frames_left == 0) {
+                trace_capture_running = false;
+
+                finished_capture.reset(new TraceCapture);
+                finished_capture->path = std::move(trace_path);
+                finished_capture->start = trace_start;
+                finished_capture->frames = std::move(trace_frames);
+                trace_frames.clear();
+
+                std::lock_guard<std::mutex> states_lock(thread_scope_states_mutex);
+                for (const auto& state : thread_scope_states) {
+                    std::lock_guard<std::mutex> events_lock(state->events_mutex);
+                    if (state->capture_id == trace_capture_id && !state->events.empty()) {
+                        finished_capture->thread_events.emplace_back(state->thread_index,
+                                                                     std::move(state->events));
+                    }
+                    state->events = std::vector<TraceEvent>();
+                }
+            }
+        }
+    }
+
+    if (finished_capture != nullptr) {
+        // Captures take at least a frame, so the previous one has normally been written by now
+        if (trace_writer.joinable())
+            trace_writer.join();
+        trace_writer = std::thread(WriteTraceCapture, std::move(finished_capture));
+    }
+
     last_frame_end = now;
 }
 
@@ -107,14 +552,64 @@ void TimingResultsAggregator::SetNumberOfCategories(size_t n) {
     }
 }
 
+void TimingResultsAggregator::SetNumberOfEventCategories(size_t n) {
+    size_t old_size = stats_per_event.size();
+    if (n == old_size)
+        return;
+
+    stats_per_event.resize(n);
+
+    const EventFrameResult zero = { 0, Duration::zero(), 0 };
+    for (size_t i = old_size; i < n; ++i) {
+        stats_per_event[i].resize(max_window_size, zero);
+    }
+}
+
+void TimingResultsAggregator::SetNumberOfCallCategories(size_t n) {
+    size_t old_size = stats_per_call.size();
+    if (n == old_size)
+        return;
+
+    stats_per_call.resize(n);
+
+    const CallFrameResult zero = { 0, Duration::zero() };
+    for (size_t i = old_size; i < n; ++i) {
+        stats_per_call[i].resize(max_window_size, zero);
+    }
+}
+
+void TimingResultsAggregator::SetNumberOfCounters(size_t n) {
+    size_t old_size = counts_per_counter.size();
+    if (n == old_size)
+        return;
+
+    counts_per_counter.resize(n);
+
+    for (size_t i = old_size; i < n; ++i) {
+        counts_per_counter[i].resize(max_window_size, 0);
+    }
+}
+
 void TimingResultsAggregator::AddFrame(const ProfilingFrameResult& frame_result) {
     SetNumberOfCategories(frame_result.time_per_category.size());
+    SetNumberOfEventCategories(frame_result.stats_per_event.size());
+    SetNumberOfCallCategories(frame_result.stats_per_call.size());
+    SetNumberOfCounters(frame_result.count_per_counter.size());
 
     interframe_times[cursor] = frame_result.interframe_time;
     frame_times[cursor] = frame_result.frame_time;
     for (size_t i = 0; i < frame_result.time_per_category.size(); ++i) {
         times_per_category[i][cursor] = frame_result.time_per_category[i];
     }
+    for (size_t i = 0; i < frame_result.stats_per_event.size(); ++i) {
+        stats_per_event[i][cursor] = frame_result.stats_per_event[i];
+    }
+    for (size_t i = 0; i < frame_result.stats_per_call.size(); ++i) {
+        stats_per_call[i][cursor] = frame_result.stats_per_call[i];
+    }
+    for (size_t i = 0; i < frame_result.count_per_counter.size(); ++i) {
+        counts_per_counter[i][cursor] = frame_result.count_per_counter[i];
+    }
 
     ++cursor;
     if (cursor == max_window_size)
@@ -140,6 +635,71 @@ static AggregatedDuration AggregateField(const std::vector<Duration>& v, size_t
     return result;
 }
 
+static AggregatedEventResult AggregateEvent(const std::vector<EventFrameResult>& v, size_t len) {
+    AggregatedEventResult result;
+    result.callback_time.avg = Duration::zero();
+    result.callback_time.min = result.callback_time.max =
+            (len == 0 ? Duration::zero() : v[0].callback_time);
+
+    u64 total_fires = 0;
+    s64 total_cycles_late = 0;
+    for (size_t i = 0; i < len; ++i) {
+        const EventFrameResult& value = v[i];
+        total_fires += value.fire_count;
+        total_cycles_late += value.cycles_late;
+        result.callback_time.avg += value.callback_time;
+        result.callback_time.min = std::min(result.callback_time.min, value.callback_time);
+        result.callback_time.max = std::max(result.callback_time.max, value.callback_time);
+    }
+    if (len != 0) {
+        result.callback_time.avg /= len;
+        result.fires_per_frame = (float)total_fires / len;
+    } else {
+        result.fires_per_frame = 0.0f;
+    }
+    result.avg_cycles_late = (total_fires != 0) ? (float)total_cycles_late / total_fires : 0.0f;
+
+    return result;
+}
+
+static AggregatedCallResult AggregateCall(const std::vector<CallFrameResult>& v, size_t len) {
+    AggregatedCallResult result;
+    result.call_time.avg = Duration::zero();
+    result.call_time.min = result.call_time.max = (len == 0 ? Duration::zero() : v[0].call_time);
+
+    u64 total_calls = 0;
+    for (size_t i = 0; i < len; ++i) {
+        const CallFrameResult& value = v[i];
+        total_calls += value.call_count;
+        result.call_time.avg += value.call_time;
+        result.call_time.min = std::min(result.call_time.min, value.call_time);
+        result.call_time.max = std::max(result.call_time.max, value.call_time);
+    }
+    if (len != 0) {
+        result.call_time.avg /= len;
+        result.calls_per_frame = (float)total_calls / len;
+    } else {
+        result.calls_per_frame = 0.0f;
+    }
+
+    return result;
+}
+
+static AggregatedCounterResult AggregateCounter(const std::vector<u64>& v, size_t len,
+                                                Duration total_time) {
+    u64 total_count = 0;
+    for (size_t i = 0; i < len; ++i)
+        total_count += v[i];
+
+    using FloatSeconds = std::chrono::duration<float>;
+    float seconds = std::chrono::duration_cast<FloatSeconds>(total_time).count();
+
+    AggregatedCounterResult result;
+    result.per_frame = (len != 0) ? (float)total_count / len : 0.0f;
+    result.per_second = (seconds > 0.0f) ? total_count / seconds : 0.0f;
+    return result;
+}
+
 static float tof(Common::Profiling::Duration dur) {
     using FloatMs = std::chrono::duration<float, std::chrono::milliseconds::period>;
     return std::chrono::duration_cast<FloatMs>(dur).count();
@@ -162,6 +722,22 @@ AggregatedFrameResult TimingResultsAggregator::GetAggregatedResults() const {
         result.time_per_category[i] = AggregateField(times_per_category[i], window_size);
     }
 
+    result.stats_per_event.resize(stats_per_event.size());
+    for (size_t i = 0; i < stats_per_event.size(); ++i) {
+        result.stats_per_event[i] = AggregateEvent(stats_per_event[i], window_size);
+    }
+
+    result.stats_per_call.resize(stats_per_call.size());
+    for (size_t i = 0; i < stats_per_call.size(); ++i) {
+        result.stats_per_call[i] = AggregateCall(stats_per_call[i], window_size);
+    }
+
+    result.stats_per_counter.resize(counts_per_counter.size());
+    for (size_t i = 0; i < counts_per_counter.size(); ++i) {
+        result.stats_per_counter[i] = AggregateCounter(counts_per_counter[i], window_size,
+                                                       result.interframe_time.avg * window_size);
+    }
+
     return result;
 }
 
@@ -4,10 +4,12 @@
 
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <chrono>
 
 #include "common/assert.h"
+#include "common/common_types.h"
 #include "common/thread.h"
 
 namespace Common {
@@ -73,6 +75,184 @@ private:
     std::atomic<Duration::rep> accumulated_duration;
 };
 
+/**
+ * Accumulates statistics about a type of scheduled event: how many times it fired, how much host
+ * time was spent in its callback and how many emulated cycles late it ran in total. Unlike
+ * TimingCategory these are created at runtime, use ProfilingManager::RegisterEventCategory.
+ */
+class EventCategory final {
+public:
+    explicit EventCategory(unsigned int category_id) : category_id(category_id),
+            fire_count(0), accumulated_duration(0), accumulated_cycles_late(0) {
+    }
+
+    unsigned int GetCategoryId() const {
+        return category_id;
+    }
+
+    /// Records one firing of the event. Can safely be called from multiple threads at the same time.
+    void AddFire(Duration callback_time, s64 cycles_late) {
+        std::atomic_fetch_add_explicit(&fire_count, 1u, std::memory_order_relaxed);
+        std::atomic_fetch_add_explicit(&accumulated_duration, callback_time.count(),
+                std::memory_order_relaxed);
+        std::atomic_fetch_add_explicit(&accumulated_cycles_late, cycles_late,
+                std::memory_order_relaxed);
+    }
+
+    /// Atomically retrieves the number of times the event fired and resets the counter to zero.
+    unsigned int GetAccumulatedFireCount() {
+        return std::atomic_exchange_explicit(&fire_count, 0u, std::memory_order_relaxed);
+    }
+
+    /// Atomically retrieves the time spent in the event callback and resets the counter to zero.
+    Duration GetAccumulatedTime() {
+        return Duration(std::atomic_exchange_explicit(
+                &accumulated_duration, (Duration::rep)0,
+                std::memory_order_relaxed));
+    }
+
+    /// Atomically retrieves the summed lateness of all firings and resets the counter to zero.
+    s64 GetAccumulatedCyclesLate() {
+        return std::atomic_exchange_explicit(&accumulated_cycles_late, (s64)0,
+                std::memory_order_relaxed);
+    }
+
+private:
+    unsigned int category_id;
+    std::atomic<unsigned int> fire_count;
+    std::atomic<Duration::rep> accumulated_duration;
+    std::atomic<s64> accumulated_cycles_late;
+};
+
+/**
+ * Counts calls to a function that is invoked many times per frame (e.g. an SVC or a service
+ * command) and keeps a histogram of the host time taken by each call. Like EventCategory, these are
+ * created at runtime, use ProfilingManager::RegisterCallCategory.
+ */
+class CallCategory final {
+public:
+    /// Bucket i of the histogram counts calls that took [2^i, 2^(i+1)) ns, bucket 0 also counts 0 ns
+    static const unsigned int NUM_HISTOGRAM_BUCKETS = 32;
+
+    using Histogram = std::array<u64, NUM_HISTOGRAM_BUCKETS>;
+
+    explicit CallCategory(unsigned int category_id);
+
+    unsigned int GetCategoryId() const {
+        return category_id;
+    }
+
+    /// Records one call. Can safely be called from multiple threads at the same time.
+    void AddCall(Duration time) {
+        std::atomic_fetch_add_explicit(&call_count, 1u, std::memory_order_relaxed);
+        std::atomic_fetch_add_explicit(&accumulated_duration, time.count(),
+                std::memory_order_relaxed);
+        std::atomic_fetch_add_explicit(&histogram[GetHistogramBucket(time)], (u64)1,
+                std::memory_order_relaxed);
+    }
+
+    /// Atomically retrieves the number of calls and resets the counter to zero.
+    unsigned int GetAccumulatedCallCount() {
+        return std::atomic_exchange_explicit(&call_count, 0u, std::memory_order_relaxed);
+    }
+
+    /// Atomically retrieves the time spent in the calls and resets the counter to zero.
+    Duration GetAccumulatedTime() {
+        return Duration(std::atomic_exchange_explicit(
+                &accumulated_duration, (Duration::rep)0,
+                std::memory_order_relaxed));
+    }
+
+    /// Returns the histogram of call times. Unlike the other counters it is never reset.
+    Histogram GetHistogram() const;
+
+private:
+    static unsigned int GetHistogramBucket(Duration time);
+
+    unsigned int category_id;
+    std::atomic<unsigned int> call_count;
+    std::atomic<Duration::rep> accumulated_duration;
+    std::array<std::atomic<u64>, NUM_HISTOGRAM_BUCKETS> histogram;
+};
+
+/**
+ * Measures the time taken by a call and records it in the given CallCategory when it goes out of
+ * scope. Unlike Timer, it doesn't pause other timers, so it can be nested inside a ScopeTimer.
+ */
+class CallTimer {
+public:
+    CallTimer(CallCategory& category) : category(category) {
+#if ENABLE_PROFILING
+        start = Clock::now();
+#endif
+    }
+
+    ~CallTimer() {
+#if ENABLE_PROFILING
+        category.AddCall(std::chrono::duration_cast<Duration>(Clock::now() - start));
+#endif
+    }
+
+private:
+#if ENABLE_PROFILING
+    Clock::time_point start;
+#endif
+    CallCategory& category;
+};
+
+/**
+ * Counts occurrences of something, e.g. triangles drawn. Unlike the categories above, counters are
+ * never reset and are always on, even when profiling is disabled: the profiler reports how much they
+ * increased during each frame and the metrics exporter publishes their totals. Should be declared
+ * as a global variable.
+ */
+class Counter final {
+public:
+    explicit Counter(const char* name);
+
+    unsigned int GetCounterId() const {
+        return counter_id;
+    }
+
+    /**
+     * Increments the counter. Can safely be called from multiple threads at the same time, but it
+     * is cheaper to add up counts locally in hot loops and call this once.
+     */
+    void Add(u64 amount = 1) {
+        std::atomic_fetch_add_explicit(&value, amount, std::memory_order_relaxed);
+    }
+
+    /// Returns the total count since the counter was created.
+    u64 GetValue() const {
+        return value.load(std::memory_order_relaxed);
+    }
+
+private:
+    unsigned int counter_id;
+    std::atomic<u64> value;
+};
+
+/**
+ * A value that is sampled instead of accumulated, e.g. the emulation speed. Like Counters, gauges
+ * are always on. Should be declared as a global variable.
+ */
+class Gauge final {
+public:
+    explicit Gauge(const char* name);
+
+    /// Can safely be called from multiple threads at the same time.
+    void Set(double new_value) {
+        value.store(new_value, std::memory_order_relaxed);
+    }
+
+    double GetValue() const {
+        return value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<double> value;
+};
+
 /**
  * Measures time elapsed between a call to Start and a call to Stop and attributes it to the given
  * TimingCategory. Start/Stop can be called multiple times on the same timer, but each call must be
@@ -148,5 +328,52 @@ public:
     }
 };
 
+/**
+ * A kind of nested scope, usually a function. The scopes entered on each thread are tracked as a
+ * tree, in which a node accumulates the time spent in and the number of calls to a scope for a
+ * given chain of parent scopes. Scopes are also what trace captures record (see
+ * ProfilingManager::StartTraceCapture). Should be declared as a global variable and passed to
+ * ProfileScopes.
+ */
+class ScopeCategory final {
+public:
+    explicit ScopeCategory(const char* name) : name(name) {
+    }
+
+    const char* GetName() const {
+        return name;
+    }
+
+private:
+    const char* name;
+};
+
+/**
+ * Enters a scope on the current thread. Calls must be paired with LeaveScope, these can be used
+ * directly when a ProfileScope doesn't fit the structure of the code.
+ */
+void EnterScope(const ScopeCategory& category);
+/// Leaves the scope entered last on the current thread.
+void LeaveScope();
+
+/**
+ * Enters the given scope when created and leaves it at the end of the C++ scope. Unlike Timers,
+ * nested ProfileScopes don't pause their parents, the time of a scope includes its children.
+ */
+class ProfileScope {
+public:
+    ProfileScope(const ScopeCategory& category) {
+#if ENABLE_PROFILING
+        EnterScope(category);
+#endif
+    }
+
+    ~ProfileScope() {
+#if ENABLE_PROFILING
+        LeaveScope();
+#endif
+    }
+};
+
 } // namespace Profiling
 } // namespace Common
@@ -6,12 +6,16 @@
 
 #include <array>
 #include <chrono>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include "common/profiler.h"
 #include "common/synchronized_wrapper.h"
+#include "common/thread.h"
 
 namespace Common {
 namespace Profiling {
@@ -24,6 +28,65 @@ struct TimingCategoryInfo {
     unsigned int parent;
 };
 
+struct EventCategoryInfo {
+    EventCategory* category;
+    const char* name;
+};
+
+struct CallCategoryInfo {
+    CallCategory* category;
+    std::string name;
+};
+
+struct CounterInfo {
+    Counter* counter;
+    const char* name;
+};
+
+struct GaugeInfo {
+    Gauge* gauge;
+    const char* name;
+};
+
+/// Statistics collected for one event category during a frame.
+struct EventFrameResult {
+    /// Number of times the event fired
+    unsigned int fire_count;
+
+    /// Total host time spent inside the event callback
+    Duration callback_time;
+
+    /// Sum of the number of emulated cycles each firing was late by
+    s64 cycles_late;
+};
+
+/// Statistics collected for one call category during a frame.
+struct CallFrameResult {
+    /// Number of calls
+    unsigned int call_count;
+
+    /// Total host time spent inside the calls
+    Duration call_time;
+};
+
+/// Statistics collected for one node of the scope tree of a thread during a frame.
+struct ScopeFrameResult {
+    static const unsigned int NO_PARENT = -1;
+
+    /// Index of the thread, in the order in which threads first entered a scope
+    unsigned int thread_index;
+
+    const ScopeCategory* category;
+
+    /// Index of the parent node in ProfilingFrameResult::scope_nodes, parents come before children
+    unsigned int parent;
+
+    unsigned int call_count;
+
+    /// Total host time spent inside the scope, including its children
+    Duration time;
+};
+
 struct ProfilingFrameResult {
     /// Time since the last delivered frame
     Duration interframe_time;
@@ -33,11 +96,26 @@ struct ProfilingFrameResult {
 
     /// Total amount of time spent inside each category in this frame. Indexed by the category id
     std::vector<Duration> time_per_category;
+
+    /// Statistics of each event category in this frame. Indexed by the event category id
+    std::vector<EventFrameResult> stats_per_event;
+
+    /// Statistics of each call category in this frame. Indexed by the call category id
+    std::vector<CallFrameResult> stats_per_call;
+
+    /// Scope trees of all the threads, including the nodes which weren't entered in this frame
+    std::vector<ScopeFrameResult> scope_nodes;
+
+    /// Increase of each counter during this frame. Indexed by the counter id
+    std::vector<u64> count_per_counter;
 };
 
+struct ThreadScopeState;
+
 class ProfilingManager final {
 public:
     ProfilingManager();
+    ~ProfilingManager();
 
     unsigned int RegisterTimingCategory(TimingCategory* category, const char* name);
     void SetTimingCategoryParent(unsigned int category, unsigned int parent);
@@ -46,6 +124,52 @@ public:
         return timing_categories;
     }
 
+    /**
+     * Registers an event category with the given name, or returns the existing one if a category
+     * with the same name was registered before. Event categories are never freed, so this can be
+     * called again each time the emulated system is restarted.
+     */
+    EventCategory* RegisterEventCategory(const char* name);
+
+    /// Returns a copy of the event category list, since it can grow while emulation is running.
+    std::vector<EventCategoryInfo> GetEventCategoriesInfo() const;
+
+    /**
+     * Registers a call category with the given name, or returns the existing one if a category
+     * with the same name was registered before. Call categories are never freed.
+     */
+    CallCategory* RegisterCallCategory(std::string name);
+
+    /// Returns a copy of the call category list, since it can grow while emulation is running.
+    std::vector<CallCategoryInfo> GetCallCategoriesInfo() const;
+
+    /**
+     * Records all the scopes entered during the next `num_frames` frames, starting at the next call
+     * to BeginFrame, and then writes them to `path` in the Chrome trace event format, which can be
+     * opened with chrome://tracing. Does nothing if a capture is already running.
+     */
+    void StartTraceCapture(unsigned int num_frames, std::string path);
+
+    bool IsTraceCaptureRunning() const;
+
+    unsigned int RegisterCounter(Counter* counter, const char* name);
+
+    const std::vector<CounterInfo>& GetCountersInfo() const {
+        return counters;
+    }
+
+    void RegisterGauge(Gauge* gauge, const char* name);
+
+    const std::vector<GaugeInfo>& GetGaugesInfo() const {
+        return gauges;
+    }
+
+    /**
+     * Creates the scope state of the current thread. It is destroyed once the thread exited and
+     * its nodes were reported by FinishFrame.
+     */
+    ThreadScopeState& GetThreadScopeState();
+
     /// This should be called after swapping screen buffers.
     void BeginFrame();
     /// This should be called before swapping screen buffers.
@@ -58,6 +182,35 @@ public:
 
 private:
     std::vector<TimingCategoryInfo> timing_categories;
+    std::vector<std::unique_ptr<EventCategory>> event_categories;
+    std::vector<EventCategoryInfo> event_categories_info;
+    mutable std::mutex event_categories_mutex;
+    std::vector<std::unique_ptr<CallCategory>> call_categories;
+    std::vector<CallCategoryInfo> call_categories_info;
+    mutable std::mutex call_categories_mutex;
+    std::vector<CounterInfo> counters;
+    std::vector<GaugeInfo> gauges;
+
+    /// Value of each counter at the end of the previous frame
+    std::vector<u64> last_counter_values;
+
+    std::vector<std::unique_ptr<ThreadScopeState>> thread_scope_states;
+    unsigned int next_thread_index = 0;
+    mutable std::mutex thread_scope_states_mutex;
+
+    /// Key holding the scope state of each thread, to mark it as exited when the thread exits.
+    Common::ThreadExitKey thread_scope_state_key;
+
+    // Trace capture state, only changed from BeginFrame/FinishFrame
+    unsigned int trace_frames_left = 0;
+    std::string trace_path;
+    Clock::time_point trace_start;
+    std::vector<std::pair<Clock::time_point, Clock::time_point>> trace_frames;
+    mutable std::mutex trace_mutex;
+
+    /// Thread writing the last finished trace capture to its file, only used by FinishFrame
+    std::thread trace_writer;
+
     Clock::time_point last_frame_end;
     Clock::time_point this_frame_start;
 
@@ -68,6 +221,33 @@ struct AggregatedDuration {
     Duration avg, min, max;
 };
 
+struct AggregatedEventResult {
+    /// Average number of times the event fired per frame
+    float fires_per_frame;
+
+    /// Host time spent in the event callback per frame
+    AggregatedDuration callback_time;
+
+    /// Average number of emulated cycles each firing was late by
+    float avg_cycles_late;
+};
+
+struct AggregatedCallResult {
+    /// Average number of calls per frame
+    float calls_per_frame;
+
+    /// Host time spent in the calls per frame
+    AggregatedDuration call_time;
+};
+
+struct AggregatedCounterResult {
+    /// Average increase of the counter per frame
+    float per_frame;
+
+    /// Average increase of the counter per second of host time
+    float per_second;
+};
+
 struct AggregatedFrameResult {
     /// Time since the last delivered frame
     AggregatedDuration interframe_time;
@@ -79,6 +259,15 @@ struct AggregatedFrameResult {
 
     /// Total amount of time spent inside each category in this frame. Indexed by the category id
     std::vector<AggregatedDuration> time_per_category;
+
+    /// Statistics of each event category in this frame. Indexed by the event category id
+    std::vector<AggregatedEventResult> stats_per_event;
+
+    /// Statistics of each call category in this frame. Indexed by the call category id
+    std::vector<AggregatedCallResult> stats_per_call;
+
+    /// Rates of each counter. Indexed by the counter id
+    std::vector<AggregatedCounterResult> stats_per_counter;
 };
 
 class TimingResultsAggregator final {
@@ -87,6 +276,9 @@ public:
 
     void Clear();
     void SetNumberOfCategories(size_t n);
+    void SetNumberOfEventCategories(size_t n);
+    void SetNumberOfCallCategories(size_t n);
+    void SetNumberOfCounters(size_t n);
 
     void AddFrame(const ProfilingFrameResult& frame_result);
 
@@ -99,6 +291,9 @@ public:
     std::vector<Duration> interframe_times;
     std::vector<Duration> frame_times;
     std::vector<std::vector<Duration>> times_per_category;
+    std::vector<std::vector<EventFrameResult>> stats_per_event;
+    std::vector<std::vector<CallFrameResult>> stats_per_call;
+    std::vector<std::vector<u64>> counts_per_counter;
 };
 
 ProfilingManager& GetProfilingManager();
@@ -136,4 +136,64 @@ void SetCurrentThreadName(const char* szThreadName)
 
 #endif
 
+#ifdef _WIN32
+
+/// Value stored in the fiber local storage slot of a ThreadExitKey
+struct ThreadExitKeyValue {
+    void* value;
+    ThreadExitKey::Cleanup cleanup;
+    const std::atomic<bool>* key_destroying;
+};
+
+ThreadExitKey::ThreadExitKey(Cleanup cleanup) : destroying(false), cleanup(cleanup) {
+    index = FlsAlloc(OnFiberExit);
+}
+
+ThreadExitKey::~ThreadExitKey() {
+    // FlsFree calls OnFiberExit for the values of all threads
+    destroying = true;
+    FlsFree(index);
+}
+
+void __stdcall ThreadExitKey::OnFiberExit(void* data) {
+    ThreadExitKeyValue* key_value = static_cast<ThreadExitKeyValue*>(data);
+    if (!*key_value->key_destroying && key_value->value != nullptr)
+        key_value->cleanup(key_value->value);
+    delete key_value;
+}
+
+void* ThreadExitKey::Get() const {
+    ThreadExitKeyValue* key_value = static_cast<ThreadExitKeyValue*>(FlsGetValue(index));
+    return key_value != nullptr ? key_value->value : nullptr;
+}
+
+void ThreadExitKey::Set(void* value) {
+    ThreadExitKeyValue* key_value = static_cast<ThreadExitKeyValue*>(FlsGetValue(index));
+    if (key_value == nullptr) {
+        key_value = new ThreadExitKeyValue{ nullptr, cleanup, &destroying };
+        FlsSetValue(index, key_value);
+    }
+    key_value->value = value;
+}
+
+#else
+
+ThreadExitKey::ThreadExitKey(Cleanup cleanup) : cleanup(cleanup) {
+    pthread_key_create(&key, cleanup);
+}
+
+ThreadExitKey::~ThreadExitKey() {
+    pthread_key_delete(key);
+}
+
+void* ThreadExitKey::Get() const {
+    return pthread_getspecific(key);
+}
+
+void ThreadExitKey::Set(void* value) {
+    pthread_setspecific(key, value);
+}
+
+#endif
+
 } // namespace Common
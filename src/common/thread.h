@@ -5,6 +5,7 @@
 #pragma once
 
 #include "common/common_types.h"
+#include <atomic>
 #include <cstdio>
 #include <cstring>
 #include <thread>
@@ -21,6 +22,7 @@
 #include <time.h>
 #include <sys/time.h>
 #include <unistd.h>
+#include <pthread.h>
 #endif
 
 // Support for C++11's thread_local keyword was surprisingly spotty in compilers until very
@@ -119,4 +121,38 @@ inline void YieldCPU()
 
 void SetCurrentThreadName(const char *name);
 
+/**
+ * A pointer with a separate value for each thread, like a thread_local variable, except that the
+ * value set by a thread is passed to a cleanup function when the thread exits. This lets the owner
+ * of per-thread data know when a thread is gone, which thread_local can't do on all the compilers
+ * supported (see above).
+ */
+class ThreadExitKey : NonCopyable {
+public:
+    /// Function called on an exiting thread with the value it had set, if it isn't null
+    using Cleanup = void (*)(void* value);
+
+    explicit ThreadExitKey(Cleanup cleanup);
+
+    /// The cleanup function isn't called for the values still set when the key is destroyed
+    ~ThreadExitKey();
+
+    /// Returns the value set by the calling thread, or null if it didn't set any
+    void* Get() const;
+
+    /// Sets the value of the calling thread
+    void Set(void* value);
+
+private:
+#ifdef _WIN32
+    static void __stdcall OnFiberExit(void* data);
+
+    u32 index; ///< Fiber local storage index
+    std::atomic<bool> destroying;
+#else
+    pthread_key_t key;
+#endif
+    Cleanup cleanup;
+};
+
 } // namespace Common
@@ -0,0 +1,83 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include "common/thread.h"
+#include "common/thread_pool.h"
+
+namespace Common {
+
+ThreadPool::ThreadPool(unsigned num_threads) : next_task(0) {
+    for (unsigned i = 1; i < num_threads; ++i)
+        workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        exiting = true;
+    }
+    batch_started.notify_all();
+
+    for (auto& worker : workers)
+        worker.join();
+}
+
+void ThreadPool::ParallelFor(unsigned num_tasks, const std::function<void(unsigned)>& task) {
+    if (workers.empty() || num_tasks <= 1) {
+        for (unsigned i = 0; i < num_tasks; ++i)
+            task(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->task = &task;
+        this->num_tasks = num_tasks;
+        next_task = 0;
+        ++batch_id;
+    }
+    batch_started.notify_all();
+
+    RunTasks();
+
+    // All tasks have been started once RunTasks returns, wait for the workers still running one.
+    // Workers which didn't wake up in time never join the batch, since they check the task under
+    // the same lock before touching it.
+    std::unique_lock<std::mutex> lock(mutex);
+    batch_finished.wait(lock, [&] { return active_workers == 0; });
+    this->task = nullptr;
+}
+
+void ThreadPool::WorkerLoop() {
+    SetCurrentThreadName("ThreadPool");
+
+    u64 last_batch_id = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            batch_started.wait(lock, [&] { return exiting || (task != nullptr && batch_id != last_batch_id); });
+            if (exiting)
+                return;
+
+            last_batch_id = batch_id;
+            ++active_workers;
+        }
+
+        RunTasks();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --active_workers;
+        }
+        batch_finished.notify_one();
+    }
+}
+
+void ThreadPool::RunTasks() {
+    unsigned index;
+    while ((index = next_task++) < num_tasks)
+        (*task)(index);
+}
+
+} // namespace Common
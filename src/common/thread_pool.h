@@ -0,0 +1,70 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/common_types.h"
+
+namespace Common {
+
+/**
+ * A fixed set of worker threads which process batches of independent tasks. The thread submitting
+ * a batch takes part in processing it and blocks until all its tasks are done, so a batch can
+ * freely reference data on the stack of the submitting thread.
+ */
+class ThreadPool {
+public:
+    /// Creates a pool using num_threads threads in total, including the submitting thread
+    explicit ThreadPool(unsigned num_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /// Number of threads processing a batch, including the submitting thread
+    unsigned GetNumThreads() const {
+        return static_cast<unsigned>(workers.size()) + 1;
+    }
+
+    /**
+     * Runs task(0) to task(num_tasks - 1), in no particular order and spread across the threads of
+     * the pool, and returns once all of them finished. Must not be called by several threads at
+     * once, nor from inside a task.
+     */
+    void ParallelFor(unsigned num_tasks, const std::function<void(unsigned)>& task);
+
+private:
+    void WorkerLoop();
+
+    /// Runs tasks of the current batch until none are left
+    void RunTasks();
+
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    /// Signals the workers that a batch was submitted or that they should exit
+    std::condition_variable batch_started;
+    /// Signals the submitting thread that the workers are done with the batch
+    std::condition_variable batch_finished;
+
+    // Current batch, only modified while no worker is active
+    const std::function<void(unsigned)>* task = nullptr;
+    unsigned num_tasks = 0;
+    std::atomic<unsigned> next_task;
+
+    /// Incremented for each batch, used by the workers to detect new batches
+    u64 batch_id = 0;
+    /// Number of workers which joined the current batch and didn't leave it yet
+    unsigned active_workers = 0;
+    bool exiting = false;
+};
+
+} // namespace Common
@@ -5,157 +5,192 @@
 #pragma once
 
 #include <array>
-#include <deque>
 
-#include <boost/range/algorithm_ext/erase.hpp>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "common/assert.h"
+#include "common/common_types.h"
 
 namespace Common {
 
-template<class T, unsigned int N>
-struct ThreadQueueList {
-    // TODO(yuriks): If performance proves to be a problem, the std::deques can be replaced with
-    //               (dynamically resizable) circular buffers to remove their overhead when
-    //               inserting and popping.
+/**
+ * Links embedded into every object that can be stored in a ThreadQueueList. An object can only be
+ * in one list (and one priority level) at a time.
+ */
+template<class T>
+struct ThreadQueueListHook {
+    T* prev = nullptr;
+    T* next = nullptr;
+    bool linked = false;
+    /// Priority level of the list the object is in, only valid while linked
+    unsigned int priority = 0;
+};
 
+/**
+ * Priority queue of ready threads. Each priority level is an intrusive doubly-linked list threaded
+ * through the ThreadQueueListHook member `Hook` of T, and a bitmap of the non-empty levels is kept
+ * so that finding the highest priority ready thread is a single bit scan. All operations are O(1).
+ */
+template<class T, unsigned int N, ThreadQueueListHook<T> T::*Hook>
+struct ThreadQueueList {
     typedef unsigned int Priority;
 
     // Number of priority levels. (Valid levels are [0..NUM_QUEUES).)
     static const Priority NUM_QUEUES = N;
 
+    static_assert(N <= 64, "The priority bitmap only has room for 64 priority levels");
+
     ThreadQueueList() {
-        first = nullptr;
+        clear();
     }
 
     // Only for debugging, returns priority level.
-    Priority contains(const T& uid) {
+    Priority contains(const T* thread) const {
         for (Priority i = 0; i < NUM_QUEUES; ++i) {
-            Queue& cur = queues[i];
-            if (std::find(cur.data.cbegin(), cur.data.cend(), uid) != cur.data.cend()) {
-                return i;
+            for (const T* cur = queues[i].head; cur != nullptr; cur = (cur->*Hook).next) {
+                if (cur == thread)
+                    return i;
             }
         }
 
         return -1;
     }
 
-    T get_first() {
-        Queue *cur = first;
-        while (cur != nullptr) {
-            if (!cur->data.empty()) {
-                return cur->data.front();
-            }
-            cur = cur->next_nonempty;
-        }
+    T* get_first() const {
+        if (nonempty_mask == 0)
+            return nullptr;
 
-        return T();
+        return queues[LowestSetBit(nonempty_mask)].head;
     }
 
-    T pop_first() {
-        Queue *cur = first;
-        while (cur != nullptr) {
-            if (!cur->data.empty()) {
-                auto tmp = std::move(cur->data.front());
-                cur->data.pop_front();
-                return tmp;
-            }
-            cur = cur->next_nonempty;
-        }
+    T* pop_first() {
+        if (nonempty_mask == 0)
+            return nullptr;
 
-        return T();
+        return pop_front(LowestSetBit(nonempty_mask));
     }
 
-    T pop_first_better(Priority priority) {
-        Queue *cur = first;
-        Queue *stop = &queues[priority];
-        while (cur < stop) {
-            if (!cur->data.empty()) {
-                auto tmp = std::move(cur->data.front());
-                cur->data.pop_front();
-                return tmp;
-            }
-            cur = cur->next_nonempty;
-        }
+    T* pop_first_better(Priority priority) {
+        // Only consider the levels strictly above (numerically lower than) `priority`
+        u64 better_mask = nonempty_mask & ((1ULL << priority) - 1);
+        if (better_mask == 0)
+            return nullptr;
 
-        return T();
+        return pop_front(LowestSetBit(better_mask));
     }
 
-    void push_front(Priority priority, const T& thread_id) {
-        Queue *cur = &queues[priority];
-        cur->data.push_front(thread_id);
+    void push_front(Priority priority, T* thread) {
+        ThreadQueueListHook<T>& hook = thread->*Hook;
+        DEBUG_ASSERT(!hook.linked);
+        Queue& cur = queues[priority];
+
+        hook.prev = nullptr;
+        hook.next = cur.head;
+        hook.linked = true;
+        hook.priority = priority;
+        if (cur.head != nullptr)
+            (cur.head->*Hook).prev = thread;
+        else
+            cur.tail = thread;
+        cur.head = thread;
+
+        nonempty_mask |= 1ULL << priority;
     }
 
-    void push_back(Priority priority, const T& thread_id) {
-        Queue *cur = &queues[priority];
-        cur->data.push_back(thread_id);
+    void push_back(Priority priority, T* thread) {
+        ThreadQueueListHook<T>& hook = thread->*Hook;
+        DEBUG_ASSERT(!hook.linked);
+        Queue& cur = queues[priority];
+
+        hook.prev = cur.tail;
+        hook.next = nullptr;
+        hook.linked = true;
+        hook.priority = priority;
+        if (cur.tail != nullptr)
+            (cur.tail->*Hook).next = thread;
+        else
+            cur.head = thread;
+        cur.tail = thread;
+
+        nonempty_mask |= 1ULL << priority;
     }
 
-    void move(const T& thread_id, Priority old_priority, Priority new_priority) {
-        remove(old_priority, thread_id);
-        prepare(new_priority);
-        push_back(new_priority, thread_id);
+    void move(T* thread, Priority old_priority, Priority new_priority) {
+        remove(old_priority, thread);
+        push_back(new_priority, thread);
     }
 
-    void remove(Priority priority, const T& thread_id) {
-        Queue *cur = &queues[priority];
-        boost::remove_erase(cur->data, thread_id);
+    /// Removes the thread from the given priority level. Does nothing if it isn't in the list.
+    void remove(Priority priority, T* thread) {
+        ThreadQueueListHook<T>& hook = thread->*Hook;
+        if (!hook.linked)
+            return;
+
+        // Unlinking from another level's list would corrupt both lists
+        DEBUG_ASSERT(hook.priority == priority);
+
+        Queue& cur = queues[priority];
+        if (hook.prev != nullptr)
+            (hook.prev->*Hook).next = hook.next;
+        else
+            cur.head = hook.next;
+        if (hook.next != nullptr)
+            (hook.next->*Hook).prev = hook.prev;
+        else
+            cur.tail = hook.prev;
+
+        hook.prev = hook.next = nullptr;
+        hook.linked = false;
+
+        if (cur.head == nullptr)
+            nonempty_mask &= ~(1ULL << priority);
     }
 
     void rotate(Priority priority) {
-        Queue *cur = &queues[priority];
+        Queue& cur = queues[priority];
 
-        if (cur->data.size() > 1) {
-            cur->data.push_back(std::move(cur->data.front()));
-            cur->data.pop_front();
+        if (cur.head != cur.tail) {
+            T* front = pop_front(priority);
+            push_back(priority, front);
         }
     }
 
     void clear() {
         queues.fill(Queue());
-        first = nullptr;
+        nonempty_mask = 0;
     }
 
     bool empty(Priority priority) const {
-        const Queue *cur = &queues[priority];
-        return cur->data.empty();
-    }
-
-    void prepare(Priority priority) {
-        Queue* cur = &queues[priority];
-        if (cur->next_nonempty == UnlinkedTag())
-            link(priority);
+        return (nonempty_mask & (1ULL << priority)) == 0;
     }
 
 private:
     struct Queue {
-        // Points to the next active priority, skipping over ones that have never been used.
-        Queue* next_nonempty = UnlinkedTag();
-        // Double-ended queue of threads in this priority level
-        std::deque<T> data;
+        T* head = nullptr;
+        T* tail = nullptr;
     };
 
-    /// Special tag used to mark priority levels that have never been used.
-    static Queue* UnlinkedTag() {
-        return reinterpret_cast<Queue*>(1);
+    static Priority LowestSetBit(u64 mask) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, mask);
+        return index;
+#else
+        return __builtin_ctzll(mask);
+#endif
     }
 
-    void link(Priority priority) {
-        Queue *cur = &queues[priority];
-
-        for (int i = priority - 1; i >= 0; --i) {
-            if (queues[i].next_nonempty != UnlinkedTag()) {
-                cur->next_nonempty = queues[i].next_nonempty;
-                queues[i].next_nonempty = cur;
-                return;
-            }
-        }
-
-        cur->next_nonempty = first;
-        first = cur;
+    T* pop_front(Priority priority) {
+        T* thread = queues[priority].head;
+        remove(priority, thread);
+        return thread;
     }
 
-    // The first queue that's ever been used.
-    Queue* first;
-    // The priority level queues of thread ids.
+    // Bit i is set if priority level i has at least one thread in it.
+    u64 nonempty_mask;
+    // The priority level queues of threads.
     std::array<Queue, NUM_QUEUES> queues;
 };
 
@@ -61,6 +61,15 @@ public:
      */
     virtual void SetReg(int index, u32 value) = 0;
 
+    /**
+     * Gets the general purpose registers (r0-r15) as an array. Hot paths such as the SVC argument
+     * marshalling use this instead of the virtual GetReg/SetReg.
+     * @return Pointer to the 16 registers of the core
+     */
+    u32* GetRegisterFile() const {
+        return register_file;
+    }
+
     /**
      * Get the current CPSR register
      * @return Returns the value of the CPSR register
@@ -126,6 +135,9 @@ public:
 
 protected:
 
+    /// The general purpose registers of the core, must be set by the implementation
+    u32* register_file = nullptr;
+
     /**
      * Executes the given number of instructions
      * @param num_instructions Number of instructions to executes
@@ -5,6 +5,7 @@
 #include <cstring>
 
 #include "common/make_unique.h"
+#include "common/profiler.h"
 
 #include "core/arm/skyeye_common/armemu.h"
 #include "core/arm/skyeye_common/vfp/vfp.h"
@@ -37,6 +38,8 @@ ARM_DynCom::ARM_DynCom(PrivilegeMode initial_mode) {
 
     state->Reg[13] = 0x10000000; // Set stack pointer to the top of the stack
     state->Reg[15] = 0x00000000;
+
+    register_file = state->Reg;
 }
 
 ARM_DynCom::~ARM_DynCom() {
@@ -80,6 +83,9 @@ void ARM_DynCom::AddTicks(u64 ticks) {
         CoreTiming::Advance();
 }
 
+/// Dyncom accounts one tick per executed instruction, so this counts instructions
+static Common::Profiling::Counter counter_instructions("arm11_instructions");
+
 void ARM_DynCom::ExecuteInstructions(int num_instructions) {
     state->NumInstrsToExecute = num_instructions;
 
@@ -88,6 +94,7 @@ void ARM_DynCom::ExecuteInstructions(int num_instructions) {
     // instructions may actually be executed than specified.
     unsigned ticks_executed = InterpreterMainLoop(state.get());
     AddTicks(ticks_executed);
+    counter_instructions.Add(ticks_executed);
 }
 
 void ARM_DynCom::ResetContext(Core::ThreadContext& context, u32 stack_top, u32 entry_point, u32 arg) {
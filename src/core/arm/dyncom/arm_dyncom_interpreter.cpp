@@ -22,6 +22,7 @@
 
 Common::Profiling::TimingCategory profile_execute("DynCom::Execute");
 Common::Profiling::TimingCategory profile_decode("DynCom::Decode");
+static Common::Profiling::ScopeCategory profile_main_loop("InterpreterMainLoop");
 
 enum {
     COND            = (1 << 0),
@@ -3674,6 +3675,7 @@ static int clz(unsigned int x) {
 
 unsigned InterpreterMainLoop(ARMul_State* cpu) {
     Common::Profiling::ScopeTimer timer_execute(profile_execute);
+    Common::Profiling::ProfileScope scope(profile_main_loop);
 
     #undef RM
     #undef RS
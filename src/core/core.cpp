@@ -4,6 +4,7 @@
 
 #include "common/common_types.h"
 #include "common/logging/log.h"
+#include "common/profiler.h"
 
 #include "core/core.h"
 #include "core/core_timing.h"
@@ -23,7 +24,11 @@ ARM_Interface*     g_app_core = nullptr;  ///< ARM11 application core
 ARM_Interface*     g_sys_core = nullptr;  ///< ARM11 system (OS) core
 
 /// Run the core CPU loop
+static Common::Profiling::ScopeCategory profile_run_loop("Core::RunLoop");
+
 void RunLoop(int tight_loop) {
+    Common::Profiling::ProfileScope scope(profile_run_loop);
+
     // If the current thread is an idle thread, then don't execute instructions,
     // instead advance to the next event and try to yield to the next thread
     if (Kernel::GetCurrentThread()->IsIdle()) {
@@ -9,6 +9,7 @@
 
 #include "common/assert.h"
 #include "common/chunk_file.h"
+#include "common/profiler_reporting.h"
 
 #include "core/arm/arm_interface.h"
 #include "core/core.h"
@@ -24,13 +25,16 @@ namespace CoreTiming
 {
 struct EventType
 {
-    EventType() {}
+    EventType() : name(nullptr), profiling_category(nullptr) {}
 
     EventType(TimedCallback cb, const char* n)
-        : callback(cb), name(n) {}
+        : callback(cb), name(n),
+          profiling_category(Common::Profiling::GetProfilingManager().RegisterEventCategory(n)) {}
 
     TimedCallback callback;
     const char* name;
+    /// Collects fire counts, callback time and lateness of this event type for the profiler
+    Common::Profiling::EventCategory* profiling_category;
 };
 
 static std::vector<EventType> event_types;
@@ -117,6 +121,23 @@ static Event* GetNewTsEvent() {
     return event;
 }
 
+static Common::Profiling::Counter counter_events_fired("events_fired");
+
+/// Runs the callback of the given event type, accounting the time it took in the profiler
+static void FireEvent(int event_type, u64 userdata, int cycles_late) {
+    using Common::Profiling::Clock;
+
+    const EventType& type = event_types[event_type];
+    // Callbacks may register new event types, so don't keep a reference into event_types around
+    Common::Profiling::EventCategory* category = type.profiling_category;
+
+    Clock::time_point start = Clock::now();
+    type.callback(userdata, cycles_late);
+    category->AddFire(std::chrono::duration_cast<Common::Profiling::Duration>(Clock::now() - start),
+            cycles_late);
+    counter_events_fired.Add();
+}
+
 static void FreeEvent(Event* event) {
     event->next = event_pool;
     event_pool = event;
@@ -224,7 +245,7 @@ void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata) {
     if (false) //Core::IsCPUThread())
     {
         std::lock_guard<std::recursive_mutex> lock(external_event_section);
-        event_types[event_type].callback(userdata, 0);
+        FireEvent(event_type, userdata, 0);
     }
     else
         ScheduleEvent_Threadsafe(0, event_type, userdata);
@@ -438,7 +459,7 @@ void ProcessFifoWaitEvents() {
         if (first->time <= (s64)GetTicks()) {
             Event* evt = first;
             first = first->next;
-            event_types[evt->type].callback(evt->userdata, (int)(GetTicks() - evt->time));
+            FireEvent(evt->type, evt->userdata, (int)(GetTicks() - evt->time));
             FreeEvent(evt);
         } else {
             break;
@@ -12,14 +12,25 @@
 
 namespace HLE {
 
-#define PARAM(n)    Core::g_app_core->GetReg(n)
+// The wrappers access the register file directly rather than through the virtual GetReg/SetReg,
+// since they run on every SVC.
+#define PARAM(n)    Core::g_app_core->GetRegisterFile()[n]
+
+/**
+ * Sets an ARM register of the current ARM11 userland process, e.g. to return an output parameter
+ * @param index Register index (0-15)
+ * @param value Value to set register to
+ */
+static inline void SetParam(int index, u32 value) {
+    Core::g_app_core->GetRegisterFile()[index] = value;
+}
 
 /**
  * HLE a function return from the current ARM11 userland process
  * @param res Result to return
  */
 static inline void FuncReturn(u32 res) {
-    Core::g_app_core->SetReg(0, res);
+    SetParam(0, res);
 }
 
 /**
@@ -28,8 +39,8 @@ static inline void FuncReturn(u32 res) {
  * @todo Verify that this function is correct
  */
 static inline void FuncReturn64(u64 res) {
-    Core::g_app_core->SetReg(0, (u32)(res & 0xFFFFFFFF));
-    Core::g_app_core->SetReg(1, (u32)((res >> 32) & 0xFFFFFFFF));
+    SetParam(0, (u32)(res & 0xFFFFFFFF));
+    SetParam(1, (u32)((res >> 32) & 0xFFFFFFFF));
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -42,14 +53,14 @@ template<ResultCode func(u32, u32, u32, u32)> void Wrap() {
 template<ResultCode func(u32*, u32, u32, u32, u32, u32)> void Wrap(){
     u32 param_1 = 0;
     u32 retval = func(&param_1, PARAM(0), PARAM(1), PARAM(2), PARAM(3), PARAM(4)).raw;
-    Core::g_app_core->SetReg(1, param_1);
+    SetParam(1, param_1);
     FuncReturn(retval);
 }
 
 template<ResultCode func(u32*, s32, u32, u32, u32, s32)> void Wrap() {
     u32 param_1 = 0;
     u32 retval = func(&param_1, PARAM(0), PARAM(1), PARAM(2), PARAM(3), PARAM(4)).raw;
-    Core::g_app_core->SetReg(1, param_1);
+    SetParam(1, param_1);
     FuncReturn(retval);
 }
 
@@ -57,7 +68,7 @@ template<ResultCode func(s32*, u32*, s32, bool, s64)> void Wrap() {
     s32 param_1 = 0;
     s32 retval = func(&param_1, (Handle*)Memory::GetPointer(PARAM(1)), (s32)PARAM(2),
         (PARAM(3) != 0), (((s64)PARAM(4) << 32) | PARAM(0))).raw;
-    Core::g_app_core->SetReg(1, (u32)param_1);
+    SetParam(1, (u32)param_1);
     FuncReturn(retval);
 }
 
@@ -68,7 +79,7 @@ template<ResultCode func(u32, u32, u32, u32, s64)> void Wrap() {
 template<ResultCode func(u32*)> void Wrap(){
     u32 param_1 = 0;
     u32 retval = func(&param_1).raw;
-    Core::g_app_core->SetReg(1, param_1);
+    SetParam(1, param_1);
     FuncReturn(retval);
 }
 
@@ -83,7 +94,7 @@ template<ResultCode func(void*, void*, u32)> void Wrap(){
 template<ResultCode func(s32*, u32)> void Wrap(){
     s32 param_1 = 0;
     u32 retval = func(&param_1, PARAM(1)).raw;
-    Core::g_app_core->SetReg(1, param_1);
+    SetParam(1, param_1);
     FuncReturn(retval);
 }
 
@@ -94,7 +105,7 @@ template<ResultCode func(u32, s32)> void Wrap() {
 template<ResultCode func(u32*, u32)> void Wrap(){
     u32 param_1 = 0;
     u32 retval = func(&param_1, PARAM(1)).raw;
-    Core::g_app_core->SetReg(1, param_1);
+    SetParam(1, param_1);
     FuncReturn(retval);
 }
 
@@ -110,28 +121,28 @@ template<ResultCode func(s64*, u32, void*, s32)> void Wrap(){
 template<ResultCode func(u32*, const char*)> void Wrap() {
     u32 param_1 = 0;
     u32 retval = func(&param_1, Memory::GetCharPointer(PARAM(1))).raw;
-    Core::g_app_core->SetReg(1, param_1);
+    SetParam(1, param_1);
     FuncReturn(retval);
 }
 
 template<ResultCode func(u32*, s32, s32)> void Wrap() {
     u32 param_1 = 0;
     u32 retval = func(&param_1, PARAM(1), PARAM(2)).raw;
-    Core::g_app_core->SetReg(1, param_1);
+    SetParam(1, param_1);
     FuncReturn(retval);
 }
 
 template<ResultCode func(s32*, u32, s32)> void Wrap() {
     s32 param_1 = 0;
     u32 retval = func(&param_1, PARAM(1), PARAM(2)).raw;
-    Core::g_app_core->SetReg(1, param_1);
+    SetParam(1, param_1);
     FuncReturn(retval);
 }
 
 template<ResultCode func(u32*, u32, u32, u32, u32)> void Wrap() {
     u32 param_1 = 0;
     u32 retval = func(&param_1, PARAM(1), PARAM(2), PARAM(3), PARAM(4)).raw;
-    Core::g_app_core->SetReg(1, param_1);
+    SetParam(1, param_1);
     FuncReturn(retval);
 }
 
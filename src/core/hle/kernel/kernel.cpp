@@ -10,6 +10,7 @@
 #include "core/arm/arm_interface.h"
 #include "core/core.h"
 #include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/object_pool.h"
 #include "core/hle/kernel/process.h"
 #include "core/hle/kernel/thread.h"
 #include "core/hle/kernel/timer.h"
@@ -19,24 +20,58 @@ namespace Kernel {
 unsigned int Object::next_object_id;
 HandleTable g_handle_table;
 
-void WaitObject::AddWaitingThread(SharedPtr<Thread> thread) {
-    auto itr = std::find(waiting_threads.begin(), waiting_threads.end(), thread);
-    if (itr == waiting_threads.end())
-        waiting_threads.push_back(std::move(thread));
+void WaitObject::AddWaitingThread(WaitLink& link) {
+    if (link.linked)
+        return;
+
+    // A thread waiting on the same object through several handles only gets woken up once
+    for (WaitLink* waiter = first_waiter; waiter != nullptr; waiter = waiter->next) {
+        if (waiter->thread == link.thread)
+            return;
+    }
+
+    link.prev = last_waiter;
+    link.next = nullptr;
+    link.linked = true;
+    if (last_waiter != nullptr)
+        last_waiter->next = &link;
+    else
+        first_waiter = &link;
+    last_waiter = &link;
+}
+
+void WaitObject::RemoveWaitingThread(WaitLink& link) {
+    if (!link.linked)
+        return;
+
+    if (link.prev != nullptr)
+        link.prev->next = link.next;
+    else
+        first_waiter = link.next;
+    if (link.next != nullptr)
+        link.next->prev = link.prev;
+    else
+        last_waiter = link.prev;
+
+    link.prev = link.next = nullptr;
+    link.linked = false;
 }
 
 void WaitObject::RemoveWaitingThread(Thread* thread) {
-    auto itr = std::find(waiting_threads.begin(), waiting_threads.end(), thread);
-    if (itr != waiting_threads.end())
-        waiting_threads.erase(itr);
+    for (auto& entry : thread->wait_objects) {
+        if (entry.object == this && entry.link.linked) {
+            RemoveWaitingThread(entry.link);
+            return;
+        }
+    }
 }
 
 SharedPtr<Thread> WaitObject::WakeupNextThread() {
-    if (waiting_threads.empty())
+    if (first_waiter == nullptr)
         return nullptr;
 
-    auto next_thread = std::move(waiting_threads.front());
-    waiting_threads.erase(waiting_threads.begin());
+    SharedPtr<Thread> next_thread = first_waiter->thread;
+    RemoveWaitingThread(*first_waiter);
 
     next_thread->ReleaseWaitObject(this);
 
@@ -44,14 +79,13 @@ SharedPtr<Thread> WaitObject::WakeupNextThread() {
 }
 
 void WaitObject::WakeupAllWaitingThreads() {
-    auto waiting_threads_copy = waiting_threads;
+    // The thread is unlinked before ReleaseWaitObject is called so that this always terminates
+    while (first_waiter != nullptr) {
+        SharedPtr<Thread> thread = first_waiter->thread;
+        RemoveWaitingThread(*first_waiter);
 
-    // We use a copy because ReleaseWaitObject will remove the thread from this object's
-    // waiting_threads list
-    for (auto thread : waiting_threads_copy)
         thread->ReleaseWaitObject(this);
-
-    ASSERT_MSG(waiting_threads.empty(), "failed to awaken all waiting threads!");
+    }
 }
 
 HandleTable::HandleTable() {
@@ -147,6 +181,12 @@ void Shutdown() {
     Kernel::TimersShutdown();
     g_handle_table.Clear(); // Free all kernel objects
     g_current_process = nullptr;
+
+    for (const ObjectPoolStats& stats : GetObjectPoolStats()) {
+        LOG_DEBUG(Kernel, "%s pool: %u live, %u peak, %u reserved (%u bytes each)", stats.name,
+                (unsigned)stats.live, (unsigned)stats.peak, (unsigned)stats.capacity,
+                (unsigned)stats.object_size);
+    }
 }
 
 } // namespace
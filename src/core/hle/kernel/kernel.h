@@ -115,6 +115,18 @@ inline void intrusive_ptr_release(Object* object) {
 template <typename T>
 using SharedPtr = boost::intrusive_ptr<T>;
 
+/**
+ * Intrusive link of a thread in the list of threads waiting on a WaitObject. Links are stored in the
+ * waiting thread itself, one per object it waits on, so that adding and removing waiters never
+ * allocates and removal is O(1).
+ */
+struct WaitLink {
+    Thread* thread = nullptr;
+    WaitLink* prev = nullptr;
+    WaitLink* next = nullptr;
+    bool linked = false;
+};
+
 /// Class that represents a Kernel object that a thread can be waiting on
 class WaitObject : public Object {
 public:
@@ -129,10 +141,16 @@ public:
     virtual void Acquire() = 0;
 
     /**
-     * Add a thread to wait on this object
-     * @param thread Pointer to thread to add
+     * Add a thread to wait on this object. Does nothing if the thread is already waiting on it.
+     * @param link The link, owned by the waiting thread, to insert into the list of waiters
+     */
+    void AddWaitingThread(WaitLink& link);
+
+    /**
+     * Removes a thread from waiting on this object (e.g. if it was resumed already)
+     * @param link The link of the thread to remove. Does nothing if it isn't linked.
      */
-    void AddWaitingThread(SharedPtr<Thread> thread);
+    void RemoveWaitingThread(WaitLink& link);
 
     /**
      * Removes a thread from waiting on this object (e.g. if it was resumed already)
@@ -150,8 +168,9 @@ public:
     void WakeupAllWaitingThreads();
 
 private:
-    /// Threads waiting for this object to become available
-    std::vector<SharedPtr<Thread>> waiting_threads;
+    /// Threads waiting for this object to become available, in the order they started waiting
+    WaitLink* first_waiter = nullptr;
+    WaitLink* last_waiter = nullptr;
 };
 
 /**
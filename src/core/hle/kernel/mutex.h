@@ -9,12 +9,13 @@
 #include "common/common_types.h"
 
 #include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/object_pool.h"
 
 namespace Kernel {
 
 class Thread;
 
-class Mutex final : public WaitObject {
+class Mutex final : public WaitObject, public PooledObject<Mutex> {
 public:
     /**
      * Creates a mutex.
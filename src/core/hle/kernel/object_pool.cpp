@@ -0,0 +1,113 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __GNUC__
+#include <cxxabi.h>
+#endif
+
+#include "core/hle/kernel/object_pool.h"
+
+namespace Kernel {
+
+/// Amount of memory reserved at once by a pool. Pools of large objects still get one per slab.
+static const size_t SLAB_SIZE = 64 * 1024;
+
+/// Lists all the pools, in construction order. Never destroyed, like the pools themselves.
+static std::vector<ObjectPool*>& GetPoolList() {
+    static std::vector<ObjectPool*>* pools = new std::vector<ObjectPool*>;
+    return *pools;
+}
+
+/// Returns the readable name of a type, without the "class " prefix added by some compilers
+static std::string GetTypeName(const std::type_info& type) {
+    std::string name = type.name();
+
+#ifdef __GNUC__
+    int status;
+    char* demangled = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+    if (demangled != nullptr) {
+        name = demangled;
+        std::free(demangled);
+    }
+#endif
+
+    for (const char* prefix : { "class ", "struct " }) {
+        if (name.compare(0, std::strlen(prefix), prefix) == 0)
+            name.erase(0, std::strlen(prefix));
+    }
+    return name;
+}
+
+ObjectPool::ObjectPool(const std::type_info& type, size_t object_size)
+        : name(GetTypeName(type)), object_size(object_size) {
+    // Blocks must be able to hold a free list link and keep every object suitably aligned
+    const size_t alignment = alignof(std::max_align_t);
+    block_size = std::max(object_size, sizeof(FreeBlock));
+    block_size = (block_size + alignment - 1) / alignment * alignment;
+    blocks_per_slab = std::max<size_t>(SLAB_SIZE / block_size, 1);
+
+    GetPoolList().push_back(this);
+}
+
+void* ObjectPool::Allocate() {
+    if (free_list == nullptr)
+        Grow();
+
+    FreeBlock* block = free_list;
+    free_list = block->next;
+
+    ++live_count;
+    peak_count = std::max(peak_count, live_count);
+
+    return block;
+}
+
+void ObjectPool::Free(void* block) {
+    if (block == nullptr)
+        return;
+
+    DEBUG_ASSERT(live_count != 0);
+
+    FreeBlock* free_block = static_cast<FreeBlock*>(block);
+    free_block->next = free_list;
+    free_list = free_block;
+
+    --live_count;
+}
+
+void ObjectPool::Grow() {
+    // new[] of a char type returns memory aligned for any fundamental type
+    u8* slab = new u8[block_size * blocks_per_slab];
+    slabs.emplace_back(slab);
+
+    // Push the blocks in reverse so that they are handed out in address order
+    for (size_t i = blocks_per_slab; i-- > 0;) {
+        FreeBlock* block = reinterpret_cast<FreeBlock*>(slab + i * block_size);
+        block->next = free_list;
+        free_list = block;
+    }
+}
+
+ObjectPoolStats ObjectPool::GetStats() const {
+    ObjectPoolStats stats;
+    stats.name = name.c_str();
+    stats.object_size = object_size;
+    stats.live = live_count;
+    stats.peak = peak_count;
+    stats.capacity = slabs.size() * blocks_per_slab;
+    return stats;
+}
+
+std::vector<ObjectPoolStats> GetObjectPoolStats() {
+    std::vector<ObjectPoolStats> stats;
+    for (const ObjectPool* pool : GetPoolList())
+        stats.push_back(pool->GetStats());
+    return stats;
+}
+
+} // namespace
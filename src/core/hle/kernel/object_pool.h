@@ -0,0 +1,100 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#include "common/assert.h"
+#include "common/common_types.h"
+
+namespace Kernel {
+
+/// Allocation statistics of an ObjectPool, for diagnostics.
+struct ObjectPoolStats {
+    const char* name;   ///< Name of the object type stored in the pool
+    size_t object_size; ///< Size of a single object, in bytes
+    size_t live;        ///< Number of objects currently allocated
+    size_t peak;        ///< Maximum number of objects that were allocated at the same time
+    size_t capacity;    ///< Number of objects that fit in the memory reserved by the pool
+};
+
+/**
+ * Allocator for kernel objects of a single type. Memory is reserved in slabs of several objects and
+ * freed blocks are put on a free list to be reused by the next allocation, so that objects that are
+ * created and destroyed often (events, file sessions, ...) don't churn the general purpose heap.
+ * Memory is never given back, the pool only grows up to the peak number of live objects.
+ *
+ * Kernel objects are only created and destroyed on the emulation thread, so this isn't thread-safe.
+ */
+class ObjectPool final : NonCopyable {
+public:
+    /**
+     * @param type Type of the stored objects, its name is used in the statistics
+     * @param object_size Size of a single object, in bytes
+     */
+    ObjectPool(const std::type_info& type, size_t object_size);
+
+    /// Returns a block of memory large enough to hold one object.
+    void* Allocate();
+
+    /// Returns a block obtained from Allocate to the pool.
+    void Free(void* block);
+
+    ObjectPoolStats GetStats() const;
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    /// Reserves a new slab and puts all its blocks on the free list.
+    void Grow();
+
+    std::string name;
+    size_t object_size;
+    size_t block_size;
+    size_t blocks_per_slab;
+
+    FreeBlock* free_list = nullptr;
+    std::vector<std::unique_ptr<u8[]>> slabs;
+
+    size_t live_count = 0;
+    size_t peak_count = 0;
+};
+
+/// Returns the statistics of all the object pools, in the order they were first used.
+std::vector<ObjectPoolStats> GetObjectPoolStats();
+
+/**
+ * Base class that makes `new T` and `delete` allocate from a dedicated ObjectPool, created the first
+ * time an object of type T is allocated. The pool is intentionally never destroyed: objects held by
+ * static variables in other files may still be freed during static destruction, which happens in
+ * an unspecified order.
+ * T must be final, as the pool only holds objects of exactly sizeof(T) bytes.
+ */
+template <typename T>
+class PooledObject {
+public:
+    static void* operator new(size_t size) {
+        DEBUG_ASSERT(size == sizeof(T));
+        return GetPool().Allocate();
+    }
+
+    static void operator delete(void* block) {
+        GetPool().Free(block);
+    }
+
+private:
+    static ObjectPool& GetPool() {
+        static ObjectPool* pool = new ObjectPool(typeid(T), sizeof(T));
+        return *pool;
+    }
+};
+
+} // namespace
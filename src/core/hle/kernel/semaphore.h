@@ -10,10 +10,11 @@
 #include "common/common_types.h"
 
 #include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/object_pool.h"
 
 namespace Kernel {
 
-class Semaphore final : public WaitObject {
+class Semaphore final : public WaitObject, public PooledObject<Semaphore> {
 public:
     /**
      * Creates a semaphore.
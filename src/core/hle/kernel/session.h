@@ -62,6 +62,9 @@ public:
      */
     virtual ResultVal<bool> SyncRequest() = 0;
 
+    /// Whether this session is the port of an HLE service, i.e. a Service::Interface
+    virtual bool IsServicePort() const { return false; }
+
     // TODO(bunnei): These functions exist to satisfy a hardware test with a Session object
     // passed into WaitSynchronization. Figure out the meaning of them.
 
@@ -4,6 +4,7 @@
 
 #include <algorithm>
 #include <list>
+#include <unordered_map>
 #include <vector>
 
 #include "common/assert.h"
@@ -26,6 +27,14 @@ namespace Kernel {
 
 /// Event type for the thread wake up event
 static int ThreadWakeupEventType;
+/// Event type for the event that boosts the priority of starved ready threads
+static int ThreadStarvationEventType;
+
+// TODO(bunnei): Threads that have been waiting to be scheduled for `boost_ticks` (or longer) will
+// have their priority temporarily adjusted to 1 higher than the highest priority thread to prevent
+// thread starvation. This general behavior has been verified on hardware. However, this is almost
+// certainly not perfect, and the real CTR OS scheduler should probably be reversed to verify this.
+static const u64 boost_timeout = 2000000;  // Boost threads that have been ready for > this long
 
 bool Thread::ShouldWait() {
     return status != THREADSTATUS_DEAD;
@@ -39,7 +48,7 @@ void Thread::Acquire() {
 static std::vector<SharedPtr<Thread>> thread_list;
 
 // Lists only ready thread ids.
-static Common::ThreadQueueList<Thread*, THREADPRIO_LOWEST+1> ready_queue;
+static Common::ThreadQueueList<Thread, THREADPRIO_LOWEST+1, &Thread::ready_queue_hook> ready_queue;
 
 static Thread* current_thread;
 
@@ -57,6 +66,27 @@ inline static u32 const NewThreadId() {
 Thread::Thread() {}
 Thread::~Thread() {}
 
+void Thread::WaitEntryList::Reset(size_t new_capacity) {
+    for (WaitEntry& entry : *this) {
+        DEBUG_ASSERT(!entry.link.linked);
+        entry.object = nullptr;
+    }
+    count = 0;
+
+    if (new_capacity <= INLINE_CAPACITY) {
+        entries = inline_entries.data();
+        capacity = INLINE_CAPACITY;
+        return;
+    }
+
+    if (new_capacity > spilled_capacity) {
+        spilled_entries.reset(new WaitEntry[new_capacity]);
+        spilled_capacity = new_capacity;
+    }
+    entries = spilled_entries.get();
+    capacity = spilled_capacity;
+}
+
 Thread* GetCurrentThread() {
     return current_thread;
 }
@@ -71,18 +101,43 @@ static bool CheckWait_WaitObject(const Thread* thread, WaitObject* wait_object)
     if (thread->status != THREADSTATUS_WAIT_SYNCH)
         return false;
 
-    auto itr = std::find(thread->wait_objects.begin(), thread->wait_objects.end(), wait_object);
-    return itr != thread->wait_objects.end();
+    for (const auto& entry : thread->wait_objects) {
+        if (entry.object == wait_object)
+            return true;
+    }
+    return false;
 }
 
+// Threads waiting to be arbitrated, keyed by arbitration address. Each queue is sorted by priority,
+// threads of the same priority are kept in the order they started waiting.
+static std::unordered_map<VAddr, std::vector<Thread*>> arbiter_wait_queues;
+
 /**
- * Check if the specified thread is waiting on the specified address to be arbitrated
- * @param thread The thread to test
- * @param wait_address The address to test against
- * @return True if the thread is waiting, false otherwise
+ * Adds a thread to the wait queue of the address it is waiting to be arbitrated on
+ * @param thread The thread to add, its wait_address must already be set
+ */
+static void AddToArbiterWaitQueue(Thread* thread) {
+    std::vector<Thread*>& queue = arbiter_wait_queues[thread->wait_address];
+    auto itr = std::upper_bound(queue.begin(), queue.end(), thread->current_priority,
+            [](s32 priority, const Thread* other) { return priority < other->current_priority; });
+    queue.insert(itr, thread);
+}
+
+/**
+ * Removes a thread from the wait queue of the address it is waiting to be arbitrated on
+ * @param thread The thread to remove
  */
-static bool CheckWait_AddressArbiter(const Thread* thread, VAddr wait_address) {
-    return thread->status == THREADSTATUS_WAIT_ARB && wait_address == thread->wait_address;
+static void RemoveFromArbiterWaitQueue(Thread* thread) {
+    auto map_itr = arbiter_wait_queues.find(thread->wait_address);
+    if (map_itr == arbiter_wait_queues.end())
+        return;
+
+    std::vector<Thread*>& queue = map_itr->second;
+    queue.erase(std::remove(queue.begin(), queue.end(), thread), queue.end());
+
+    // Drop empty queues, so that the map doesn't grow with every address ever waited on
+    if (queue.empty())
+        arbiter_wait_queues.erase(map_itr);
 }
 
 void Thread::Stop() {
@@ -91,11 +146,15 @@ void Thread::Stop() {
 
     // Cancel any outstanding wakeup events for this thread
     CoreTiming::UnscheduleEvent(ThreadWakeupEventType, callback_handle);
+    CoreTiming::UnscheduleEvent(ThreadStarvationEventType, callback_handle);
+    starvation_check_pending = false;
 
     // Clean up thread from ready queue
     // This is only needed when the thread is termintated forcefully (SVC TerminateProcess)
     if (status == THREADSTATUS_READY){
         ready_queue.remove(current_priority, this);
+    } else if (status == THREADSTATUS_WAIT_ARB) {
+        RemoveFromArbiterWaitQueue(this);
     }
 
     status = THREADSTATUS_DEAD;
@@ -103,65 +162,82 @@ void Thread::Stop() {
     WakeupAllWaitingThreads();
 
     // Clean up any dangling references in objects that this thread was waiting for
-    for (auto& wait_object : wait_objects) {
-        wait_object->RemoveWaitingThread(this);
+    for (auto& entry : wait_objects) {
+        entry.object->RemoveWaitingThread(entry.link);
     }
 }
 
 Thread* ArbitrateHighestPriorityThread(u32 address) {
-    Thread* highest_priority_thread = nullptr;
-    s32 priority = THREADPRIO_LOWEST;
-
-    // Iterate through threads, find highest priority thread that is waiting to be arbitrated...
-    for (auto& thread : thread_list) {
-        if (!CheckWait_AddressArbiter(thread.get(), address))
-            continue;
-
-        if (thread == nullptr)
-            continue;
-
-        if(thread->current_priority <= priority) {
-            highest_priority_thread = thread.get();
-            priority = thread->current_priority;
-        }
-    }
+    auto map_itr = arbiter_wait_queues.find(address);
+    if (map_itr == arbiter_wait_queues.end() || map_itr->second.empty())
+        return nullptr;
 
-    // If a thread was arbitrated, resume it
-    if (nullptr != highest_priority_thread) {
-        highest_priority_thread->ResumeFromWait();
-    }
+    // The queue is sorted by priority, so the first thread is the one to resume. Resuming it also
+    // removes it from the queue.
+    Thread* highest_priority_thread = map_itr->second.front();
+    highest_priority_thread->ResumeFromWait();
 
     return highest_priority_thread;
 }
 
 void ArbitrateAllThreads(u32 address) {
-    // Resume all threads found to be waiting on the address
-    for (auto& thread : thread_list) {
-        if (CheckWait_AddressArbiter(thread.get(), address))
-            thread->ResumeFromWait();
-    }
+    auto map_itr = arbiter_wait_queues.find(address);
+    if (map_itr == arbiter_wait_queues.end())
+        return;
+
+    // Take the whole queue at once, so that resuming the threads doesn't have to search it
+    std::vector<Thread*> waiting_threads = std::move(map_itr->second);
+    arbiter_wait_queues.erase(map_itr);
+
+    for (Thread* thread : waiting_threads)
+        thread->ResumeFromWait();
 }
 
-/// Boost low priority threads (temporarily) that have been starved
-static void PriorityBoostStarvedThreads() {
-    u64 current_ticks = CoreTiming::GetTicks();
+// TODO(yuriks): This can be removed if Thread objects are explicitly pooled in the future, allowing
+//               us to simply use a pool index or similar.
+static Kernel::HandleTable wakeup_callback_handle_table;
+
+void Thread::ScheduleStarvationCheck() {
+    if (idle || starvation_check_pending)
+        return;
+
+    u64 delta = CoreTiming::GetTicks() - last_running_ticks;
+    s64 cycles_until_starved = (delta > boost_timeout) ? 0 : (s64)(boost_timeout - delta + 1);
 
-    for (auto& thread : thread_list) {
-        // TODO(bunnei): Threads that have been waiting to be scheduled for `boost_ticks` (or
-        // longer) will have their priority temporarily adjusted to 1 higher than the highest
-        // priority thread to prevent thread starvation. This general behavior has been verified
-        // on hardware. However, this is almost certainly not perfect, and the real CTR OS scheduler
-        // should probably be reversed to verify this.
+    starvation_check_pending = true;
+    CoreTiming::ScheduleEvent(cycles_until_starved, ThreadStarvationEventType, callback_handle);
+}
+
+/**
+ * Callback that boosts the priority of a thread (temporarily) if it has been starved
+ * @param thread_handle The handle of the thread to check
+ * @param cycles_late The number of CPU cycles that have passed since the desired check time
+ */
+static void ThreadStarvationCallback(u64 thread_handle, int cycles_late) {
+    SharedPtr<Thread> thread = wakeup_callback_handle_table.Get<Thread>((Handle)thread_handle);
+    if (thread == nullptr) {
+        LOG_CRITICAL(Kernel, "Callback fired for invalid thread %08X", (Handle)thread_handle);
+        return;
+    }
 
-        const u64 boost_timeout = 2000000;  // Boost threads that have been ready for > this long
+    thread->starvation_check_pending = false;
 
-        u64 delta = current_ticks - thread->last_running_ticks;
+    // The thread was scheduled in the meantime, the check is rearmed once it is ready again
+    if (thread->status != THREADSTATUS_READY || thread->idle)
+        return;
 
-        if (thread->status == THREADSTATUS_READY && delta > boost_timeout && !thread->idle) {
-            const s32 priority = std::max(ready_queue.get_first()->current_priority - 1, 0);
-            thread->BoostPriority(priority);
-        }
+    u64 delta = CoreTiming::GetTicks() - thread->last_running_ticks;
+    if (delta <= boost_timeout) {
+        thread->ScheduleStarvationCheck();
+        return;
     }
+
+    const s32 priority = std::max(ready_queue.get_first()->current_priority - 1, 0);
+    thread->BoostPriority(priority);
+
+    // Keep the thread boosted above the others for as long as it stays starved
+    thread->starvation_check_pending = true;
+    CoreTiming::ScheduleEvent(boost_timeout, ThreadStarvationEventType, thread_handle);
 }
 
 /** 
@@ -183,6 +259,7 @@ static void SwitchContext(Thread* new_thread) {
             // yielding execution (i.e. an event triggered, system core time-sliced, etc)
             ready_queue.push_front(previous_thread->current_priority, previous_thread);
             previous_thread->status = THREADSTATUS_READY;
+            previous_thread->ScheduleStarvationCheck();
         }
     }
 
@@ -227,11 +304,25 @@ void WaitCurrentThread_Sleep() {
     thread->status = THREADSTATUS_WAIT_SLEEP;
 }
 
-void WaitCurrentThread_WaitSynchronization(std::vector<SharedPtr<WaitObject>> wait_objects, bool wait_set_output, bool wait_all) {
+void WaitCurrentThread_ServiceRequest() {
+    Thread* thread = GetCurrentThread();
+    thread->status = THREADSTATUS_WAIT_IPC;
+}
+
+void WaitCurrentThread_WaitSynchronization(const WaitObjectList& wait_objects, bool wait_set_output, bool wait_all) {
     Thread* thread = GetCurrentThread();
     thread->wait_set_output = wait_set_output;
     thread->wait_all = wait_all;
-    thread->wait_objects = std::move(wait_objects);
+
+    // The links of the previous wait were all removed when the thread resumed from it
+    thread->wait_objects.Reset(wait_objects.size());
+    for (const auto& object : wait_objects) {
+        Thread::WaitEntry& entry = thread->wait_objects.Add();
+        entry.object = object;
+        entry.link.thread = thread;
+        object->AddWaitingThread(entry.link);
+    }
+
     thread->status = THREADSTATUS_WAIT_SYNCH;
 }
 
@@ -239,12 +330,9 @@ void WaitCurrentThread_ArbitrateAddress(VAddr wait_address) {
     Thread* thread = GetCurrentThread();
     thread->wait_address = wait_address;
     thread->status = THREADSTATUS_WAIT_ARB;
+    AddToArbiterWaitQueue(thread);
 }
 
-// TODO(yuriks): This can be removed if Thread objects are explicitly pooled in the future, allowing
-//               us to simply use a pool index or similar.
-static Kernel::HandleTable wakeup_callback_handle_table;
-
 /**
  * Callback that will wake up the thread it was scheduled for
  * @param thread_handle The handle of the thread that's been awoken
@@ -291,11 +379,11 @@ void Thread::ReleaseWaitObject(WaitObject* wait_object) {
 
     // Iterate through all waiting objects to check availability...
     for (auto itr = wait_objects.begin(); itr != wait_objects.end(); ++itr) {
-        if ((*itr)->ShouldWait())
+        if (itr->object->ShouldWait())
             wait_all_failed = true;
 
         // The output should be the last index of wait_object
-        if (*itr == wait_object)
+        if (itr->object == wait_object)
             index = itr - wait_objects.begin();
     }
 
@@ -326,11 +414,15 @@ void Thread::ResumeFromWait() {
     switch (status) {
         case THREADSTATUS_WAIT_SYNCH:
             // Remove this thread from all other WaitObjects
-            for (auto wait_object : wait_objects)
-                wait_object->RemoveWaitingThread(this);
+            for (auto& entry : wait_objects)
+                entry.object->RemoveWaitingThread(entry.link);
             break;
         case THREADSTATUS_WAIT_ARB:
+            // Also reached when an arbitration wait times out
+            RemoveFromArbiterWaitQueue(this);
+            break;
         case THREADSTATUS_WAIT_SLEEP:
+        case THREADSTATUS_WAIT_IPC:
             break;
         case THREADSTATUS_RUNNING:
         case THREADSTATUS_READY:
@@ -345,6 +437,7 @@ void Thread::ResumeFromWait() {
     
     ready_queue.push_back(current_priority, this);
     status = THREADSTATUS_READY;
+    ScheduleStarvationCheck();
 }
 
 /**
@@ -387,7 +480,6 @@ ResultVal<SharedPtr<Thread>> Thread::Create(std::string name, VAddr entry_point,
     SharedPtr<Thread> thread(new Thread);
 
     thread_list.push_back(thread);
-    ready_queue.prepare(priority);
 
     thread->thread_id = NewThreadId();
     thread->status = THREADSTATUS_DORMANT;
@@ -398,7 +490,6 @@ ResultVal<SharedPtr<Thread>> Thread::Create(std::string name, VAddr entry_point,
     thread->processor_id = processor_id;
     thread->wait_set_output = false;
     thread->wait_all = false;
-    thread->wait_objects.clear();
     thread->wait_address = 0;
     thread->name = std::move(name);
     thread->callback_handle = wakeup_callback_handle_table.Create(thread).MoveFrom();
@@ -415,6 +506,7 @@ ResultVal<SharedPtr<Thread>> Thread::Create(std::string name, VAddr entry_point,
 
     ready_queue.push_back(thread->current_priority, thread.get());
     thread->status = THREADSTATUS_READY;
+    thread->ScheduleStarvationCheck();
 
     return MakeResult<SharedPtr<Thread>>(std::move(thread));
 }
@@ -441,6 +533,12 @@ void Thread::SetPriority(s32 priority) {
         ready_queue.move(this, current_priority, priority);
 
     nominal_priority = current_priority = priority;
+
+    // Keep the arbiter wait queue sorted by priority
+    if (status == THREADSTATUS_WAIT_ARB) {
+        RemoveFromArbiterWaitQueue(this);
+        AddToArbiterWaitQueue(this);
+    }
 }
 
 void Thread::BoostPriority(s32 priority) {
@@ -476,8 +574,6 @@ SharedPtr<Thread> SetupMainThread(u32 entry_point, s32 priority) {
 void Reschedule() {
     Thread* prev = GetCurrentThread();
 
-    PriorityBoostStarvedThreads();
-
     Thread* next = PopNextReadyThread();
     HLE::g_reschedule = false;
 
@@ -510,12 +606,15 @@ VAddr Thread::GetTLSAddress() const {
 
 void ThreadingInit() {
     ThreadWakeupEventType = CoreTiming::RegisterEvent("ThreadWakeupCallback", ThreadWakeupCallback);
+    ThreadStarvationEventType = CoreTiming::RegisterEvent("ThreadStarvationCallback",
+            ThreadStarvationCallback);
 
     current_thread = nullptr;
     next_thread_id = 1;
 
     thread_list.clear();
     ready_queue.clear();
+    arbiter_wait_queues.clear();
 
     // Setup the idle thread
     SetupIdleThread();
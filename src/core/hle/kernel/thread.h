@@ -4,17 +4,23 @@
 
 #pragma once
 
+#include <array>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include <boost/container/flat_set.hpp>
+#include <boost/container/static_vector.hpp>
 
+#include "common/assert.h"
 #include "common/common_types.h"
+#include "common/thread_queue_list.h"
 
 #include "core/core.h"
 #include "core/mem_map.h"
 
 #include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/object_pool.h"
 #include "core/hle/result.h"
 
 enum ThreadPriority : s32{
@@ -38,6 +44,7 @@ enum ThreadStatus {
     THREADSTATUS_WAIT_ARB,      ///< Waiting on an address arbiter
     THREADSTATUS_WAIT_SLEEP,    ///< Waiting due to a SleepThread SVC
     THREADSTATUS_WAIT_SYNCH,    ///< Waiting due to a WaitSynchronization SVC
+    THREADSTATUS_WAIT_IPC,      ///< Waiting for a service request handled on a host thread
     THREADSTATUS_DORMANT,       ///< Created but not yet made ready
     THREADSTATUS_DEAD           ///< Run to completion, or forcefully terminated
 };
@@ -46,7 +53,13 @@ namespace Kernel {
 
 class Mutex;
 
-class Thread final : public WaitObject {
+/// Maximum number of objects a thread can wait on at once (the handle limit of WaitSynchronizationN)
+const size_t MAX_WAIT_OBJECTS = 256;
+
+/// List of objects passed to WaitCurrentThread_WaitSynchronization. Never allocates.
+using WaitObjectList = boost::container::static_vector<SharedPtr<WaitObject>, MAX_WAIT_OBJECTS>;
+
+class Thread final : public WaitObject, public PooledObject<Thread> {
 public:
     /**
      * Creates and returns a new thread. The new thread is immediately scheduled
@@ -118,6 +131,12 @@ public:
     */
     void WakeAfterDelay(s64 nanoseconds);
 
+    /**
+     * Schedules a check that temporarily boosts the thread's priority if it is still waiting to be
+     * scheduled a while after it last ran. Does nothing if a check is already pending.
+     */
+    void ScheduleStarvationCheck();
+
     /**
      * Sets the result after the thread awakens (from either WaitSynchronization SVC)
      * @param result Value to set to the returned result
@@ -154,6 +173,11 @@ public:
 
     u64 last_running_ticks; ///< CPU tick when thread was last running
 
+    /// Links of this thread in the scheduler's ready queue
+    Common::ThreadQueueListHook<Thread> ready_queue_hook;
+    /// True if a starvation check event is scheduled for this thread
+    bool starvation_check_pending = false;
+
     s32 processor_id;
 
     VAddr tls_address; ///< Address of the Thread Local Storage of the thread
@@ -161,7 +185,51 @@ public:
     /// Mutexes currently held by this thread, which will be released when it exits.
     boost::container::flat_set<SharedPtr<Mutex>> held_mutexes;
 
-    std::vector<SharedPtr<WaitObject>> wait_objects; ///< Objects that the thread is waiting on
+    /// An object the thread is waiting on, and the link of the thread in that object's waiter list
+    struct WaitEntry {
+        SharedPtr<WaitObject> object;
+        WaitLink link;
+    };
+
+    /**
+     * Objects that the thread is waiting on. Most waits are on a few objects, which are stored
+     * inline; larger waits spill into a heap buffer that is kept for the thread's later waits.
+     * Entries never move while the thread waits, as their links are in the objects' waiter lists.
+     */
+    class WaitEntryList : ::NonCopyable {
+    public:
+        /**
+         * Releases the objects of the previous wait and makes room for a new one
+         * @param capacity Number of objects of the new wait
+         */
+        void Reset(size_t capacity);
+
+        /// Appends an entry, there must be room left for it since the last Reset
+        WaitEntry& Add() {
+            DEBUG_ASSERT(count < capacity);
+            return entries[count++];
+        }
+
+        WaitEntry* begin() { return entries; }
+        WaitEntry* end() { return entries + count; }
+        const WaitEntry* begin() const { return entries; }
+        const WaitEntry* end() const { return entries + count; }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+
+    private:
+        static const size_t INLINE_CAPACITY = 4;
+
+        std::array<WaitEntry, INLINE_CAPACITY> inline_entries;
+        std::unique_ptr<WaitEntry[]> spilled_entries;
+        size_t spilled_capacity = 0;
+
+        WaitEntry* entries = inline_entries.data();
+        size_t capacity = INLINE_CAPACITY;
+        size_t count = 0;
+    };
+
+    WaitEntryList wait_objects;
     VAddr wait_address;     ///< If waiting on an AddressArbiter, this is the arbitration address
     bool wait_all;          ///< True if the thread is waiting on all objects before resuming
     bool wait_set_output;   ///< True if the output parameter should be set on thread wakeup
@@ -214,13 +282,18 @@ Thread* GetCurrentThread();
  */
 void WaitCurrentThread_Sleep();
 
+/**
+ * Waits the current thread until the service request it made is completed asynchronously
+ */
+void WaitCurrentThread_ServiceRequest();
+
 /**
  * Waits the current thread from a WaitSynchronization call
- * @param wait_objects Kernel objects that we are waiting on
+ * @param wait_objects Kernel objects that we are waiting on, the thread is added as a waiter to each
  * @param wait_set_output If true, set the output parameter on thread wakeup (for WaitSynchronizationN only)
  * @param wait_all If true, wait on all objects before resuming (for WaitSynchronizationN only)
  */
-void WaitCurrentThread_WaitSynchronization(std::vector<SharedPtr<WaitObject>> wait_objects, bool wait_set_output, bool wait_all);
+void WaitCurrentThread_WaitSynchronization(const WaitObjectList& wait_objects, bool wait_set_output, bool wait_all);
 
 /**
  * Waits the current thread from an ArbitrateAddress call
@@ -7,11 +7,12 @@
 #include "common/common_types.h"
 
 #include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/object_pool.h"
 #include "core/hle/svc.h"
 
 namespace Kernel {
 
-class Timer final : public WaitObject {
+class Timer final : public WaitObject, public PooledObject<Timer> {
 public:
     /**
      * Creates a timer
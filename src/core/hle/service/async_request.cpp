@@ -0,0 +1,224 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common/logging/log.h"
+#include "common/thread.h"
+
+#include "core/core_timing.h"
+#include "core/mem_map.h"
+#include "core/hle/hle.h"
+#include "core/hle/kernel/session.h"
+#include "core/hle/kernel/thread.h"
+#include "core/hle/service/async_request.h"
+#include "core/hle/service/ipc_trace.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace Service
+
+namespace Service {
+
+/// Maximum number of worker threads. New ones are only started when all the others are busy.
+static const size_t MAX_WORKER_THREADS = 16;
+
+struct AsyncRequest {
+    Kernel::SharedPtr<Kernel::Thread> thread; ///< Guest thread waiting for the request
+    Kernel::SharedPtr<Kernel::Object> owner;  ///< Object kept alive while the request is in flight
+    std::array<u32, ASYNC_COMMAND_BUFFER_WORDS> cmd_buff; ///< Copy of the command buffer
+    AsyncWork work;
+    AsyncCompletion completion;
+    bool ordered; ///< True if the work has to run after that of earlier ordered requests of owner
+};
+
+/// Event used to complete requests on the emulation thread once their work is done
+static int completion_event_type = -1;
+
+/// Requests that have been queued and haven't completed yet. Only used on the emulation thread.
+static std::unordered_map<u64, std::unique_ptr<AsyncRequest>> pending_requests;
+static u64 next_request_id;
+/// Number of ordered requests of each owner that haven't completed yet
+static std::unordered_map<const Kernel::Object*, unsigned int> pending_ordered_counts;
+
+// The state below is shared with the worker threads and guarded by queue_mutex.
+static std::mutex queue_mutex;
+static std::condition_variable queue_changed;
+/// Requests waiting for a worker. The AsyncRequests are owned by pending_requests.
+static std::deque<std::pair<u64, AsyncRequest*>> work_queue;
+/**
+ * Ordered requests waiting for the one of the same owner that is in the work queue or running. An
+ * owner is in the map for as long as one of its ordered requests is queued or running.
+ */
+static std::unordered_map<const Kernel::Object*, std::deque<std::pair<u64, AsyncRequest*>>> ordered_backlogs;
+static std::vector<std::thread> worker_threads;
+static size_t idle_workers;
+
+static std::atomic<bool> shutdown_pending(false);
+
+static void WorkerThread() {
+    Common::SetCurrentThreadName("AsyncRequestWorker");
+
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    while (true) {
+        ++idle_workers;
+        queue_changed.wait(lock, [] { return shutdown_pending || !work_queue.empty(); });
+        --idle_workers;
+
+        if (shutdown_pending)
+            return;
+
+        std::pair<u64, AsyncRequest*> item = work_queue.front();
+        work_queue.pop_front();
+
+        lock.unlock();
+        item.second->work(item.second->cmd_buff.data());
+        lock.lock();
+
+        // The request may be freed as soon as its completion is scheduled, so the next request of
+        // the same owner is started first
+        if (item.second->ordered) {
+            auto itr = ordered_backlogs.find(item.second->owner.get());
+            if (itr->second.empty()) {
+                ordered_backlogs.erase(itr);
+            } else {
+                work_queue.push_back(itr->second.front());
+                itr->second.pop_front();
+            }
+        }
+
+        CoreTiming::ScheduleEvent_Threadsafe(0, completion_event_type, item.first);
+    }
+}
+
+/**
+ * Callback that completes a request after its work has been done
+ * @param request_id Id of the request, as given to the worker thread
+ * @param cycles_late The number of CPU cycles that have passed since the work was done
+ */
+static void AsyncRequestCompletionCallback(u64 request_id, int cycles_late) {
+    auto itr = pending_requests.find(request_id);
+    if (itr == pending_requests.end()) {
+        LOG_ERROR(Service, "Completion fired for unknown request %llu",
+                  (unsigned long long)request_id);
+        return;
+    }
+
+    std::unique_ptr<AsyncRequest> request = std::move(itr->second);
+    pending_requests.erase(itr);
+
+    if (request->ordered) {
+        auto count_itr = pending_ordered_counts.find(request->owner.get());
+        if (--count_itr->second == 0)
+            pending_ordered_counts.erase(count_itr);
+    }
+
+    if (request->completion)
+        request->completion(request->cmd_buff.data());
+
+    // The thread might have been stopped while the work was in flight, in which case the reply is
+    // simply discarded
+    Kernel::Thread* thread = request->thread.get();
+    if (thread->status != THREADSTATUS_WAIT_IPC)
+        return;
+
+    u32* cmd_buff = (u32*)Memory::GetPointer(thread->GetTLSAddress() + Kernel::kCommandHeaderOffset);
+    std::memcpy(cmd_buff, request->cmd_buff.data(), sizeof(request->cmd_buff));
+    IPCTrace::OnReply(thread);
+    thread->ResumeFromWait();
+}
+
+/**
+ * Queues the work of a request for the worker threads
+ * @param ordered If true, the work waits for that of the owner's earlier ordered requests
+ */
+static void QueueRequest(Kernel::SharedPtr<Kernel::Object> owner, AsyncWork work,
+                         AsyncCompletion completion, bool ordered) {
+    std::unique_ptr<AsyncRequest> request(new AsyncRequest);
+    request->thread = Kernel::GetCurrentThread();
+    request->owner = std::move(owner);
+    std::memcpy(request->cmd_buff.data(), Kernel::GetCommandBuffer(), sizeof(request->cmd_buff));
+    request->work = std::move(work);
+    request->completion = std::move(completion);
+    request->ordered = ordered;
+
+    u64 request_id = next_request_id++;
+    AsyncRequest* request_ptr = request.get();
+    pending_requests.emplace(request_id, std::move(request));
+
+    Kernel::WaitCurrentThread_ServiceRequest();
+    HLE::Reschedule(__func__);
+
+    if (ordered)
+        ++pending_ordered_counts[request_ptr->owner.get()];
+
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    if (ordered) {
+        auto itr = ordered_backlogs.find(request_ptr->owner.get());
+        if (itr != ordered_backlogs.end()) {
+            itr->second.emplace_back(request_id, request_ptr);
+            return;
+        }
+        ordered_backlogs[request_ptr->owner.get()];
+    }
+
+    work_queue.emplace_back(request_id, request_ptr);
+    if (work_queue.size() > idle_workers && worker_threads.size() < MAX_WORKER_THREADS)
+        worker_threads.emplace_back(WorkerThread);
+    queue_changed.notify_one();
+}
+
+void QueueAsyncRequest(Kernel::SharedPtr<Kernel::Object> owner, AsyncWork work,
+                       AsyncCompletion completion) {
+    QueueRequest(std::move(owner), std::move(work), std::move(completion), false);
+}
+
+void QueueOrderedAsyncRequest(Kernel::SharedPtr<Kernel::Object> owner, AsyncWork work,
+                              AsyncCompletion completion) {
+    QueueRequest(std::move(owner), std::move(work), std::move(completion), true);
+}
+
+bool HasPendingOrderedAsyncRequests(const Kernel::Object* owner) {
+    return pending_ordered_counts.count(owner) != 0;
+}
+
+bool IsAsyncRequestShutdownPending() {
+    return shutdown_pending;
+}
+
+void AsyncRequestsInit() {
+    shutdown_pending = false;
+    next_request_id = 0;
+    completion_event_type = CoreTiming::RegisterEvent("AsyncRequestCompletion",
+                                                      AsyncRequestCompletionCallback);
+}
+
+void AsyncRequestsShutdown() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        shutdown_pending = true;
+        queue_changed.notify_all();
+    }
+
+    for (std::thread& worker : worker_threads)
+        worker.join();
+
+    worker_threads.clear();
+    work_queue.clear();
+    ordered_backlogs.clear();
+    idle_workers = 0;
+    pending_requests.clear();
+    pending_ordered_counts.clear();
+}
+
+} // namespace
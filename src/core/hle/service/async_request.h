@@ -0,0 +1,74 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <functional>
+
+#include "common/common_types.h"
+
+#include "core/hle/kernel/kernel.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace Service
+
+namespace Service {
+
+/// Number of words of the command buffer that are handed to asynchronous work and copied back
+const size_t ASYNC_COMMAND_BUFFER_WORDS = 0x40;
+
+/**
+ * Work done by an asynchronous request on a host worker thread. It gets a copy of the command buffer
+ * of the request, which is where the reply should be written to. It must not touch any emulator
+ * state (kernel objects, service state, the emulated CPU): everything it needs, including host
+ * pointers to guest memory, should be captured by value when the request is queued.
+ */
+using AsyncWork = std::function<void(u32* cmd_buff)>;
+
+/**
+ * Called on the emulation thread once the work of a request is done, before the reply is copied to
+ * the command buffer of the guest thread. Can be used to update service state with the results.
+ */
+using AsyncCompletion = std::function<void(u32* cmd_buff)>;
+
+/**
+ * Completes the service request currently being handled asynchronously: the requesting guest
+ * thread is put to sleep, `work` is run on a host worker thread and once it's done the reply is
+ * copied to the thread's command buffer and the thread is resumed. Must be called from a service
+ * request handler, which shouldn't touch the command buffer afterwards.
+ * @param owner Object kept alive until the request completes, usually the session handling it
+ * @param work Work to be done on the worker thread
+ * @param completion Optional callback run on the emulation thread when the work is done
+ */
+void QueueAsyncRequest(Kernel::SharedPtr<Kernel::Object> owner, AsyncWork work,
+                       AsyncCompletion completion = nullptr);
+
+/**
+ * Like QueueAsyncRequest, but the work of the requests queued this way with the same owner is run
+ * one at a time, in the order the requests were made.
+ */
+void QueueOrderedAsyncRequest(Kernel::SharedPtr<Kernel::Object> owner, AsyncWork work,
+                              AsyncCompletion completion = nullptr);
+
+/**
+ * Checks if requests queued with QueueOrderedAsyncRequest for an owner haven't completed yet. Other
+ * requests on the owner should then be queued behind them to keep their order.
+ * @param owner Owner of the requests
+ * @return True if any of the owner's ordered requests is still in flight
+ */
+bool HasPendingOrderedAsyncRequests(const Kernel::Object* owner);
+
+/**
+ * Returns true once the emulator has started shutting down. Work that might block for a long time
+ * (e.g. waiting for data on a socket) should poll this and give up when it's set.
+ */
+bool IsAsyncRequestShutdownPending();
+
+/// Initializes the worker threads used for asynchronous requests
+void AsyncRequestsInit();
+
+/// Waits for the worker threads to finish and discards all the requests that are still pending
+void AsyncRequestsShutdown();
+
+} // namespace
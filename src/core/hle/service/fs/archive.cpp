@@ -21,6 +21,7 @@
 #include "core/file_sys/archive_sdmc.h"
 #include "core/file_sys/archive_systemsavedata.h"
 #include "core/file_sys/directory_backend.h"
+#include "core/hle/service/async_request.h"
 #include "core/hle/service/service.h"
 #include "core/hle/service/fs/archive.h"
 #include "core/hle/service/fs/fs_user.h"
@@ -53,6 +54,12 @@ namespace FS {
 const ResultCode ERR_INVALID_HANDLE(ErrorDescription::InvalidHandle, ErrorModule::FS,
         ErrorSummary::InvalidArgument, ErrorLevel::Permanent);
 
+/**
+ * File reads and writes of at least this many bytes are done on a worker thread, so the emulated CPU
+ * keeps running while the host does the I/O. Smaller ones aren't worth the extra latency.
+ */
+static const u32 ASYNC_TRANSFER_THRESHOLD = 0x10000;
+
 // Command to access archive file
 enum class FileCommand : u32 {
     Dummy1          = 0x000100C6,
@@ -84,6 +91,24 @@ File::File(std::unique_ptr<FileSys::FileBackend>&& backend, const FileSys::Path
 
 File::~File() {}
 
+/**
+ * Runs a file command that accesses the backend. The command is handled on a worker thread if it's
+ * a large transfer, or if earlier requests on the file are still in flight there: the requests of
+ * a file are handled in the order they were made, one at a time.
+ * @param file File the command is for
+ * @param large_transfer Whether the command transfers enough data to be worth doing asynchronously
+ * @param work Handles the command, writing the reply to the command buffer it is passed
+ */
+template <typename Work>
+static void RunBackendCommand(File* file, bool large_transfer, Work work) {
+    if (large_transfer || HasPendingOrderedAsyncRequests(file)) {
+        QueueOrderedAsyncRequest(file, work);
+        return;
+    }
+
+    work(Kernel::GetCommandBuffer());
+}
+
 ResultVal<bool> File::SyncRequest() {
     u32* cmd_buff = Kernel::GetCommandBuffer();
     FileCommand cmd = static_cast<FileCommand>(cmd_buff[0]);
@@ -97,8 +122,14 @@ ResultVal<bool> File::SyncRequest() {
             u32 address = cmd_buff[5];
             LOG_TRACE(Service_FS, "Read %s %s: offset=0x%llx length=%d address=0x%x",
                       GetTypeName().c_str(), GetName().c_str(), offset, length, address);
-            cmd_buff[2] = static_cast<u32>(backend->Read(offset, length, Memory::GetPointer(address)));
-            break;
+            u8* buffer = Memory::GetPointer(address);
+
+            RunBackendCommand(this, length >= ASYNC_TRANSFER_THRESHOLD,
+                    [this, offset, length, buffer](u32* reply) {
+                reply[2] = static_cast<u32>(backend->Read(offset, length, buffer));
+                reply[1] = RESULT_SUCCESS.raw;
+            });
+            return MakeResult<bool>(false);
         }
 
         // Write to file...
@@ -110,17 +141,26 @@ ResultVal<bool> File::SyncRequest() {
             u32 address = cmd_buff[6];
             LOG_TRACE(Service_FS, "Write %s %s: offset=0x%llx length=%d address=0x%x, flush=0x%x",
                       GetTypeName().c_str(), GetName().c_str(), offset, length, address, flush);
-            cmd_buff[2] = static_cast<u32>(backend->Write(offset, length, flush, Memory::GetPointer(address)));
-            break;
+            const u8* buffer = Memory::GetPointer(address);
+
+            RunBackendCommand(this, length >= ASYNC_TRANSFER_THRESHOLD,
+                    [this, offset, length, flush, buffer](u32* reply) {
+                reply[2] = static_cast<u32>(backend->Write(offset, length, flush, buffer));
+                reply[1] = RESULT_SUCCESS.raw;
+            });
+            return MakeResult<bool>(false);
         }
 
         case FileCommand::GetSize:
         {
             LOG_TRACE(Service_FS, "GetSize %s %s", GetTypeName().c_str(), GetName().c_str());
-            u64 size = backend->GetSize();
-            cmd_buff[2] = (u32)size;
-            cmd_buff[3] = size >> 32;
-            break;
+            RunBackendCommand(this, false, [this](u32* reply) {
+                u64 size = backend->GetSize();
+                reply[2] = (u32)size;
+                reply[3] = size >> 32;
+                reply[1] = RESULT_SUCCESS.raw;
+            });
+            return MakeResult<bool>(false);
         }
 
         case FileCommand::SetSize:
@@ -128,27 +168,38 @@ ResultVal<bool> File::SyncRequest() {
             u64 size = cmd_buff[1] | ((u64)cmd_buff[2] << 32);
             LOG_TRACE(Service_FS, "SetSize %s %s size=%llu",
                 GetTypeName().c_str(), GetName().c_str(), size);
-            backend->SetSize(size);
-            break;
+            RunBackendCommand(this, false, [this, size](u32* reply) {
+                backend->SetSize(size);
+                reply[1] = RESULT_SUCCESS.raw;
+            });
+            return MakeResult<bool>(false);
         }
 
         case FileCommand::Close:
         {
             LOG_TRACE(Service_FS, "Close %s %s", GetTypeName().c_str(), GetName().c_str());
-            backend->Close();
-            break;
+            RunBackendCommand(this, false, [this](u32* reply) {
+                backend->Close();
+                reply[1] = RESULT_SUCCESS.raw;
+            });
+            return MakeResult<bool>(false);
         }
 
         case FileCommand::Flush:
         {
             LOG_TRACE(Service_FS, "Flush");
-            backend->Flush();
-            break;
+            RunBackendCommand(this, false, [this](u32* reply) {
+                backend->Flush();
+                reply[1] = RESULT_SUCCESS.raw;
+            });
+            return MakeResult<bool>(false);
         }
 
         case FileCommand::OpenLinkFile:
         {
             LOG_WARNING(Service_FS, "(STUBBED) File command OpenLinkFile %s", GetName().c_str());
+            cmd_buff[0] = 0x080C0042; // Reply header: 1 normal and 2 translate parameters
+            cmd_buff[2] = 0x10;       // Moves 1 handle
             cmd_buff[3] = Kernel::g_handle_table.Create(this).ValueOr(INVALID_HANDLE);
             break;
         }
@@ -8,6 +8,7 @@
 
 #include "core/file_sys/archive_backend.h"
 #include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/object_pool.h"
 #include "core/hle/kernel/session.h"
 #include "core/hle/result.h"
 
@@ -43,7 +44,7 @@ enum class MediaType : u32 {
 
 typedef u64 ArchiveHandle;
 
-class File : public Kernel::Session {
+class File final : public Kernel::Session, public Kernel::PooledObject<File> {
 public:
     File(std::unique_ptr<FileSys::FileBackend>&& backend, const FileSys::Path& path);
     ~File();
@@ -53,10 +54,14 @@ public:
 
     FileSys::Path path; ///< Path of the file
     u32 priority; ///< Priority of the file. TODO(Subv): Find out what this means
-    std::unique_ptr<FileSys::FileBackend> backend; ///< File backend interface
+    /**
+     * File backend interface. Commands accessing it may run on worker threads, but they run one at
+     * a time, see RunBackendCommand.
+     */
+    std::unique_ptr<FileSys::FileBackend> backend;
 };
 
-class Directory : public Kernel::Session {
+class Directory final : public Kernel::Session, public Kernel::PooledObject<Directory> {
 public:
     Directory(std::unique_ptr<FileSys::DirectoryBackend>&& backend, const FileSys::Path& path);
     ~Directory();
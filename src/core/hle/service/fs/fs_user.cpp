@@ -67,7 +67,9 @@ static void OpenFile(Service::Interface* self) {
     LOG_DEBUG(Service_FS, "path=%s, mode=%d attrs=%u", file_path.DebugStr().c_str(), mode.hex, attributes);
 
     ResultVal<SharedPtr<File>> file_res = OpenFileFromArchive(archive_handle, file_path, mode);
+    cmd_buff[0] = 0x08020042; // Reply header: 1 normal and 2 translate parameters
     cmd_buff[1] = file_res.Code().raw;
+    cmd_buff[2] = 0x10;       // Moves 1 handle
     if (file_res.Succeeded()) {
         cmd_buff[3] = Kernel::g_handle_table.Create(*file_res).MoveFrom();
     } else {
@@ -123,7 +125,9 @@ static void OpenFileDirectly(Service::Interface* self) {
     SCOPE_EXIT({ CloseArchive(*archive_handle); });
 
     ResultVal<SharedPtr<File>> file_res = OpenFileFromArchive(*archive_handle, file_path, mode);
+    cmd_buff[0] = 0x08030042; // Reply header: 1 normal and 2 translate parameters
     cmd_buff[1] = file_res.Code().raw;
+    cmd_buff[2] = 0x10;       // Moves 1 handle
     if (file_res.Succeeded()) {
         cmd_buff[3] = Kernel::g_handle_table.Create(*file_res).MoveFrom();
     } else {
@@ -343,10 +347,13 @@ static void OpenDirectory(Service::Interface* self) {
     LOG_DEBUG(Service_FS, "type=%d size=%d data=%s", dirname_type, dirname_size, dir_path.DebugStr().c_str());
 
     ResultVal<SharedPtr<Directory>> dir_res = OpenDirectoryFromArchive(archive_handle, dir_path);
+    cmd_buff[0] = 0x080B0042; // Reply header: 1 normal and 2 translate parameters
     cmd_buff[1] = dir_res.Code().raw;
+    cmd_buff[2] = 0x10;       // Moves 1 handle
     if (dir_res.Succeeded()) {
         cmd_buff[3] = Kernel::g_handle_table.Create(*dir_res).MoveFrom();
     } else {
+        cmd_buff[3] = 0;
         LOG_ERROR(Service_FS, "failed to get a handle for directory");
     }
 }
@@ -0,0 +1,306 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <unordered_map>
+
+#include "common/logging/log.h"
+
+#include "core/mem_map.h"
+#include "core/hle/kernel/process.h"
+#include "core/hle/kernel/session.h"
+#include "core/hle/kernel/thread.h"
+#include "core/hle/service/ipc_trace.h"
+#include "core/hle/service/service.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace Service
+
+namespace Service {
+namespace IPCTrace {
+
+/// A request that has been recorded but hasn't been replied to yet
+struct PendingRecord {
+    Record record;
+    /// Whole command buffer at the time of the request, to find which words the reply changed
+    std::array<u32, COMMAND_BUFFER_WORDS> request;
+    std::chrono::steady_clock::time_point start;
+};
+
+static bool tracing = false;
+static bool header_written;
+static FileUtil::IOFile trace_file;
+/// Requests waiting for their reply, indexed by the id of the thread that made them
+static std::unordered_map<u32, PendingRecord> pending_records;
+
+static const u32* GetThreadCommandBuffer(Kernel::Thread* thread) {
+    return (const u32*)Memory::GetPointer(thread->GetTLSAddress() + Kernel::kCommandHeaderOffset);
+}
+
+/**
+ * Reads the contents of a guest buffer, truncated to MAX_BUFFER_DATA_SIZE. The buffer is read page
+ * by page, so that a buffer reaching beyond its memory region is cut off at the region's end
+ * instead of being read past the memory backing it.
+ */
+static std::vector<u8> ReadGuestBuffer(const Buffer& buffer) {
+    std::vector<u8> data;
+    VAddr address = buffer.address;
+    u32 remaining = std::min(buffer.size, MAX_BUFFER_DATA_SIZE);
+
+    while (remaining != 0) {
+        const u8* page = Memory::GetPointer(address);
+        if (page == nullptr)
+            break;
+
+        u32 chunk_size = std::min(remaining, Memory::PAGE_SIZE - (address & (Memory::PAGE_SIZE - 1)));
+        data.insert(data.end(), page, page + chunk_size);
+        address += chunk_size;
+        remaining -= chunk_size;
+    }
+
+    return data;
+}
+
+std::vector<Buffer> GetRequestBuffers(const u32* cmd_buff) {
+    std::vector<Buffer> buffers;
+
+    size_t index = 1 + ((cmd_buff[0] >> 6) & 0x3F);
+    size_t end = std::min(index + (cmd_buff[0] & 0x3F), COMMAND_BUFFER_WORDS);
+    while (index < end) {
+        u32 descriptor = cmd_buff[index++];
+
+        Buffer buffer = {};
+        if ((descriptor & 0xF) == 0x0) {
+            // Handles (or the calling process id), followed by one word per handle
+            index += (descriptor >> 26) + 1;
+            continue;
+        } else if ((descriptor & 0xF) == 0x2) {
+            // Static buffer
+            buffer.size = descriptor >> 14;
+            buffer.flags = BUFFER_INPUT;
+        } else if (descriptor & 0x8) {
+            // Mapped buffer, bits 1-2 hold its access permissions
+            buffer.size = descriptor >> 4;
+            if (descriptor & 0x2)
+                buffer.flags |= BUFFER_INPUT;
+            if (descriptor & 0x4)
+                buffer.flags |= BUFFER_OUTPUT;
+        } else {
+            // Unsupported descriptor, assume it's followed by a single word
+            ++index;
+            continue;
+        }
+
+        if (index >= end)
+            break;
+
+        buffer.address = cmd_buff[index++];
+        buffers.push_back(buffer);
+    }
+
+    return buffers;
+}
+
+static void WriteRecord(const Record& record) {
+    if (!header_written) {
+        FileHeader file_header;
+        file_header.magic = FILE_MAGIC;
+        file_header.version = FILE_VERSION;
+        file_header.program_id = Kernel::g_current_process != nullptr ?
+                Kernel::g_current_process->program_id : 0;
+        trace_file.WriteBytes(&file_header, sizeof(file_header));
+        header_written = true;
+    }
+
+    trace_file.WriteBytes(&record.header, sizeof(record.header));
+    trace_file.WriteBytes(record.session_name.data(), record.session_name.size());
+    trace_file.WriteArray(record.request.data(), record.request.size());
+    trace_file.WriteArray(record.reply.data(), record.reply.size());
+    for (const Record::BufferData& buffer : record.buffers) {
+        trace_file.WriteBytes(&buffer.buffer, sizeof(buffer.buffer));
+        trace_file.WriteArray(buffer.input_data.data(), buffer.input_data.size());
+        trace_file.WriteArray(buffer.output_data.data(), buffer.output_data.size());
+    }
+    trace_file.WriteArray(record.handles.data(), record.handles.size());
+
+    if (!trace_file.IsGood()) {
+        LOG_ERROR(Service, "Failed to write to the IPC trace, stopping");
+        StopTracing();
+    }
+}
+
+void StartTracing(const std::string& path) {
+    if (tracing) {
+        LOG_WARNING(Service, "IPC tracing was already running");
+        StopTracing();
+    }
+
+    if (!trace_file.Open(path, "wb")) {
+        LOG_ERROR(Service, "Failed to open IPC trace file %s", path.c_str());
+        return;
+    }
+
+    header_written = false;
+    tracing = true;
+    LOG_INFO(Service, "Recording IPC trace to %s", path.c_str());
+}
+
+void StopTracing() {
+    if (!tracing)
+        return;
+
+    tracing = false;
+    pending_records.clear();
+    trace_file.Close();
+}
+
+bool IsTracing() {
+    return tracing;
+}
+
+void OnRequest(Kernel::Thread* thread, Kernel::Session* session) {
+    if (!tracing)
+        return;
+
+    const u32* cmd_buff = GetThreadCommandBuffer(thread);
+
+    PendingRecord& pending = pending_records[thread->GetThreadId()];
+    std::copy(cmd_buff, cmd_buff + COMMAND_BUFFER_WORDS, pending.request.begin());
+
+    Record& record = pending.record;
+    record = Record();
+
+    record.header.session_object_id = session->GetObjectId();
+    record.header.thread_id = thread->GetThreadId();
+    record.header.session_kind = session->IsServicePort() ? SessionKind::Port : SessionKind::Other;
+    // Service ports are named after the port
+    record.session_name = session->GetName();
+    record.session_name.resize(std::min<size_t>(record.session_name.size(), 0xFF));
+
+    size_t num_words = 1 + ((cmd_buff[0] >> 6) & 0x3F) + (cmd_buff[0] & 0x3F);
+    record.request.assign(cmd_buff, cmd_buff + std::min(num_words, COMMAND_BUFFER_WORDS));
+
+    for (const Buffer& buffer : GetRequestBuffers(cmd_buff)) {
+        Record::BufferData buffer_data;
+        buffer_data.buffer = buffer;
+        if (buffer.flags & BUFFER_INPUT)
+            buffer_data.input_data = ReadGuestBuffer(buffer);
+        record.buffers.push_back(std::move(buffer_data));
+    }
+
+    pending.start = std::chrono::steady_clock::now();
+}
+
+void OnReply(Kernel::Thread* thread) {
+    if (!tracing)
+        return;
+
+    auto itr = pending_records.find(thread->GetThreadId());
+    if (itr == pending_records.end())
+        return;
+
+    PendingRecord& pending = itr->second;
+    Record& record = pending.record;
+    record.header.duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - pending.start).count();
+
+    // Services don't always write a reply header, so keep every word up to the last one they changed
+    // as well as all the words declared by the header
+    const u32* cmd_buff = GetThreadCommandBuffer(thread);
+    size_t translate_start = 1 + ((cmd_buff[0] >> 6) & 0x3F);
+    size_t translate_end = std::min(translate_start + (cmd_buff[0] & 0x3F), COMMAND_BUFFER_WORDS);
+    size_t num_words = std::max<size_t>(2, translate_end);
+    for (size_t i = num_words; i < COMMAND_BUFFER_WORDS; ++i) {
+        if (cmd_buff[i] != pending.request[i])
+            num_words = i + 1;
+    }
+    record.reply.assign(cmd_buff, cmd_buff + num_words);
+
+    for (Record::BufferData& buffer_data : record.buffers) {
+        if (buffer_data.buffer.flags & BUFFER_OUTPUT)
+            buffer_data.output_data = ReadGuestBuffer(buffer_data.buffer);
+        buffer_data.buffer.input_data_size = (u32)buffer_data.input_data.size();
+        buffer_data.buffer.output_data_size = (u32)buffer_data.output_data.size();
+    }
+
+    // Remember the sessions moved or copied by the reply, so that the requests later sent to them
+    // can be matched up with the sessions created when replaying. Only the words following the
+    // handle descriptors of the translate parameters hold handles.
+    size_t index = translate_start;
+    while (index < translate_end) {
+        u32 descriptor = cmd_buff[index++];
+
+        if ((descriptor & 0xF) != 0x0) {
+            // Buffer descriptor, followed by the buffer address
+            ++index;
+            continue;
+        }
+
+        size_t num_handles = (descriptor >> 26) + 1;
+        for (; num_handles > 0 && index < translate_end; --num_handles, ++index) {
+            // The calling process id isn't a handle
+            if (descriptor & 0x20)
+                continue;
+
+            Kernel::SharedPtr<Kernel::Session> session =
+                    Kernel::g_handle_table.Get<Kernel::Session>(cmd_buff[index]);
+            if (session != nullptr)
+                record.handles.push_back({ (u32)index, session->GetObjectId() });
+        }
+    }
+
+    record.header.name_length = (u8)record.session_name.size();
+    record.header.num_request_words = (u8)record.request.size();
+    record.header.num_reply_words = (u8)record.reply.size();
+    record.header.num_buffers = (u8)std::min<size_t>(record.buffers.size(), 0xFF);
+    record.header.num_handles = (u8)std::min<size_t>(record.handles.size(), 0xFF);
+    record.header.padding = 0;
+    record.buffers.resize(record.header.num_buffers);
+    record.handles.resize(record.header.num_handles);
+
+    WriteRecord(record);
+    pending_records.erase(thread->GetThreadId());
+}
+
+bool ReadRecord(FileUtil::IOFile& file, Record& record) {
+    if (file.ReadBytes(&record.header, sizeof(record.header)) != sizeof(record.header))
+        return false;
+
+    const RecordHeader& header = record.header;
+    if (header.num_request_words > COMMAND_BUFFER_WORDS || header.num_reply_words > COMMAND_BUFFER_WORDS)
+        return false;
+
+    record.session_name.resize(header.name_length);
+    record.request.resize(header.num_request_words);
+    record.reply.resize(header.num_reply_words);
+    if (file.ReadBytes(&record.session_name[0], header.name_length) != header.name_length ||
+        file.ReadArray(record.request.data(), record.request.size()) != record.request.size() ||
+        file.ReadArray(record.reply.data(), record.reply.size()) != record.reply.size()) {
+        return false;
+    }
+
+    record.buffers.resize(header.num_buffers);
+    for (Record::BufferData& buffer_data : record.buffers) {
+        Buffer& buffer = buffer_data.buffer;
+        if (file.ReadBytes(&buffer, sizeof(buffer)) != sizeof(buffer) ||
+            buffer.input_data_size > MAX_BUFFER_DATA_SIZE || buffer.output_data_size > MAX_BUFFER_DATA_SIZE) {
+            return false;
+        }
+
+        buffer_data.input_data.resize(buffer.input_data_size);
+        buffer_data.output_data.resize(buffer.output_data_size);
+        if (file.ReadArray(buffer_data.input_data.data(), buffer.input_data_size) != buffer.input_data_size ||
+            file.ReadArray(buffer_data.output_data.data(), buffer.output_data_size) != buffer.output_data_size) {
+            return false;
+        }
+    }
+
+    record.handles.resize(header.num_handles);
+    return file.ReadArray(record.handles.data(), record.handles.size()) == record.handles.size();
+}
+
+} // namespace IPCTrace
+} // namespace Service
@@ -0,0 +1,146 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/file_util.h"
+
+namespace Kernel {
+class Session;
+class Thread;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace Service
+
+namespace Service {
+
+/**
+ * IPC traces record every request sent to a service session along with its reply and the contents
+ * of the guest buffers it references, so that it can later be replayed against the HLE services
+ * without the rest of the emulator (see citra-ipc-replay).
+ *
+ * A trace file starts with a FileHeader and is followed by records, each made of a RecordHeader
+ * followed by the session name, the request words, the reply words, the buffers (a Buffer followed
+ * by its input and then its output data) and the handles returned in the reply (ReplyHandles). All
+ * values are little-endian.
+ */
+namespace IPCTrace {
+
+const u32 FILE_MAGIC = 0x54504943; // "CIPT"
+const u32 FILE_VERSION = 1;
+
+/// Number of words of the command buffer that can be used by a request or its reply
+const size_t COMMAND_BUFFER_WORDS = 0x40;
+/// Buffer contents larger than this are truncated in the trace
+const u32 MAX_BUFFER_DATA_SIZE = 1024 * 1024;
+
+struct FileHeader {
+    u32 magic;
+    u32 version;
+    u64 program_id; ///< Program id of the traced application, used to locate its save data
+};
+static_assert(sizeof(FileHeader) == 16, "FileHeader has incorrect size");
+
+enum class SessionKind : u8 {
+    Port = 0,  ///< Session to a service port, identified by its port name
+    Other = 1, ///< Any other session (e.g. an open file), identified by its object id
+};
+
+struct RecordHeader {
+    u32 session_object_id;
+    u32 thread_id;          ///< Id of the guest thread that made the request
+    u64 duration_ns;        ///< Host time between the request and its reply
+    SessionKind session_kind;
+    u8 name_length;
+    u8 num_request_words;
+    u8 num_reply_words;
+    u8 num_buffers;
+    u8 num_handles;
+    u16 padding;
+};
+static_assert(sizeof(RecordHeader) == 24, "RecordHeader has incorrect size");
+
+enum BufferFlags : u32 {
+    BUFFER_INPUT = 1,  ///< The service reads from the buffer, its data is recorded with the request
+    BUFFER_OUTPUT = 2, ///< The service writes to the buffer, its data is recorded with the reply
+};
+
+struct Buffer {
+    u32 address;
+    u32 size;
+    u32 flags;
+    u32 input_data_size;
+    u32 output_data_size;
+};
+static_assert(sizeof(Buffer) == 20, "Buffer has incorrect size");
+
+/// A handle returned in a reply, which lets later requests to the same session be matched up
+struct ReplyHandle {
+    u32 reply_word_index;
+    u32 object_id;
+};
+static_assert(sizeof(ReplyHandle) == 8, "ReplyHandle has incorrect size");
+
+/// A record of a trace, as read back from a trace file
+struct Record {
+    RecordHeader header;
+    std::string session_name;
+    std::vector<u32> request;
+    std::vector<u32> reply;
+    struct BufferData {
+        Buffer buffer;
+        std::vector<u8> input_data;
+        std::vector<u8> output_data;
+    };
+    std::vector<BufferData> buffers;
+    std::vector<ReplyHandle> handles;
+};
+
+/**
+ * Finds the guest buffers referenced by the translate parameters of a request
+ * @param cmd_buff Command buffer of the request
+ * @return The buffers, with only their address, size and flags filled in
+ */
+std::vector<Buffer> GetRequestBuffers(const u32* cmd_buff);
+
+/**
+ * Starts recording a trace of all the IPC requests to the given file. The file header is written
+ * along with the first record, once the application has been loaded.
+ * @param path Path of the trace file, which is overwritten
+ */
+void StartTracing(const std::string& path);
+
+/// Stops recording and closes the trace file. Requests which haven't been replied to are dropped.
+void StopTracing();
+
+bool IsTracing();
+
+/**
+ * Records a request, called before it is handled
+ * @param thread Guest thread making the request
+ * @param session Session the request is sent to
+ */
+void OnRequest(Kernel::Thread* thread, Kernel::Session* session);
+
+/**
+ * Records the reply to the last request made by a thread and writes the record to the trace
+ * @param thread Guest thread that made the request, which should have its reply in its TLS
+ */
+void OnReply(Kernel::Thread* thread);
+
+/**
+ * Reads the next record from a trace file
+ * @param file Trace file, positioned after the file header or after the previous record
+ * @param record Where to store the record
+ * @return True if a record was read, false at the end of the file or if it is corrupted
+ */
+bool ReadRecord(FileUtil::IOFile& file, Record& record);
+
+} // namespace IPCTrace
+} // namespace Service
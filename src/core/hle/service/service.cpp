@@ -2,10 +2,17 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <array>
+#include <cstdio>
+
 #include "common/logging/log.h"
-#include "common/string_util.h"
+#include "common/profiler.h"
+#include "common/profiler_reporting.h"
 
+#include "core/settings.h"
 #include "core/hle/service/service.h"
+#include "core/hle/service/async_request.h"
+#include "core/hle/service/ipc_trace.h"
 #include "core/hle/service/ac_u.h"
 #include "core/hle/service/act_u.h"
 #include "core/hle/service/am_app.h"
@@ -52,45 +59,99 @@ std::unordered_map<std::string, Kernel::SharedPtr<Interface>> g_kernel_named_por
 std::unordered_map<std::string, Kernel::SharedPtr<Interface>> g_srv_services;
 
 /**
- * Creates a function string for logging, complete with the name (or header code, depending 
- * on what's passed in) the port name, and all the cmd_buff arguments.
+ * Formats a function call for logging, complete with the name (or header code, depending on what's
+ * passed in) the port name, and all the cmd_buff arguments. The string is written to a fixed-size
+ * buffer so no allocations are made, messages that don't fit are truncated.
  */
-static std::string MakeFunctionString(const char* name, const char* port_name, const u32* cmd_buff) {
+static void FormatFunctionCall(std::array<char, 4 * 1024>& buffer, const char* name,
+                               const char* port_name, const u32* cmd_buff) {
     // Number of params == bits 0-5 + bits 6-11
     int num_params = (cmd_buff[0] & 0x3F) + ((cmd_buff[0] >> 6) & 0x3F);
 
-    std::string function_string = Common::StringFromFormat("function '%s': port=%s", name, port_name);
-    for (int i = 1; i <= num_params; ++i) {
-        function_string += Common::StringFromFormat(", cmd_buff[%i]=%u", i, cmd_buff[i]);
+    size_t size = buffer.size();
+    int length = snprintf(buffer.data(), size, "function '%s': port=%s", name, port_name);
+    for (int i = 1; i <= num_params && length >= 0 && (size_t)length < size; ++i) {
+        length += snprintf(buffer.data() + length, size - length, ", cmd_buff[%i]=%u", i, cmd_buff[i]);
     }
-    return function_string;
+}
+
+Interface::FunctionEntry* Interface::FindFunction(u32 header) {
+    u32 command_id = header >> 16;
+    if (command_id >= m_function_index.size() || m_function_index[command_id] == 0)
+        return nullptr;
+
+    FunctionEntry& entry = m_functions[m_function_index[command_id] - 1];
+    // The parameter descriptors in the lower half of the header need to match as well
+    if (entry.info.id != header)
+        return nullptr;
+
+    return &entry;
 }
 
 ResultVal<bool> Interface::SyncRequest() {
     u32* cmd_buff = Kernel::GetCommandBuffer();
-    auto itr = m_functions.find(cmd_buff[0]);
-
-    if (itr == m_functions.end() || itr->second.func == nullptr) {
-        std::string function_name = (itr == m_functions.end()) ? Common::StringFromFormat("0x%08X", cmd_buff[0]) : itr->second.name;
-        LOG_ERROR(Service, "unknown / unimplemented %s", MakeFunctionString(function_name.c_str(), GetPortName().c_str(), cmd_buff).c_str());
+    FunctionEntry* entry = FindFunction(cmd_buff[0]);
+
+    if (entry == nullptr || entry->info.func == nullptr) {
+        if (Log::IsMessageEnabled(Log::Class::Service, Log::Level::Error)) {
+            std::array<char, 16> header_string;
+            const char* function_name = header_string.data();
+            if (entry != nullptr)
+                function_name = entry->info.name;
+            else
+                snprintf(header_string.data(), header_string.size(), "0x%08X", cmd_buff[0]);
+
+            std::array<char, 4 * 1024> function_string;
+            FormatFunctionCall(function_string, function_name, m_port_name.c_str(), cmd_buff);
+            LOG_ERROR(Service, "unknown / unimplemented %s", function_string.data());
+        }
 
         // TODO(bunnei): Hack - ignore error
         cmd_buff[1] = 0;
         return MakeResult<bool>(false);
-    } else {
-        LOG_TRACE(Service, "%s", MakeFunctionString(itr->second.name, GetPortName().c_str(), cmd_buff).c_str());
     }
 
-    itr->second.func(this);
+#ifdef _DEBUG
+    if (Log::IsMessageEnabled(Log::Class::Service, Log::Level::Trace)) {
+        std::array<char, 4 * 1024> function_string;
+        FormatFunctionCall(function_string, entry->info.name, m_port_name.c_str(), cmd_buff);
+        LOG_TRACE(Service, "%s", function_string.data());
+    }
+#endif
+
+    if (entry->category == nullptr) {
+        entry->category = Common::Profiling::GetProfilingManager().RegisterCallCategory(
+                m_port_name + "::" + entry->info.name);
+    }
+
+    Common::Profiling::CallTimer timer_call(*entry->category);
+    entry->info.func(this);
 
     return MakeResult<bool>(false); // TODO: Implement return from actual function
 }
 
 void Interface::Register(const FunctionInfo* functions, size_t n) {
-    m_functions.reserve(n);
+    // This is called from the constructor of the service, after its vtable has been set up
+    m_port_name = GetPortName();
+
+    m_functions.reserve(m_functions.size() + n);
     for (size_t i = 0; i < n; ++i) {
-        // Usually this array is sorted by id already, so hint to instead at the end
-        m_functions.emplace_hint(m_functions.cend(), functions[i].id, functions[i]);
+        u32 command_id = functions[i].id >> 16;
+        if (command_id >= m_function_index.size())
+            m_function_index.resize(command_id + 1, 0);
+
+        u16& index = m_function_index[command_id];
+        if (index != 0) {
+            LOG_ERROR(Service, "%s: command 0x%08X (%s) registered twice, ignoring it",
+                      m_port_name.c_str(), functions[i].id, functions[i].name);
+            continue;
+        }
+
+        FunctionEntry entry;
+        entry.info = functions[i];
+        entry.category = nullptr;
+        m_functions.push_back(entry);
+        index = static_cast<u16>(m_functions.size());
     }
 }
 
@@ -107,6 +168,10 @@ void AddService(Interface* interface_) {
 
 /// Initialize ServiceManager
 void Init() {
+    AsyncRequestsInit();
+    if (!Settings::values.ipc_trace_path.empty())
+        IPCTrace::StartTracing(Settings::values.ipc_trace_path);
+
     AddNamedPort(new SRV::Interface);
     AddNamedPort(new ERR_F::Interface);
 
@@ -153,6 +218,10 @@ void Init() {
 
 /// Shutdown ServiceManager
 void Shutdown() {
+    // Requests still in flight may be using the state of the services, so finish them first
+    AsyncRequestsShutdown();
+    IPCTrace::StopTracing();
+
     Service::IR::Shutdown();
     Service::HID::Shutdown();
     Service::PTM::Shutdown();
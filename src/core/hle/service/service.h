@@ -6,14 +6,19 @@
 
 #include <string>
 #include <unordered_map>
-
-#include <boost/container/flat_map.hpp>
+#include <vector>
 
 #include "common/common_types.h"
 
 #include "core/hle/kernel/kernel.h"
 #include "core/hle/kernel/session.h"
 
+namespace Common {
+namespace Profiling {
+class CallCategory;
+}
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Namespace Service
 
@@ -47,6 +52,8 @@ public:
 
     ResultVal<bool> SyncRequest() override;
 
+    bool IsServicePort() const override { return true; }
+
 protected:
 
     /**
@@ -60,8 +67,28 @@ protected:
     void Register(const FunctionInfo* functions, size_t n);
 
 private:
-    boost::container::flat_map<u32, FunctionInfo> m_functions;
+    /// A registered function, along with the profiling category its calls are accounted to.
+    struct FunctionEntry {
+        FunctionInfo info;
+        /// Registered lazily on the first call, so that unused commands don't clutter the profiler
+        Common::Profiling::CallCategory* category;
+    };
 
+    /**
+     * Looks up the function registered for the given command header.
+     * @return The function entry, or nullptr if no function is registered for the header
+     */
+    FunctionEntry* FindFunction(u32 header);
+
+    /// Registered functions, in the order they were registered.
+    std::vector<FunctionEntry> m_functions;
+    /**
+     * Dense dispatch table indexed by command id (the upper 16 bits of the command header). Each
+     * element is an index into m_functions plus one, or 0 if no function has that command id.
+     */
+    std::vector<u16> m_function_index;
+    /// Port name of the service, cached so that it doesn't need to be rebuilt for every request.
+    std::string m_port_name;
 };
 
 /// Initialize ServiceManager
@@ -32,7 +32,10 @@
 
 #include "common/scope_exit.h"
 #include "core/hle/hle.h"
+#include "core/hle/service/async_request.h"
 #include "core/hle/service/soc_u.h"
+#include <algorithm>
+#include <cstring>
 #include <unordered_map>
 
 #if EMU_PLATFORM == PLATFORM_WINDOWS
@@ -297,6 +300,36 @@ static void CleanupSockets() {
     open_sockets.clear();
 }
 
+/// Returns whether the socket is in blocking mode
+static bool IsBlocking(u32 socket_handle) {
+#if EMU_PLATFORM == PLATFORM_WINDOWS
+    auto iter = open_sockets.find(socket_handle);
+    return iter == open_sockets.end() || iter->second.blocking;
+#else
+    int flags = ::fcntl(socket_handle, F_GETFL, 0);
+    return flags != SOCKET_ERROR_VALUE && (flags & O_NONBLOCK) == 0;
+#endif
+}
+
+/**
+ * Waits until the socket has data to read (or, for listening sockets, a pending connection). Used
+ * by the blocking calls that are handled on a worker thread, so that they don't prevent shutdown.
+ * @return True if the socket is ready or in an error state, false if the emulator is shutting down
+ */
+static bool WaitUntilReadable(u32 socket_handle) {
+    pollfd poll_fd = {};
+    poll_fd.fd = socket_handle;
+    poll_fd.events = POLLIN;
+
+    while (!Service::IsAsyncRequestShutdownPending()) {
+        // Errors are reported by the call that follows the wait
+        int ret = ::poll(&poll_fd, 1, 100);
+        if (ret != 0)
+            return true;
+    }
+    return false;
+}
+
 static void Socket(Service::Interface* self) {
     u32* cmd_buffer = Kernel::GetCommandBuffer();
     u32 domain = cmd_buffer[1]; // Address family
@@ -438,30 +471,53 @@ static void Listen(Service::Interface* self) {
     cmd_buffer[1] = result;
 }
 
-static void Accept(Service::Interface* self) {
-    // TODO(Subv): Calling this function on a blocking socket will block the emu thread, 
-    // preventing graceful shutdown when closing the emulator, this can be fixed by always 
-    // performing nonblocking operations and spinlock until the data is available
-    u32* cmd_buffer = Kernel::GetCommandBuffer();
-    u32 socket_handle = cmd_buffer[1];
-    socklen_t max_addr_len = static_cast<socklen_t>(cmd_buffer[2]);
+/**
+ * Accepts a connection on a socket. Only touches host resources, so it can run on a worker thread.
+ * @param ctr_addr Where to write the address of the peer, may be nullptr
+ * @param reply Command buffer the result is written to
+ */
+static void DoAccept(u32 socket_handle, CTRSockAddr* ctr_addr, socklen_t max_addr_len, u32* reply) {
     sockaddr addr;
     socklen_t addr_len = sizeof(addr);
     u32 ret = static_cast<u32>(::accept(socket_handle, &addr, &addr_len));
-    
-    if ((s32)ret != SOCKET_ERROR_VALUE)
-        open_sockets[ret] = { ret, true };
 
     int result = 0;
     if ((s32)ret == SOCKET_ERROR_VALUE) {
         result = TranslateError(GET_ERRNO);
-    } else {
-        CTRSockAddr ctr_addr = CTRSockAddr::FromPlatform(addr);
-        Memory::WriteBlock(cmd_buffer[0x104 >> 2], (const u8*)&ctr_addr, max_addr_len);
+    } else if (ctr_addr != nullptr) {
+        CTRSockAddr ctr_peer_addr = CTRSockAddr::FromPlatform(addr);
+        std::memcpy(ctr_addr, &ctr_peer_addr, std::min<size_t>(max_addr_len, sizeof(ctr_peer_addr)));
     }
 
-    cmd_buffer[2] = ret;
-    cmd_buffer[1] = result;
+    reply[2] = ret;
+    reply[1] = result;
+}
+
+static void Accept(Service::Interface* self) {
+    u32* cmd_buffer = Kernel::GetCommandBuffer();
+    u32 socket_handle = cmd_buffer[1];
+    socklen_t max_addr_len = static_cast<socklen_t>(cmd_buffer[2]);
+    CTRSockAddr* ctr_addr = reinterpret_cast<CTRSockAddr*>(Memory::GetPointer(cmd_buffer[0x104 >> 2]));
+
+    if (IsBlocking(socket_handle)) {
+        // Wait for the connection on a worker thread instead of blocking the emulated CPU
+        Service::QueueAsyncRequest(self, [=](u32* reply) {
+            if (WaitUntilReadable(socket_handle)) {
+                DoAccept(socket_handle, ctr_addr, max_addr_len, reply);
+            } else {
+                reply[2] = SOCKET_ERROR_VALUE;
+                reply[1] = -1;
+            }
+        }, [](u32* reply) {
+            if ((s32)reply[2] != SOCKET_ERROR_VALUE)
+                open_sockets[reply[2]] = { reply[2], true };
+        });
+        return;
+    }
+
+    DoAccept(socket_handle, ctr_addr, max_addr_len, cmd_buffer);
+    if ((s32)cmd_buffer[2] != SOCKET_ERROR_VALUE)
+        open_sockets[cmd_buffer[2]] = { cmd_buffer[2], true };
 }
 
 static void GetHostId(Service::Interface* self) {
@@ -524,25 +580,20 @@ static void SendTo(Service::Interface* self) {
     cmd_buffer[1] = result;
 }
 
-static void RecvFrom(Service::Interface* self) {
-    // TODO(Subv): Calling this function on a blocking socket will block the emu thread, 
-    // preventing graceful shutdown when closing the emulator, this can be fixed by always 
-    // performing nonblocking operations and spinlock until the data is available
-    u32* cmd_buffer = Kernel::GetCommandBuffer();
-    u32 socket_handle = cmd_buffer[1];
-    u32 len = cmd_buffer[2];
-    u32 flags = cmd_buffer[3];
-    socklen_t addr_len = static_cast<socklen_t>(cmd_buffer[4]);
-
-    u8* output_buff = Memory::GetPointer(cmd_buffer[0x104 >> 2]);
+/**
+ * Receives data from a socket. Only touches host resources, so it can run on a worker thread.
+ * @param output_buff Where to write the received data
+ * @param ctr_src_addr Where to write the address of the sender, may be nullptr
+ * @param reply Command buffer the result is written to
+ */
+static void DoRecvFrom(u32 socket_handle, u8* output_buff, u32 len, u32 flags,
+                       CTRSockAddr* ctr_src_addr, u32* reply) {
     sockaddr src_addr;
     socklen_t src_addr_len = sizeof(src_addr);
     int ret = ::recvfrom(socket_handle, (char*)output_buff, len, flags, &src_addr, &src_addr_len);
 
-    if (cmd_buffer[0x1A0 >> 2] != 0) {
-        CTRSockAddr* ctr_src_addr = reinterpret_cast<CTRSockAddr*>(Memory::GetPointer(cmd_buffer[0x1A0 >> 2]));
+    if (ctr_src_addr != nullptr)
         *ctr_src_addr = CTRSockAddr::FromPlatform(src_addr);
-    }
 
     int result = 0;
     int total_received = ret;
@@ -551,9 +602,37 @@ static void RecvFrom(Service::Interface* self) {
         total_received = 0;
     }
 
-    cmd_buffer[1] = result;
-    cmd_buffer[2] = ret;
-    cmd_buffer[3] = total_received;
+    reply[1] = result;
+    reply[2] = ret;
+    reply[3] = total_received;
+}
+
+static void RecvFrom(Service::Interface* self) {
+    u32* cmd_buffer = Kernel::GetCommandBuffer();
+    u32 socket_handle = cmd_buffer[1];
+    u32 len = cmd_buffer[2];
+    u32 flags = cmd_buffer[3];
+
+    u8* output_buff = Memory::GetPointer(cmd_buffer[0x104 >> 2]);
+    CTRSockAddr* ctr_src_addr = nullptr;
+    if (cmd_buffer[0x1A0 >> 2] != 0)
+        ctr_src_addr = reinterpret_cast<CTRSockAddr*>(Memory::GetPointer(cmd_buffer[0x1A0 >> 2]));
+
+    if (IsBlocking(socket_handle)) {
+        // Wait for the data on a worker thread instead of blocking the emulated CPU
+        Service::QueueAsyncRequest(self, [=](u32* reply) {
+            if (WaitUntilReadable(socket_handle)) {
+                DoRecvFrom(socket_handle, output_buff, len, flags, ctr_src_addr, reply);
+            } else {
+                reply[1] = -1;
+                reply[2] = SOCKET_ERROR_VALUE;
+                reply[3] = 0;
+            }
+        });
+        return;
+    }
+
+    DoRecvFrom(socket_handle, output_buff, len, flags, ctr_src_addr, cmd_buffer);
 }
 
 static void Poll(Service::Interface* self) {
@@ -40,6 +40,8 @@ static void GetServiceHandle(Service::Interface* self) {
     auto it = Service::g_srv_services.find(port_name);
 
     if (it != Service::g_srv_services.end()) {
+        cmd_buff[0] = 0x00050042; // Reply header: 1 normal and 2 translate parameters
+        cmd_buff[2] = 0x10;       // Moves 1 handle
         cmd_buff[3] = Kernel::g_handle_table.Create(it->second).MoveFrom();
         LOG_TRACE(Service_SRV, "called port=%s, handle=0x%08X", port_name.c_str(), cmd_buff[3]);
     } else {
@@ -2,10 +2,13 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <array>
 #include <map>
+#include <string>
 
 #include "common/logging/log.h"
 #include "common/profiler.h"
+#include "common/profiler_reporting.h"
 #include "common/string_util.h"
 #include "common/symbols.h"
 
@@ -23,6 +26,7 @@
 
 #include "core/hle/function_wrappers.h"
 #include "core/hle/result.h"
+#include "core/hle/service/ipc_trace.h"
 #include "core/hle/service/service.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -129,7 +133,16 @@ static ResultCode SendSyncRequest(Handle handle) {
 
     LOG_TRACE(Kernel_SVC, "called handle=0x%08X(%s)", handle, session->GetName().c_str());
 
-    return session->SyncRequest().Code();
+    if (!Service::IPCTrace::IsTracing())
+        return session->SyncRequest().Code();
+
+    Kernel::Thread* thread = Kernel::GetCurrentThread();
+    Service::IPCTrace::OnRequest(thread, session.get());
+    ResultCode result = session->SyncRequest().Code();
+    // Requests completed asynchronously are recorded when the thread gets its reply
+    if (thread->status != THREADSTATUS_WAIT_IPC)
+        Service::IPCTrace::OnReply(thread);
+    return result;
 }
 
 /// Close a handle
@@ -152,7 +165,6 @@ static ResultCode WaitSynchronization1(Handle handle, s64 nano_seconds) {
     // Check for next thread to schedule
     if (object->ShouldWait()) {
 
-        object->AddWaitingThread(Kernel::GetCurrentThread());
         Kernel::WaitCurrentThread_WaitSynchronization({ object }, false, false);
 
         // Create an event to wake the thread up after the specified nanosecond delay has passed
@@ -181,9 +193,13 @@ static ResultCode WaitSynchronizationN(s32* out, Handle* handles, s32 handle_cou
     ASSERT_MSG(out != nullptr, "invalid output pointer specified!");
 
     // Check if 'handle_count' is invalid
-    if (handle_count < 0)
+    if (handle_count < 0 || handle_count > (s32)Kernel::MAX_WAIT_OBJECTS)
         return ResultCode(ErrorDescription::OutOfRange, ErrorModule::OS, ErrorSummary::InvalidArgument, ErrorLevel::Usage);
 
+    // Objects referenced by 'handles', looked up once. This lives on the stack so that waiting
+    // doesn't allocate.
+    Kernel::WaitObjectList wait_objects;
+
     // If 'handle_count' is non-zero, iterate through each handle and wait the current thread if
     // necessary
     if (handle_count != 0) {
@@ -192,6 +208,7 @@ static ResultCode WaitSynchronizationN(s32* out, Handle* handles, s32 handle_cou
             auto object = Kernel::g_handle_table.GetWaitObject(handles[i]);
             if (object == nullptr)
                 return ERR_INVALID_HANDLE;
+            wait_objects.push_back(object);
 
             // Check if the current thread should wait on this object...
             if (object->ShouldWait()) {
@@ -224,16 +241,7 @@ static ResultCode WaitSynchronizationN(s32* out, Handle* handles, s32 handle_cou
     if (wait_thread) {
 
         // Actually wait the current thread on each object if we decided to wait...
-        std::vector<SharedPtr<Kernel::WaitObject>> wait_objects;
-        wait_objects.reserve(handle_count);
-        
-        for (int i = 0; i < handle_count; ++i) {
-            auto object = Kernel::g_handle_table.GetWaitObject(handles[i]);
-            object->AddWaitingThread(Kernel::GetCurrentThread());
-            wait_objects.push_back(object);
-        }
-
-        Kernel::WaitCurrentThread_WaitSynchronization(std::move(wait_objects), true, wait_all);
+        Kernel::WaitCurrentThread_WaitSynchronization(wait_objects, true, wait_all);
 
         // Create an event to wake the thread up after the specified nanosecond delay has passed
         Kernel::GetCurrentThread()->WakeAfterDelay(nano_seconds);
@@ -243,9 +251,7 @@ static ResultCode WaitSynchronizationN(s32* out, Handle* handles, s32 handle_cou
     }
 
     // Acquire objects if we did not wait...
-    for (int i = 0; i < handle_count; ++i) {
-        auto object = Kernel::g_handle_table.GetWaitObject(handles[i]);
-
+    for (auto& object : wait_objects) {
         // Acquire the object if it is not waiting...
         if (!object->ShouldWait()) {
             object->Acquire();
@@ -750,6 +756,11 @@ static const FunctionDef SVC_Table[] = {
 };
 
 Common::Profiling::TimingCategory profiler_svc("SVC Calls");
+static Common::Profiling::ScopeCategory profile_call_svc("CallSVC");
+static Common::Profiling::Counter counter_svc_calls("svc_calls");
+
+/// Call counts and time histograms of each SVC, indexed like SVC_Table. Registered on first call.
+static std::array<Common::Profiling::CallCategory*, ARRAY_SIZE(SVC_Table)> svc_call_categories;
 
 static const FunctionDef* GetSVCInfo(u32 opcode) {
     u32 func_num = opcode & 0xFFFFFF; // 8 bits
@@ -762,10 +773,18 @@ static const FunctionDef* GetSVCInfo(u32 opcode) {
 
 void CallSVC(u32 opcode) {
     Common::Profiling::ScopeTimer timer_svc(profiler_svc);
+    Common::Profiling::ProfileScope scope(profile_call_svc);
+    counter_svc_calls.Add();
 
     const FunctionDef *info = GetSVCInfo(opcode);
     if (info) {
         if (info->func) {
+            Common::Profiling::CallCategory*& category = svc_call_categories[info - SVC_Table];
+            if (category == nullptr)
+                category = Common::Profiling::GetProfilingManager().RegisterCallCategory(
+                        std::string("SVC ") + info->name);
+
+            Common::Profiling::CallTimer timer_call(*category);
             info->func();
         } else {
             LOG_ERROR(Kernel_SVC, "unimplemented SVC function %s(..)", info->name);
@@ -3,6 +3,7 @@
 // Refer to the license.txt file included.
 
 #include "common/common_types.h"
+#include "common/profiler.h"
 
 #include "core/arm/arm_interface.h"
 
@@ -20,6 +21,7 @@
 #include "core/hw/gpu.h"
 
 #include "video_core/command_processor.h"
+#include "video_core/rasterizer.h"
 #include "video_core/utils.h"
 #include "video_core/video_core.h"
 #include "video_core/color.h"
@@ -38,6 +40,11 @@ static int vblank_event;
 static u64 frame_count;
 /// True if the last frame was skipped
 static bool last_skip_frame;
+/// Host time at which the previous VBlank happened
+static Common::Profiling::Clock::time_point last_vblank_time;
+
+/// Emulated time divided by host time between the two last VBlanks, in percent
+static Common::Profiling::Gauge gauge_emulation_speed("emulation_speed_percent");
 
 template <typename T>
 inline void Read(T &var, const u32 raw_addr) {
@@ -76,6 +83,8 @@ inline void Write(u32 addr, const T data) {
         auto& config = g_regs.memory_fill_config[is_second_filler];
 
         if (config.address_start && config.trigger) {
+            Pica::Rasterizer::WaitForIdle();
+
             u8* start = Memory::GetPhysicalPointer(config.GetStartAddress());
             u8* end = Memory::GetPhysicalPointer(config.GetEndAddress());
 
@@ -114,6 +123,9 @@ inline void Write(u32 addr, const T data) {
     {
         const auto& config = g_regs.display_transfer_config;
         if (config.trigger & 1) {
+            // Display transfers usually copy the render target
+            Pica::Rasterizer::WaitForIdle();
+
             u8* src_pointer = Memory::GetPhysicalPointer(config.GetPhysicalInputAddress());
             u8* dst_pointer = Memory::GetPhysicalPointer(config.GetPhysicalOutputAddress());
 
@@ -283,6 +295,14 @@ template void Write<u8>(u32 addr, const u8 data);
 /// Update hardware
 static void VBlankCallback(u64 userdata, int cycles_late) {
     frame_count++;
+
+    using FloatSeconds = std::chrono::duration<double>;
+    auto now = Common::Profiling::Clock::now();
+    double host_seconds = std::chrono::duration_cast<FloatSeconds>(now - last_vblank_time).count();
+    if (host_seconds > 0.0)
+        gauge_emulation_speed.Set(100.0 * frame_ticks / g_clock_rate_arm11 / host_seconds);
+    last_vblank_time = now;
+
     last_skip_frame = g_skip_frame;
     g_skip_frame = (frame_count & Settings::values.frame_skip) != 0;
 
@@ -351,6 +371,7 @@ void Init() {
     last_skip_frame = false;
     g_skip_frame = false;
     frame_count = 0;
+    last_vblank_time = Common::Profiling::Clock::now();
 
     vblank_event = CoreTiming::RegisterEvent("GPU::VBlankCallback", VBlankCallback);
     CoreTiming::ScheduleEvent(frame_ticks, vblank_event);
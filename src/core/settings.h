@@ -48,8 +48,16 @@ struct Values {
     float bg_red;
     float bg_green;
     float bg_blue;
+    int vertex_processing_threads;
+    int vertex_shader_backend;
+    int rasterizer_threads;
 
     std::string log_filter;
+    int log_overflow_policy;
+    std::string binary_log_path;
+    std::string ipc_trace_path;
+    std::string metrics_path;
+    std::string metrics_socket_path;
 } extern values;
 
 }
@@ -2,9 +2,13 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include "common/logging/log.h"
+#include "common/metrics_exporter.h"
+
 #include "core/core.h"
 #include "core/core_timing.h"
 #include "core/mem_map.h"
+#include "core/settings.h"
 #include "core/system.h"
 #include "core/hw/hw.h"
 #include "core/hle/hle.h"
@@ -22,9 +26,15 @@ void Init(EmuWindow* emu_window) {
     Kernel::Init();
     HLE::Init();
     VideoCore::Init(emu_window);
+
+    if (!Common::Profiling::StartMetricsExporter(Settings::values.metrics_path,
+                                                 Settings::values.metrics_socket_path)) {
+        LOG_ERROR(Core, "Failed to start the metrics exporter");
+    }
 }
 
 void Shutdown() {
+    Common::Profiling::StopMetricsExporter();
     VideoCore::Shutdown();
     HLE::Shutdown();
     Kernel::Shutdown();
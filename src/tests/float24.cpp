@@ -0,0 +1,166 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+// Checks float24 against scalar reference implementations: FromRawFloat24 against the previous
+// powf based decoding on all 2^24 inputs, Truncate() against a frexp based rounding on random
+// values, and the SSE specializations of the Vec4<float24> operators and Dot against the
+// component-wise float24 arithmetic on random operands. All results have to be bit-identical.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#include "common/common_types.h"
+
+#include "video_core/math.h"
+#include "video_core/pica.h"
+
+using Pica::float24;
+
+static std::mt19937 rng(1);
+
+static u32 Random(u32 n) {
+    return std::uniform_int_distribution<u32>(0, n - 1)(rng);
+}
+
+static u32 ToBits(float value) {
+    u32 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float FromBits(u32 bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/// Random value, including zeros, denormals, infinities and NaNs, as well as values outside of the
+/// float24 exponent range
+static float RandomFloat() {
+    switch (Random(8)) {
+    case 0: return FromBits(Random(2) << 31);
+    case 1: return FromBits((Random(2) << 31) | 0x7F800000 | Random(2) * Random(0x800000));
+    case 2: return FromBits((Random(2) << 31) | Random(0x800000));
+    case 3: return (float)Random(9) - 4.0f;
+    case 4: return FromBits((u32)rng());
+    default: return std::uniform_real_distribution<float>(-8.0f, 8.0f)(rng);
+    }
+}
+
+static bool SameBits(float value, float expected) {
+    return ToBits(value) == ToBits(expected) || (std::isnan(value) && std::isnan(expected));
+}
+
+/// FromRawFloat24 as implemented before it moved the bit fields directly
+static float DecodeFloat24Reference(u32 hex) {
+    if ((hex & 0xFFFFFF) == 0)
+        return 0.0f;
+
+    u32 mantissa = hex & 0xFFFF;
+    u32 exponent = (hex >> 16) & 0x7F;
+    u32 sign = hex >> 23;
+    float value = powf(2.0f, (float)exponent - 63.0f) * (1.0f + mantissa * powf(2.0f, -16.f));
+    return sign ? -value : value;
+}
+
+/// Rounds towards zero to 16 mantissa bits, flushing values outside of the float24 exponent range
+static float TruncateReference(float value) {
+    if (std::isnan(value) || std::isinf(value) || value == 0.0f)
+        return value;
+
+    int exponent;
+    float fraction = std::frexp(std::fabs(value), &exponent);
+    // fraction is in [0.5, 1), i.e. the value is 2^(exponent - 1) * (2 * fraction)
+    exponent -= 1;
+    float result;
+    if (exponent < -63) {
+        result = 0.0f;
+    } else if (exponent > 64) {
+        result = INFINITY;
+    } else {
+        float mantissa = std::floor((2.0f * fraction - 1.0f) * 65536.0f);
+        result = std::ldexp(1.0f + mantissa / 65536.0f, exponent);
+    }
+    return std::signbit(value) ? -result : result;
+}
+
+static int failures = 0;
+
+static void Fail(const char* what, float value, float expected) {
+    if (failures++ < 10)
+        std::printf("FAIL: %s returned %a instead of %a\n", what, value, expected);
+}
+
+static void TestFromRawFloat24() {
+    for (u32 hex = 0; hex < (1 << 24); ++hex) {
+        float24 value = float24::FromRawFloat24(hex);
+        float expected = DecodeFloat24Reference(hex);
+        if (!SameBits(value.ToFloat32(), expected))
+            Fail("FromRawFloat24", value.ToFloat32(), expected);
+
+        // Decoded values already have float24 precision
+        if (!SameBits(value.Truncate().ToFloat32(), expected))
+            Fail("Truncate on a float24 value", value.Truncate().ToFloat32(), expected);
+    }
+}
+
+static void TestTruncate(int iterations) {
+    for (int i = 0; i < iterations; ++i) {
+        float value = RandomFloat();
+        float result = float24::FromFloat32(value).Truncate().ToFloat32();
+        float expected = TruncateReference(value);
+        if (!SameBits(result, expected))
+            Fail("Truncate", result, expected);
+    }
+}
+
+static Math::Vec4<float24> RandomVec4() {
+    return { float24::FromFloat32(RandomFloat()), float24::FromFloat32(RandomFloat()),
+             float24::FromFloat32(RandomFloat()), float24::FromFloat32(RandomFloat()) };
+}
+
+static void CompareVec4(const char* what, const Math::Vec4<float24>& value,
+                        const float24 (&expected)[4]) {
+    for (int i = 0; i < 4; ++i) {
+        if (!SameBits(value[i].ToFloat32(), expected[i].ToFloat32()))
+            Fail(what, value[i].ToFloat32(), expected[i].ToFloat32());
+    }
+}
+
+static void TestVec4(int iterations) {
+    for (int i = 0; i < iterations; ++i) {
+        Math::Vec4<float24> a = RandomVec4();
+        Math::Vec4<float24> b = RandomVec4();
+        float24 f = float24::FromFloat32(RandomFloat());
+
+        const float24 sum[4] = { a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w };
+        const float24 difference[4] = { a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w };
+        const float24 product[4] = { a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w };
+        const float24 scaled[4] = { a.x * f, a.y * f, a.z * f, a.w * f };
+        CompareVec4("Vec4 +", a + b, sum);
+        CompareVec4("Vec4 -", a - b, difference);
+        CompareVec4("Vec4 *", a * b, product);
+        CompareVec4("Vec4 * scalar", a * f, scaled);
+
+        float24 dot = Math::Dot(a, b);
+        float24 expected = ((a.x * b.x + a.y * b.y) + a.z * b.z) + a.w * b.w;
+        if (!SameBits(dot.ToFloat32(), expected.ToFloat32()))
+            Fail("Dot", dot.ToFloat32(), expected.ToFloat32());
+    }
+}
+
+int main(int argc, char** argv) {
+    int iterations = (argc > 1) ? std::atoi(argv[1]) : 1000000;
+
+    TestFromRawFloat24();
+    TestTruncate(iterations);
+    TestVec4(iterations);
+
+    if (failures == 0)
+        std::printf("OK\n");
+    return failures == 0 ? 0 : 1;
+}
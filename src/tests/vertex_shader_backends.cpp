@@ -0,0 +1,320 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+// Checks that the vertex shader backends produce the same outputs as the reference interpreter
+// (backend 0) on randomly generated programs. The programs mix arithmetic with relative
+// addressing, conditional code, branches, calls and loops, and run on random uniforms and inputs.
+// Outputs are compared with the tolerance used by the verified JIT mode.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "common/logging/backend.h"
+#include "common/logging/filter.h"
+
+#include "core/settings.h"
+
+#include "video_core/pica.h"
+#include "video_core/vertex_shader.h"
+
+using Pica::float24;
+using Pica::Regs;
+
+namespace VertexShader = Pica::VertexShader;
+
+static std::mt19937 rng(1);
+
+static u32 Random(u32 n) {
+    return std::uniform_int_distribution<u32>(0, n - 1)(rng);
+}
+
+/// Random value, favoring the ones whose results are easy to get wrong (zero, integers, halves)
+static float RandomFloat() {
+    switch (Random(6)) {
+    case 0: return 0.0f;
+    case 1: return (float)Random(9) - 4.0f;
+    case 2: return 0.5f * ((float)Random(5) - 2.0f);
+    default: return std::uniform_real_distribution<float>(-8.0f, 8.0f)(rng);
+    }
+}
+
+enum : u32 {
+    ADD = 0x00, DP3 = 0x01, DP4 = 0x02, MUL = 0x08, FLR = 0x0B, MAX = 0x0C, RCP = 0x0E, RSQ = 0x0F,
+    MOVA = 0x12, MOV = 0x13, NOP = 0x21, END = 0x22, CALL = 0x24, CALLC = 0x25, CALLU = 0x26,
+    IFU = 0x27, IFC = 0x28, LOOP = 0x29, JMPC = 0x2C, JMPU = 0x2D, CMP = 0x2E,
+};
+
+static u32 Arithmetic(u32 opcode, u32 dest, u32 src1, u32 src2, u32 operand_desc, u32 address_register) {
+    return (opcode << 26) | (dest << 21) | (address_register << 19) | (src1 << 12) | (src2 << 7) | operand_desc;
+}
+
+static u32 Compare(u32 src1, u32 src2, u32 operand_desc, u32 address_register, u32 op_x, u32 op_y) {
+    return (CMP << 26) | (op_y << 24) | (op_x << 21) | (address_register << 19) | (src1 << 12) | (src2 << 7) | operand_desc;
+}
+
+/// MAD takes a 7-bit index for src2, MADI (inverted) for src3
+static u32 MultiplyAdd(bool inverted, u32 dest, u32 src1, u32 src2, u32 src3, u32 operand_desc) {
+    if (inverted)
+        return (0x6u << 29) | (dest << 24) | (src1 << 17) | (src2 << 12) | (src3 << 5) | operand_desc;
+    return (0x7u << 29) | (dest << 24) | (src1 << 17) | (src2 << 10) | (src3 << 5) | operand_desc;
+}
+
+static u32 FlowControl(u32 opcode, u32 dest_offset, u32 num_instructions, u32 condition_or_uniform,
+                       u32 ref_y, u32 ref_x) {
+    return (opcode << 26) | (ref_x << 25) | (ref_y << 24) | (condition_or_uniform << 22) |
+           (dest_offset << 10) | num_instructions;
+}
+
+/// Random arithmetic instruction, relative to address registers up to max_address_register (3 is aL)
+static u32 RandomArithmetic(u32 max_address_register) {
+    static const u32 opcodes[] = { ADD, DP3, DP4, MUL, FLR, MAX, RCP, RSQ, MOV };
+
+    u32 address_register = Random(max_address_register + 1);
+    // Keeps relative accesses within the uniforms for the offsets the programs set up
+    u32 src1 = Random(address_register ? 0x80 - 13 : 0x80);
+    u32 operand_desc = 1 + Random(127);
+    switch (Random(12)) {
+    case 0:
+        return Compare(src1, Random(0x20), operand_desc, address_register, Random(8), Random(8));
+    case 1:
+        return MultiplyAdd(false, Random(0x20), Random(0x20), Random(0x80), Random(0x20), 1 + Random(31));
+    case 2:
+        return MultiplyAdd(true, Random(0x20), Random(0x20), Random(0x20), Random(0x80), 1 + Random(31));
+    default:
+        return Arithmetic(opcodes[Random(9)], Random(0x20), src1, Random(0x20), operand_desc, address_register);
+    }
+}
+
+/**
+ * Writes a random program to the shader memory
+ * @return Entry point of the program
+ */
+static u32 GenerateProgram() {
+    std::vector<u32> program(1024);
+    std::vector<u32> swizzle_data(1024);
+    for (u32& word : program)
+        word = rng();
+    for (u32& word : swizzle_data)
+        word = rng();
+    // Writes all components of the identity swizzle, used to initialize the registers
+    swizzle_data[0] = 0xF | (0x1B << 5) | (0x1B << 14) | (0x1B << 23);
+
+    // Initializes the temporaries and outputs, the address registers (from c95 = (1, 2, ...)) and,
+    // with an empty loop, the loop counter, which the interpreter leaves uninitialized
+    u32 main_offset = Random(40);
+    u32 pc = main_offset;
+    for (u32 i = 0; i < 16; ++i)
+        program[pc++] = Arithmetic(MOV, 0x10 + i, 0x20 + Random(96), 0, 0, 0);
+    for (u32 i = 0; i < 16; ++i)
+        program[pc++] = Arithmetic(MOV, i, 0x20 + Random(96), 0, 0, 0);
+    program[pc++] = Arithmetic(MOVA, 0, 0x20 + 95, 0, 0, 0);
+    program[pc] = FlowControl(LOOP, pc, 0, 0, 0, 0);
+    ++pc;
+    program[pc++] = FlowControl(NOP, 0, 0, 0, 0, 0);
+
+    // Subroutines are placed past the main program
+    struct Subroutine {
+        u32 offset;
+        u32 num_instructions;
+    };
+    std::vector<Subroutine> subroutines;
+    u32 subroutine_pc = 700;
+    for (int i = 0; i < 4; ++i) {
+        Subroutine subroutine = { subroutine_pc, Random(6) };
+        for (u32 j = 0; j < subroutine.num_instructions; ++j)
+            program[subroutine_pc++] = RandomArithmetic(2);
+        subroutine_pc += Random(3);
+        subroutines.push_back(subroutine);
+    }
+
+    std::vector<u32> jumps;
+    int num_blocks = 5 + Random(40);
+    for (int block = 0; block < num_blocks; ++block) {
+        switch (Random(10)) {
+        case 0:
+        {
+            // Forward jump, with the target filled in once the end of the program is known
+            u32 opcode = Random(2) ? JMPC : JMPU;
+            jumps.push_back(pc);
+            program[pc++] = FlowControl(opcode, 0, 0, Random(opcode == JMPC ? 4 : 16), Random(2), Random(2));
+            break;
+        }
+
+        case 1:
+        {
+            static const u32 opcodes[] = { CALL, CALLC, CALLU };
+            const Subroutine& subroutine = subroutines[Random(4)];
+            u32 opcode = opcodes[Random(3)];
+            program[pc++] = FlowControl(opcode, subroutine.offset, subroutine.num_instructions,
+                                        Random(opcode == CALLU ? 16 : 4), Random(2), Random(2));
+            break;
+        }
+
+        case 2:
+        {
+            // The if block is followed by the else block
+            u32 num_if = Random(4), num_else = Random(4);
+            u32 opcode = Random(2) ? IFU : IFC;
+            program[pc] = FlowControl(opcode, pc + 1 + num_if, num_else, Random(opcode == IFU ? 16 : 4),
+                                      Random(2), Random(2));
+            ++pc;
+            for (u32 i = 0; i < num_if + num_else; ++i)
+                program[pc++] = RandomArithmetic(2);
+            break;
+        }
+
+        case 3:
+        {
+            // The body includes the instruction at dest_offset
+            u32 num_instructions = Random(4);
+            program[pc] = FlowControl(LOOP, pc + num_instructions, 0, Random(4), 0, 0);
+            ++pc;
+            for (u32 i = 0; i <= num_instructions; ++i)
+                program[pc++] = RandomArithmetic(3);
+            break;
+        }
+
+        case 4:
+            program[pc++] = FlowControl(NOP, 0, 0, 0, 0, 0);
+            break;
+
+        default:
+            program[pc++] = RandomArithmetic(2);
+            break;
+        }
+    }
+
+    u32 end_offset = pc;
+    program[pc++] = FlowControl(END, 0, 0, 0, 0, 0);
+    for (u32 jump : jumps) {
+        u32 target = jump + 1 + Random(end_offset - jump);
+        program[jump] = (program[jump] & ~(0xFFFu << 10)) | (target << 10);
+    }
+
+    for (u32 i = 0; i < 1024; ++i) {
+        VertexShader::SubmitShaderMemoryChange(i, program[i]);
+        VertexShader::SubmitSwizzleDataChange(i, swizzle_data[i]);
+    }
+    return main_offset;
+}
+
+/// Same comparison as the verified JIT mode: equal sign, and at most 2^7 ulp apart
+static bool ResultsMatch(float24 value, float24 reference) {
+    float a = value.ToFloat32();
+    float b = reference.ToFloat32();
+    if (a != a && b != b)
+        return true;
+
+    u32 a_bits, b_bits;
+    std::memcpy(&a_bits, &a, sizeof(a));
+    std::memcpy(&b_bits, &b, sizeof(b));
+    if ((a_bits ^ b_bits) & 0x80000000)
+        return a_bits == b_bits;
+
+    u32 difference = a_bits > b_bits ? a_bits - b_bits : b_bits - a_bits;
+    return difference <= (1 << 7);
+}
+
+int main(int argc, char** argv) {
+    Log::Filter log_filter(Log::Level::Critical);
+    Log::SetFilter(&log_filter);
+
+    const struct {
+        int setting;
+        const char* name;
+    } backends[] = {
+        { 1, "jit" },
+        { 3, "simd" },
+        { 4, "decoded" },
+        { 5, "simd avx" },
+    };
+
+    int num_programs = (argc > 1) ? std::atoi(argv[1]) : 2000;
+
+    u64 input_register_map = 0;
+    for (u64 i = 0; i < 16; ++i)
+        input_register_map |= i << (4 * i);
+    std::memcpy(&Pica::registers.vs_input_register_map, &input_register_map, sizeof(input_register_map));
+
+    int failures = 0;
+    long num_compared = 0;
+    for (int program = 0; program < num_programs; ++program) {
+        Pica::registers.vs_main_offset = GenerateProgram();
+
+        for (u32 i = 0; i < 96; ++i) {
+            VertexShader::GetFloatUniform(i) = {
+                float24::FromFloat32(RandomFloat()), float24::FromFloat32(RandomFloat()),
+                float24::FromFloat32(RandomFloat()), float24::FromFloat32(RandomFloat()) };
+        }
+        // Address register offsets used by the programs
+        VertexShader::GetFloatUniform(95) = {
+            float24::FromFloat32(1.0f), float24::FromFloat32(2.0f),
+            float24::FromFloat32(0.0f), float24::FromFloat32(0.0f) };
+        for (u32 i = 0; i < 16; ++i)
+            VertexShader::GetBoolUniform(i) = Random(2) != 0;
+        for (u32 i = 0; i < 4; ++i)
+            VertexShader::GetIntUniform(i) = { (u8)Random(4), (u8)Random(5), (u8)Random(3), 0 };
+
+        // Each output register is mapped to random semantics, only those are compared
+        std::set<u32> semantics;
+        for (int i = 0; i < 7; ++i) {
+            Regs::VSOutputAttributes::Semantic map[4];
+            for (auto& semantic : map) {
+                semantic = (Regs::VSOutputAttributes::Semantic)(Random(5) ? Random(24) : Regs::VSOutputAttributes::INVALID);
+                if (semantic != Regs::VSOutputAttributes::INVALID)
+                    semantics.insert(semantic);
+            }
+            Pica::registers.vs_output_attributes[i].map_x = map[0];
+            Pica::registers.vs_output_attributes[i].map_y = map[1];
+            Pica::registers.vs_output_attributes[i].map_z = map[2];
+            Pica::registers.vs_output_attributes[i].map_w = map[3];
+        }
+
+        VertexShader::InputVertex inputs[VertexShader::MAX_SHADER_BATCH_SIZE];
+        for (auto& input : inputs) {
+            for (auto& attribute : input.attr) {
+                for (int i = 0; i < 4; ++i)
+                    attribute[i] = float24::FromFloat32(RandomFloat());
+            }
+        }
+
+        const int num_vertices = VertexShader::MAX_SHADER_BATCH_SIZE;
+        VertexShader::OutputVertex reference[num_vertices];
+        Settings::values.vertex_shader_backend = 0;
+        VertexShader::ShaderSetup setup;
+        VertexShader::CaptureShaderSetup(setup);
+        VertexShader::RunShaderBatch(setup, inputs, num_vertices, 16, reference);
+
+        for (const auto& backend : backends) {
+            Settings::values.vertex_shader_backend = backend.setting;
+            VertexShader::CaptureShaderSetup(setup);
+            VertexShader::OutputVertex outputs[num_vertices];
+            VertexShader::RunShaderBatch(setup, inputs, num_vertices, 16, outputs);
+
+            for (int vertex = 0; vertex < num_vertices; ++vertex) {
+                for (u32 semantic : semantics) {
+                    float24 value = ((const float24*)&outputs[vertex])[semantic];
+                    float24 expected = ((const float24*)&reference[vertex])[semantic];
+                    ++num_compared;
+                    if (ResultsMatch(value, expected))
+                        continue;
+
+                    if (failures++ < 10) {
+                        std::printf("FAIL: %s backend, program %d, vertex %d, semantic %u: %a instead of %a\n",
+                                    backend.name, program, vertex, semantic, value.ToFloat32(),
+                                    expected.ToFloat32());
+                    }
+                }
+            }
+        }
+    }
+
+    if (failures == 0)
+        std::printf("OK (%ld outputs compared)\n", num_compared);
+    return failures == 0 ? 0 : 1;
+}
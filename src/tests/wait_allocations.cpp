@@ -0,0 +1,133 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+// Checks that waiting on kernel objects doesn't allocate once a thread has waited on as many
+// objects before. A thread waits on a varying number of events with WaitSynchronizationN
+// semantics, the idle thread runs while it waits, and signaling one of the events wakes it up.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "common/logging/backend.h"
+#include "common/logging/filter.h"
+
+#include "core/core.h"
+#include "core/core_timing.h"
+#include "core/mem_map.h"
+#include "core/hle/kernel/event.h"
+#include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/thread.h"
+
+static std::atomic<u64> allocation_count{0};
+
+void* operator new(std::size_t size) {
+    ++allocation_count;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+/**
+ * Waits the main thread on the first num_objects events, then signals one of them
+ * @return Number of heap allocations made
+ */
+static u64 WaitAndWake(const std::vector<Kernel::SharedPtr<Kernel::Event>>& events,
+                       size_t num_objects, size_t signaled) {
+    Kernel::Thread* thread = Kernel::GetCurrentThread();
+    u64 allocations_before = allocation_count;
+
+    Kernel::WaitObjectList wait_objects(events.begin(), events.begin() + num_objects);
+    Kernel::WaitCurrentThread_WaitSynchronization(wait_objects, true, false);
+    Kernel::Reschedule();
+
+    events[signaled]->Signal();
+    Kernel::Reschedule();
+
+    u64 allocations = allocation_count - allocations_before;
+
+    if (Kernel::GetCurrentThread() != thread ||
+        thread->context.cpu_registers[1] != static_cast<u32>(signaled)) {
+        std::printf("FAIL: thread not woken up by event %u of %u\n",
+                    (unsigned)signaled, (unsigned)num_objects);
+        std::exit(1);
+    }
+    return allocations;
+}
+
+int main(int argc, char** argv) {
+    Log::Filter log_filter(Log::Level::Critical);
+    Log::SetFilter(&log_filter);
+
+    Core::Init();
+    CoreTiming::Init();
+    Memory::Init();
+    Kernel::Init();
+
+    std::vector<Kernel::SharedPtr<Kernel::Event>> events;
+    for (size_t i = 0; i < Kernel::MAX_WAIT_OBJECTS; ++i)
+        events.push_back(Kernel::Event::Create(RESETTYPE_ONESHOT));
+    Kernel::SetupMainThread(Memory::HEAP_VADDR, THREADPRIO_DEFAULT);
+
+    const size_t wait_sizes[] = { 1, 2, 4, 5, 16, 64, 7, 3, 1, 64, 32 };
+
+    // The thread object itself is the only storage needed for small waits
+    int failures = 0;
+    for (size_t num_objects : { 1, 2, 4 }) {
+        u64 allocations = WaitAndWake(events, num_objects, num_objects - 1);
+        if (allocations != 0) {
+            std::printf("FAIL: waiting on %u objects made %u allocations\n",
+                        (unsigned)num_objects, (unsigned)allocations);
+            ++failures;
+        }
+    }
+
+    // Larger waits allocate once, and only when growing past the largest wait so far
+    size_t largest_wait = 4;
+    for (int round = 0; round < 100; ++round) {
+        for (size_t num_objects : wait_sizes) {
+            u64 allocations = WaitAndWake(events, num_objects, (round * 7) % num_objects);
+            u64 expected = num_objects > largest_wait ? 1 : 0;
+            largest_wait = std::max(largest_wait, num_objects);
+            if (allocations != expected) {
+                std::printf("FAIL: waiting on %u objects made %u allocations, expected %u\n",
+                            (unsigned)num_objects, (unsigned)allocations, (unsigned)expected);
+                ++failures;
+            }
+        }
+    }
+
+    events.clear();
+    Kernel::Shutdown();
+    Memory::Shutdown();
+    CoreTiming::Shutdown();
+    Core::Shutdown();
+
+    if (failures == 0)
+        std::printf("OK\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -5,6 +5,7 @@
 #include <boost/container/static_vector.hpp>
 
 #include "clipper.h"
+#include "draw_stats.h"
 #include "pica.h"
 #include "rasterizer.h"
 #include "vertex_shader.h"
@@ -110,6 +111,10 @@ void ProcessTriangle(OutputVertex &v0, OutputVertex &v1, OutputVertex &v2) {
     //       drop the whole primitive instead of clipping the primitive properly. We should test if
     //       this happens on the 3DS, too.
 
+    DrawStatistics& draw_stats = DrawStats::g_current_draw;
+    ++draw_stats.triangles_in;
+    bool clipped = false;
+
     // Simple implementation of the Sutherland-Hodgman clipping algorithm.
     // TODO: Make this less inefficient (currently lots of useless buffering overhead happens here)
     for (auto edge : clipping_edges) {
@@ -127,17 +132,24 @@ void ProcessTriangle(OutputVertex &v0, OutputVertex &v1, OutputVertex &v2) {
                 }
 
                 output_list->push_back(vertex);
-            } else if (edge.IsInside(*reference_vertex)) {
-                output_list->push_back(edge.GetIntersection(vertex, *reference_vertex));
+            } else {
+                clipped = true;
+                if (edge.IsInside(*reference_vertex))
+                    output_list->push_back(edge.GetIntersection(vertex, *reference_vertex));
             }
             reference_vertex = &vertex;
         }
 
         // Need to have at least a full triangle to continue...
-        if (output_list->size() < 3)
+        if (output_list->size() < 3) {
+            ++draw_stats.triangles_culled;
             return;
+        }
     }
 
+    if (clipped)
+        ++draw_stats.triangles_clipped;
+
     InitScreenCoordinates((*output_list)[0]);
     InitScreenCoordinates((*output_list)[1]);
 
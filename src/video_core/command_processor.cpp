@@ -2,18 +2,27 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
-#include <boost/range/algorithm/fill.hpp>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <vector>
 
+#include "common/make_unique.h"
 #include "common/profiler.h"
+#include "common/thread_pool.h"
 
 #include "clipper.h"
 #include "command_processor.h"
+#include "draw_stats.h"
 #include "math.h"
 #include "pica.h"
 #include "primitive_assembly.h"
+#include "rasterizer.h"
+#include "vertex_loader.h"
 #include "vertex_shader.h"
 #include "core/hle/service/gsp_gpu.h"
 #include "core/hw/gpu.h"
+#include "core/settings.h"
 
 #include "debug_utils/debug_utils.h"
 
@@ -31,7 +40,86 @@ static int default_attr_counter = 0;
 
 static u32 default_attr_write_buffer[3];
 
+/// Number of entries of the post-transform vertex cache, must be a power of two
+static const size_t VERTEX_CACHE_SIZE = 1024;
+static const u32 VERTEX_CACHE_INVALID_TAG = 0xFFFFFFFF;
+
+struct VertexCacheEntry {
+    VertexShader::OutputVertex output;
+    DebugUtils::GeometryDumper::Vertex dumped_vertex;
+};
+
+/**
+ * Post-transform vertex cache used by indexed draws, direct-mapped on the vertex index. Entries are
+ * only valid within a draw since the shader setup can change between draws. The tags are kept
+ * apart from the entries so that they can be cleared cheaply at the start of each draw.
+ */
+static std::array<u32, VERTEX_CACHE_SIZE> vertex_cache_tags;
+static std::array<VertexCacheEntry, VERTEX_CACHE_SIZE> vertex_cache;
+
+/// Shader state of the current draw, read by all threads processing its vertices
+static VertexShader::ShaderSetup shader_setup;
+
+/// Draws with fewer vertices than this are processed on the emulation thread, since handing them
+/// to the worker threads would cost more than it saves
+static const u32 MIN_PARALLEL_VERTICES = 256;
+/// Number of vertices shaded by each task of a parallel draw
+static const u32 VERTICES_PER_TASK = 64;
+
+static std::unique_ptr<Common::ThreadPool> vertex_thread_pool;
+
+// Buffers of parallel draws, kept around to avoid reallocating them for every draw
+static std::vector<u32> shaded_vertex_ids;
+static std::vector<u32> shaded_vertex_of_index;
+static std::vector<VertexShader::OutputVertex> shaded_outputs;
+static std::vector<DebugUtils::GeometryDumper::Vertex> shaded_dumped_vertices;
+
 Common::Profiling::TimingCategory category_drawing("Drawing");
+static Common::Profiling::ScopeCategory profile_process_command_list("ProcessCommandList");
+
+/**
+ * Returns the thread pool to process large draws with, or nullptr if vertices should be processed
+ * on the emulation thread only.
+ */
+static Common::ThreadPool* GetVertexThreadPool() {
+    unsigned num_threads = Settings::values.vertex_processing_threads > 0
+                         ? Settings::values.vertex_processing_threads
+                         : std::thread::hardware_concurrency();
+    if (num_threads <= 1)
+        return nullptr;
+
+    if (vertex_thread_pool == nullptr || vertex_thread_pool->GetNumThreads() != num_threads)
+        vertex_thread_pool = Common::make_unique<Common::ThreadPool>(num_threads);
+    return vertex_thread_pool.get();
+}
+
+/// Loads the input attributes of a vertex
+static void LoadVertex(const VertexLoader& vertex_loader, u32 vertex, VertexShader::InputVertex& input) {
+    // Load a debugging token to check whether this gets loaded by the running
+    // application or not.
+    static const float24 debug_token = float24::FromRawFloat24(0x00abcdef);
+    input.attr[0].w = debug_token;
+
+    vertex_loader.LoadVertex(vertex, input);
+
+    // HACK: Some games do not initialize the vertex position's w component. This leads
+    //       to critical issues since it messes up perspective division. As a
+    //       workaround, we force the fourth component to 1.0 if we find this to be the
+    //       case.
+    //       To do this, we additionally have to assume that the first input attribute
+    //       is the vertex position, since there's no information about this other than
+    //       the empiric observation that this is usually the case.
+    if (input.attr[0].w == debug_token)
+        input.attr[0].w = float24::FromFloat32(1.0);
+}
+
+static DebugUtils::GeometryDumper::Vertex GetDumpedVertex(const VertexShader::InputVertex& input) {
+    // NOTE: When dumping geometry, we simply assume that the first input attribute
+    //       corresponds to the position for now.
+    return {
+        input.attr[0][0].ToFloat32(), input.attr[0][1].ToFloat32(), input.attr[0][2].ToFloat32()
+    };
+}
 
 static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
 
@@ -54,6 +142,8 @@ static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
     switch(id) {
         // Trigger IRQ
         case PICA_REG_INDEX(trigger_irq):
+            // The application may access the render targets once it's told that rendering finished
+            Rasterizer::WaitForIdle();
             GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::P3D);
             return;
 
@@ -62,41 +152,20 @@ static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
         case PICA_REG_INDEX(trigger_draw_indexed):
         {
             Common::Profiling::ScopeTimer scope_timer(category_drawing);
+            DrawStats::BeginDraw(id);
 
             DebugUtils::DumpTevStageConfig(registers.GetTevStages());
 
             if (g_debug_context)
                 g_debug_context->OnEvent(DebugContext::Event::IncomingPrimitiveBatch, nullptr);
 
-            const auto& attribute_config = registers.vertex_attributes;
-            const u32 base_address = attribute_config.GetPhysicalBaseAddress();
-
-            // Information about internal vertex attributes
-            u32 vertex_attribute_sources[16];
-            boost::fill(vertex_attribute_sources, 0xdeadbeef);
-            u32 vertex_attribute_strides[16];
-            Regs::VertexAttributeFormat vertex_attribute_formats[16];
-
-            u32 vertex_attribute_elements[16];
-            u32 vertex_attribute_element_size[16];
-
-            // Setup attribute data from loaders
-            for (int loader = 0; loader < 12; ++loader) {
-                const auto& loader_config = attribute_config.attribute_loaders[loader];
-
-                u32 load_address = base_address + loader_config.data_offset;
-
-                // TODO: What happens if a loader overwrites a previous one's data?
-                for (unsigned component = 0; component < loader_config.component_count; ++component) {
-                    u32 attribute_index = loader_config.GetComponent(component);
-                    vertex_attribute_sources[attribute_index] = load_address;
-                    vertex_attribute_strides[attribute_index] = static_cast<u32>(loader_config.byte_count);
-                    vertex_attribute_formats[attribute_index] = attribute_config.GetFormat(attribute_index);
-                    vertex_attribute_elements[attribute_index] = attribute_config.GetNumElements(attribute_index);
-                    vertex_attribute_element_size[attribute_index] = attribute_config.GetElementSizeInBytes(attribute_index);
-                    load_address += attribute_config.GetStride(attribute_index);
-                }
-            }
+            const u32 base_address = registers.vertex_attributes.GetPhysicalBaseAddress();
+
+            VertexLoader vertex_loader;
+            vertex_loader.Setup();
+            const int num_attributes = vertex_loader.GetNumTotalAttributes();
+
+            VertexShader::CaptureShaderSetup(shader_setup);
 
             // Load vertices
             bool is_indexed = (id == PICA_REG_INDEX(trigger_draw_indexed));
@@ -105,88 +174,147 @@ static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
             const u8* index_address_8 = Memory::GetPhysicalPointer(base_address + index_info.offset);
             const u16* index_address_16 = (u16*)index_address_8;
             bool index_u16 = index_info.format != 0;
+            auto get_vertex = [&](u32 index) -> u32 {
+                return is_indexed ? (index_u16 ? index_address_16[index] : index_address_8[index]) : index;
+            };
 
             DebugUtils::GeometryDumper geometry_dumper;
             PrimitiveAssembler<VertexShader::OutputVertex> clipper_primitive_assembler(registers.triangle_topology.Value());
             PrimitiveAssembler<DebugUtils::GeometryDumper::Vertex> dumping_primitive_assembler(registers.triangle_topology.Value());
 
-            for (unsigned int index = 0; index < registers.num_vertices; ++index)
-            {
-                unsigned int vertex = is_indexed ? (index_u16 ? index_address_16[index] : index_address_8[index]) : index;
-
-                if (is_indexed) {
-                    // TODO: Implement some sort of vertex cache!
-                }
-
-                // Initialize data for the current vertex
-                VertexShader::InputVertex input;
-
-                // Load a debugging token to check whether this gets loaded by the running
-                // application or not.
-                static const float24 debug_token = float24::FromRawFloat24(0x00abcdef);
-                input.attr[0].w = debug_token;
-
-                for (int i = 0; i < attribute_config.GetNumTotalAttributes(); ++i) {
-                    if (attribute_config.IsDefaultAttribute(i)) {
-                        input.attr[i] = VertexShader::GetDefaultAttribute(i);
-                        LOG_TRACE(HW_GPU, "Loaded default attribute %x for vertex %x (index %x): (%f, %f, %f, %f)",
-                                  i, vertex, index,
-                                  input.attr[i][0].ToFloat32(), input.attr[i][1].ToFloat32(),
-                                  input.attr[i][2].ToFloat32(), input.attr[i][3].ToFloat32());
-                    } else {
-                        for (unsigned int comp = 0; comp < vertex_attribute_elements[i]; ++comp) {
-                            const u8* srcdata = Memory::GetPhysicalPointer(vertex_attribute_sources[i] + vertex_attribute_strides[i] * vertex + comp * vertex_attribute_element_size[i]);
-
-                            const float srcval = (vertex_attribute_formats[i] == Regs::VertexAttributeFormat::BYTE) ? *(s8*)srcdata :
-                                (vertex_attribute_formats[i] == Regs::VertexAttributeFormat::UBYTE) ? *(u8*)srcdata :
-                                (vertex_attribute_formats[i] == Regs::VertexAttributeFormat::SHORT) ? *(s16*)srcdata :
-                                *(float*)srcdata;
-
-                            input.attr[i][comp] = float24::FromFloat32(srcval);
-                            LOG_TRACE(HW_GPU, "Loaded component %x of attribute %x for vertex %x (index %x) from 0x%08x + 0x%08lx + 0x%04lx: %f",
-                                      comp, i, vertex, index,
-                                      attribute_config.GetPhysicalBaseAddress(),
-                                      vertex_attribute_sources[i] - base_address,
-                                      vertex_attribute_strides[i] * vertex + comp * vertex_attribute_element_size[i],
-                                      input.attr[i][comp].ToFloat32());
+            using namespace std::placeholders;
+            const auto add_dumped_triangle = std::bind(&DebugUtils::GeometryDumper::AddTriangle,
+                                                       &geometry_dumper, _1, _2, _3);
+
+            // Resolved once per draw to keep the debugging hooks out of the per-vertex path when
+            // they are disabled
+            const bool dump_geometry = DebugUtils::GeometryDumper::IsEnabled();
+            const bool break_on_vertex_loaded = g_debug_context &&
+                    g_debug_context->breakpoints[DebugContext::Event::VertexLoaded].enabled;
+
+            if (is_indexed)
+                vertex_cache_tags.fill(VERTEX_CACHE_INVALID_TAG);
+
+            // Breakpoints need to be hit on the emulation thread in vertex order, hence parallel
+            // processing is disabled while the VertexLoaded breakpoint is enabled
+            Common::ThreadPool* thread_pool = nullptr;
+            if (registers.num_vertices >= MIN_PARALLEL_VERTICES && !break_on_vertex_loaded)
+                thread_pool = GetVertexThreadPool();
+
+            // The SIMD interpreter needs several vertices at once, hence it also uses the bulk path
+            const bool shade_in_bulk = !break_on_vertex_loaded &&
+                    (thread_pool != nullptr || shader_setup.backend == VertexShader::ShaderBackend::SimdInterpreter ||
+                     shader_setup.backend == VertexShader::ShaderBackend::AvxInterpreter);
+
+            if (shade_in_bulk) {
+                // Vertices are independent until primitive assembly, so they are all loaded and
+                // shaded first (in parallel if possible), and then assembled in order. Indexed draws
+                // replay the lookups of the vertex cache to find out which vertices need to be
+                // shaded, so that the same vertices are shaded as in the serial path.
+                shaded_vertex_ids.clear();
+                shaded_vertex_of_index.resize(registers.num_vertices);
+
+                std::array<u32, VERTEX_CACHE_SIZE> cached_shaded_vertex;
+                for (unsigned int index = 0; index < registers.num_vertices; ++index) {
+                    u32 vertex = get_vertex(index);
+                    if (is_indexed) {
+                        size_t cache_slot = vertex & (VERTEX_CACHE_SIZE - 1);
+                        if (vertex_cache_tags[cache_slot] == vertex) {
+                            shaded_vertex_of_index[index] = cached_shaded_vertex[cache_slot];
+                            continue;
                         }
+                        vertex_cache_tags[cache_slot] = vertex;
+                        cached_shaded_vertex[cache_slot] = (u32)shaded_vertex_ids.size();
                     }
+                    shaded_vertex_of_index[index] = (u32)shaded_vertex_ids.size();
+                    shaded_vertex_ids.push_back(vertex);
                 }
 
-                // HACK: Some games do not initialize the vertex position's w component. This leads
-                //       to critical issues since it messes up perspective division. As a
-                //       workaround, we force the fourth component to 1.0 if we find this to be the
-                //       case.
-                //       To do this, we additionally have to assume that the first input attribute
-                //       is the vertex position, since there's no information about this other than
-                //       the empiric observation that this is usually the case.
-                if (input.attr[0].w == debug_token)
-                    input.attr[0].w = float24::FromFloat32(1.0);
-
-                if (g_debug_context)
-                    g_debug_context->OnEvent(DebugContext::Event::VertexLoaded, (void*)&input);
-
-                // NOTE: When dumping geometry, we simply assume that the first input attribute
-                //       corresponds to the position for now.
-                DebugUtils::GeometryDumper::Vertex dumped_vertex = {
-                    input.attr[0][0].ToFloat32(), input.attr[0][1].ToFloat32(), input.attr[0][2].ToFloat32()
+                const u32 num_shaded = (u32)shaded_vertex_ids.size();
+                shaded_outputs.resize(num_shaded);
+                if (dump_geometry)
+                    shaded_dumped_vertices.resize(num_shaded);
+
+                const auto shade_vertices = [&](unsigned task) {
+                    const u32 end = std::min(num_shaded, (task + 1) * VERTICES_PER_TASK);
+                    for (u32 first = task * VERTICES_PER_TASK; first < end; first += VertexShader::MAX_SHADER_BATCH_SIZE) {
+                        const int batch_size = (int)std::min<u32>(end - first, VertexShader::MAX_SHADER_BATCH_SIZE);
+
+                        VertexShader::InputVertex inputs[VertexShader::MAX_SHADER_BATCH_SIZE];
+                        for (int i = 0; i < batch_size; ++i) {
+                            LoadVertex(vertex_loader, shaded_vertex_ids[first + i], inputs[i]);
+                            if (dump_geometry)
+                                shaded_dumped_vertices[first + i] = GetDumpedVertex(inputs[i]);
+                        }
+                        VertexShader::RunShaderBatch(shader_setup, inputs, batch_size, num_attributes, &shaded_outputs[first]);
+                    }
                 };
-                using namespace std::placeholders;
-                dumping_primitive_assembler.SubmitVertex(dumped_vertex,
-                                                         std::bind(&DebugUtils::GeometryDumper::AddTriangle,
-                                                                   &geometry_dumper, _1, _2, _3));
 
-                // Send to vertex shader
-                VertexShader::OutputVertex output = VertexShader::RunShader(input, attribute_config.GetNumTotalAttributes());
+                const unsigned num_tasks = (num_shaded + VERTICES_PER_TASK - 1) / VERTICES_PER_TASK;
+                if (thread_pool != nullptr) {
+                    thread_pool->ParallelFor(num_tasks, shade_vertices);
+                } else {
+                    for (unsigned task = 0; task < num_tasks; ++task)
+                        shade_vertices(task);
+                }
 
-                if (is_indexed) {
-                    // TODO: Add processed vertex to vertex cache!
+                DrawStats::g_current_draw.vertices_loaded += num_shaded;
+                DrawStats::g_current_draw.vertices_shaded += num_shaded;
+                DrawStats::g_current_draw.vertex_cache_hits += registers.num_vertices - num_shaded;
+
+                for (unsigned int index = 0; index < registers.num_vertices; ++index) {
+                    u32 shaded_vertex = shaded_vertex_of_index[index];
+                    if (dump_geometry)
+                        dumping_primitive_assembler.SubmitVertex(shaded_dumped_vertices[shaded_vertex], add_dumped_triangle);
+                    clipper_primitive_assembler.SubmitVertex(shaded_outputs[shaded_vertex], Clipper::ProcessTriangle);
                 }
+            } else {
+                for (unsigned int index = 0; index < registers.num_vertices; ++index) {
+                    unsigned int vertex = get_vertex(index);
+
+                    // Indexed meshes usually reference each vertex several times, reuse the output of
+                    // the vertex shader if this vertex was already processed in this draw
+                    size_t cache_slot = vertex & (VERTEX_CACHE_SIZE - 1);
+                    if (is_indexed && vertex_cache_tags[cache_slot] == vertex) {
+                        VertexCacheEntry& entry = vertex_cache[cache_slot];
+                        ++DrawStats::g_current_draw.vertex_cache_hits;
+                        if (dump_geometry)
+                            dumping_primitive_assembler.SubmitVertex(entry.dumped_vertex, add_dumped_triangle);
+                        clipper_primitive_assembler.SubmitVertex(entry.output, Clipper::ProcessTriangle);
+                        continue;
+                    }
+
+                    // Initialize data for the current vertex
+                    VertexShader::InputVertex input;
+                    ++DrawStats::g_current_draw.vertices_loaded;
+
+                    LoadVertex(vertex_loader, vertex, input);
 
-                // Send to triangle clipper
-                clipper_primitive_assembler.SubmitVertex(output, Clipper::ProcessTriangle);
+                    if (break_on_vertex_loaded)
+                        g_debug_context->OnEvent(DebugContext::Event::VertexLoaded, (void*)&input);
+
+                    DebugUtils::GeometryDumper::Vertex dumped_vertex = GetDumpedVertex(input);
+                    if (dump_geometry)
+                        dumping_primitive_assembler.SubmitVertex(dumped_vertex, add_dumped_triangle);
+
+                    // Send to vertex shader
+                    VertexShader::OutputVertex output = VertexShader::RunShader(shader_setup, input, num_attributes);
+                    ++DrawStats::g_current_draw.vertices_shaded;
+
+                    if (is_indexed) {
+                        vertex_cache_tags[cache_slot] = vertex;
+                        vertex_cache[cache_slot].output = output;
+                        vertex_cache[cache_slot].dumped_vertex = dumped_vertex;
+                    }
+
+                    // Send to triangle clipper
+                    clipper_primitive_assembler.SubmitVertex(output, Clipper::ProcessTriangle);
+                }
             }
-            geometry_dumper.Dump();
+            if (dump_geometry)
+                geometry_dumper.Dump();
+            Rasterizer::SubmitTriangles();
+            DrawStats::EndDraw();
 
             if (g_debug_context)
                 g_debug_context->OnEvent(DebugContext::Event::FinishedPrimitiveBatch, nullptr);
@@ -243,9 +371,10 @@ static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
                 }
 
                 // NOTE: The destination component order indeed is "backwards"
+                // Float32 uniforms are converted to the float24 precision the shader units work with
                 if (uniform_setup.IsFloat32()) {
                     for (auto i : {0,1,2,3})
-                        uniform[3 - i] = float24::FromFloat32(*(float*)(&uniform_write_buffer[i]));
+                        uniform[3 - i] = float24::FromFloat32(*(float*)(&uniform_write_buffer[i])).Truncate();
                 } else {
                     // TODO: Untested
                     uniform.w = float24::FromRawFloat24(uniform_write_buffer[0] >> 8);
@@ -369,6 +498,8 @@ static std::ptrdiff_t ExecuteCommandBlock(const u32* first_command_word) {
 }
 
 void ProcessCommandList(const u32* list, u32 size) {
+    Common::Profiling::ProfileScope scope(profile_process_command_list);
+
     u32* read_pointer = (u32*)list;
     u32 list_length = size / sizeof(u32);
 
@@ -377,6 +508,10 @@ void ProcessCommandList(const u32* list, u32 size) {
     }
 }
 
+void Shutdown() {
+    vertex_thread_pool.reset();
+}
+
 } // namespace
 
 } // namespace
@@ -37,6 +37,9 @@ static_assert(sizeof(CommandHeader) == sizeof(u32), "CommandHeader has incorrect
 
 void ProcessCommandList(const u32* list, u32 size);
 
+/// Stops the threads processing the vertices of large draws
+void Shutdown();
+
 } // namespace
 
 } // namespace
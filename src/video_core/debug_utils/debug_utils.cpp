@@ -23,6 +23,7 @@
 #include "video_core/color.h"
 #include "video_core/math.h"
 #include "video_core/pica.h"
+#include "video_core/rasterizer.h"
 #include "video_core/utils.h"
 
 #include "debug_utils.h"
@@ -37,6 +38,9 @@ void DebugContext::OnEvent(Event event, void* data) {
     if (!breakpoints[event].enabled)
         return;
 
+    // Make the framebuffer contents up to date for inspection
+    Rasterizer::WaitForIdle();
+
     {
         std::unique_lock<std::mutex> lock(breakpoint_mutex);
 
@@ -75,6 +79,12 @@ std::shared_ptr<DebugContext> g_debug_context; // TODO: Get rid of this global
 
 namespace DebugUtils {
 
+bool GeometryDumper::IsEnabled() {
+    // NOTE: Permanently enabling this just trashes the hard disk for no reason.
+    //       Hence, this is currently disabled.
+    return false;
+}
+
 void GeometryDumper::AddTriangle(Vertex& v0, Vertex& v1, Vertex& v2) {
     vertices.push_back(v0);
     vertices.push_back(v1);
@@ -85,9 +95,8 @@ void GeometryDumper::AddTriangle(Vertex& v0, Vertex& v1, Vertex& v2) {
 }
 
 void GeometryDumper::Dump() {
-    // NOTE: Permanently enabling this just trashes the hard disk for no reason.
-    //       Hence, this is currently disabled.
-    return;
+    if (!IsEnabled())
+        return;
 
     static int index = 0;
     std::string filename = std::string("geometry_dump") + std::to_string(++index) + ".obj";
@@ -156,6 +156,9 @@ public:
         std::array<float,3> pos;
     };
 
+    /// Whether geometry dumping is enabled, the draw loop only collects triangles when it is
+    static bool IsEnabled();
+
     void AddTriangle(Vertex& v0, Vertex& v1, Vertex& v2);
 
     void Dump();
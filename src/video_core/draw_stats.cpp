@@ -0,0 +1,104 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <mutex>
+
+#include "common/profiler.h"
+
+#include "video_core/draw_stats.h"
+#include "video_core/pica.h"
+
+namespace Pica {
+
+namespace DrawStats {
+
+DrawStatistics g_current_draw;
+
+static std::vector<DrawStatistics> current_frame_draws;
+
+static std::vector<DrawStatistics> previous_frame_draws;
+static std::mutex previous_frame_mutex;
+
+static Common::Profiling::Counter counter_draw_calls("draw_calls");
+static Common::Profiling::Counter counter_vertices_loaded("vertices_loaded");
+static Common::Profiling::Counter counter_vertices_shaded("vertices_shaded");
+static Common::Profiling::Counter counter_vertex_cache_hits("vertex_cache_hits");
+static Common::Profiling::Counter counter_triangles("triangles");
+static Common::Profiling::Counter counter_triangles_clipped("triangles_clipped");
+static Common::Profiling::Counter counter_triangles_culled("triangles_culled");
+static Common::Profiling::Counter counter_pixels_shaded("pixels_shaded");
+static Common::Profiling::Counter counter_depth_test_rejects("depth_test_rejects");
+static Common::Profiling::Counter counter_early_depth_test_rejects("early_depth_test_rejects");
+static Common::Profiling::Counter counter_fragments_passed("fragments_passed");
+static Common::Profiling::Counter counter_texture_lookups("texture_lookups");
+
+void BeginDraw(u32 trigger_id) {
+    g_current_draw = DrawStatistics();
+    g_current_draw.draw_index = (u32)current_frame_draws.size();
+    g_current_draw.trigger_id = trigger_id;
+    g_current_draw.color_buffer_address = registers.framebuffer.GetColorBufferPhysicalAddress();
+    g_current_draw.framebuffer_pixels = registers.framebuffer.width * registers.framebuffer.height;
+}
+
+static void AddFragmentCounters(const DrawStatistics& stats) {
+    counter_pixels_shaded.Add(stats.fragments_tested);
+    counter_depth_test_rejects.Add(stats.depth_test_rejects);
+    counter_early_depth_test_rejects.Add(stats.early_depth_test_rejects);
+    counter_fragments_passed.Add(stats.fragments_passed);
+    counter_texture_lookups.Add(stats.texture_lookups[0] + stats.texture_lookups[1] +
+                                stats.texture_lookups[2]);
+}
+
+void EndDraw() {
+    const DrawStatistics& draw = g_current_draw;
+
+    counter_draw_calls.Add();
+    counter_vertices_loaded.Add(draw.vertices_loaded);
+    counter_vertices_shaded.Add(draw.vertices_shaded);
+    counter_vertex_cache_hits.Add(draw.vertex_cache_hits);
+    counter_triangles.Add(draw.triangles_in);
+    counter_triangles_clipped.Add(draw.triangles_clipped);
+    counter_triangles_culled.Add(draw.triangles_culled);
+    AddFragmentCounters(draw);
+
+    current_frame_draws.push_back(draw);
+}
+
+void AddRasterizerStatistics(u32 draw_index, const DrawStatistics& stats) {
+    // The counters of the current draw are only reported once it ends
+    bool draw_ended = draw_index < current_frame_draws.size();
+    DrawStatistics& draw = draw_ended ? current_frame_draws[draw_index] : g_current_draw;
+
+    draw.fragments_tested += stats.fragments_tested;
+    draw.alpha_test_rejects += stats.alpha_test_rejects;
+    draw.depth_test_rejects += stats.depth_test_rejects;
+    draw.early_depth_test_rejects += stats.early_depth_test_rejects;
+    draw.fragments_passed += stats.fragments_passed;
+    for (int i = 0; i < 3; ++i)
+        draw.texture_lookups[i] += stats.texture_lookups[i];
+
+    if (draw_ended)
+        AddFragmentCounters(stats);
+}
+
+void FinishFrame() {
+    {
+        std::lock_guard<std::mutex> lock(previous_frame_mutex);
+        previous_frame_draws.swap(current_frame_draws);
+    }
+    current_frame_draws.clear();
+}
+
+std::vector<DrawStatistics> GetPreviousFrameDraws() {
+    std::lock_guard<std::mutex> lock(previous_frame_mutex);
+    return previous_frame_draws;
+}
+
+const std::vector<DrawStatistics>& GetCurrentFrameDraws() {
+    return current_frame_draws;
+}
+
+} // namespace DrawStats
+
+} // namespace Pica
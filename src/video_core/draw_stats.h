@@ -0,0 +1,107 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "common/common_types.h"
+
+namespace Pica {
+
+/// Statistics collected while processing a single draw call
+struct DrawStatistics {
+    /// Index of the draw call in its frame
+    u32 draw_index = 0;
+
+    /// Pica command triggering the draw (trigger_draw or trigger_draw_indexed)
+    u32 trigger_id = 0;
+
+    /// Color buffer the draw rendered to, and its size in pixels
+    PAddr color_buffer_address = 0;
+    u32 framebuffer_pixels = 0;
+
+    /// Vertices fetched by the vertex loader
+    u32 vertices_loaded = 0;
+    /// Vertices processed by the vertex shader
+    u32 vertices_shaded = 0;
+    /// Vertices of indexed draws which were taken from the post-transform vertex cache instead
+    u32 vertex_cache_hits = 0;
+
+    /// Triangles submitted to the clipper
+    u32 triangles_in = 0;
+    /// Triangles which crossed a clipping plane and were split into new triangles
+    u32 triangles_clipped = 0;
+    /// Triangles discarded because they were entirely outside the clip volume or back-facing
+    u32 triangles_culled = 0;
+    /// Triangles which reached the rasterization loop
+    u32 triangles_rasterized = 0;
+
+    /// Pixels inside the bounding boxes of the rasterized triangles, which are all tested
+    u64 bounding_box_pixels = 0;
+    /// Pixels covered by a rasterized triangle
+    u64 fragments_tested = 0;
+    u64 alpha_test_rejects = 0;
+    u64 depth_test_rejects = 0;
+    /// Depth test rejects which happened before texturing and the texture combiners
+    u64 early_depth_test_rejects = 0;
+    /// Fragments written to the framebuffer
+    u64 fragments_passed = 0;
+
+    /// Texels fetched from each texture unit
+    std::array<u64, 3> texture_lookups{};
+
+    /// Fraction of the vertices which were taken from the post-transform vertex cache
+    float GetVertexCacheHitRate() const {
+        u32 total = vertex_cache_hits + vertices_loaded;
+        return total != 0 ? (float)vertex_cache_hits / total : 0.0f;
+    }
+
+    /// Fraction of the tested bounding box pixels which were covered by their triangle
+    float GetBoundingBoxUtilization() const {
+        return bounding_box_pixels != 0 ? (float)fragments_tested / bounding_box_pixels : 0.0f;
+    }
+
+    /// Average number of times each framebuffer pixel was written by this draw
+    float GetOverdraw() const {
+        return framebuffer_pixels != 0 ? (float)fragments_passed / framebuffer_pixels : 0.0f;
+    }
+};
+
+namespace DrawStats {
+
+/**
+ * Statistics of the draw call being processed. Only accessed on the thread processing Pica
+ * commands, the pipeline stages add their counts to it directly.
+ */
+extern DrawStatistics g_current_draw;
+
+/// Resets g_current_draw for a new draw call triggered by the given command
+void BeginDraw(u32 trigger_id);
+
+/// Adds g_current_draw to the statistics of the current frame and to the profiler counters
+void EndDraw();
+
+/**
+ * Adds the fragment statistics of triangles which were rasterized asynchronously to the draw with
+ * the given index in the current frame (which may still be g_current_draw).
+ */
+void AddRasterizerStatistics(u32 draw_index, const DrawStatistics& stats);
+
+/// Makes the draws of the current frame available through GetPreviousFrameDraws and starts a new frame
+void FinishFrame();
+
+/// Returns the statistics of all the draws of the last finished frame. Can be called from any thread.
+std::vector<DrawStatistics> GetPreviousFrameDraws();
+
+/**
+ * Returns the statistics of the draws processed so far in the current frame. Only safe to call
+ * while the thread processing Pica commands is paused, e.g. at a debugger breakpoint.
+ */
+const std::vector<DrawStatistics>& GetCurrentFrameDraws();
+
+} // namespace DrawStats
+
+} // namespace Pica
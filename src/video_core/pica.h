@@ -6,6 +6,7 @@
 
 #include <array>
 #include <cstddef>
+#include <cstring>
 #include <initializer_list>
 #include <map>
 #include <vector>
@@ -18,6 +19,12 @@
 
 #include "core/mem_map.h"
 
+#include "video_core/math.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
 namespace Pica {
 
 // Returns index corresponding to the Regs member labeled by field_name
@@ -955,90 +962,175 @@ struct float24 {
         if ((hex & 0xFFFFFF) == 0) {
             ret.value = 0;
         } else {
+            // Every float24 value is a normal float32, so the fields only need to be moved to
+            // their float32 positions (with the exponent bias changed from 63 to 127).
             u32 mantissa = hex & 0xFFFF;
             u32 exponent = (hex >> 16) & 0x7F;
-            u32 sign = hex >> 23;
-            ret.value = powf(2.0f, (float)exponent-63.0f) * (1.0f + mantissa * powf(2.0f, -16.f));
-            if (sign)
-                ret.value = -ret.value;
+            u32 sign = (hex >> 23) & 1;
+            u32 bits = (sign << 31) | ((exponent + 127 - 63) << 23) | (mantissa << 7);
+            std::memcpy(&ret.value, &bits, sizeof(bits));
         }
         return ret;
     }
 
-    // Not recommended for anything but logging
     float ToFloat32() const {
         return value;
     }
 
+    /**
+     * Reduces the value to the precision of an actual float24, i.e. drops the lower 7 bits of the
+     * mantissa and flushes values outside of the exponent range to zero or infinity respectively.
+     * Arithmetic is carried out at float32 precision, so this is only applied where the hardware
+     * converts float32 input to float24.
+     */
+    float24 Truncate() const {
+        u32 bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+
+        u32 sign = bits & 0x80000000;
+        u32 exponent = (bits >> 23) & 0xFF;
+        if (exponent == 0xFF) {
+            // Infinity and NaN are kept as they are
+            return *this;
+        } else if (exponent < 127 - 63) {
+            bits = sign;
+        } else if (exponent > 127 + 64) {
+            bits = sign | 0x7F800000;
+        } else {
+            bits &= 0xFFFFFF80;
+        }
+
+        float24 ret;
+        std::memcpy(&ret.value, &bits, sizeof(bits));
+        return ret;
+    }
+
     float24 operator * (const float24& flt) const {
-        return float24::FromFloat32(ToFloat32() * flt.ToFloat32());
+        return float24::FromFloat32(value * flt.value);
     }
 
     float24 operator / (const float24& flt) const {
-        return float24::FromFloat32(ToFloat32() / flt.ToFloat32());
+        return float24::FromFloat32(value / flt.value);
     }
 
     float24 operator + (const float24& flt) const {
-        return float24::FromFloat32(ToFloat32() + flt.ToFloat32());
+        return float24::FromFloat32(value + flt.value);
     }
 
     float24 operator - (const float24& flt) const {
-        return float24::FromFloat32(ToFloat32() - flt.ToFloat32());
+        return float24::FromFloat32(value - flt.value);
     }
 
     float24& operator *= (const float24& flt) {
-        value *= flt.ToFloat32();
+        value *= flt.value;
         return *this;
     }
 
     float24& operator /= (const float24& flt) {
-        value /= flt.ToFloat32();
+        value /= flt.value;
         return *this;
     }
 
     float24& operator += (const float24& flt) {
-        value += flt.ToFloat32();
+        value += flt.value;
         return *this;
     }
 
     float24& operator -= (const float24& flt) {
-        value -= flt.ToFloat32();
+        value -= flt.value;
         return *this;
     }
 
     float24 operator - () const {
-        return float24::FromFloat32(-ToFloat32());
+        return float24::FromFloat32(-value);
     }
 
     bool operator < (const float24& flt) const {
-        return ToFloat32() < flt.ToFloat32();
+        return value < flt.value;
     }
 
     bool operator > (const float24& flt) const {
-        return ToFloat32() > flt.ToFloat32();
+        return value > flt.value;
     }
 
     bool operator >= (const float24& flt) const {
-        return ToFloat32() >= flt.ToFloat32();
+        return value >= flt.value;
     }
 
     bool operator <= (const float24& flt) const {
-        return ToFloat32() <= flt.ToFloat32();
+        return value <= flt.value;
     }
 
     bool operator == (const float24& flt) const {
-        return ToFloat32() == flt.ToFloat32();
+        return value == flt.value;
     }
 
     bool operator != (const float24& flt) const {
-        return ToFloat32() != flt.ToFloat32();
+        return value != flt.value;
     }
 
 private:
-    // Stored as a regular float, merely for convenience
-    // TODO: Perform proper arithmetic on this!
+    // Stored as a regular float, which is what all arithmetic is performed on. Use Truncate() to
+    // get down to the actual float24 precision.
     float value;
 };
+static_assert(sizeof(float24) == sizeof(float), "float24 is expected to wrap a float");
+
+} // namespace
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+namespace Math {
+
+// Vectors of float24 are laid out like four floats, so they are processed as a whole with SSE.
+// The scalar order of operations is kept such that results are identical to the generic versions.
+
+inline __m128 LoadFloat24Vec(const Vec4<Pica::float24>& vec) {
+    return _mm_loadu_ps(reinterpret_cast<const float*>(&vec.x));
+}
+
+inline Vec4<Pica::float24> StoreFloat24Vec(__m128 value) {
+    Vec4<Pica::float24> ret;
+    _mm_storeu_ps(reinterpret_cast<float*>(&ret.x), value);
+    return ret;
+}
+
+template<>
+inline Vec4<Pica::float24> Vec4<Pica::float24>::operator + (const Vec4& other) const {
+    return StoreFloat24Vec(_mm_add_ps(LoadFloat24Vec(*this), LoadFloat24Vec(other)));
+}
+
+template<>
+inline Vec4<Pica::float24> Vec4<Pica::float24>::operator - (const Vec4& other) const {
+    return StoreFloat24Vec(_mm_sub_ps(LoadFloat24Vec(*this), LoadFloat24Vec(other)));
+}
+
+template<>
+inline Vec4<Pica::float24> Vec4<Pica::float24>::operator * (const Vec4& other) const {
+    return StoreFloat24Vec(_mm_mul_ps(LoadFloat24Vec(*this), LoadFloat24Vec(other)));
+}
+
+template<>
+template<>
+inline Vec4<Pica::float24> Vec4<Pica::float24>::operator * (const Pica::float24& f) const {
+    return StoreFloat24Vec(_mm_mul_ps(LoadFloat24Vec(*this), _mm_set1_ps(f.ToFloat32())));
+}
+
+static inline Pica::float24 Dot(const Vec4<Pica::float24>& a, const Vec4<Pica::float24>& b) {
+    __m128 product = _mm_mul_ps(LoadFloat24Vec(a), LoadFloat24Vec(b));
+
+    // Sum up as ((x + y) + z) + w
+    __m128 sum = _mm_add_ss(product, _mm_shuffle_ps(product, product, _MM_SHUFFLE(1, 1, 1, 1)));
+    sum = _mm_add_ss(sum, _mm_movehl_ps(product, product));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(product, product, _MM_SHUFFLE(3, 3, 3, 3)));
+    return Pica::float24::FromFloat32(_mm_cvtss_f32(sum));
+}
+
+} // namespace
+
+#endif
+
+namespace Pica {
 
 union CommandHeader {
     CommandHeader(u32 h) : hex(h) {}
@@ -3,12 +3,25 @@
 // Refer to the license.txt file included.
 
 #include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "common/common_types.h"
+#include "common/make_unique.h"
 #include "common/math_util.h"
+#include "common/profiler.h"
+#include "common/thread.h"
+#include "common/thread_pool.h"
 
 #include "core/hw/gpu.h"
+#include "core/settings.h"
 #include "debug_utils/debug_utils.h"
+#include "draw_stats.h"
 #include "math.h"
 #include "color.h"
 #include "pica.h"
@@ -20,93 +33,93 @@ namespace Pica {
 
 namespace Rasterizer {
 
-static void DrawPixel(int x, int y, const Math::Vec4<u8>& color) {
-    const PAddr addr = registers.framebuffer.GetColorBufferPhysicalAddress();
+static void DrawPixel(const Regs& regs, int x, int y, const Math::Vec4<u8>& color) {
+    const PAddr addr = regs.framebuffer.GetColorBufferPhysicalAddress();
 
     // Similarly to textures, the render framebuffer is laid out from bottom to top, too.
     // NOTE: The framebuffer height register contains the actual FB height minus one.
-    y = (registers.framebuffer.height - y);
+    y = (regs.framebuffer.height - y);
 
     const u32 coarse_y = y & ~7;
-    u32 bytes_per_pixel = GPU::Regs::BytesPerPixel(GPU::Regs::PixelFormat(registers.framebuffer.color_format.Value()));
-    u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * registers.framebuffer.width * bytes_per_pixel;
+    u32 bytes_per_pixel = GPU::Regs::BytesPerPixel(GPU::Regs::PixelFormat(regs.framebuffer.color_format.Value()));
+    u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * regs.framebuffer.width * bytes_per_pixel;
     u8* dst_pixel = Memory::GetPhysicalPointer(addr) + dst_offset;
 
-    switch (registers.framebuffer.color_format) {
-    case registers.framebuffer.RGBA8:
+    switch (regs.framebuffer.color_format) {
+    case regs.framebuffer.RGBA8:
         Color::EncodeRGBA8(color, dst_pixel);
         break;
 
-    case registers.framebuffer.RGB8:
+    case regs.framebuffer.RGB8:
         Color::EncodeRGB8(color, dst_pixel);
         break;
 
-    case registers.framebuffer.RGB5A1:
+    case regs.framebuffer.RGB5A1:
         Color::EncodeRGB5A1(color, dst_pixel);
         break;
 
-    case registers.framebuffer.RGB565:
+    case regs.framebuffer.RGB565:
         Color::EncodeRGB565(color, dst_pixel);
         break;
 
-    case registers.framebuffer.RGBA4:
+    case regs.framebuffer.RGBA4:
         Color::EncodeRGBA4(color, dst_pixel);
         break;
 
     default:
-        LOG_CRITICAL(Render_Software, "Unknown framebuffer color format %x", registers.framebuffer.color_format.Value());
+        LOG_CRITICAL(Render_Software, "Unknown framebuffer color format %x", regs.framebuffer.color_format.Value());
         UNIMPLEMENTED();
     }
 }
 
-static const Math::Vec4<u8> GetPixel(int x, int y) {
-    const PAddr addr = registers.framebuffer.GetColorBufferPhysicalAddress();
+static const Math::Vec4<u8> GetPixel(const Regs& regs, int x, int y) {
+    const PAddr addr = regs.framebuffer.GetColorBufferPhysicalAddress();
 
-    y = (registers.framebuffer.height - y);
+    y = (regs.framebuffer.height - y);
 
     const u32 coarse_y = y & ~7;
-    u32 bytes_per_pixel = GPU::Regs::BytesPerPixel(GPU::Regs::PixelFormat(registers.framebuffer.color_format.Value()));
-    u32 src_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * registers.framebuffer.width * bytes_per_pixel;
+    u32 bytes_per_pixel = GPU::Regs::BytesPerPixel(GPU::Regs::PixelFormat(regs.framebuffer.color_format.Value()));
+    u32 src_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * regs.framebuffer.width * bytes_per_pixel;
     u8* src_pixel = Memory::GetPhysicalPointer(addr) + src_offset;
 
-    switch (registers.framebuffer.color_format) {
-    case registers.framebuffer.RGBA8:
+    switch (regs.framebuffer.color_format) {
+    case regs.framebuffer.RGBA8:
         return Color::DecodeRGBA8(src_pixel);
 
-    case registers.framebuffer.RGB8:
+    case regs.framebuffer.RGB8:
         return Color::DecodeRGB8(src_pixel);
 
-    case registers.framebuffer.RGB5A1:
+    case regs.framebuffer.RGB5A1:
         return Color::DecodeRGB5A1(src_pixel);
 
-    case registers.framebuffer.RGB565:
+    case regs.framebuffer.RGB565:
         return Color::DecodeRGB565(src_pixel);
 
-    case registers.framebuffer.RGBA4:
+    case regs.framebuffer.RGBA4:
         return Color::DecodeRGBA4(src_pixel);
 
     default:
-        LOG_CRITICAL(Render_Software, "Unknown framebuffer color format %x", registers.framebuffer.color_format.Value());
+        LOG_CRITICAL(Render_Software, "Unknown framebuffer color format %x", regs.framebuffer.color_format.Value());
         UNIMPLEMENTED();
     }
 
     return {0, 0, 0, 0};
 }
 
-static u32 GetDepth(int x, int y) {
-    const PAddr addr = registers.framebuffer.GetDepthBufferPhysicalAddress();
+static u32 GetDepth(const Regs& regs, int x, int y) {
+    const PAddr addr = regs.framebuffer.GetDepthBufferPhysicalAddress();
     u8* depth_buffer = Memory::GetPhysicalPointer(addr);
 
-    y = (registers.framebuffer.height - y);
+    y = (regs.framebuffer.height - y);
     
     const u32 coarse_y = y & ~7;
-    u32 bytes_per_pixel = Pica::Regs::BytesPerDepthPixel(registers.framebuffer.depth_format);
-    u32 stride = registers.framebuffer.width * bytes_per_pixel;
+    u32 bytes_per_pixel = Pica::Regs::BytesPerDepthPixel(regs.framebuffer.depth_format);
+    u32 stride = regs.framebuffer.width * bytes_per_pixel;
 
     u32 src_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * stride;
     u8* src_pixel = depth_buffer + src_offset;
 
-    switch (registers.framebuffer.depth_format) {
+    switch (regs.framebuffer.depth_format) {
         case Pica::Regs::DepthFormat::D16:
             return Color::DecodeD16(src_pixel);
         case Pica::Regs::DepthFormat::D24:
@@ -114,26 +127,26 @@ static u32 GetDepth(int x, int y) {
         case Pica::Regs::DepthFormat::D24S8:
             return Color::DecodeD24S8(src_pixel).x;
         default:
-            LOG_CRITICAL(HW_GPU, "Unimplemented depth format %u", registers.framebuffer.depth_format);
+            LOG_CRITICAL(HW_GPU, "Unimplemented depth format %u", regs.framebuffer.depth_format);
             UNIMPLEMENTED();
             return 0;
     }
 }
 
-static void SetDepth(int x, int y, u32 value) {
-    const PAddr addr = registers.framebuffer.GetDepthBufferPhysicalAddress();
+static void SetDepth(const Regs& regs, int x, int y, u32 value) {
+    const PAddr addr = regs.framebuffer.GetDepthBufferPhysicalAddress();
     u8* depth_buffer = Memory::GetPhysicalPointer(addr);
 
-    y = (registers.framebuffer.height - y);
+    y = (regs.framebuffer.height - y);
 
     const u32 coarse_y = y & ~7;
-    u32 bytes_per_pixel = Pica::Regs::BytesPerDepthPixel(registers.framebuffer.depth_format);
-    u32 stride = registers.framebuffer.width * bytes_per_pixel;
+    u32 bytes_per_pixel = Pica::Regs::BytesPerDepthPixel(regs.framebuffer.depth_format);
+    u32 stride = regs.framebuffer.width * bytes_per_pixel;
 
     u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * stride;
     u8* dst_pixel = depth_buffer + dst_offset;
 
-    switch (registers.framebuffer.depth_format) {
+    switch (regs.framebuffer.depth_format) {
         case Pica::Regs::DepthFormat::D16:
             Color::EncodeD16(value, dst_pixel);
             break;
@@ -145,7 +158,7 @@ static void SetDepth(int x, int y, u32 value) {
             Color::EncodeD24S8(value, 0, dst_pixel);
             break;
         default:
-            LOG_CRITICAL(HW_GPU, "Unimplemented depth format %u", registers.framebuffer.depth_format);
+            LOG_CRITICAL(HW_GPU, "Unimplemented depth format %u", regs.framebuffer.depth_format);
             UNIMPLEMENTED();
             break;
     }
@@ -186,15 +199,38 @@ static int SignedArea (const Math::Vec2<Fix12P4>& vtx1,
     return Math::Cross(vec1, vec2).z;
 };
 
+static Common::Profiling::ScopeCategory profile_process_triangle("Rasterizer::ProcessTriangle");
+static Common::Profiling::ScopeCategory profile_triangle_setup("Rasterizer::TriangleSetup");
+static Common::Profiling::ScopeCategory profile_rasterize_batch("Rasterizer::RasterizeBatch");
+
+/// A triangle which passed culling, along with everything needed to rasterize it
+struct Triangle {
+    /// Vertices in counter-clockwise order
+    VertexShader::OutputVertex vertices[3];
+
+    /// Vertex positions in rasterizer coordinates
+    Math::Vec3<Fix12P4> vtxpos[3];
+
+    /// Values added to the barycentric coordinates w0, w1 and w2 to implement the filling rules
+    int bias[3];
+
+    /// Bounding box in rasterizer coordinates, aligned to pixel boundaries
+    u16 min_x, min_y, max_x, max_y;
+};
+
 /**
- * Helper function for ProcessTriangle with the "reversed" flag to allow for implementing
- * culling via recursion.
+ * Culls the given triangle or prepares it for rasterization. Vertices are reordered such that the
+ * triangle is wound counter-clockwise.
+ * @return Whether the triangle needs to be rasterized
  */
-static void ProcessTriangleInternal(const VertexShader::OutputVertex& v0,
-                                    const VertexShader::OutputVertex& v1,
-                                    const VertexShader::OutputVertex& v2,
-                                    bool reversed = false)
+static bool SetupTriangle(const Regs& regs,
+                          const VertexShader::OutputVertex& v0,
+                          const VertexShader::OutputVertex& v1,
+                          const VertexShader::OutputVertex& v2,
+                          Triangle& triangle)
 {
+    Common::Profiling::ProfileScope scope(profile_triangle_setup);
+
     // vertex positions in rasterizer coordinates
     static auto FloatToFix = [](float24 flt) {
         // TODO: Rounding here is necessary to prevent garbage pixels at
@@ -205,26 +241,36 @@ static void ProcessTriangleInternal(const VertexShader::OutputVertex& v0,
         return Math::Vec3<Fix12P4>{FloatToFix(vec.x), FloatToFix(vec.y), FloatToFix(vec.z)};
     };
 
+    const VertexShader::OutputVertex* vertices[3] = { &v0, &v1, &v2 };
     Math::Vec3<Fix12P4> vtxpos[3]{ ScreenToRasterizerCoordinates(v0.screenpos),
                                    ScreenToRasterizerCoordinates(v1.screenpos),
                                    ScreenToRasterizerCoordinates(v2.screenpos) };
 
-    if (registers.cull_mode == Regs::CullMode::KeepAll) {
+    auto ReverseVertexOrder = [&]() {
+        std::swap(vertices[1], vertices[2]);
+        std::swap(vtxpos[1], vtxpos[2]);
+    };
+
+    if (regs.cull_mode == Regs::CullMode::KeepAll) {
         // Make sure we always end up with a triangle wound counter-clockwise
-        if (!reversed && SignedArea(vtxpos[0].xy(), vtxpos[1].xy(), vtxpos[2].xy()) <= 0) {
-            ProcessTriangleInternal(v0, v2, v1, true);
-            return;
-        }
+        if (SignedArea(vtxpos[0].xy(), vtxpos[1].xy(), vtxpos[2].xy()) <= 0)
+            ReverseVertexOrder();
     } else {
-        if (!reversed && registers.cull_mode == Regs::CullMode::KeepClockWise) {
+        if (regs.cull_mode == Regs::CullMode::KeepClockWise) {
             // Reverse vertex order and use the CCW code path.
-            ProcessTriangleInternal(v0, v2, v1, true);
-            return;
+            ReverseVertexOrder();
         }
 
         // Cull away triangles which are wound clockwise.
-        if (SignedArea(vtxpos[0].xy(), vtxpos[1].xy(), vtxpos[2].xy()) <= 0)
-            return;
+        if (SignedArea(vtxpos[0].xy(), vtxpos[1].xy(), vtxpos[2].xy()) <= 0) {
+            ++DrawStats::g_current_draw.triangles_culled;
+            return false;
+        }
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        triangle.vertices[i] = *vertices[i];
+        triangle.vtxpos[i] = vtxpos[i];
     }
 
     // TODO: Proper scissor rect test!
@@ -233,10 +279,10 @@ static void ProcessTriangleInternal(const VertexShader::OutputVertex& v0,
     u16 max_x = std::max({vtxpos[0].x, vtxpos[1].x, vtxpos[2].x});
     u16 max_y = std::max({vtxpos[0].y, vtxpos[1].y, vtxpos[2].y});
 
-    min_x &= Fix12P4::IntMask();
-    min_y &= Fix12P4::IntMask();
-    max_x = ((max_x + Fix12P4::FracMask()) & Fix12P4::IntMask());
-    max_y = ((max_y + Fix12P4::FracMask()) & Fix12P4::IntMask());
+    triangle.min_x = min_x & Fix12P4::IntMask();
+    triangle.min_y = min_y & Fix12P4::IntMask();
+    triangle.max_x = ((max_x + Fix12P4::FracMask()) & Fix12P4::IntMask());
+    triangle.max_y = ((max_y + Fix12P4::FracMask()) & Fix12P4::IntMask());
 
     // Triangle filling rules: Pixels on the right-sided edge or on flat bottom edges are not
     // drawn. Pixels on any other triangle border are drawn. This is implemented with three bias
@@ -255,624 +301,1076 @@ static void ProcessTriangleInternal(const VertexShader::OutputVertex& v0,
             return (int)vtx.x < (int)line1.x + ((int)line2.x - (int)line1.x) * ((int)vtx.y - (int)line1.y) / ((int)line2.y - (int)line1.y);
         }
     };
-    int bias0 = IsRightSideOrFlatBottomEdge(vtxpos[0].xy(), vtxpos[1].xy(), vtxpos[2].xy()) ? -1 : 0;
-    int bias1 = IsRightSideOrFlatBottomEdge(vtxpos[1].xy(), vtxpos[2].xy(), vtxpos[0].xy()) ? -1 : 0;
-    int bias2 = IsRightSideOrFlatBottomEdge(vtxpos[2].xy(), vtxpos[0].xy(), vtxpos[1].xy()) ? -1 : 0;
+    triangle.bias[0] = IsRightSideOrFlatBottomEdge(vtxpos[0].xy(), vtxpos[1].xy(), vtxpos[2].xy()) ? -1 : 0;
+    triangle.bias[1] = IsRightSideOrFlatBottomEdge(vtxpos[1].xy(), vtxpos[2].xy(), vtxpos[0].xy()) ? -1 : 0;
+    triangle.bias[2] = IsRightSideOrFlatBottomEdge(vtxpos[2].xy(), vtxpos[0].xy(), vtxpos[1].xy()) ? -1 : 0;
+
+    DrawStatistics& draw_stats = DrawStats::g_current_draw;
+    ++draw_stats.triangles_rasterized;
+    draw_stats.bounding_box_pixels += (u64)((triangle.max_x - triangle.min_x) >> 4) * ((triangle.max_y - triangle.min_y) >> 4);
+    return true;
+}
+
+/// Compares the depth of a fragment against the value in the depth buffer
+static bool PassesDepthTest(const Regs& regs, u32 z, u32 ref_z) {
+    switch (regs.output_merger.depth_test_func) {
+    case regs.output_merger.Never:
+        return false;
+
+    case regs.output_merger.Always:
+        return true;
+
+    case regs.output_merger.Equal:
+        return z == ref_z;
+
+    case regs.output_merger.NotEqual:
+        return z != ref_z;
+
+    case regs.output_merger.LessThan:
+        return z < ref_z;
+
+    case regs.output_merger.LessThanOrEqual:
+        return z <= ref_z;
+
+    case regs.output_merger.GreaterThan:
+        return z > ref_z;
+
+    case regs.output_merger.GreaterThanOrEqual:
+        return z >= ref_z;
+    }
 
-    auto w_inverse = Math::MakeVec(v0.pos.w, v1.pos.w, v2.pos.w);
+    return false;
+}
 
-    auto textures = registers.GetTextures();
-    auto tev_stages = registers.GetTevStages();
+/**
+ * Whether the depth test may be performed before texturing and the texture combiners, so that
+ * those are skipped for occluded fragments. The depth of a fragment only depends on its position,
+ * but fragments rejected by the alpha test must not write to the depth buffer. Hence this is
+ * only done if either the alpha test cannot reject any fragments or depth writes are disabled,
+ * which is determined from the register state of the draw.
+ */
+static bool IsEarlyDepthTestPossible(const Regs& regs) {
+    const auto& output_merger = regs.output_merger;
+    if (!output_merger.depth_test_enable)
+        return false;
+
+    bool alpha_test_rejects = output_merger.alpha_test.enable &&
+                              output_merger.alpha_test.func != output_merger.Always;
+    return !alpha_test_rejects || !output_merger.depth_write_enable;
+}
+
+/**
+ * SignedArea(vtx1, vtx2, p) plus a bias, as a function of the pixel whose center is p. It is
+ * linear in the pixel coordinates, so it can be stepped from pixel to pixel by adding constants
+ * instead of being recomputed.
+ */
+struct EdgeFunction {
+    EdgeFunction(const Math::Vec2<Fix12P4>& vtx1, const Math::Vec2<Fix12P4>& vtx2, int bias) {
+        const int dx = (int)vtx2.x - (int)vtx1.x;
+        const int dy = (int)vtx2.y - (int)vtx1.y;
+
+        // Pixel centers are 16 rasterizer units apart and offset by 8 units
+        step_x = -dy * 16;
+        step_y = dx * 16;
+        origin = bias + dx * (8 - (int)vtx1.y) - dy * (8 - (int)vtx1.x);
+    }
 
-    // Enter rasterization loop, starting at the center of the topleft bounding box corner.
-    // TODO: Not sure if looping through x first might be faster
-    for (u16 y = min_y + 8; y < max_y; y += 0x10) {
-        for (u16 x = min_x + 8; x < max_x; x += 0x10) {
+    int Evaluate(int pixel_x, int pixel_y) const {
+        return origin + pixel_x * step_x + pixel_y * step_y;
+    }
 
-            // Calculate the barycentric coordinates w0, w1 and w2
-            int w0 = bias0 + SignedArea(vtxpos[1].xy(), vtxpos[2].xy(), {x, y});
-            int w1 = bias1 + SignedArea(vtxpos[2].xy(), vtxpos[0].xy(), {x, y});
-            int w2 = bias2 + SignedArea(vtxpos[0].xy(), vtxpos[1].xy(), {x, y});
-            int wsum = w0 + w1 + w2;
+    /// Value at the center of pixel (0, 0)
+    int origin;
+    /// Change of the value per pixel in x and y direction
+    int step_x;
+    int step_y;
+};
 
-            // If current pixel is not covered by the current primitive
-            if (w0 < 0 || w1 < 0 || w2 < 0)
+/**
+ * Rasterizes the pixels of the triangle within the given range of pixel columns and rows, which
+ * are given in framebuffer pixels (not in rasterizer coordinates) and exclude the end. The
+ * fragment statistics are added to stats.
+ */
+static void RasterizeTriangle(const Regs& regs, const Triangle& triangle,
+                              int x_begin, int x_end, int y_begin, int y_end,
+                              DrawStatistics& stats)
+{
+    const auto& v0 = triangle.vertices[0];
+    const auto& v1 = triangle.vertices[1];
+    const auto& v2 = triangle.vertices[2];
+    const auto& vtxpos = triangle.vtxpos;
+    const int bias0 = triangle.bias[0];
+    const int bias1 = triangle.bias[1];
+    const int bias2 = triangle.bias[2];
+
+    // Interpolation is done on plain floats, since float24 precision is not modeled here anyway
+    auto w_inverse = Math::MakeVec(v0.pos.w.ToFloat32(), v1.pos.w.ToFloat32(), v2.pos.w.ToFloat32());
+
+    auto textures = regs.GetTextures();
+    auto tev_stages = regs.GetTevStages();
+
+    // Counted locally and added to the statistics once per call
+    u64 fragments_tested = 0;
+    u64 alpha_test_rejects = 0;
+    u64 depth_test_rejects = 0;
+    u64 early_depth_test_rejects = 0;
+    u64 fragments_passed = 0;
+    std::array<u64, 3> texture_lookups{};
+
+    x_begin = std::max<int>(x_begin, triangle.min_x >> 4);
+    x_end = std::min<int>(x_end, triangle.max_x >> 4);
+    y_begin = std::max<int>(y_begin, triangle.min_y >> 4);
+    y_end = std::min<int>(y_end, triangle.max_y >> 4);
+
+    const bool early_depth_test = IsEarlyDepthTestPossible(regs);
+    const unsigned depth_bits = Pica::Regs::DepthBitsPerPixel(regs.framebuffer.depth_format);
+
+    // Processes the covered pixel at the given rasterizer coordinates
+    auto ShadeFragment = [&](u16 x, u16 y, int w0, int w1, int w2) {
+        int wsum = w0 + w1 + w2;
+
+        ++fragments_tested;
+
+        u32 z = 0;
+        if (regs.output_merger.depth_test_enable) {
+            z = (u32)((v0.screenpos[2].ToFloat32() * w0 +
+                       v1.screenpos[2].ToFloat32() * w1 +
+                       v2.screenpos[2].ToFloat32() * w2) * ((1 << depth_bits) - 1) / wsum);
+
+            if (early_depth_test && !PassesDepthTest(regs, z, GetDepth(regs, x >> 4, y >> 4))) {
+                ++depth_test_rejects;
+                ++early_depth_test_rejects;
+                return;
+            }
+        }
+
+        auto baricentric_coordinates = Math::MakeVec(static_cast<float>(w0),
+                                                     static_cast<float>(w1),
+                                                     static_cast<float>(w2));
+        float interpolated_w_inverse = 1.0f / Math::Dot(w_inverse, baricentric_coordinates);
+
+        // Perspective correct attribute interpolation:
+        // Attribute values cannot be calculated by simple linear interpolation since
+        // they are not linear in screen space. For example, when interpolating a
+        // texture coordinate across two vertices, something simple like
+        //     u = (u0*w0 + u1*w1)/(w0+w1)
+        // will not work. However, the attribute value divided by the
+        // clipspace w-coordinate (u/w) and and the inverse w-coordinate (1/w) are linear
+        // in screenspace. Hence, we can linearly interpolate these two independently and
+        // calculate the interpolated attribute by dividing the results.
+        // I.e.
+        //     u_over_w   = ((u0/v0.pos.w)*w0 + (u1/v1.pos.w)*w1)/(w0+w1)
+        //     one_over_w = (( 1/v0.pos.w)*w0 + ( 1/v1.pos.w)*w1)/(w0+w1)
+        //     u = u_over_w / one_over_w
+        //
+        // The generalization to three vertices is straightforward in baricentric coordinates.
+        auto GetInterpolatedAttribute = [&](float24 attr0, float24 attr1, float24 attr2) {
+            auto attr_over_w = Math::MakeVec(attr0.ToFloat32(), attr1.ToFloat32(), attr2.ToFloat32());
+            float interpolated_attr_over_w = Math::Dot(attr_over_w, baricentric_coordinates);
+            return interpolated_attr_over_w * interpolated_w_inverse;
+        };
+
+        Math::Vec4<u8> primary_color{
+            (u8)(GetInterpolatedAttribute(v0.color.r(), v1.color.r(), v2.color.r()) * 255),
+            (u8)(GetInterpolatedAttribute(v0.color.g(), v1.color.g(), v2.color.g()) * 255),
+            (u8)(GetInterpolatedAttribute(v0.color.b(), v1.color.b(), v2.color.b()) * 255),
+            (u8)(GetInterpolatedAttribute(v0.color.a(), v1.color.a(), v2.color.a()) * 255)
+        };
+
+        Math::Vec2<float> uv[3];
+        uv[0].u() = GetInterpolatedAttribute(v0.tc0.u(), v1.tc0.u(), v2.tc0.u());
+        uv[0].v() = GetInterpolatedAttribute(v0.tc0.v(), v1.tc0.v(), v2.tc0.v());
+        uv[1].u() = GetInterpolatedAttribute(v0.tc1.u(), v1.tc1.u(), v2.tc1.u());
+        uv[1].v() = GetInterpolatedAttribute(v0.tc1.v(), v1.tc1.v(), v2.tc1.v());
+        uv[2].u() = GetInterpolatedAttribute(v0.tc2.u(), v1.tc2.u(), v2.tc2.u());
+        uv[2].v() = GetInterpolatedAttribute(v0.tc2.v(), v1.tc2.v(), v2.tc2.v());
+
+        Math::Vec4<u8> texture_color[3]{};
+        for (int i = 0; i < 3; ++i) {
+            const auto& texture = textures[i];
+            if (!texture.enabled)
                 continue;
 
-            auto baricentric_coordinates = Math::MakeVec(float24::FromFloat32(static_cast<float>(w0)),
-                                                float24::FromFloat32(static_cast<float>(w1)),
-                                                float24::FromFloat32(static_cast<float>(w2)));
-            float24 interpolated_w_inverse = float24::FromFloat32(1.0f) / Math::Dot(w_inverse, baricentric_coordinates);
-
-            // Perspective correct attribute interpolation:
-            // Attribute values cannot be calculated by simple linear interpolation since
-            // they are not linear in screen space. For example, when interpolating a
-            // texture coordinate across two vertices, something simple like
-            //     u = (u0*w0 + u1*w1)/(w0+w1)
-            // will not work. However, the attribute value divided by the
-            // clipspace w-coordinate (u/w) and and the inverse w-coordinate (1/w) are linear
-            // in screenspace. Hence, we can linearly interpolate these two independently and
-            // calculate the interpolated attribute by dividing the results.
-            // I.e.
-            //     u_over_w   = ((u0/v0.pos.w)*w0 + (u1/v1.pos.w)*w1)/(w0+w1)
-            //     one_over_w = (( 1/v0.pos.w)*w0 + ( 1/v1.pos.w)*w1)/(w0+w1)
-            //     u = u_over_w / one_over_w
-            //
-            // The generalization to three vertices is straightforward in baricentric coordinates.
-            auto GetInterpolatedAttribute = [&](float24 attr0, float24 attr1, float24 attr2) {
-                auto attr_over_w = Math::MakeVec(attr0, attr1, attr2);
-                float24 interpolated_attr_over_w = Math::Dot(attr_over_w, baricentric_coordinates);
-                return interpolated_attr_over_w * interpolated_w_inverse;
-            };
+            DEBUG_ASSERT(0 != texture.config.address);
 
-            Math::Vec4<u8> primary_color{
-                (u8)(GetInterpolatedAttribute(v0.color.r(), v1.color.r(), v2.color.r()).ToFloat32() * 255),
-                (u8)(GetInterpolatedAttribute(v0.color.g(), v1.color.g(), v2.color.g()).ToFloat32() * 255),
-                (u8)(GetInterpolatedAttribute(v0.color.b(), v1.color.b(), v2.color.b()).ToFloat32() * 255),
-                (u8)(GetInterpolatedAttribute(v0.color.a(), v1.color.a(), v2.color.a()).ToFloat32() * 255)
-            };
+            int s = (int)(uv[i].u() * static_cast<float>(texture.config.width));
+            int t = (int)(uv[i].v() * static_cast<float>(texture.config.height));
+            static auto GetWrappedTexCoord = [](Regs::TextureConfig::WrapMode mode, int val, unsigned size) {
+                switch (mode) {
+                    case Regs::TextureConfig::ClampToEdge:
+                        val = std::max(val, 0);
+                        val = std::min(val, (int)size - 1);
+                        return val;
+
+                    case Regs::TextureConfig::Repeat:
+                        return (int)((unsigned)val % size);
 
-            Math::Vec2<float24> uv[3];
-            uv[0].u() = GetInterpolatedAttribute(v0.tc0.u(), v1.tc0.u(), v2.tc0.u());
-            uv[0].v() = GetInterpolatedAttribute(v0.tc0.v(), v1.tc0.v(), v2.tc0.v());
-            uv[1].u() = GetInterpolatedAttribute(v0.tc1.u(), v1.tc1.u(), v2.tc1.u());
-            uv[1].v() = GetInterpolatedAttribute(v0.tc1.v(), v1.tc1.v(), v2.tc1.v());
-            uv[2].u() = GetInterpolatedAttribute(v0.tc2.u(), v1.tc2.u(), v2.tc2.u());
-            uv[2].v() = GetInterpolatedAttribute(v0.tc2.v(), v1.tc2.v(), v2.tc2.v());
-
-            Math::Vec4<u8> texture_color[3]{};
-            for (int i = 0; i < 3; ++i) {
-                const auto& texture = textures[i];
-                if (!texture.enabled)
-                    continue;
-
-                DEBUG_ASSERT(0 != texture.config.address);
-
-                int s = (int)(uv[i].u() * float24::FromFloat32(static_cast<float>(texture.config.width))).ToFloat32();
-                int t = (int)(uv[i].v() * float24::FromFloat32(static_cast<float>(texture.config.height))).ToFloat32();
-                static auto GetWrappedTexCoord = [](Regs::TextureConfig::WrapMode mode, int val, unsigned size) {
-                    switch (mode) {
-                        case Regs::TextureConfig::ClampToEdge:
-                            val = std::max(val, 0);
-                            val = std::min(val, (int)size - 1);
-                            return val;
-
-                        case Regs::TextureConfig::Repeat:
-                            return (int)((unsigned)val % size);
-
-                        case Regs::TextureConfig::MirroredRepeat:
-                        {
-                            unsigned int coord = ((unsigned)val % (2 * size));
-                            if (coord >= size)
-                                coord = 2 * size - 1 - coord;
-                            return (int)coord;
-                        }
-
-                        default:
-                            LOG_ERROR(HW_GPU, "Unknown texture coordinate wrapping mode %x\n", (int)mode);
-                            UNIMPLEMENTED();
-                            return 0;
+                    case Regs::TextureConfig::MirroredRepeat:
+                    {
+                        unsigned int coord = ((unsigned)val % (2 * size));
+                        if (coord >= size)
+                            coord = 2 * size - 1 - coord;
+                        return (int)coord;
                     }
-                };
 
-                // Textures are laid out from bottom to top, hence we invert the t coordinate.
-                // NOTE: This may not be the right place for the inversion.
-                // TODO: Check if this applies to ETC textures, too.
-                s = GetWrappedTexCoord(texture.config.wrap_s, s, texture.config.width);
-                t = texture.config.height - 1 - GetWrappedTexCoord(texture.config.wrap_t, t, texture.config.height);
+                    default:
+                        LOG_ERROR(HW_GPU, "Unknown texture coordinate wrapping mode %x\n", (int)mode);
+                        UNIMPLEMENTED();
+                        return 0;
+                }
+            };
 
-                u8* texture_data = Memory::GetPhysicalPointer(texture.config.GetPhysicalAddress());
-                auto info = DebugUtils::TextureInfo::FromPicaRegister(texture.config, texture.format);
+            // Textures are laid out from bottom to top, hence we invert the t coordinate.
+            // NOTE: This may not be the right place for the inversion.
+            // TODO: Check if this applies to ETC textures, too.
+            s = GetWrappedTexCoord(texture.config.wrap_s, s, texture.config.width);
+            t = texture.config.height - 1 - GetWrappedTexCoord(texture.config.wrap_t, t, texture.config.height);
 
-                texture_color[i] = DebugUtils::LookupTexture(texture_data, s, t, info);
-                DebugUtils::DumpTexture(texture.config, texture_data);
-            }
+            u8* texture_data = Memory::GetPhysicalPointer(texture.config.GetPhysicalAddress());
+            auto info = DebugUtils::TextureInfo::FromPicaRegister(texture.config, texture.format);
 
-            // Texture environment - consists of 6 stages of color and alpha combining.
-            //
-            // Color combiners take three input color values from some source (e.g. interpolated
-            // vertex color, texture color, previous stage, etc), perform some very simple
-            // operations on each of them (e.g. inversion) and then calculate the output color
-            // with some basic arithmetic. Alpha combiners can be configured separately but work
-            // analogously.
-            Math::Vec4<u8> combiner_output;
-            Math::Vec4<u8> combiner_buffer = {
-                registers.tev_combiner_buffer_color.r, registers.tev_combiner_buffer_color.g,
-                registers.tev_combiner_buffer_color.b, registers.tev_combiner_buffer_color.a
+            texture_color[i] = DebugUtils::LookupTexture(texture_data, s, t, info);
+            ++texture_lookups[i];
+            DebugUtils::DumpTexture(texture.config, texture_data);
+        }
+
+        // Texture environment - consists of 6 stages of color and alpha combining.
+        //
+        // Color combiners take three input color values from some source (e.g. interpolated
+        // vertex color, texture color, previous stage, etc), perform some very simple
+        // operations on each of them (e.g. inversion) and then calculate the output color
+        // with some basic arithmetic. Alpha combiners can be configured separately but work
+        // analogously.
+        Math::Vec4<u8> combiner_output;
+        Math::Vec4<u8> combiner_buffer = {
+            regs.tev_combiner_buffer_color.r, regs.tev_combiner_buffer_color.g,
+            regs.tev_combiner_buffer_color.b, regs.tev_combiner_buffer_color.a
+        };
+
+        for (unsigned tev_stage_index = 0; tev_stage_index < tev_stages.size(); ++tev_stage_index) {
+            const auto& tev_stage = tev_stages[tev_stage_index];
+            using Source = Regs::TevStageConfig::Source;
+            using ColorModifier = Regs::TevStageConfig::ColorModifier;
+            using AlphaModifier = Regs::TevStageConfig::AlphaModifier;
+            using Operation = Regs::TevStageConfig::Operation;
+
+            auto GetSource = [&](Source source) -> Math::Vec4<u8> {
+                switch (source) {
+                // TODO: What's the difference between these two?
+                case Source::PrimaryColor:
+                case Source::PrimaryFragmentColor:
+                    return primary_color;
+
+                case Source::Texture0:
+                    return texture_color[0];
+
+                case Source::Texture1:
+                    return texture_color[1];
+
+                case Source::Texture2:
+                    return texture_color[2];
+
+                case Source::PreviousBuffer:
+                    return combiner_buffer;
+
+                case Source::Constant:
+                    return {tev_stage.const_r, tev_stage.const_g, tev_stage.const_b, tev_stage.const_a};
+
+                case Source::Previous:
+                    return combiner_output;
+
+                default:
+                    LOG_ERROR(HW_GPU, "Unknown color combiner source %d\n", (int)source);
+                    UNIMPLEMENTED();
+                    return {0, 0, 0, 0};
+                }
             };
 
-            for (unsigned tev_stage_index = 0; tev_stage_index < tev_stages.size(); ++tev_stage_index) {
-                const auto& tev_stage = tev_stages[tev_stage_index];
-                using Source = Regs::TevStageConfig::Source;
-                using ColorModifier = Regs::TevStageConfig::ColorModifier;
-                using AlphaModifier = Regs::TevStageConfig::AlphaModifier;
-                using Operation = Regs::TevStageConfig::Operation;
+            static auto GetColorModifier = [](ColorModifier factor, const Math::Vec4<u8>& values) -> Math::Vec3<u8> {
+                switch (factor) {
+                case ColorModifier::SourceColor:
+                    return values.rgb();
 
-                auto GetSource = [&](Source source) -> Math::Vec4<u8> {
-                    switch (source) {
-                    // TODO: What's the difference between these two?
-                    case Source::PrimaryColor:
-                    case Source::PrimaryFragmentColor:
-                        return primary_color;
+                case ColorModifier::OneMinusSourceColor:
+                    return (Math::Vec3<u8>(255, 255, 255) - values.rgb()).Cast<u8>();
 
-                    case Source::Texture0:
-                        return texture_color[0];
+                case ColorModifier::SourceAlpha:
+                    return values.aaa();
 
-                    case Source::Texture1:
-                        return texture_color[1];
+                case ColorModifier::OneMinusSourceAlpha:
+                    return (Math::Vec3<u8>(255, 255, 255) - values.aaa()).Cast<u8>();
 
-                    case Source::Texture2:
-                        return texture_color[2];
+                case ColorModifier::SourceRed:
+                    return values.rrr();
 
-                    case Source::PreviousBuffer:
-                        return combiner_buffer;
+                case ColorModifier::OneMinusSourceRed:
+                    return (Math::Vec3<u8>(255, 255, 255) - values.rrr()).Cast<u8>();
 
-                    case Source::Constant:
-                        return {tev_stage.const_r, tev_stage.const_g, tev_stage.const_b, tev_stage.const_a};
+                case ColorModifier::SourceGreen:
+                    return values.ggg();
 
-                    case Source::Previous:
-                        return combiner_output;
+                case ColorModifier::OneMinusSourceGreen:
+                    return (Math::Vec3<u8>(255, 255, 255) - values.ggg()).Cast<u8>();
 
-                    default:
-                        LOG_ERROR(HW_GPU, "Unknown color combiner source %d\n", (int)source);
-                        UNIMPLEMENTED();
-                        return {0, 0, 0, 0};
-                    }
-                };
+                case ColorModifier::SourceBlue:
+                    return values.bbb();
 
-                static auto GetColorModifier = [](ColorModifier factor, const Math::Vec4<u8>& values) -> Math::Vec3<u8> {
-                    switch (factor) {
-                    case ColorModifier::SourceColor:
-                        return values.rgb();
+                case ColorModifier::OneMinusSourceBlue:
+                    return (Math::Vec3<u8>(255, 255, 255) - values.bbb()).Cast<u8>();
+                }
+            };
 
-                    case ColorModifier::OneMinusSourceColor:
-                        return (Math::Vec3<u8>(255, 255, 255) - values.rgb()).Cast<u8>();
+            static auto GetAlphaModifier = [](AlphaModifier factor, const Math::Vec4<u8>& values) -> u8 {
+                switch (factor) {
+                case AlphaModifier::SourceAlpha:
+                    return values.a();
 
-                    case ColorModifier::SourceAlpha:
-                        return values.aaa();
+                case AlphaModifier::OneMinusSourceAlpha:
+                    return 255 - values.a();
 
-                    case ColorModifier::OneMinusSourceAlpha:
-                        return (Math::Vec3<u8>(255, 255, 255) - values.aaa()).Cast<u8>();
+                case AlphaModifier::SourceRed:
+                    return values.r();
 
-                    case ColorModifier::SourceRed:
-                        return values.rrr();
+                case AlphaModifier::OneMinusSourceRed:
+                    return 255 - values.r();
 
-                    case ColorModifier::OneMinusSourceRed:
-                        return (Math::Vec3<u8>(255, 255, 255) - values.rrr()).Cast<u8>();
+                case AlphaModifier::SourceGreen:
+                    return values.g();
 
-                    case ColorModifier::SourceGreen:
-                        return values.ggg();
+                case AlphaModifier::OneMinusSourceGreen:
+                    return 255 - values.g();
 
-                    case ColorModifier::OneMinusSourceGreen:
-                        return (Math::Vec3<u8>(255, 255, 255) - values.ggg()).Cast<u8>();
+                case AlphaModifier::SourceBlue:
+                    return values.b();
 
-                    case ColorModifier::SourceBlue:
-                        return values.bbb();
+                case AlphaModifier::OneMinusSourceBlue:
+                    return 255 - values.b();
+                }
+            };
 
-                    case ColorModifier::OneMinusSourceBlue:
-                        return (Math::Vec3<u8>(255, 255, 255) - values.bbb()).Cast<u8>();
-                    }
-                };
+            static auto ColorCombine = [](Operation op, const Math::Vec3<u8> input[3]) -> Math::Vec3<u8> {
+                switch (op) {
+                case Operation::Replace:
+                    return input[0];
+
+                case Operation::Modulate:
+                    return ((input[0] * input[1]) / 255).Cast<u8>();
+
+                case Operation::Add:
+                {
+                    auto result = input[0] + input[1];
+                    result.r() = std::min(255, result.r());
+                    result.g() = std::min(255, result.g());
+                    result.b() = std::min(255, result.b());
+                    return result.Cast<u8>();
+                }
 
-                static auto GetAlphaModifier = [](AlphaModifier factor, const Math::Vec4<u8>& values) -> u8 {
-                    switch (factor) {
-                    case AlphaModifier::SourceAlpha:
-                        return values.a();
+                case Operation::AddSigned:
+                {
+                    // TODO(bunnei): Verify that the color conversion from (float) 0.5f to (byte) 128 is correct
+                    auto result = input[0].Cast<int>() + input[1].Cast<int>() - Math::MakeVec<int>(128, 128, 128);
+                    result.r() = MathUtil::Clamp<int>(result.r(), 0, 255);
+                    result.g() = MathUtil::Clamp<int>(result.g(), 0, 255);
+                    result.b() = MathUtil::Clamp<int>(result.b(), 0, 255);
+                    return result.Cast<u8>();
+                }
 
-                    case AlphaModifier::OneMinusSourceAlpha:
-                        return 255 - values.a();
+                case Operation::Lerp:
+                    return ((input[0] * input[2] + input[1] * (Math::MakeVec<u8>(255, 255, 255) - input[2]).Cast<u8>()) / 255).Cast<u8>();
 
-                    case AlphaModifier::SourceRed:
-                        return values.r();
+                case Operation::Subtract:
+                {
+                    auto result = input[0].Cast<int>() - input[1].Cast<int>();
+                    result.r() = std::max(0, result.r());
+                    result.g() = std::max(0, result.g());
+                    result.b() = std::max(0, result.b());
+                    return result.Cast<u8>();
+                }
 
-                    case AlphaModifier::OneMinusSourceRed:
-                        return 255 - values.r();
+                case Operation::MultiplyThenAdd:
+                {
+                    auto result = (input[0] * input[1] + 255 * input[2].Cast<int>()) / 255;
+                    result.r() = std::min(255, result.r());
+                    result.g() = std::min(255, result.g());
+                    result.b() = std::min(255, result.b());
+                    return result.Cast<u8>();
+                }
 
-                    case AlphaModifier::SourceGreen:
-                        return values.g();
+                case Operation::AddThenMultiply:
+                {
+                    auto result = input[0] + input[1];
+                    result.r() = std::min(255, result.r());
+                    result.g() = std::min(255, result.g());
+                    result.b() = std::min(255, result.b());
+                    result = (result * input[2].Cast<int>()) / 255;
+                    return result.Cast<u8>();
+                }
 
-                    case AlphaModifier::OneMinusSourceGreen:
-                        return 255 - values.g();
+                default:
+                    LOG_ERROR(HW_GPU, "Unknown color combiner operation %d\n", (int)op);
+                    UNIMPLEMENTED();
+                    return {0, 0, 0};
+                }
+            };
 
-                    case AlphaModifier::SourceBlue:
-                        return values.b();
+            static auto AlphaCombine = [](Operation op, const std::array<u8,3>& input) -> u8 {
+                switch (op) {
+                case Operation::Replace:
+                    return input[0];
 
-                    case AlphaModifier::OneMinusSourceBlue:
-                        return 255 - values.b();
-                    }
-                };
+                case Operation::Modulate:
+                    return input[0] * input[1] / 255;
 
-                static auto ColorCombine = [](Operation op, const Math::Vec3<u8> input[3]) -> Math::Vec3<u8> {
-                    switch (op) {
-                    case Operation::Replace:
-                        return input[0];
+                case Operation::Add:
+                    return std::min(255, input[0] + input[1]);
 
-                    case Operation::Modulate:
-                        return ((input[0] * input[1]) / 255).Cast<u8>();
+                case Operation::Lerp:
+                    return (input[0] * input[2] + input[1] * (255 - input[2])) / 255;
 
-                    case Operation::Add:
-                    {
-                        auto result = input[0] + input[1];
-                        result.r() = std::min(255, result.r());
-                        result.g() = std::min(255, result.g());
-                        result.b() = std::min(255, result.b());
-                        return result.Cast<u8>();
-                    }
+                case Operation::Subtract:
+                    return std::max(0, (int)input[0] - (int)input[1]);
 
-                    case Operation::AddSigned:
-                    {
-                        // TODO(bunnei): Verify that the color conversion from (float) 0.5f to (byte) 128 is correct
-                        auto result = input[0].Cast<int>() + input[1].Cast<int>() - Math::MakeVec<int>(128, 128, 128);
-                        result.r() = MathUtil::Clamp<int>(result.r(), 0, 255);
-                        result.g() = MathUtil::Clamp<int>(result.g(), 0, 255);
-                        result.b() = MathUtil::Clamp<int>(result.b(), 0, 255);
-                        return result.Cast<u8>();
-                    }
+                case Operation::MultiplyThenAdd:
+                    return std::min(255, (input[0] * input[1] + 255 * input[2]) / 255);
 
-                    case Operation::Lerp:
-                        return ((input[0] * input[2] + input[1] * (Math::MakeVec<u8>(255, 255, 255) - input[2]).Cast<u8>()) / 255).Cast<u8>();
+                case Operation::AddThenMultiply:
+                    return (std::min(255, (input[0] + input[1])) * input[2]) / 255;
 
-                    case Operation::Subtract:
-                    {
-                        auto result = input[0].Cast<int>() - input[1].Cast<int>();
-                        result.r() = std::max(0, result.r());
-                        result.g() = std::max(0, result.g());
-                        result.b() = std::max(0, result.b());
-                        return result.Cast<u8>();
-                    }
+                default:
+                    LOG_ERROR(HW_GPU, "Unknown alpha combiner operation %d\n", (int)op);
+                    UNIMPLEMENTED();
+                    return 0;
+                }
+            };
 
-                    case Operation::MultiplyThenAdd:
-                    {
-                        auto result = (input[0] * input[1] + 255 * input[2].Cast<int>()) / 255;
-                        result.r() = std::min(255, result.r());
-                        result.g() = std::min(255, result.g());
-                        result.b() = std::min(255, result.b());
-                        return result.Cast<u8>();
-                    }
+            // color combiner
+            // NOTE: Not sure if the alpha combiner might use the color output of the previous
+            //       stage as input. Hence, we currently don't directly write the result to
+            //       combiner_output.rgb(), but instead store it in a temporary variable until
+            //       alpha combining has been done.
+            Math::Vec3<u8> color_result[3] = {
+                GetColorModifier(tev_stage.color_modifier1, GetSource(tev_stage.color_source1)),
+                GetColorModifier(tev_stage.color_modifier2, GetSource(tev_stage.color_source2)),
+                GetColorModifier(tev_stage.color_modifier3, GetSource(tev_stage.color_source3))
+            };
+            auto color_output = ColorCombine(tev_stage.color_op, color_result);
 
-                    case Operation::AddThenMultiply:
-                    {
-                        auto result = input[0] + input[1];
-                        result.r() = std::min(255, result.r());
-                        result.g() = std::min(255, result.g());
-                        result.b() = std::min(255, result.b());
-                        result = (result * input[2].Cast<int>()) / 255;
-                        return result.Cast<u8>();
-                    }
+            // alpha combiner
+            std::array<u8,3> alpha_result = {
+                GetAlphaModifier(tev_stage.alpha_modifier1, GetSource(tev_stage.alpha_source1)),
+                GetAlphaModifier(tev_stage.alpha_modifier2, GetSource(tev_stage.alpha_source2)),
+                GetAlphaModifier(tev_stage.alpha_modifier3, GetSource(tev_stage.alpha_source3))
+            };
+            auto alpha_output = AlphaCombine(tev_stage.alpha_op, alpha_result);
 
-                    default:
-                        LOG_ERROR(HW_GPU, "Unknown color combiner operation %d\n", (int)op);
-                        UNIMPLEMENTED();
-                        return {0, 0, 0};
-                    }
-                };
+            combiner_output[0] = std::min((unsigned)255, color_output.r() * tev_stage.GetColorMultiplier());
+            combiner_output[1] = std::min((unsigned)255, color_output.g() * tev_stage.GetColorMultiplier());
+            combiner_output[2] = std::min((unsigned)255, color_output.b() * tev_stage.GetColorMultiplier());
+            combiner_output[3] = std::min((unsigned)255, alpha_output * tev_stage.GetAlphaMultiplier());
 
-                static auto AlphaCombine = [](Operation op, const std::array<u8,3>& input) -> u8 {
-                    switch (op) {
-                    case Operation::Replace:
-                        return input[0];
+            if (regs.tev_combiner_buffer_input.TevStageUpdatesCombinerBufferColor(tev_stage_index)) {
+                combiner_buffer.r() = combiner_output.r();
+                combiner_buffer.g() = combiner_output.g();
+                combiner_buffer.b() = combiner_output.b();
+            }
 
-                    case Operation::Modulate:
-                        return input[0] * input[1] / 255;
+            if (regs.tev_combiner_buffer_input.TevStageUpdatesCombinerBufferAlpha(tev_stage_index)) {
+                combiner_buffer.a() = combiner_output.a();
+            }
+        }
 
-                    case Operation::Add:
-                        return std::min(255, input[0] + input[1]);
+        if (regs.output_merger.alpha_test.enable) {
+            bool pass = false;
 
-                    case Operation::Lerp:
-                        return (input[0] * input[2] + input[1] * (255 - input[2])) / 255;
+            switch (regs.output_merger.alpha_test.func) {
+            case regs.output_merger.Never:
+                pass = false;
+                break;
 
-                    case Operation::Subtract:
-                        return std::max(0, (int)input[0] - (int)input[1]);
+            case regs.output_merger.Always:
+                pass = true;
+                break;
 
-                    case Operation::MultiplyThenAdd:
-                        return std::min(255, (input[0] * input[1] + 255 * input[2]) / 255);
+            case regs.output_merger.Equal:
+                pass = combiner_output.a() == regs.output_merger.alpha_test.ref;
+                break;
 
-                    case Operation::AddThenMultiply:
-                        return (std::min(255, (input[0] + input[1])) * input[2]) / 255;
+            case regs.output_merger.NotEqual:
+                pass = combiner_output.a() != regs.output_merger.alpha_test.ref;
+                break;
 
-                    default:
-                        LOG_ERROR(HW_GPU, "Unknown alpha combiner operation %d\n", (int)op);
-                        UNIMPLEMENTED();
-                        return 0;
-                    }
-                };
-
-                // color combiner
-                // NOTE: Not sure if the alpha combiner might use the color output of the previous
-                //       stage as input. Hence, we currently don't directly write the result to
-                //       combiner_output.rgb(), but instead store it in a temporary variable until
-                //       alpha combining has been done.
-                Math::Vec3<u8> color_result[3] = {
-                    GetColorModifier(tev_stage.color_modifier1, GetSource(tev_stage.color_source1)),
-                    GetColorModifier(tev_stage.color_modifier2, GetSource(tev_stage.color_source2)),
-                    GetColorModifier(tev_stage.color_modifier3, GetSource(tev_stage.color_source3))
-                };
-                auto color_output = ColorCombine(tev_stage.color_op, color_result);
-
-                // alpha combiner
-                std::array<u8,3> alpha_result = {
-                    GetAlphaModifier(tev_stage.alpha_modifier1, GetSource(tev_stage.alpha_source1)),
-                    GetAlphaModifier(tev_stage.alpha_modifier2, GetSource(tev_stage.alpha_source2)),
-                    GetAlphaModifier(tev_stage.alpha_modifier3, GetSource(tev_stage.alpha_source3))
-                };
-                auto alpha_output = AlphaCombine(tev_stage.alpha_op, alpha_result);
-
-                combiner_output[0] = std::min((unsigned)255, color_output.r() * tev_stage.GetColorMultiplier());
-                combiner_output[1] = std::min((unsigned)255, color_output.g() * tev_stage.GetColorMultiplier());
-                combiner_output[2] = std::min((unsigned)255, color_output.b() * tev_stage.GetColorMultiplier());
-                combiner_output[3] = std::min((unsigned)255, alpha_output * tev_stage.GetAlphaMultiplier());
-
-                if (registers.tev_combiner_buffer_input.TevStageUpdatesCombinerBufferColor(tev_stage_index)) {
-                    combiner_buffer.r() = combiner_output.r();
-                    combiner_buffer.g() = combiner_output.g();
-                    combiner_buffer.b() = combiner_output.b();
-                }
+            case regs.output_merger.LessThan:
+                pass = combiner_output.a() < regs.output_merger.alpha_test.ref;
+                break;
 
-                if (registers.tev_combiner_buffer_input.TevStageUpdatesCombinerBufferAlpha(tev_stage_index)) {
-                    combiner_buffer.a() = combiner_output.a();
-                }
+            case regs.output_merger.LessThanOrEqual:
+                pass = combiner_output.a() <= regs.output_merger.alpha_test.ref;
+                break;
+
+            case regs.output_merger.GreaterThan:
+                pass = combiner_output.a() > regs.output_merger.alpha_test.ref;
+                break;
+
+            case regs.output_merger.GreaterThanOrEqual:
+                pass = combiner_output.a() >= regs.output_merger.alpha_test.ref;
+                break;
             }
 
-            if (registers.output_merger.alpha_test.enable) {
-                bool pass = false;
+            if (!pass) {
+                ++alpha_test_rejects;
+                return;
+            }
+        }
 
-                switch (registers.output_merger.alpha_test.func) {
-                case registers.output_merger.Never:
-                    pass = false;
-                    break;
+        // TODO: Does depth indeed only get written even if depth testing is enabled?
+        if (regs.output_merger.depth_test_enable) {
+            if (!early_depth_test && !PassesDepthTest(regs, z, GetDepth(regs, x >> 4, y >> 4))) {
+                ++depth_test_rejects;
+                return;
+            }
 
-                case registers.output_merger.Always:
-                    pass = true;
-                    break;
+            if (regs.output_merger.depth_write_enable)
+                SetDepth(regs, x >> 4, y >> 4, z);
+        }
 
-                case registers.output_merger.Equal:
-                    pass = combiner_output.a() == registers.output_merger.alpha_test.ref;
-                    break;
+        auto dest = GetPixel(regs, x >> 4, y >> 4);
+        Math::Vec4<u8> blend_output = combiner_output;
 
-                case registers.output_merger.NotEqual:
-                    pass = combiner_output.a() != registers.output_merger.alpha_test.ref;
-                    break;
+        if (regs.output_merger.alphablend_enable) {
+            auto params = regs.output_merger.alpha_blending;
 
-                case registers.output_merger.LessThan:
-                    pass = combiner_output.a() < registers.output_merger.alpha_test.ref;
-                    break;
+            auto LookupFactorRGB = [&](decltype(params)::BlendFactor factor) -> Math::Vec3<u8> {
+                switch (factor) {
+                case params.Zero:
+                    return Math::Vec3<u8>(0, 0, 0);
 
-                case registers.output_merger.LessThanOrEqual:
-                    pass = combiner_output.a() <= registers.output_merger.alpha_test.ref;
-                    break;
+                case params.One:
+                    return Math::Vec3<u8>(255, 255, 255);
 
-                case registers.output_merger.GreaterThan:
-                    pass = combiner_output.a() > registers.output_merger.alpha_test.ref;
-                    break;
+                case params.SourceColor:
+                    return combiner_output.rgb();
+
+                case params.OneMinusSourceColor:
+                    return Math::Vec3<u8>(255 - combiner_output.r(), 255 - combiner_output.g(), 255 - combiner_output.b());
+
+                case params.DestColor:
+                    return dest.rgb();
+
+                case params.OneMinusDestColor:
+                    return Math::Vec3<u8>(255 - dest.r(), 255 - dest.g(), 255 - dest.b());
+
+                case params.SourceAlpha:
+                    return Math::Vec3<u8>(combiner_output.a(), combiner_output.a(), combiner_output.a());
+
+                case params.OneMinusSourceAlpha:
+                    return Math::Vec3<u8>(255 - combiner_output.a(), 255 - combiner_output.a(), 255 - combiner_output.a());
+
+                case params.DestAlpha:
+                    return Math::Vec3<u8>(dest.a(), dest.a(), dest.a());
+
+                case params.OneMinusDestAlpha:
+                    return Math::Vec3<u8>(255 - dest.a(), 255 - dest.a(), 255 - dest.a());
+
+                case params.ConstantColor:
+                    return Math::Vec3<u8>(regs.output_merger.blend_const.r, regs.output_merger.blend_const.g, regs.output_merger.blend_const.b);
+
+                case params.OneMinusConstantColor:
+                    return Math::Vec3<u8>(255 - regs.output_merger.blend_const.r, 255 - regs.output_merger.blend_const.g, 255 - regs.output_merger.blend_const.b);
 
-                case registers.output_merger.GreaterThanOrEqual:
-                    pass = combiner_output.a() >= registers.output_merger.alpha_test.ref;
+                case params.ConstantAlpha:
+                    return Math::Vec3<u8>(regs.output_merger.blend_const.a, regs.output_merger.blend_const.a, regs.output_merger.blend_const.a);
+
+                case params.OneMinusConstantAlpha:
+                    return Math::Vec3<u8>(255 - regs.output_merger.blend_const.a, 255 - regs.output_merger.blend_const.a, 255 - regs.output_merger.blend_const.a);
+
+                default:
+                    LOG_CRITICAL(HW_GPU, "Unknown color blend factor %x", factor);
+                    UNIMPLEMENTED();
                     break;
                 }
+            };
 
-                if (!pass)
-                    continue;
-            }
+            auto LookupFactorA = [&](decltype(params)::BlendFactor factor) -> u8 {
+                switch (factor) {
+                case params.Zero:
+                    return 0;
 
-            // TODO: Does depth indeed only get written even if depth testing is enabled?
-            if (registers.output_merger.depth_test_enable) {
-                unsigned num_bits = Pica::Regs::DepthBitsPerPixel(registers.framebuffer.depth_format);
-                u32 z = (u32)((v0.screenpos[2].ToFloat32() * w0 +
-                               v1.screenpos[2].ToFloat32() * w1 +
-                               v2.screenpos[2].ToFloat32() * w2) * ((1 << num_bits) - 1) / wsum);
-                u32 ref_z = GetDepth(x >> 4, y >> 4);
+                case params.One:
+                    return 255;
 
-                bool pass = false;
+                case params.SourceAlpha:
+                    return combiner_output.a();
 
-                switch (registers.output_merger.depth_test_func) {
-                case registers.output_merger.Never:
-                    pass = false;
-                    break;
+                case params.OneMinusSourceAlpha:
+                    return 255 - combiner_output.a();
 
-                case registers.output_merger.Always:
-                    pass = true;
-                    break;
+                case params.DestAlpha:
+                    return dest.a();
+
+                case params.OneMinusDestAlpha:
+                    return 255 - dest.a();
 
-                case registers.output_merger.Equal:
-                    pass = z == ref_z;
+                case params.ConstantAlpha:
+                    return regs.output_merger.blend_const.a;
+
+                case params.OneMinusConstantAlpha:
+                    return 255 - regs.output_merger.blend_const.a;
+
+                default:
+                    LOG_CRITICAL(HW_GPU, "Unknown alpha blend factor %x", factor);
+                    UNIMPLEMENTED();
                     break;
+                }
+            };
+
+            using BlendEquation = decltype(params)::BlendEquation;
+            static auto EvaluateBlendEquation = [](const Math::Vec4<u8>& src, const Math::Vec4<u8>& srcfactor,
+                                                   const Math::Vec4<u8>& dest, const Math::Vec4<u8>& destfactor,
+                                                   BlendEquation equation) {
+                Math::Vec4<int> result;
+
+                auto src_result = (src  *  srcfactor).Cast<int>();
+                auto dst_result = (dest * destfactor).Cast<int>();
 
-                case registers.output_merger.NotEqual:
-                    pass = z != ref_z;
+                switch (equation) {
+                case BlendEquation::Add:
+                    result = (src_result + dst_result) / 255;
                     break;
 
-                case registers.output_merger.LessThan:
-                    pass = z < ref_z;
+                case BlendEquation::Subtract:
+                    result = (src_result - dst_result) / 255;
                     break;
 
-                case registers.output_merger.LessThanOrEqual:
-                    pass = z <= ref_z;
+                case BlendEquation::ReverseSubtract:
+                    result = (dst_result - src_result) / 255;
                     break;
 
-                case registers.output_merger.GreaterThan:
-                    pass = z > ref_z;
+                // TODO: How do these two actually work?
+                //       OpenGL doesn't include the blend factors in the min/max computations,
+                //       but is this what the 3DS actually does?
+                case BlendEquation::Min:
+                    result.r() = std::min(src.r(), dest.r());
+                    result.g() = std::min(src.g(), dest.g());
+                    result.b() = std::min(src.b(), dest.b());
+                    result.a() = std::min(src.a(), dest.a());
                     break;
 
-                case registers.output_merger.GreaterThanOrEqual:
-                    pass = z >= ref_z;
+                case BlendEquation::Max:
+                    result.r() = std::max(src.r(), dest.r());
+                    result.g() = std::max(src.g(), dest.g());
+                    result.b() = std::max(src.b(), dest.b());
+                    result.a() = std::max(src.a(), dest.a());
                     break;
+
+                default:
+                    LOG_CRITICAL(HW_GPU, "Unknown RGB blend equation %x", equation);
+                    UNIMPLEMENTED();
                 }
 
-                if (!pass)
-                    continue;
+                return Math::Vec4<u8>(MathUtil::Clamp(result.r(), 0, 255),
+                                MathUtil::Clamp(result.g(), 0, 255),
+                                MathUtil::Clamp(result.b(), 0, 255),
+                                MathUtil::Clamp(result.a(), 0, 255));
+            };
+
+            auto srcfactor = Math::MakeVec(LookupFactorRGB(params.factor_source_rgb),
+                                           LookupFactorA(params.factor_source_a));
+            auto dstfactor = Math::MakeVec(LookupFactorRGB(params.factor_dest_rgb),
+                                           LookupFactorA(params.factor_dest_a));
+
+            blend_output     = EvaluateBlendEquation(combiner_output, srcfactor, dest, dstfactor, params.blend_equation_rgb);
+            blend_output.a() = EvaluateBlendEquation(combiner_output, srcfactor, dest, dstfactor, params.blend_equation_a).a();
+        } else {
+            LOG_CRITICAL(HW_GPU, "logic op: %x", (int)regs.output_merger.logic_op.op.Value());
+            UNIMPLEMENTED();
+        }
+
+        const Math::Vec4<u8> result = {
+            regs.output_merger.red_enable   ? blend_output.r() : dest.r(),
+            regs.output_merger.green_enable ? blend_output.g() : dest.g(),
+            regs.output_merger.blue_enable  ? blend_output.b() : dest.b(),
+            regs.output_merger.alpha_enable ? blend_output.a() : dest.a()
+        };
+
+        DrawPixel(regs, x >> 4, y >> 4, result);
+        ++fragments_passed;
+    };
 
-                if (registers.output_merger.depth_write_enable)
-                    SetDepth(x >> 4, y >> 4, z);
+    // The barycentric coordinates w0, w1 and w2 are the edge functions of the edges opposite to
+    // the respective vertices
+    const EdgeFunction edges[3] = {
+        { vtxpos[1].xy(), vtxpos[2].xy(), bias0 },
+        { vtxpos[2].xy(), vtxpos[0].xy(), bias1 },
+        { vtxpos[0].xy(), vtxpos[1].xy(), bias2 },
+    };
+
+    // The range is walked in blocks of 8x8 pixels aligned to those the framebuffer is stored in,
+    // which start at rows where the flipped y coordinate is a multiple of 8 (see DrawPixel).
+    const int block_row_offset = (regs.framebuffer.height + 1) & 7;
+    const int first_block_x = x_begin & ~7;
+    const int first_block_y = y_begin - ((y_begin - block_row_offset) & 7);
+
+    for (int block_y = first_block_y; block_y < y_end; block_y += 8) {
+        const int block_y_begin = std::max(block_y, y_begin);
+        const int block_y_end = std::min(block_y + 8, y_end);
+
+        for (int block_x = first_block_x; block_x < x_end; block_x += 8) {
+            const int block_x_begin = std::max(block_x, x_begin);
+            const int block_x_end = std::min(block_x + 8, x_end);
+
+            // Edge functions are linear, hence their extremes within the block are found at its
+            // corners. Blocks entirely outside of an edge are skipped, and the per-pixel coverage
+            // test is skipped for blocks entirely inside of all edges.
+            bool block_outside = false;
+            bool block_inside = true;
+            for (const auto& edge : edges) {
+                const int low_x = (edge.step_x >= 0) ? block_x_begin : block_x_end - 1;
+                const int low_y = (edge.step_y >= 0) ? block_y_begin : block_y_end - 1;
+                const int high_x = (edge.step_x >= 0) ? block_x_end - 1 : block_x_begin;
+                const int high_y = (edge.step_y >= 0) ? block_y_end - 1 : block_y_begin;
+                if (edge.Evaluate(high_x, high_y) < 0)
+                    block_outside = true;
+                if (edge.Evaluate(low_x, low_y) < 0)
+                    block_inside = false;
             }
+            if (block_outside)
+                continue;
 
-            auto dest = GetPixel(x >> 4, y >> 4);
-            Math::Vec4<u8> blend_output = combiner_output;
+            // Pixels are processed in 2x2 quads aligned to the block. The edge functions are
+            // stepped from quad to quad and offset for the pixels within each quad.
+            int row_w[3];
+            for (int i = 0; i < 3; ++i)
+                row_w[i] = edges[i].Evaluate(block_x, block_y);
 
-            if (registers.output_merger.alphablend_enable) {
-                auto params = registers.output_merger.alpha_blending;
+            for (int quad_y = block_y; quad_y < block_y_end; quad_y += 2) {
+                int quad_w[3] = { row_w[0], row_w[1], row_w[2] };
 
-                auto LookupFactorRGB = [&](decltype(params)::BlendFactor factor) -> Math::Vec3<u8> {
-                    switch (factor) {
-                    case params.Zero:
-                        return Math::Vec3<u8>(0, 0, 0);
+                for (int quad_x = block_x; quad_x < block_x_end; quad_x += 2) {
+                    for (int pixel = 0; pixel < 4; ++pixel) {
+                        const int pixel_x = quad_x + (pixel & 1);
+                        const int pixel_y = quad_y + (pixel >> 1);
+                        if (pixel_x < block_x_begin || pixel_x >= block_x_end ||
+                            pixel_y < block_y_begin || pixel_y >= block_y_end)
+                            continue;
 
-                    case params.One:
-                        return Math::Vec3<u8>(255, 255, 255);
+                        int w[3];
+                        for (int i = 0; i < 3; ++i)
+                            w[i] = quad_w[i] + (pixel & 1) * edges[i].step_x + (pixel >> 1) * edges[i].step_y;
 
-                    case params.SourceColor:
-                        return combiner_output.rgb();
+                        // If current pixel is not covered by the current primitive
+                        if (!block_inside && (w[0] < 0 || w[1] < 0 || w[2] < 0))
+                            continue;
 
-                    case params.OneMinusSourceColor:
-                        return Math::Vec3<u8>(255 - combiner_output.r(), 255 - combiner_output.g(), 255 - combiner_output.b());
+                        ShadeFragment((u16)((pixel_x << 4) + 8), (u16)((pixel_y << 4) + 8), w[0], w[1], w[2]);
+                    }
 
-                    case params.DestColor:
-                        return dest.rgb();
+                    for (int i = 0; i < 3; ++i)
+                        quad_w[i] += 2 * edges[i].step_x;
+                }
 
-                    case params.OneMinusDestColor:
-                        return Math::Vec3<u8>(255 - dest.r(), 255 - dest.g(), 255 - dest.b());
+                for (int i = 0; i < 3; ++i)
+                    row_w[i] += 2 * edges[i].step_y;
+            }
+        }
+    }
 
-                    case params.SourceAlpha:
-                        return Math::Vec3<u8>(combiner_output.a(), combiner_output.a(), combiner_output.a());
+    stats.fragments_tested += fragments_tested;
+    stats.alpha_test_rejects += alpha_test_rejects;
+    stats.depth_test_rejects += depth_test_rejects;
+    stats.early_depth_test_rejects += early_depth_test_rejects;
+    stats.fragments_passed += fragments_passed;
+    for (int i = 0; i < 3; ++i)
+        stats.texture_lookups[i] += texture_lookups[i];
+}
 
-                    case params.OneMinusSourceAlpha:
-                        return Math::Vec3<u8>(255 - combiner_output.a(), 255 - combiner_output.a(), 255 - combiner_output.a());
+/// Rasterizer coordinates are 12.4 fixed-point values, hence no pixel lies beyond this
+static const int MAX_PIXEL_COORDINATE = 1 << 12;
 
-                    case params.DestAlpha:
-                        return Math::Vec3<u8>(dest.a(), dest.a(), dest.a());
+/**
+ * Width and height of the square screen tiles which the triangles are binned into. This is a
+ * multiple of the 8x8 pixel blocks the framebuffer is stored in, so that no two tiles share a block.
+ */
+static const int TILE_SIZE = 32;
 
-                    case params.OneMinusDestAlpha:
-                        return Math::Vec3<u8>(255 - dest.a(), 255 - dest.a(), 255 - dest.a());
+/// Triangles are handed to the rasterizer thread once this many have been set up, even mid-draw
+static const size_t MAX_BATCH_TRIANGLES = 1024;
 
-                    case params.ConstantColor:
-                        return Math::Vec3<u8>(registers.output_merger.blend_const.r, registers.output_merger.blend_const.g, registers.output_merger.blend_const.b);
+/**
+ * Triangles of a draw call which are rasterized together on the rasterizer threads. Since the
+ * emulation thread goes on processing Pica commands in the meantime, the batch keeps its own copy
+ * of the Pica registers.
+ */
+struct TriangleBatch {
+    Regs regs;
 
-                    case params.OneMinusConstantColor:
-                        return Math::Vec3<u8>(255 - registers.output_merger.blend_const.r, 255 - registers.output_merger.blend_const.g, 255 - registers.output_merger.blend_const.b);
+    /// Index of the draw (in its frame) which the fragment statistics are added to
+    u32 draw_index;
 
-                    case params.ConstantAlpha:
-                        return Math::Vec3<u8>(registers.output_merger.blend_const.a, registers.output_merger.blend_const.a, registers.output_merger.blend_const.a);
+    std::vector<Triangle> triangles;
 
-                    case params.OneMinusConstantAlpha:
-                        return Math::Vec3<u8>(255 - registers.output_merger.blend_const.a, 255 - registers.output_merger.blend_const.a, 255 - registers.output_merger.blend_const.a);
+    // Filled in by the rasterizer thread
 
-                    default:
-                        LOG_CRITICAL(HW_GPU, "Unknown color blend factor %x", factor);
-                        UNIMPLEMENTED();
-                        break;
-                    }
-                };
+    int num_tiles_x;
+    int num_tiles_y;
 
-                auto LookupFactorA = [&](decltype(params)::BlendFactor factor) -> u8 {
-                    switch (factor) {
-                    case params.Zero:
-                        return 0;
+    /// Indices of the triangles overlapping each tile, in submission order
+    std::vector<std::vector<u32>> tile_triangles;
 
-                    case params.One:
-                        return 255;
+    /// Fragment statistics of each tile, and their sum once the batch is done
+    std::vector<DrawStatistics> tile_stats;
+    DrawStatistics stats;
+};
 
-                    case params.SourceAlpha:
-                        return combiner_output.a();
+// State only accessed by the emulation thread
+
+/// Number of threads rasterizing triangles, 1 if they are rasterized on the emulation thread
+static unsigned num_rasterizer_threads = 0;
+/// Batch of the triangles which were set up but not submitted yet
+static std::unique_ptr<TriangleBatch> current_batch;
+/// Batches which can be reused, to avoid reallocating their buffers
+static std::vector<std::unique_ptr<TriangleBatch>> free_batches;
+
+// State shared with the rasterizer thread
+
+static std::thread rasterizer_thread;
+/// Worker threads shading the tiles of a batch, only used by the rasterizer thread
+static std::unique_ptr<Common::ThreadPool> tile_thread_pool;
+
+static std::mutex batch_queue_mutex;
+/// Signals the rasterizer thread that a batch was queued or that it should exit
+static std::condition_variable batch_queued;
+/// Signals the emulation thread that a batch was rasterized
+static std::condition_variable batch_finished;
+/// Batches waiting to be rasterized, in submission order
+static std::deque<std::unique_ptr<TriangleBatch>> queued_batches;
+/// Batches which were rasterized, but whose statistics were not collected yet
+static std::vector<std::unique_ptr<TriangleBatch>> finished_batches;
+/// Whether the rasterizer thread is currently working on a batch
+static bool rasterizing_batch = false;
+static bool exit_rasterizer_thread = false;
+
+/// Returns the tile containing the given framebuffer coordinate, pixels outside the framebuffer are assigned to the border tiles
+static int GetTileIndex(int coordinate, int num_tiles) {
+    return MathUtil::Clamp(coordinate >= 0 ? coordinate / TILE_SIZE : -1, 0, num_tiles - 1);
+}
 
-                    case params.OneMinusSourceAlpha:
-                        return 255 - combiner_output.a();
+/// Bins the triangles of the batch into screen tiles and rasterizes the tiles in parallel
+static void RasterizeBatch(TriangleBatch& batch) {
+    Common::Profiling::ProfileScope scope(profile_rasterize_batch);
 
-                    case params.DestAlpha:
-                        return dest.a();
+    const Regs& regs = batch.regs;
 
-                    case params.OneMinusDestAlpha:
-                        return 255 - dest.a();
+    // The framebuffer is stored from bottom to top, see DrawPixel. Tiles are laid out in
+    // framebuffer rows rather than in rasterizer rows so that they are aligned to its blocks.
+    // NOTE: The framebuffer height register contains the actual FB height minus one.
+    const int flip_y = regs.framebuffer.height;
+    batch.num_tiles_x = std::max<int>(1, (regs.framebuffer.width + TILE_SIZE - 1) / TILE_SIZE);
+    batch.num_tiles_y = std::max<int>(1, (flip_y + TILE_SIZE) / TILE_SIZE);
+    const int num_tiles = batch.num_tiles_x * batch.num_tiles_y;
+
+    batch.tile_triangles.resize(num_tiles);
+    for (auto& tile : batch.tile_triangles)
+        tile.clear();
+
+    for (u32 index = 0; index < batch.triangles.size(); ++index) {
+        const Triangle& triangle = batch.triangles[index];
+        if (triangle.min_x >= triangle.max_x || triangle.min_y >= triangle.max_y)
+            continue;
+
+        // Bounding box in pixels, including the last row and column
+        const int min_x = triangle.min_x >> 4;
+        const int max_x = (triangle.max_x >> 4) - 1;
+        const int min_y = triangle.min_y >> 4;
+        const int max_y = (triangle.max_y >> 4) - 1;
+
+        const int first_tile_x = GetTileIndex(min_x, batch.num_tiles_x);
+        const int last_tile_x = GetTileIndex(max_x, batch.num_tiles_x);
+        const int first_tile_y = GetTileIndex(flip_y - max_y, batch.num_tiles_y);
+        const int last_tile_y = GetTileIndex(flip_y - min_y, batch.num_tiles_y);
+
+        for (int tile_y = first_tile_y; tile_y <= last_tile_y; ++tile_y)
+            for (int tile_x = first_tile_x; tile_x <= last_tile_x; ++tile_x)
+                batch.tile_triangles[tile_y * batch.num_tiles_x + tile_x].push_back(index);
+    }
 
-                    case params.ConstantAlpha:
-                        return registers.output_merger.blend_const.a;
+    batch.tile_stats.assign(num_tiles, DrawStatistics());
 
-                    case params.OneMinusConstantAlpha:
-                        return 255 - registers.output_merger.blend_const.a;
+    // Each pixel belongs to exactly one tile, and the triangles of each tile are rasterized in
+    // submission order, so the result is the same as when rasterizing the triangles one by one.
+    tile_thread_pool->ParallelFor(num_tiles, [&](unsigned tile) {
+        const auto& tile_triangles = batch.tile_triangles[tile];
+        if (tile_triangles.empty())
+            return;
 
-                    default:
-                        LOG_CRITICAL(HW_GPU, "Unknown alpha blend factor %x", factor);
-                        UNIMPLEMENTED();
-                        break;
-                    }
-                };
-
-                using BlendEquation = decltype(params)::BlendEquation;
-                static auto EvaluateBlendEquation = [](const Math::Vec4<u8>& src, const Math::Vec4<u8>& srcfactor,
-                                                       const Math::Vec4<u8>& dest, const Math::Vec4<u8>& destfactor,
-                                                       BlendEquation equation) {
-                    Math::Vec4<int> result;
-
-                    auto src_result = (src  *  srcfactor).Cast<int>();
-                    auto dst_result = (dest * destfactor).Cast<int>();
-
-                    switch (equation) {
-                    case BlendEquation::Add:
-                        result = (src_result + dst_result) / 255;
-                        break;
-
-                    case BlendEquation::Subtract:
-                        result = (src_result - dst_result) / 255;
-                        break;
-
-                    case BlendEquation::ReverseSubtract:
-                        result = (dst_result - src_result) / 255;
-                        break;
-
-                    // TODO: How do these two actually work?
-                    //       OpenGL doesn't include the blend factors in the min/max computations,
-                    //       but is this what the 3DS actually does?
-                    case BlendEquation::Min:
-                        result.r() = std::min(src.r(), dest.r());
-                        result.g() = std::min(src.g(), dest.g());
-                        result.b() = std::min(src.b(), dest.b());
-                        result.a() = std::min(src.a(), dest.a());
-                        break;
-
-                    case BlendEquation::Max:
-                        result.r() = std::max(src.r(), dest.r());
-                        result.g() = std::max(src.g(), dest.g());
-                        result.b() = std::max(src.b(), dest.b());
-                        result.a() = std::max(src.a(), dest.a());
-                        break;
+        const int tile_x = tile % batch.num_tiles_x;
+        const int tile_y = tile / batch.num_tiles_x;
+
+        // Pixel range covered by the tile, border tiles extend to the rasterizer's limits
+        const int x_begin = (tile_x == 0) ? 0 : tile_x * TILE_SIZE;
+        const int x_end = (tile_x == batch.num_tiles_x - 1) ? MAX_PIXEL_COORDINATE : (tile_x + 1) * TILE_SIZE;
+        const int y_begin = (tile_y == batch.num_tiles_y - 1) ? 0 : flip_y - (tile_y + 1) * TILE_SIZE + 1;
+        const int y_end = (tile_y == 0) ? MAX_PIXEL_COORDINATE : flip_y - tile_y * TILE_SIZE + 1;
+
+        DrawStatistics stats;
+        for (u32 index : tile_triangles)
+            RasterizeTriangle(regs, batch.triangles[index], x_begin, x_end, y_begin, y_end, stats);
+        batch.tile_stats[tile] = stats;
+    });
+
+    batch.stats = DrawStatistics();
+    for (const auto& stats : batch.tile_stats) {
+        batch.stats.fragments_tested += stats.fragments_tested;
+        batch.stats.alpha_test_rejects += stats.alpha_test_rejects;
+        batch.stats.depth_test_rejects += stats.depth_test_rejects;
+        batch.stats.early_depth_test_rejects += stats.early_depth_test_rejects;
+        batch.stats.fragments_passed += stats.fragments_passed;
+        for (int i = 0; i < 3; ++i)
+            batch.stats.texture_lookups[i] += stats.texture_lookups[i];
+    }
+}
 
-                    default:
-                        LOG_CRITICAL(HW_GPU, "Unknown RGB blend equation %x", equation);
-                        UNIMPLEMENTED();
-                    }
+static void RasterizerThreadLoop() {
+    Common::SetCurrentThreadName("RasterizerThread");
 
-                    return Math::Vec4<u8>(MathUtil::Clamp(result.r(), 0, 255),
-                                    MathUtil::Clamp(result.g(), 0, 255),
-                                    MathUtil::Clamp(result.b(), 0, 255),
-                                    MathUtil::Clamp(result.a(), 0, 255));
-                };
-
-                auto srcfactor = Math::MakeVec(LookupFactorRGB(params.factor_source_rgb),
-                                               LookupFactorA(params.factor_source_a));
-                auto dstfactor = Math::MakeVec(LookupFactorRGB(params.factor_dest_rgb),
-                                               LookupFactorA(params.factor_dest_a));
-
-                blend_output     = EvaluateBlendEquation(combiner_output, srcfactor, dest, dstfactor, params.blend_equation_rgb);
-                blend_output.a() = EvaluateBlendEquation(combiner_output, srcfactor, dest, dstfactor, params.blend_equation_a).a();
-            } else {
-                LOG_CRITICAL(HW_GPU, "logic op: %x", registers.output_merger.logic_op);
-                UNIMPLEMENTED();
-            }
+    while (true) {
+        std::unique_ptr<TriangleBatch> batch;
+        {
+            std::unique_lock<std::mutex> lock(batch_queue_mutex);
+            batch_queued.wait(lock, [] { return exit_rasterizer_thread || !queued_batches.empty(); });
 
-            const Math::Vec4<u8> result = {
-                registers.output_merger.red_enable   ? blend_output.r() : dest.r(),
-                registers.output_merger.green_enable ? blend_output.g() : dest.g(),
-                registers.output_merger.blue_enable  ? blend_output.b() : dest.b(),
-                registers.output_merger.alpha_enable ? blend_output.a() : dest.a()
-            };
+            // Queued batches are still completed when exiting
+            if (queued_batches.empty())
+                return;
+
+            batch = std::move(queued_batches.front());
+            queued_batches.pop_front();
+            rasterizing_batch = true;
+        }
+
+        RasterizeBatch(*batch);
 
-            DrawPixel(x >> 4, y >> 4, result);
+        {
+            std::lock_guard<std::mutex> lock(batch_queue_mutex);
+            finished_batches.push_back(std::move(batch));
+            rasterizing_batch = false;
         }
+        batch_finished.notify_all();
+    }
+}
+
+static void StopRasterizerThreads() {
+    if (!rasterizer_thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(batch_queue_mutex);
+        exit_rasterizer_thread = true;
+    }
+    batch_queued.notify_one();
+    rasterizer_thread.join();
+    tile_thread_pool.reset();
+}
+
+/**
+ * Adds the statistics of the rasterized batches to their draws and recycles the batches. Must be
+ * called with batch_queue_mutex held.
+ */
+static void CollectFinishedBatches() {
+    for (auto& batch : finished_batches) {
+        DrawStats::AddRasterizerStatistics(batch->draw_index, batch->stats);
+        batch->triangles.clear();
+        free_batches.push_back(std::move(batch));
+    }
+    finished_batches.clear();
+}
+
+/// Starts or stops the rasterizer threads if the configured number of threads changed
+static void UpdateRasterizerThreads() {
+    unsigned num_threads = Settings::values.rasterizer_threads > 0
+                         ? Settings::values.rasterizer_threads
+                         : std::thread::hardware_concurrency();
+    num_threads = std::max(num_threads, 1u);
+    if (num_threads == num_rasterizer_threads)
+        return;
+
+    WaitForIdle();
+    StopRasterizerThreads();
+
+    num_rasterizer_threads = num_threads;
+    if (num_threads > 1) {
+        // The rasterizer thread takes part in shading the tiles, so it counts as one of the threads
+        tile_thread_pool = Common::make_unique<Common::ThreadPool>(num_threads);
+        exit_rasterizer_thread = false;
+        rasterizer_thread = std::thread(RasterizerThreadLoop);
     }
 }
 
 void ProcessTriangle(const VertexShader::OutputVertex& v0,
                      const VertexShader::OutputVertex& v1,
                      const VertexShader::OutputVertex& v2) {
-    ProcessTriangleInternal(v0, v1, v2);
+    Common::Profiling::ProfileScope scope(profile_process_triangle);
+
+    if (current_batch == nullptr)
+        UpdateRasterizerThreads();
+
+    if (num_rasterizer_threads <= 1) {
+        Triangle triangle;
+        if (SetupTriangle(registers, v0, v1, v2, triangle))
+            RasterizeTriangle(registers, triangle, 0, MAX_PIXEL_COORDINATE, 0, MAX_PIXEL_COORDINATE, DrawStats::g_current_draw);
+        return;
+    }
+
+    if (current_batch == nullptr) {
+        if (!free_batches.empty()) {
+            current_batch = std::move(free_batches.back());
+            free_batches.pop_back();
+        } else {
+            current_batch = Common::make_unique<TriangleBatch>();
+        }
+
+        // Regs can't be assigned since BitField disables copy assignment
+        std::memcpy(&current_batch->regs, &registers, sizeof(Regs));
+        current_batch->draw_index = DrawStats::g_current_draw.draw_index;
+    }
+
+    current_batch->triangles.emplace_back();
+    if (!SetupTriangle(current_batch->regs, v0, v1, v2, current_batch->triangles.back()))
+        current_batch->triangles.pop_back();
+
+    if (current_batch->triangles.size() >= MAX_BATCH_TRIANGLES)
+        SubmitTriangles();
+}
+
+void SubmitTriangles() {
+    if (current_batch == nullptr)
+        return;
+
+    if (current_batch->triangles.empty()) {
+        free_batches.push_back(std::move(current_batch));
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(batch_queue_mutex);
+        queued_batches.push_back(std::move(current_batch));
+        CollectFinishedBatches();
+    }
+    batch_queued.notify_one();
+}
+
+void WaitForIdle() {
+    SubmitTriangles();
+
+    std::unique_lock<std::mutex> lock(batch_queue_mutex);
+    batch_finished.wait(lock, [] { return queued_batches.empty() && !rasterizing_batch; });
+    CollectFinishedBatches();
+}
+
+void Shutdown() {
+    WaitForIdle();
+    StopRasterizerThreads();
+    num_rasterizer_threads = 0;
+    free_batches.clear();
 }
 
 } // namespace Rasterizer
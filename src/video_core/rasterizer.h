@@ -12,10 +12,26 @@ namespace VertexShader {
 
 namespace Rasterizer {
 
+/**
+ * Sets up the given triangle and either rasterizes it right away or, if rasterizer threads are
+ * enabled, adds it to the batch of triangles to be rasterized on these threads.
+ */
 void ProcessTriangle(const VertexShader::OutputVertex& v0,
                      const VertexShader::OutputVertex& v1,
                      const VertexShader::OutputVertex& v2);
 
+/// Hands the triangles set up so far to the rasterizer threads, called at the end of each draw
+void SubmitTriangles();
+
+/**
+ * Blocks until all triangles have been rasterized. Must be called before anything accesses the
+ * framebuffer or depth buffer other than the rasterizer itself.
+ */
+void WaitForIdle();
+
+/// Finishes outstanding work and stops the rasterizer threads
+void Shutdown();
+
 } // namespace Rasterizer
 
 } // namespace Pica
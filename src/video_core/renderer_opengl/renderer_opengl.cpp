@@ -12,6 +12,8 @@
 #include "common/logging/log.h"
 #include "common/profiler_reporting.h"
 
+#include "video_core/draw_stats.h"
+#include "video_core/rasterizer.h"
 #include "video_core/video_core.h"
 #include "video_core/renderer_opengl/renderer_opengl.h"
 #include "video_core/renderer_opengl/gl_shader_util.h"
@@ -61,11 +63,19 @@ RendererOpenGL::RendererOpenGL() {
 RendererOpenGL::~RendererOpenGL() {
 }
 
+static Common::Profiling::ScopeCategory profile_load_framebuffer("RendererOpenGL::LoadFramebuffer");
+static Common::Profiling::ScopeCategory profile_draw_screens("RendererOpenGL::DrawScreens");
+
 /// Swap buffers (render frame)
 void RendererOpenGL::SwapBuffers() {
+    // The displayed framebuffers and the statistics of the frame must be complete
+    Pica::Rasterizer::WaitForIdle();
+
     render_window->MakeCurrent();
 
     for(int i : {0, 1}) {
+        Common::Profiling::ProfileScope scope(profile_load_framebuffer);
+
         const auto& framebuffer = GPU::g_regs.framebuffer_config[i];
 
         // Main LCD (0): 0x1ED02204, Sub LCD (1): 0x1ED02A04
@@ -101,6 +111,7 @@ void RendererOpenGL::SwapBuffers() {
 
     auto& profiler = Common::Profiling::GetProfilingManager();
     profiler.FinishFrame();
+    Pica::DrawStats::FinishFrame();
     {
         auto aggregator = Common::Profiling::GetTimingResultsAggregator();
         aggregator->AddFrame(profiler.GetPreviousFrameResults());
@@ -290,6 +301,8 @@ void RendererOpenGL::DrawSingleScreenRotated(const TextureInfo& texture, float x
  * Draws the emulated screens to the emulator window.
  */
 void RendererOpenGL::DrawScreens() {
+    Common::Profiling::ProfileScope scope(profile_draw_screens);
+
     auto layout = render_window->GetFramebufferLayout();
 
     glViewport(0, 0, layout.width, layout.height);
@@ -0,0 +1,129 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cstring>
+
+#include "common/logging/log.h"
+
+#include "core/mem_map.h"
+
+#include "video_core/vertex_loader.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace Pica {
+
+static_assert(sizeof(float24) == sizeof(float), "float24 is expected to wrap a float");
+
+/// Converts `N` elements of type `T` into float24s
+template <typename T, unsigned N>
+static void ConvertElements(const u8* source, Math::Vec4<float24>& attribute) {
+    for (unsigned i = 0; i < N; ++i) {
+        T value;
+        std::memcpy(&value, source + i * sizeof(T), sizeof(T));
+        attribute[i] = float24::FromFloat32(static_cast<float>(value));
+    }
+}
+
+/// Float elements are stored as is, so they are simply copied
+template <unsigned N>
+static void ConvertFloatElements(const u8* source, Math::Vec4<float24>& attribute) {
+    std::memcpy(&attribute[0], source, N * sizeof(float));
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+// Attributes with 4 integer elements are converted with a single SSE conversion. Attributes with
+// fewer elements use the generic version, since loading 4 elements could read past the source.
+// Only SSE2 is used, which every x86-64 CPU supports: the elements are widened to 32 bits by
+// unpacking them into the upper bits of each lane and shifting them back down.
+
+template <>
+void ConvertElements<s8, 4>(const u8* source, Math::Vec4<float24>& attribute) {
+    s32 packed;
+    std::memcpy(&packed, source, sizeof(packed));
+    __m128i values = _mm_cvtsi32_si128(packed);
+    values = _mm_unpacklo_epi8(values, values);
+    values = _mm_srai_epi32(_mm_unpacklo_epi16(values, values), 24);
+    _mm_storeu_ps(reinterpret_cast<float*>(&attribute[0]), _mm_cvtepi32_ps(values));
+}
+
+template <>
+void ConvertElements<u8, 4>(const u8* source, Math::Vec4<float24>& attribute) {
+    s32 packed;
+    std::memcpy(&packed, source, sizeof(packed));
+    const __m128i zero = _mm_setzero_si128();
+    __m128i values = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+    _mm_storeu_ps(reinterpret_cast<float*>(&attribute[0]), _mm_cvtepi32_ps(values));
+}
+
+template <>
+void ConvertElements<s16, 4>(const u8* source, Math::Vec4<float24>& attribute) {
+    __m128i values = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(source));
+    values = _mm_srai_epi32(_mm_unpacklo_epi16(values, values), 16);
+    _mm_storeu_ps(reinterpret_cast<float*>(&attribute[0]), _mm_cvtepi32_ps(values));
+}
+#endif
+
+/// Converters indexed by format and number of elements minus one
+static const VertexLoader::ConvertFunction convert_functions[4][4] = {
+    { ConvertElements<s8, 1>,  ConvertElements<s8, 2>,  ConvertElements<s8, 3>,  ConvertElements<s8, 4> },
+    { ConvertElements<u8, 1>,  ConvertElements<u8, 2>,  ConvertElements<u8, 3>,  ConvertElements<u8, 4> },
+    { ConvertElements<s16, 1>, ConvertElements<s16, 2>, ConvertElements<s16, 3>, ConvertElements<s16, 4> },
+    { ConvertFloatElements<1>, ConvertFloatElements<2>, ConvertFloatElements<3>, ConvertFloatElements<4> },
+};
+
+void VertexLoader::Setup() {
+    const auto& attribute_config = registers.vertex_attributes;
+    const u32 base_address = attribute_config.GetPhysicalBaseAddress();
+
+    num_total_attributes = attribute_config.GetNumTotalAttributes();
+    for (int i = 0; i < 16; ++i) {
+        attribute_loaders[i].source = nullptr;
+        attribute_loaders[i].stride = 0;
+        attribute_loaders[i].convert = nullptr;
+        attribute_loaders[i].is_default = attribute_config.IsDefaultAttribute(i);
+    }
+
+    // Setup attribute data from loaders
+    for (int loader = 0; loader < 12; ++loader) {
+        const auto& loader_config = attribute_config.attribute_loaders[loader];
+
+        u32 load_address = base_address + loader_config.data_offset;
+
+        // TODO: What happens if a loader overwrites a previous one's data?
+        for (unsigned component = 0; component < loader_config.component_count; ++component) {
+            u32 attribute_index = loader_config.GetComponent(component);
+            if (attribute_index >= 12) {
+                // Components 12 to 15 don't describe an attribute but 4 to 16 bytes of padding
+                load_address += (attribute_index - 11) * 4;
+                continue;
+            }
+
+            AttributeLoader& attribute = attribute_loaders[attribute_index];
+            auto format = attribute_config.GetFormat(attribute_index);
+            int num_elements = attribute_config.GetNumElements(attribute_index);
+
+            if (!attribute.is_default) {
+                attribute.source = Memory::GetPhysicalPointer(load_address);
+                attribute.stride = static_cast<u32>(loader_config.byte_count);
+                attribute.convert = convert_functions[static_cast<int>(format)][num_elements - 1];
+
+                if (attribute.source == nullptr) {
+                    LOG_ERROR(HW_GPU, "Attribute %u is loaded from invalid address 0x%08x",
+                              attribute_index, load_address);
+                }
+
+                LOG_TRACE(HW_GPU, "Attribute %u: %d elements of format %d at 0x%08x, stride %u",
+                          attribute_index, num_elements, static_cast<int>(format), load_address,
+                          attribute.stride);
+            }
+
+            load_address += attribute_config.GetStride(attribute_index);
+        }
+    }
+}
+
+} // namespace Pica
@@ -0,0 +1,63 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+
+#include "common/common_types.h"
+
+#include "video_core/pica.h"
+#include "video_core/vertex_shader.h"
+
+namespace Pica {
+
+/**
+ * Loads the input attributes of the vertices of a draw. The attribute layout given by the Pica
+ * registers is resolved once per draw by Setup, so that loading a vertex only needs one host
+ * pointer computation and one conversion call per attribute.
+ */
+class VertexLoader {
+public:
+    /// Converts the elements of an attribute from its source format, specialized per format and size
+    using ConvertFunction = void (*)(const u8* source, Math::Vec4<float24>& attribute);
+
+    /// Resolves the attribute layout of the current Pica register state
+    void Setup();
+
+    /// Number of input attributes loaded for each vertex
+    int GetNumTotalAttributes() const {
+        return num_total_attributes;
+    }
+
+    /**
+     * Loads the attributes of a vertex
+     * @param vertex Index of the vertex in the attribute arrays
+     * @param input Where to store the attributes. Attributes with no source are left untouched.
+     */
+    void LoadVertex(u32 vertex, VertexShader::InputVertex& input) const {
+        for (int i = 0; i < num_total_attributes; ++i) {
+            const AttributeLoader& loader = attribute_loaders[i];
+            if (loader.source != nullptr)
+                loader.convert(loader.source + loader.stride * vertex, input.attr[i]);
+            else if (loader.is_default)
+                input.attr[i] = VertexShader::GetDefaultAttribute(i);
+        }
+    }
+
+private:
+    struct AttributeLoader {
+        /// Host pointer to the attribute of the first vertex, null if not loaded from memory
+        const u8* source;
+        u32 stride;
+        ConvertFunction convert;
+        /// True if the attribute takes its default value instead
+        bool is_default;
+    };
+
+    int num_total_attributes = 0;
+    std::array<AttributeLoader, 16> attribute_loaders;
+};
+
+} // namespace Pica
@@ -2,19 +2,26 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <memory>
 #include <stack>
+#include <unordered_map>
 
-#include <boost/range/algorithm.hpp>
+#include <common/assert.h>
+#include <common/make_unique.h>
 
-#include <common/file_util.h>
-
-#include <core/mem_map.h>
+#include <core/settings.h>
 
 #include <nihstro/shader_bytecode.h>
 
-
 #include "pica.h"
 #include "vertex_shader.h"
+#include "vertex_shader_jit_x64.h"
+#include "vertex_shader_program.h"
+#include "vertex_shader_simd.h"
 #include "debug_utils/debug_utils.h"
 
 using nihstro::OpCode;
@@ -27,13 +34,7 @@ namespace Pica {
 
 namespace VertexShader {
 
-static struct {
-    Math::Vec4<float24> f[96];
-
-    std::array<bool,16> b;
-
-    std::array<Math::Vec4<u8>,4> i;
-} shader_uniforms;
+static ShaderSetup::Uniforms shader_uniforms;
 
 static Math::Vec4<float24> vs_default_attributes[16];
 
@@ -42,12 +43,17 @@ static Math::Vec4<float24> vs_default_attributes[16];
 static std::array<u32, 1024> shader_memory;
 static std::array<u32, 1024> swizzle_data;
 
+/// Set whenever the shader memory or swizzle data change, so that the program is decoded again
+static bool shader_memory_dirty = true;
+
 void SubmitShaderMemoryChange(u32 addr, u32 value) {
     shader_memory[addr] = value;
+    shader_memory_dirty = true;
 }
 
 void SubmitSwizzleDataChange(u32 addr, u32 value) {
     swizzle_data[addr] = value;
+    shader_memory_dirty = true;
 }
 
 Math::Vec4<float24>& GetFloatUniform(u32 index) {
@@ -74,8 +80,146 @@ const std::array<u32, 1024>& GetSwizzlePatterns() {
     return swizzle_data;
 }
 
+/// A shader program along with its decoded and compiled versions
+struct CachedShader {
+    std::array<u32, 1024> program_code;
+    std::array<u32, 1024> swizzle_data;
+    u32 main_offset;
+
+    // Only decoded for the backends which need it. It has to outlive the compiled program.
+    std::unique_ptr<ShaderProgram> program;
+    std::unique_ptr<JitProgram> jit_program;
+
+    /// Set once a mismatch against the interpreter has been reported, to avoid flooding the log
+    mutable std::atomic<bool> reported_mismatch;
+};
+
+/// Maximal number of shaders to keep around, the cache is flushed once it is exceeded
+static const size_t MAX_CACHED_SHADERS = 256;
+
+/// Decoded shaders, by hash of their program, swizzle data and entry point
+static std::unordered_map<u64, std::unique_ptr<CachedShader>> cached_shaders;
+
+/// Cached version of the current shader program, only valid while shader_memory_dirty is unset
+static CachedShader* current_shader = nullptr;
+
+/// Continues the 64-bit FNV-1a hash of a sequence of words
+static u64 HashWords(u64 hash, const u32* words, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        hash ^= words[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+/// Looks up the current shader program in the cache, adding it if necessary
+static CachedShader* LookupShader(u32 main_offset) {
+    u64 hash = 0xCBF29CE484222325ULL;
+    hash = HashWords(hash, shader_memory.data(), shader_memory.size());
+    hash = HashWords(hash, swizzle_data.data(), swizzle_data.size());
+    hash = HashWords(hash, &main_offset, 1);
+
+    auto it = cached_shaders.find(hash);
+    if (it != cached_shaders.end()) {
+        CachedShader& shader = *it->second;
+        if (shader.main_offset == main_offset && shader.program_code == shader_memory &&
+            shader.swizzle_data == swizzle_data) {
+            return &shader;
+        }
+
+        // Hash collision, the entry is replaced below
+        LOG_DEBUG(HW_GPU, "Vertex shader hash collision (%016llx)", (unsigned long long)hash);
+    } else if (cached_shaders.size() >= MAX_CACHED_SHADERS) {
+        cached_shaders.clear();
+    }
+
+    auto shader = Common::make_unique<CachedShader>();
+    shader->program_code = shader_memory;
+    shader->swizzle_data = swizzle_data;
+    shader->main_offset = main_offset;
+    shader->reported_mismatch = false;
+
+    auto& entry = cached_shaders[hash];
+    entry = std::move(shader);
+    return entry.get();
+}
+
+void CaptureShaderSetup(ShaderSetup& setup) {
+    setup.uniforms = shader_uniforms;
+
+    const auto& attribute_register_map = registers.vs_input_register_map;
+    setup.input_register_map = {{
+        (u32)attribute_register_map.attribute0_register, (u32)attribute_register_map.attribute1_register,
+        (u32)attribute_register_map.attribute2_register, (u32)attribute_register_map.attribute3_register,
+        (u32)attribute_register_map.attribute4_register, (u32)attribute_register_map.attribute5_register,
+        (u32)attribute_register_map.attribute6_register, (u32)attribute_register_map.attribute7_register,
+        (u32)attribute_register_map.attribute8_register, (u32)attribute_register_map.attribute9_register,
+        (u32)attribute_register_map.attribute10_register, (u32)attribute_register_map.attribute11_register,
+        (u32)attribute_register_map.attribute12_register, (u32)attribute_register_map.attribute13_register,
+        (u32)attribute_register_map.attribute14_register, (u32)attribute_register_map.attribute15_register,
+    }};
+
+    // Copied as a whole, since the bit fields can't be assigned individually
+    memcpy(setup.output_attributes.data(), registers.vs_output_attributes, sizeof(setup.output_attributes));
+
+    // The program is only decoded or looked up again after it has been changed
+    u32 main_offset = registers.vs_main_offset;
+    if (shader_memory_dirty || current_shader == nullptr || current_shader->main_offset != main_offset) {
+        current_shader = LookupShader(main_offset);
+        shader_memory_dirty = false;
+    }
+    setup.shader = current_shader;
+
+    // Backends which aren't supported by the host fall back to the interpreter, AVX to SSE
+    static const bool jit_supported = JitProgram::IsSupported();
+    static const bool simd_supported = IsSimdInterpreterSupported();
+    static const bool avx_supported = IsAvxInterpreterSupported();
+    switch (Settings::values.vertex_shader_backend) {
+    case 1:
+        setup.backend = jit_supported ? ShaderBackend::Jit : ShaderBackend::Interpreter;
+        break;
+
+    case 2:
+        setup.backend = jit_supported ? ShaderBackend::VerifiedJit : ShaderBackend::Interpreter;
+        break;
+
+    case 3:
+        setup.backend = simd_supported ? ShaderBackend::SimdInterpreter : ShaderBackend::Interpreter;
+        break;
+
+    case 4:
+        setup.backend = ShaderBackend::DecodedInterpreter;
+        break;
+
+    case 5:
+        setup.backend = avx_supported ? ShaderBackend::AvxInterpreter
+                      : simd_supported ? ShaderBackend::SimdInterpreter
+                      : ShaderBackend::Interpreter;
+        break;
+
+    default:
+        setup.backend = ShaderBackend::Interpreter;
+        break;
+    }
+
+    // The interpreter runs the shader memory as-is, the other backends run the decoded program
+    if (setup.backend != ShaderBackend::Interpreter && current_shader->program == nullptr) {
+        current_shader->program = DecodeShaderProgram(current_shader->program_code,
+                                                      current_shader->swizzle_data, main_offset);
+
+        DebugUtils::DumpShader(current_shader->program_code.data(), current_shader->program->max_offset,
+                               current_shader->swizzle_data.data(), current_shader->program->max_opdesc_id,
+                               main_offset, registers.vs_output_attributes);
+    }
+
+    bool use_jit = (setup.backend == ShaderBackend::Jit || setup.backend == ShaderBackend::VerifiedJit);
+    if (use_jit && current_shader->jit_program == nullptr)
+        current_shader->jit_program = Common::make_unique<JitProgram>(*current_shader->program);
+}
+
 struct VertexShaderState {
-    u32* program_counter;
+    const u32* program_code;
+    const u32* program_counter;
 
     const float24* input_register_table[16];
     Math::Vec4<float24> output_registers[16];
@@ -91,15 +235,6 @@ struct VertexShaderState {
         INVALID_ADDRESS = 0xFFFFFFFF
     };
 
-    struct CallStackElement {
-        u32 final_address;  // Address upon which we jump to return_address
-        u32 return_address; // Where to jump when leaving scope
-        u8 repeat_counter;  // How often to repeat until this call stack element is removed
-        u8 loop_increment;  // Which value to add to the loop counter after an iteration
-                            // TODO: Should this be a signed value? Does it even matter?
-        u32 loop_address;   // The address where we'll return to after each loop iteration
-    };
-
     // TODO: Is there a maximal size for this?
     std::stack<CallStackElement> call_stack;
 
@@ -109,7 +244,14 @@ struct VertexShaderState {
     } debug;
 };
 
-static void ProcessShaderCode(VertexShaderState& state) {
+/**
+ * Interprets the shader memory of the given setup, decoding each instruction as it is executed.
+ * This is the reference the other backends are checked against.
+ */
+static void ProcessShaderCode(VertexShaderState& state, const ShaderSetup& setup) {
+    const u32* shader_memory = state.program_code;
+    const u32* swizzle_data = setup.shader->swizzle_data.data();
+    const ShaderSetup::Uniforms& shader_uniforms = setup.uniforms;
 
     // Placeholder for invalid inputs
     static float24 dummy_vec4_float24[4];
@@ -117,7 +259,7 @@ static void ProcessShaderCode(VertexShaderState& state) {
     while (true) {
         if (!state.call_stack.empty()) {
             auto& top = state.call_stack.top();
-            if (state.program_counter - shader_memory.data() == top.final_address) {
+            if (state.program_counter - shader_memory == top.final_address) {
                 state.address_registers[2] += top.loop_increment;
 
                 if (top.repeat_counter-- == 0) {
@@ -138,10 +280,10 @@ static void ProcessShaderCode(VertexShaderState& state) {
 
         static auto call = [](VertexShaderState& state, u32 offset, u32 num_instructions,
                               u32 return_offset, u8 repeat_count, u8 loop_increment) {
-            state.program_counter = &shader_memory[offset] - 1; // -1 to make sure when incrementing the PC we end up at the correct offset
+            state.program_counter = &state.program_code[offset] - 1; // -1 to make sure when incrementing the PC we end up at the correct offset
             state.call_stack.push({ offset + num_instructions, return_offset, repeat_count, loop_increment, offset });
         };
-        u32 binary_offset = state.program_counter - shader_memory.data();
+        u32 binary_offset = state.program_counter - shader_memory;
 
         state.debug.max_offset = std::max<u32>(state.debug.max_offset, 1 + binary_offset);
 
@@ -294,7 +436,7 @@ static void ProcessShaderCode(VertexShaderState& state) {
 
                     // TODO: Be stable against division by zero!
                     // TODO: I think this might be wrong... we should only use one component here
-                    dest[i] = float24::FromFloat32(1.0f / sqrt(src1[i].ToFloat32()));
+                    dest[i] = float24::FromFloat32(1.0 / std::sqrt((double)src1[i].ToFloat32()));
                 }
 
                 break;
@@ -375,7 +517,7 @@ static void ProcessShaderCode(VertexShaderState& state) {
 
         case OpCode::Type::MultiplyAdd:
         {
-            if ((instr.opcode.Value().EffectiveOpCode() == OpCode::Id::MAD) || 
+            if ((instr.opcode.Value().EffectiveOpCode() == OpCode::Id::MAD) ||
                 (instr.opcode.Value().EffectiveOpCode() == OpCode::Id::MADI)) {
                 const SwizzlePattern& swizzle = *(SwizzlePattern*)&swizzle_data[instr.mad.operand_desc_id];
 
@@ -574,50 +716,342 @@ static void ProcessShaderCode(VertexShaderState& state) {
     }
 }
 
-OutputVertex RunShader(const InputVertex& input, int num_attributes) {
-    VertexShaderState state;
-
-    const u32* main = &shader_memory[registers.vs_main_offset];
-    state.program_counter = (u32*)main;
+/// Runs the interpreter for the given vertex, leaving the results in the output registers of `state`
+static void InterpretShader(const ShaderSetup& setup, const InputVertex& input, int num_attributes,
+                            VertexShaderState& state) {
+    state.program_code = setup.shader->program_code.data();
+    state.program_counter = &state.program_code[setup.shader->main_offset];
     state.debug.max_offset = 0;
     state.debug.max_opdesc_id = 0;
 
-    // Setup input register table
-    const auto& attribute_register_map = registers.vs_input_register_map;
-    float24 dummy_register;
-    boost::fill(state.input_register_table, &dummy_register);
-    
-    if (num_attributes > 0) state.input_register_table[attribute_register_map.attribute0_register] = &input.attr[0].x;
-    if (num_attributes > 1) state.input_register_table[attribute_register_map.attribute1_register] = &input.attr[1].x;
-    if (num_attributes > 2) state.input_register_table[attribute_register_map.attribute2_register] = &input.attr[2].x;
-    if (num_attributes > 3) state.input_register_table[attribute_register_map.attribute3_register] = &input.attr[3].x;
-    if (num_attributes > 4) state.input_register_table[attribute_register_map.attribute4_register] = &input.attr[4].x;
-    if (num_attributes > 5) state.input_register_table[attribute_register_map.attribute5_register] = &input.attr[5].x;
-    if (num_attributes > 6) state.input_register_table[attribute_register_map.attribute6_register] = &input.attr[6].x;
-    if (num_attributes > 7) state.input_register_table[attribute_register_map.attribute7_register] = &input.attr[7].x;
-    if (num_attributes > 8) state.input_register_table[attribute_register_map.attribute8_register] = &input.attr[8].x;
-    if (num_attributes > 9) state.input_register_table[attribute_register_map.attribute9_register] = &input.attr[9].x;
-    if (num_attributes > 10) state.input_register_table[attribute_register_map.attribute10_register] = &input.attr[10].x;
-    if (num_attributes > 11) state.input_register_table[attribute_register_map.attribute11_register] = &input.attr[11].x;
-    if (num_attributes > 12) state.input_register_table[attribute_register_map.attribute12_register] = &input.attr[12].x;
-    if (num_attributes > 13) state.input_register_table[attribute_register_map.attribute13_register] = &input.attr[13].x;
-    if (num_attributes > 14) state.input_register_table[attribute_register_map.attribute14_register] = &input.attr[14].x;
-    if (num_attributes > 15) state.input_register_table[attribute_register_map.attribute15_register] = &input.attr[15].x;
+    // Setup input register table. Registers without an attribute read as zero.
+    static const float24 zero_register[4] = {};
+    std::fill(std::begin(state.input_register_table), std::end(state.input_register_table), zero_register);
+    for (int i = 0; i < num_attributes; ++i)
+        state.input_register_table[setup.input_register_map[i]] = &input.attr[i].x;
 
+    memset(state.output_registers, 0, sizeof(state.output_registers));
+    state.address_registers[0] = 0;
+    state.address_registers[1] = 0;
+    state.address_registers[2] = 0;
     state.conditional_code[0] = false;
     state.conditional_code[1] = false;
 
-    ProcessShaderCode(state);
-    DebugUtils::DumpShader(shader_memory.data(), state.debug.max_offset, swizzle_data.data(),
-                           state.debug.max_opdesc_id, registers.vs_main_offset,
-                           registers.vs_output_attributes);
+    ProcessShaderCode(state, setup);
+    DebugUtils::DumpShader(state.program_code, state.debug.max_offset, setup.shader->swizzle_data.data(),
+                           state.debug.max_opdesc_id, setup.shader->main_offset,
+                           setup.output_attributes.data());
+}
+
+/// Returns the register read by the given operand, after applying the address register offset
+static const float24* LookupSourceRegister(const UnitState& state, const ShaderSetup& setup,
+                                           const SourceOperand& operand) {
+    static const float24 zero_register[4] = {};
+
+    int index = operand.index;
+    if (operand.address_register != 0)
+        index += state.address_registers[operand.address_register - 1];
+
+    if (index >= REGISTER_INPUT_BASE && index < REGISTER_TEMPORARY_BASE)
+        return &state.input_registers[index - REGISTER_INPUT_BASE].x;
+    else if (index >= REGISTER_TEMPORARY_BASE && index < REGISTER_FLOAT_UNIFORM_BASE)
+        return &state.temporary_registers[index - REGISTER_TEMPORARY_BASE].x;
+    else if (index >= REGISTER_FLOAT_UNIFORM_BASE && index < REGISTER_FLOAT_UNIFORM_END)
+        return &setup.uniforms.f[index - REGISTER_FLOAT_UNIFORM_BASE].x;
+    else
+        return zero_register;
+}
+
+/// Reads the given operand, applying its swizzle and negation
+static void ReadSourceOperand(const UnitState& state, const ShaderSetup& setup,
+                              const SourceOperand& operand, float24 (&value)[4]) {
+    const float24* reg = LookupSourceRegister(state, setup, operand);
+    for (int i = 0; i < 4; ++i) {
+        value[i] = reg[operand.selectors[i]];
+        if (operand.negate)
+            value[i] = value[i] * float24::FromFloat32(-1);
+    }
+}
+
+static bool EvaluateComparison(ShaderOp::CompareOp compare_op, float24 src1, float24 src2, bool previous) {
+    switch (compare_op) {
+    case ShaderOp::CompareOp::Equal:
+        return src1 == src2;
+
+    case ShaderOp::CompareOp::NotEqual:
+        return src1 != src2;
+
+    case ShaderOp::CompareOp::LessThan:
+        return src1 < src2;
+
+    case ShaderOp::CompareOp::LessEqual:
+        return src1 <= src2;
+
+    case ShaderOp::CompareOp::GreaterThan:
+        return src1 > src2;
+
+    case ShaderOp::CompareOp::GreaterEqual:
+        return src1 >= src2;
+
+    default:
+        // Unknown compare modes have been reported when decoding
+        return previous;
+    }
+}
+
+/// Interprets the decoded program, which only requires executing the pre-resolved ops
+static void ProcessDecodedShaderCode(const ShaderProgram& program, UnitState& state, const ShaderSetup& setup) {
+    // Placeholder for discarded results
+    float24 dummy_vec4_float24[4];
+
+    u32 offset = program.main_offset;
+    while (offset < ShaderProgram::MAX_PROGRAM_SIZE) {
+        if (program.return_points[offset]) {
+            u32 return_offset = ReturnFromCall(state, offset);
+            if (return_offset != RETURN_NONE) {
+                offset = return_offset;
+                continue;
+            }
+        }
+
+        const ShaderOp& op = program.ops[offset];
+
+        float24* dest = (op.dest.index < REGISTER_TEMPORARY_BASE) ? &state.output_registers[op.dest.index].x
+                      : (op.dest.index < REGISTER_DISCARD) ? &state.temporary_registers[op.dest.index - REGISTER_TEMPORARY_BASE].x
+                      : dummy_vec4_float24;
+
+        auto IsEnabled = [&op](int component) {
+            return (op.dest.mask & (1 << component)) != 0;
+        };
+
+        float24 src1[4];
+        float24 src2[4];
+        float24 src3[4];
+
+        switch (op.type) {
+        case ShaderOp::Type::Nop:
+            break;
+
+        case ShaderOp::Type::Add:
+            ReadSourceOperand(state, setup, op.src[0], src1);
+            ReadSourceOperand(state, setup, op.src[1], src2);
+            for (int i = 0; i < 4; ++i) {
+                if (IsEnabled(i))
+                    dest[i] = src1[i] + src2[i];
+            }
+            break;
+
+        case ShaderOp::Type::Mul:
+            ReadSourceOperand(state, setup, op.src[0], src1);
+            ReadSourceOperand(state, setup, op.src[1], src2);
+            for (int i = 0; i < 4; ++i) {
+                if (IsEnabled(i))
+                    dest[i] = src1[i] * src2[i];
+            }
+            break;
+
+        case ShaderOp::Type::Flr:
+            ReadSourceOperand(state, setup, op.src[0], src1);
+            for (int i = 0; i < 4; ++i) {
+                if (IsEnabled(i))
+                    dest[i] = float24::FromFloat32(std::floor(src1[i].ToFloat32()));
+            }
+            break;
+
+        case ShaderOp::Type::Max:
+            ReadSourceOperand(state, setup, op.src[0], src1);
+            ReadSourceOperand(state, setup, op.src[1], src2);
+            for (int i = 0; i < 4; ++i) {
+                if (IsEnabled(i))
+                    dest[i] = std::max(src1[i], src2[i]);
+            }
+            break;
+
+        case ShaderOp::Type::Dp3:
+        case ShaderOp::Type::Dp4:
+        {
+            ReadSourceOperand(state, setup, op.src[0], src1);
+            ReadSourceOperand(state, setup, op.src[1], src2);
+
+            float24 dot = float24::FromFloat32(0.f);
+            int num_components = (op.type == ShaderOp::Type::Dp3) ? 3 : 4;
+            for (int i = 0; i < num_components; ++i)
+                dot = dot + src1[i] * src2[i];
+
+            for (int i = 0; i < num_components; ++i) {
+                if (IsEnabled(i))
+                    dest[i] = dot;
+            }
+            break;
+        }
+
+        // Reciprocal
+        case ShaderOp::Type::Rcp:
+            ReadSourceOperand(state, setup, op.src[0], src1);
+            for (int i = 0; i < 4; ++i) {
+                // TODO: Be stable against division by zero!
+                // TODO: I think this might be wrong... we should only use one component here
+                if (IsEnabled(i))
+                    dest[i] = float24::FromFloat32(1.0f / src1[i].ToFloat32());
+            }
+            break;
+
+        // Reciprocal Square Root
+        case ShaderOp::Type::Rsq:
+            ReadSourceOperand(state, setup, op.src[0], src1);
+            for (int i = 0; i < 4; ++i) {
+                // TODO: Be stable against division by zero!
+                // TODO: I think this might be wrong... we should only use one component here
+                if (IsEnabled(i))
+                    dest[i] = float24::FromFloat32(1.0 / std::sqrt((double)src1[i].ToFloat32()));
+            }
+            break;
+
+        case ShaderOp::Type::Mova:
+            ReadSourceOperand(state, setup, op.src[0], src1);
+            for (int i = 0; i < 2; ++i) {
+                // TODO: Figure out how the rounding is done on hardware
+                if (IsEnabled(i))
+                    state.address_registers[i] = static_cast<s32>(src1[i].ToFloat32());
+            }
+            break;
+
+        case ShaderOp::Type::Mov:
+            ReadSourceOperand(state, setup, op.src[0], src1);
+            for (int i = 0; i < 4; ++i) {
+                if (IsEnabled(i))
+                    dest[i] = src1[i];
+            }
+            break;
+
+        case ShaderOp::Type::Cmp:
+            ReadSourceOperand(state, setup, op.src[0], src1);
+            ReadSourceOperand(state, setup, op.src[1], src2);
+            for (int i = 0; i < 2; ++i) {
+                // TODO: Can you restrict to one compare via dest masking?
+                state.conditional_code[i] = EvaluateComparison(op.compare_op[i], src1[i], src2[i],
+                                                               state.conditional_code[i]);
+            }
+            break;
+
+        case ShaderOp::Type::Mad:
+            ReadSourceOperand(state, setup, op.src[0], src1);
+            ReadSourceOperand(state, setup, op.src[1], src2);
+            ReadSourceOperand(state, setup, op.src[2], src3);
+            for (int i = 0; i < 4; ++i) {
+                if (IsEnabled(i))
+                    dest[i] = src1[i] * src2[i] + src3[i];
+            }
+            break;
+
+        case ShaderOp::Type::End:
+            return;
+
+        case ShaderOp::Type::Jmp:
+            if (EvaluateCondition(state, op, setup.uniforms.b)) {
+                offset = op.dest_offset;
+                continue;
+            }
+            break;
+
+        case ShaderOp::Type::Call:
+            if (EvaluateCondition(state, op, setup.uniforms.b)) {
+                PushCall(state, op.calls[0]);
+                offset = op.calls[0].loop_address;
+                continue;
+            }
+            break;
+
+        case ShaderOp::Type::If:
+        {
+            const CallStackElement& call = op.calls[EvaluateCondition(state, op, setup.uniforms.b) ? 0 : 1];
+            PushCall(state, call);
+            offset = call.loop_address;
+            continue;
+        }
+
+        case ShaderOp::Type::Loop:
+            PushLoop(state, op, setup.uniforms.i[op.uniform_id]);
+            offset = op.calls[0].loop_address;
+            continue;
+        }
+
+        ++offset;
+    }
+}
+
+/**
+ * Compares a compiled and an interpreted result. The host compiler may turn the multiply-adds of
+ * the interpreter into fused ones, so results which only differ below the precision of float24
+ * (16 mantissa bits, i.e. up to 2^7 units in the last place of a float32) are accepted.
+ */
+static bool ResultsMatch(float24 compiled, float24 interpreted) {
+    float a = compiled.ToFloat32();
+    float b = interpreted.ToFloat32();
+    if (std::isnan(a) && std::isnan(b))
+        return true;
+
+    u32 a_bits, b_bits;
+    memcpy(&a_bits, &a, sizeof(a));
+    memcpy(&b_bits, &b, sizeof(b));
+    if ((a_bits ^ b_bits) & 0x80000000)
+        return a_bits == b_bits;
+
+    return std::max(a_bits, b_bits) - std::min(a_bits, b_bits) <= (1 << 7);
+}
+
+/// Logs the first output of a compiled shader which differs from the interpreted one
+static void VerifyCompiledShader(const ShaderSetup& setup, const Math::Vec4<float24> (&compiled)[16],
+                                 const Math::Vec4<float24> (&interpreted)[16]) {
+    for (int i = 0; i < 7; ++i) {
+        const auto& output_register_map = setup.output_attributes[i];
+
+        u32 semantics[4] = {
+            output_register_map.map_x, output_register_map.map_y,
+            output_register_map.map_z, output_register_map.map_w
+        };
 
+        for (int comp = 0; comp < 4; ++comp) {
+            if (semantics[comp] == Regs::VSOutputAttributes::INVALID ||
+                ResultsMatch(compiled[i][comp], interpreted[i][comp])) {
+                continue;
+            }
+
+            if (!setup.shader->reported_mismatch.exchange(true)) {
+                LOG_ERROR(HW_GPU, "Compiled vertex shader (entry point 0x%x) differs from the interpreter "
+                          "in output o%d.%c: %f instead of %f", setup.shader->main_offset, i, "xyzw"[comp],
+                          compiled[i][comp].ToFloat32(), interpreted[i][comp].ToFloat32());
+            }
+            return;
+        }
+    }
+}
+
+/// Sets up the state of a shader invocation for the given vertex
+static void InitUnitState(const ShaderSetup& setup, const InputVertex& input, int num_attributes,
+                          UnitState& state) {
+    // Registers without an attribute read as zero
+    memset(state.input_registers, 0, sizeof(state.input_registers));
+    for (int i = 0; i < num_attributes; ++i)
+        state.input_registers[setup.input_register_map[i]] = input.attr[i];
+
+    memset(state.output_registers, 0, sizeof(state.output_registers));
+    state.address_registers[0] = 0;
+    state.address_registers[1] = 0;
+    state.address_registers[2] = 0;
+    state.conditional_code[0] = false;
+    state.conditional_code[1] = false;
+    state.call_stack_size = 0;
+}
+
+/// Builds the output vertex from the output registers of a finished shader invocation
+static OutputVertex MakeOutputVertex(const ShaderSetup& setup, const Math::Vec4<float24> (&output_registers)[16]) {
     // Setup output data
     OutputVertex ret;
     // TODO(neobrain): Under some circumstances, up to 16 attributes may be output. We need to
     // figure out what those circumstances are and enable the remaining outputs then.
     for (int i = 0; i < 7; ++i) {
-        const auto& output_register_map = registers.vs_output_attributes[i];
+        const auto& output_register_map = setup.output_attributes[i];
 
         u32 semantics[4] = {
             output_register_map.map_x, output_register_map.map_y,
@@ -627,7 +1061,7 @@ OutputVertex RunShader(const InputVertex& input, int num_attributes) {
         for (int comp = 0; comp < 4; ++comp) {
             float24* out = ((float24*)&ret) + semantics[comp];
             if (semantics[comp] != Regs::VSOutputAttributes::INVALID) {
-                *out = state.output_registers[i][comp];
+                *out = output_registers[i][comp];
             } else {
                 // Zero output so that attributes which aren't output won't have denormals in them,
                 // which would slow us down later.
@@ -644,6 +1078,73 @@ OutputVertex RunShader(const InputVertex& input, int num_attributes) {
     return ret;
 }
 
+OutputVertex RunShader(const ShaderSetup& setup, const InputVertex& input, int num_attributes) {
+    switch (setup.backend) {
+    case ShaderBackend::Interpreter:
+    default:
+    {
+        VertexShaderState state;
+        InterpretShader(setup, input, num_attributes, state);
+        return MakeOutputVertex(setup, state.output_registers);
+    }
+
+    case ShaderBackend::Jit:
+    {
+        UnitState state;
+        InitUnitState(setup, input, num_attributes, state);
+        setup.shader->jit_program->Run(state, setup);
+        return MakeOutputVertex(setup, state.output_registers);
+    }
+
+    case ShaderBackend::VerifiedJit:
+    {
+        UnitState compiled_state;
+        InitUnitState(setup, input, num_attributes, compiled_state);
+        setup.shader->jit_program->Run(compiled_state, setup);
+
+        // Continue with the interpreted result, so that mismatches don't affect emulation
+        VertexShaderState state;
+        InterpretShader(setup, input, num_attributes, state);
+        VerifyCompiledShader(setup, compiled_state.output_registers, state.output_registers);
+        return MakeOutputVertex(setup, state.output_registers);
+    }
+
+    case ShaderBackend::DecodedInterpreter:
+    case ShaderBackend::SimdInterpreter:
+    case ShaderBackend::AvxInterpreter:
+    {
+        UnitState state;
+        InitUnitState(setup, input, num_attributes, state);
+        ProcessDecodedShaderCode(*setup.shader->program, state, setup);
+        return MakeOutputVertex(setup, state.output_registers);
+    }
+    }
+}
+
+void RunShaderBatch(const ShaderSetup& setup, const InputVertex* inputs, int num_vertices,
+                    int num_attributes, OutputVertex* outputs) {
+    ASSERT(num_vertices <= MAX_SHADER_BATCH_SIZE);
+
+    if (setup.backend != ShaderBackend::SimdInterpreter && setup.backend != ShaderBackend::AvxInterpreter) {
+        for (int i = 0; i < num_vertices; ++i)
+            outputs[i] = RunShader(setup, inputs[i], num_attributes);
+        return;
+    }
+
+    UnitState states[MAX_SHADER_BATCH_SIZE];
+    for (int i = 0; i < num_vertices; ++i)
+        InitUnitState(setup, inputs[i], num_attributes, states[i]);
+
+    if (setup.backend == ShaderBackend::AvxInterpreter) {
+        ProcessShaderCodeAvx(*setup.shader->program, states, num_vertices, setup);
+    } else {
+        for (int first = 0; first < num_vertices; first += SIMD_LANES)
+            ProcessShaderCodeSimd(*setup.shader->program, states + first, std::min(num_vertices - first, SIMD_LANES), setup);
+    }
+
+    for (int i = 0; i < num_vertices; ++i)
+        outputs[i] = MakeOutputVertex(setup, states[i].output_registers);
+}
 
 } // namespace
 
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <array>
 #include <initializer_list>
 
 #include <common/common_types.h>
@@ -66,10 +67,64 @@ struct OutputVertex {
 static_assert(std::is_pod<OutputVertex>::value, "Structure is not POD");
 static_assert(sizeof(OutputVertex) == 32 * sizeof(float), "OutputVertex has invalid size");
 
+struct CachedShader;
+
+/// How vertex shaders are run, see Settings::values.vertex_shader_backend
+enum class ShaderBackend : u8 {
+    Interpreter = 0,        ///< Decodes each instruction of the shader memory as it runs it
+    Jit = 1,
+    VerifiedJit = 2,        ///< Runs the JIT and checks its results against the interpreter
+    SimdInterpreter = 3,    ///< Interprets batches of vertices at once, see RunShaderBatch
+    DecodedInterpreter = 4, ///< Interprets the program decoded by DecodeShaderProgram
+    AvxInterpreter = 5,     ///< SimdInterpreter running eight vertices at once with AVX
+};
+
+/**
+ * Everything the vertex shader depends on, i.e. the uniforms, the shader program and the related
+ * Pica registers. A copy is captured at the start of each draw, which makes running the shader
+ * independent of global state, so that vertices may be processed on any thread.
+ */
+struct ShaderSetup {
+    struct Uniforms {
+        Math::Vec4<float24> f[96];
+
+        std::array<bool,16> b;
+
+        std::array<Math::Vec4<u8>,4> i;
+    } uniforms;
+
+    /**
+     * Shader program, along with its decoded (and if needed compiled) version when the backend
+     * uses it. Owned by a cache which is only modified by CaptureShaderSetup.
+     */
+    const CachedShader* shader;
+
+    /// Input register each vertex attribute is loaded to
+    std::array<u32, 16> input_register_map;
+
+    std::array<Regs::VSOutputAttributes, 7> output_attributes;
+
+    /// Backend to run the shader with, supported by the host
+    ShaderBackend backend;
+};
+
 void SubmitShaderMemoryChange(u32 addr, u32 value);
 void SubmitSwizzleDataChange(u32 addr, u32 value);
 
-OutputVertex RunShader(const InputVertex& input, int num_attributes);
+/// Copies the current shader state into the given setup
+void CaptureShaderSetup(ShaderSetup& setup);
+
+OutputVertex RunShader(const ShaderSetup& setup, const InputVertex& input, int num_attributes);
+
+/// Maximal number of vertices passed to RunShaderBatch
+static const int MAX_SHADER_BATCH_SIZE = 8;
+
+/**
+ * Runs the shader for up to MAX_SHADER_BATCH_SIZE vertices. The vertices are processed together
+ * with the SIMD interpreter if it is the selected backend, and one by one otherwise.
+ */
+void RunShaderBatch(const ShaderSetup& setup, const InputVertex* inputs, int num_vertices,
+                    int num_attributes, OutputVertex* outputs);
 
 Math::Vec4<float24>& GetFloatUniform(u32 index);
 bool& GetBoolUniform(u32 index);
@@ -0,0 +1,733 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "common/assert.h"
+#include "common/memory_util.h"
+
+#include "video_core/vertex_shader.h"
+#include "video_core/vertex_shader_jit_x64.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+namespace Pica {
+
+namespace VertexShader {
+
+namespace {
+
+enum X64Reg {
+    RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15,
+};
+
+enum XmmReg {
+    XMM0 = 0, XMM1, XMM2, XMM3, XMM4, XMM5,
+};
+
+enum Condition {
+    CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7, CC_P = 0xA, CC_NP = 0xB,
+};
+
+#ifdef _WIN32
+static const X64Reg ABI_PARAM1 = RCX;
+static const X64Reg ABI_PARAM2 = RDX;
+static const X64Reg ABI_PARAM3 = R8;
+#else
+static const X64Reg ABI_PARAM1 = RDI;
+static const X64Reg ABI_PARAM2 = RSI;
+static const X64Reg ABI_PARAM3 = RDX;
+#endif
+
+/// Holds the UnitState of the running program
+static const X64Reg STATE = RBX;
+/// Holds the ShaderSetup of the running program
+static const X64Reg SETUP = RBP;
+
+/**
+ * Minimal x86-64 code emitter, supporting only the instructions needed by the shader compiler.
+ * Memory operands are always encoded as base register plus 32-bit displacement. Code is emitted
+ * position-independently into a buffer, so that it can be copied to executable memory afterwards.
+ */
+class Emitter {
+public:
+    using Label = size_t;
+
+    std::vector<u8> code;
+
+    Label NewLabel() {
+        label_positions.push_back(size_t(UNBOUND));
+        return label_positions.size() - 1;
+    }
+
+    void Bind(Label label) {
+        label_positions[label] = code.size();
+    }
+
+    size_t GetLabelPosition(Label label) const {
+        return label_positions[label];
+    }
+
+    /// Resolves the jumps to labels, all of which must be bound
+    void ResolveLabels() {
+        for (const auto& fixup : fixups) {
+            size_t target = label_positions[fixup.second];
+            ASSERT(target != UNBOUND);
+            s32 displacement = static_cast<s32>(target - (fixup.first + 4));
+            std::memcpy(&code[fixup.first], &displacement, sizeof(displacement));
+        }
+        fixups.clear();
+    }
+
+    // General purpose instructions
+
+    void PUSH(X64Reg reg) { Rex(false, 0, reg); Write8(0x50 + (reg & 7)); }
+    void POP(X64Reg reg) { Rex(false, 0, reg); Write8(0x58 + (reg & 7)); }
+    void RET() { Write8(0xC3); }
+
+    void SUB_RSP(u8 imm) { Write8(0x48); Write8(0x83); ModRMReg(5, RSP); Write8(imm); }
+    void ADD_RSP(u8 imm) { Write8(0x48); Write8(0x83); ModRMReg(0, RSP); Write8(imm); }
+
+    void MOV_64(X64Reg dst, X64Reg src) { Rex(true, src, dst); Write8(0x89); ModRMReg(src, dst); }
+    void MOV_32(X64Reg dst, X64Reg src) { Rex(false, src, dst); Write8(0x89); ModRMReg(src, dst); }
+    void MOV_64_Imm(X64Reg dst, const void* imm) {
+        Rex(true, 0, dst);
+        Write8(0xB8 + (dst & 7));
+        Write64(reinterpret_cast<u64>(imm));
+    }
+    void MOV_32_Imm(X64Reg dst, u32 imm) { Rex(false, 0, dst); Write8(0xB8 + (dst & 7)); Write32(imm); }
+
+    void MOV_32_Load(X64Reg dst, X64Reg base, s32 disp) { Rex(false, dst, base); Write8(0x8B); ModRMMem(dst, base, disp); }
+    void MOV_32_Store(X64Reg base, s32 disp, X64Reg src) { Rex(false, src, base); Write8(0x89); ModRMMem(src, base, disp); }
+    /// Stores the low byte of src, which must be RAX, RCX, RDX or RBX
+    void MOV_8_Store(X64Reg base, s32 disp, X64Reg src) { Rex(false, src, base); Write8(0x88); ModRMMem(src, base, disp); }
+
+    void ADD_32_Imm(X64Reg dst, u32 imm) { Rex(false, 0, dst); Write8(0x81); ModRMReg(0, dst); Write32(imm); }
+    void CMP_32_Imm(X64Reg dst, u32 imm) { Rex(false, 0, dst); Write8(0x81); ModRMReg(7, dst); Write32(imm); }
+    void SHL_32_Imm(X64Reg dst, u8 imm) { Rex(false, 0, dst); Write8(0xC1); ModRMReg(4, dst); Write8(imm); }
+    void ADD_64(X64Reg dst, X64Reg src) { Rex(true, src, dst); Write8(0x01); ModRMReg(src, dst); }
+
+    void CMP_8_Mem_Imm(X64Reg base, s32 disp, u8 imm) { Rex(false, 0, base); Write8(0x80); ModRMMem(7, base, disp); Write8(imm); }
+    void CMP_32_Mem_Imm(X64Reg base, s32 disp, u32 imm) { Rex(false, 0, base); Write8(0x81); ModRMMem(7, base, disp); Write32(imm); }
+
+    /// Sets the low byte of dst, which must be RAX, RCX, RDX or RBX
+    void SETcc(Condition cc, X64Reg dst) { Write8(0x0F); Write8(0x90 + cc); ModRMReg(0, dst); }
+    void AND_8(X64Reg dst, X64Reg src) { Write8(0x20); ModRMReg(src, dst); }
+    void OR_8(X64Reg dst, X64Reg src) { Write8(0x08); ModRMReg(src, dst); }
+
+    void CALL(X64Reg target) { Rex(false, 0, target); Write8(0xFF); ModRMReg(2, target); }
+    /// Jumps to the address stored at table[index], which must both be below R8
+    void JMP_Table(X64Reg table, X64Reg index) { Write8(0xFF); Write8(0x24); Write8(0xC0 | (index << 3) | table); }
+
+    void JMP(Label label) { Write8(0xE9); AddFixup(label); }
+    void Jcc(Condition cc, Label label) { Write8(0x0F); Write8(0x80 + cc); AddFixup(label); }
+
+    // SSE instructions
+
+    void MOVUPS_Load(XmmReg dst, X64Reg base, s32 disp) { SseMem(0, 0x10, dst, base, disp); }
+    void MOVUPS_Store(X64Reg base, s32 disp, XmmReg src) { SseMem(0, 0x11, src, base, disp); }
+
+    void ADDPS(XmmReg dst, XmmReg src) { SseReg(0, 0x58, dst, src); }
+    void MULPS(XmmReg dst, XmmReg src) { SseReg(0, 0x59, dst, src); }
+    void DIVPS(XmmReg dst, XmmReg src) { SseReg(0, 0x5E, dst, src); }
+    void MAXPS(XmmReg dst, XmmReg src) { SseReg(0, 0x5F, dst, src); }
+    void XORPS(XmmReg dst, XmmReg src) { SseReg(0, 0x57, dst, src); }
+    void ADDSS(XmmReg dst, XmmReg src) { SseReg(0xF3, 0x58, dst, src); }
+    void UCOMISS(XmmReg lhs, XmmReg rhs) { SseReg(0, 0x2E, lhs, rhs); }
+    void SHUFPS(XmmReg dst, XmmReg src, u8 imm) { SseReg(0, 0xC6, dst, src); Write8(imm); }
+    void CVTTSS2SI(X64Reg dst, XmmReg src) { SseReg(0xF3, 0x2C, dst, src); }
+    /// Moves the high half of src into the low half of dst
+    void MOVHLPS(XmmReg dst, XmmReg src) { SseReg(0, 0x12, dst, src); }
+    /// Moves the low half of src into the high half of dst
+    void MOVLHPS(XmmReg dst, XmmReg src) { SseReg(0, 0x16, dst, src); }
+
+    // SSE2
+    void DIVPD(XmmReg dst, XmmReg src) { SseReg(0x66, 0x5E, dst, src); }
+    void SQRTPD(XmmReg dst, XmmReg src) { SseReg(0x66, 0x51, dst, src); }
+    /// Converts the two low floats of src to doubles
+    void CVTPS2PD(XmmReg dst, XmmReg src) { SseReg(0, 0x5A, dst, src); }
+    /// Converts the two doubles of src to the two low floats of dst, zeroing the high ones
+    void CVTPD2PS(XmmReg dst, XmmReg src) { SseReg(0x66, 0x5A, dst, src); }
+
+    // SSE4.1
+    void ROUNDPS(XmmReg dst, XmmReg src, u8 mode) { Sse41Reg(0x08, dst, src); Write8(mode); }
+    void BLENDPS(XmmReg dst, XmmReg src, u8 mask) { Sse41Reg(0x0C, dst, src); Write8(mask); }
+
+private:
+    static const size_t UNBOUND = ~size_t(0);
+
+    void Write8(u8 value) { code.push_back(value); }
+    void Write32(u32 value) { for (int i = 0; i < 4; ++i) Write8(value >> (8 * i)); }
+    void Write64(u64 value) { for (int i = 0; i < 8; ++i) Write8(value >> (8 * i)); }
+
+    void Rex(bool w, int reg, int rm) {
+        u8 rex = 0x40 | (w << 3) | (((reg >> 3) & 1) << 2) | ((rm >> 3) & 1);
+        if (rex != 0x40)
+            Write8(rex);
+    }
+
+    void ModRMReg(int reg, int rm) {
+        Write8(0xC0 | ((reg & 7) << 3) | (rm & 7));
+    }
+
+    void ModRMMem(int reg, X64Reg base, s32 disp) {
+        Write8(0x80 | ((reg & 7) << 3) | (base & 7));
+        if ((base & 7) == RSP)
+            Write8(0x24); // SIB byte without index
+        Write32(static_cast<u32>(disp));
+    }
+
+    void SseReg(u8 prefix, u8 opcode, int reg, int rm) {
+        if (prefix)
+            Write8(prefix);
+        Rex(false, reg, rm);
+        Write8(0x0F);
+        Write8(opcode);
+        ModRMReg(reg, rm);
+    }
+
+    void SseMem(u8 prefix, u8 opcode, int reg, X64Reg base, s32 disp) {
+        if (prefix)
+            Write8(prefix);
+        Rex(false, reg, base);
+        Write8(0x0F);
+        Write8(opcode);
+        ModRMMem(reg, base, disp);
+    }
+
+    void Sse41Reg(u8 opcode, int reg, int rm) {
+        Write8(0x66);
+        Rex(false, reg, rm);
+        Write8(0x0F);
+        Write8(0x3A);
+        Write8(opcode);
+        ModRMReg(reg, rm);
+    }
+
+    void AddFixup(Label label) {
+        fixups.emplace_back(code.size(), label);
+        Write32(0);
+    }
+
+    std::vector<size_t> label_positions;
+    /// Positions of 32-bit relative jump displacements, and the labels they jump to
+    std::vector<std::pair<size_t, Label>> fixups;
+};
+
+static const float minus_ones[4] = { -1.0f, -1.0f, -1.0f, -1.0f };
+static const float ones[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+static const double double_ones[2] = { 1.0, 1.0 };
+
+// Called by the compiled code. References are passed as pointers by both calling conventions,
+// but these wrappers spell it out.
+
+static u32 JitReturnFromCall(UnitState* state, u32 offset) {
+    u32 next_offset = ReturnFromCall(*state, offset);
+    if (next_offset != RETURN_NONE && next_offset > ShaderProgram::MAX_PROGRAM_SIZE)
+        return ShaderProgram::MAX_PROGRAM_SIZE;
+    return next_offset;
+}
+
+static void JitPushCall(UnitState* state, const CallStackElement* call) {
+    PushCall(*state, *call);
+}
+
+static void JitPushLoop(UnitState* state, const ShaderOp* op, const ShaderSetup* setup) {
+    PushLoop(*state, *op, setup->uniforms.i[op->uniform_id]);
+}
+
+static const s32 OFFSET_INPUT = offsetof(UnitState, input_registers);
+static const s32 OFFSET_OUTPUT = offsetof(UnitState, output_registers);
+static const s32 OFFSET_ADDRESS = offsetof(UnitState, address_registers);
+static const s32 OFFSET_CONDITIONAL_CODE = offsetof(UnitState, conditional_code);
+static const s32 OFFSET_CALL_STACK_SIZE = offsetof(UnitState, call_stack_size);
+static const s32 OFFSET_FLOAT_UNIFORMS = offsetof(ShaderSetup, uniforms) + offsetof(ShaderSetup::Uniforms, f);
+static const s32 OFFSET_BOOL_UNIFORMS = offsetof(ShaderSetup, uniforms) + offsetof(ShaderSetup::Uniforms, b);
+
+static_assert(offsetof(UnitState, temporary_registers) == offsetof(UnitState, input_registers) + 16 * sizeof(Math::Vec4<float24>),
+              "Input and temporary registers must be adjacent");
+static_assert(sizeof(Math::Vec4<float24>) == 4 * sizeof(float), "Vec4<float24> must be packed floats");
+
+class Compiler {
+public:
+    Compiler(const ShaderProgram& program) : program(program) {
+    }
+
+    /**
+     * Compiles the program into the emitter
+     * @return Position of each instruction in the code, with the exit code at the last index
+     */
+    std::array<size_t, ShaderProgram::MAX_PROGRAM_SIZE + 1> Compile(const std::array<const u8*, ShaderProgram::MAX_PROGRAM_SIZE + 1>& instruction_addresses);
+
+    Emitter emitter;
+
+private:
+    /// Label of the given instruction, or of the exit if the instruction is not compiled
+    Emitter::Label GetLabel(u32 offset) const {
+        if (offset >= ShaderProgram::MAX_PROGRAM_SIZE || (!program.reachable[offset] && !program.return_points[offset]))
+            return exit_label;
+        return instruction_labels[offset];
+    }
+
+    void CallHelper(const void* function) {
+        emitter.MOV_64_Imm(RAX, function);
+        emitter.CALL(RAX);
+    }
+
+    void LoadSource(XmmReg dst, const SourceOperand& source);
+    void StoreDest(XmmReg src, const DestOperand& dest, u8 mask);
+    void EvaluateCondition(const ShaderOp& op, Emitter::Label false_label);
+    void Compare(ShaderOp::CompareOp compare_op, int component);
+
+    void CompileReturnCheck(u32 offset, const std::array<const u8*, ShaderProgram::MAX_PROGRAM_SIZE + 1>& instruction_addresses);
+    void CompileOp(u32 offset);
+
+    const ShaderProgram& program;
+
+    std::array<Emitter::Label, ShaderProgram::MAX_PROGRAM_SIZE> instruction_labels;
+    Emitter::Label exit_label;
+};
+
+void Compiler::LoadSource(XmmReg dst, const SourceOperand& source) {
+    if (source.address_register != 0) {
+        // The register is only known at runtime: inputs and temporaries are addressed relative to
+        // the state, uniforms relative to the setup, and other indices read zero.
+        Emitter::Label in_state = emitter.NewLabel();
+        Emitter::Label in_uniforms = emitter.NewLabel();
+        Emitter::Label done = emitter.NewLabel();
+
+        emitter.MOV_32_Load(RAX, STATE, OFFSET_ADDRESS + 4 * (source.address_register - 1));
+        emitter.ADD_32_Imm(RAX, source.index);
+        emitter.CMP_32_Imm(RAX, REGISTER_FLOAT_UNIFORM_BASE);
+        emitter.Jcc(CC_B, in_state);
+        emitter.CMP_32_Imm(RAX, REGISTER_FLOAT_UNIFORM_END);
+        emitter.Jcc(CC_B, in_uniforms);
+        emitter.XORPS(dst, dst);
+        emitter.JMP(done);
+
+        emitter.Bind(in_uniforms);
+        emitter.SHL_32_Imm(RAX, 4);
+        emitter.ADD_64(RAX, SETUP);
+        emitter.MOVUPS_Load(dst, RAX, OFFSET_FLOAT_UNIFORMS - REGISTER_FLOAT_UNIFORM_BASE * 16);
+        emitter.JMP(done);
+
+        emitter.Bind(in_state);
+        emitter.SHL_32_Imm(RAX, 4);
+        emitter.ADD_64(RAX, STATE);
+        emitter.MOVUPS_Load(dst, RAX, OFFSET_INPUT);
+
+        emitter.Bind(done);
+    } else if (source.index < REGISTER_FLOAT_UNIFORM_BASE) {
+        emitter.MOVUPS_Load(dst, STATE, OFFSET_INPUT + source.index * 16);
+    } else if (source.index < REGISTER_FLOAT_UNIFORM_END) {
+        emitter.MOVUPS_Load(dst, SETUP, OFFSET_FLOAT_UNIFORMS + (source.index - REGISTER_FLOAT_UNIFORM_BASE) * 16);
+    } else {
+        emitter.XORPS(dst, dst);
+    }
+
+    u8 shuffle = source.selectors[0] | (source.selectors[1] << 2) |
+                 (source.selectors[2] << 4) | (source.selectors[3] << 6);
+    if (shuffle != 0xE4) // Identity
+        emitter.SHUFPS(dst, dst, shuffle);
+
+    if (source.negate) {
+        // Multiplied like the interpreter does, which unlike flipping the sign keeps NaNs intact
+        emitter.MOV_64_Imm(RAX, minus_ones);
+        emitter.MOVUPS_Load(XMM5, RAX, 0);
+        emitter.MULPS(dst, XMM5);
+    }
+}
+
+void Compiler::StoreDest(XmmReg src, const DestOperand& dest, u8 mask) {
+    if (dest.index >= REGISTER_DISCARD || mask == 0)
+        return;
+
+    s32 disp = (dest.index < REGISTER_TEMPORARY_BASE) ? OFFSET_OUTPUT + (dest.index - REGISTER_OUTPUT_BASE) * 16
+                                                      : OFFSET_INPUT + dest.index * 16;
+    if (mask == 0xF) {
+        emitter.MOVUPS_Store(STATE, disp, src);
+    } else {
+        emitter.MOVUPS_Load(XMM4, STATE, disp);
+        emitter.BLENDPS(XMM4, src, mask);
+        emitter.MOVUPS_Store(STATE, disp, XMM4);
+    }
+}
+
+void Compiler::EvaluateCondition(const ShaderOp& op, Emitter::Label false_label) {
+    switch (op.condition) {
+    case ShaderOp::Condition::Always:
+        break;
+
+    case ShaderOp::Condition::BoolUniform:
+        emitter.CMP_8_Mem_Imm(SETUP, OFFSET_BOOL_UNIFORMS + op.uniform_id, 0);
+        emitter.Jcc(CC_E, false_label);
+        break;
+
+    case ShaderOp::Condition::ConditionCode:
+        switch (op.condition_op) {
+        case ShaderOp::ConditionOp::Or:
+        {
+            Emitter::Label true_label = emitter.NewLabel();
+            emitter.CMP_8_Mem_Imm(STATE, OFFSET_CONDITIONAL_CODE, op.refx);
+            emitter.Jcc(CC_E, true_label);
+            emitter.CMP_8_Mem_Imm(STATE, OFFSET_CONDITIONAL_CODE + 1, op.refy);
+            emitter.Jcc(CC_NE, false_label);
+            emitter.Bind(true_label);
+            break;
+        }
+
+        case ShaderOp::ConditionOp::And:
+            emitter.CMP_8_Mem_Imm(STATE, OFFSET_CONDITIONAL_CODE, op.refx);
+            emitter.Jcc(CC_NE, false_label);
+            emitter.CMP_8_Mem_Imm(STATE, OFFSET_CONDITIONAL_CODE + 1, op.refy);
+            emitter.Jcc(CC_NE, false_label);
+            break;
+
+        case ShaderOp::ConditionOp::JustX:
+            emitter.CMP_8_Mem_Imm(STATE, OFFSET_CONDITIONAL_CODE, op.refx);
+            emitter.Jcc(CC_NE, false_label);
+            break;
+
+        case ShaderOp::ConditionOp::JustY:
+            emitter.CMP_8_Mem_Imm(STATE, OFFSET_CONDITIONAL_CODE + 1, op.refy);
+            emitter.Jcc(CC_NE, false_label);
+            break;
+        }
+        break;
+    }
+}
+
+/// Compares the lowest components of XMM0 and XMM1 into the given conditional code
+void Compiler::Compare(ShaderOp::CompareOp compare_op, int component) {
+    // UCOMISS sets ZF, PF and CF if either operand is NaN, in which case only NotEqual is true
+    switch (compare_op) {
+    case ShaderOp::CompareOp::Equal:
+        emitter.UCOMISS(XMM0, XMM1);
+        emitter.SETcc(CC_E, RAX);
+        emitter.SETcc(CC_NP, RCX);
+        emitter.AND_8(RAX, RCX);
+        break;
+
+    case ShaderOp::CompareOp::NotEqual:
+        emitter.UCOMISS(XMM0, XMM1);
+        emitter.SETcc(CC_NE, RAX);
+        emitter.SETcc(CC_P, RCX);
+        emitter.OR_8(RAX, RCX);
+        break;
+
+    case ShaderOp::CompareOp::LessThan:
+        emitter.UCOMISS(XMM1, XMM0);
+        emitter.SETcc(CC_A, RAX);
+        break;
+
+    case ShaderOp::CompareOp::LessEqual:
+        emitter.UCOMISS(XMM1, XMM0);
+        emitter.SETcc(CC_AE, RAX);
+        break;
+
+    case ShaderOp::CompareOp::GreaterThan:
+        emitter.UCOMISS(XMM0, XMM1);
+        emitter.SETcc(CC_A, RAX);
+        break;
+
+    case ShaderOp::CompareOp::GreaterEqual:
+        emitter.UCOMISS(XMM0, XMM1);
+        emitter.SETcc(CC_AE, RAX);
+        break;
+
+    case ShaderOp::CompareOp::Unknown:
+        return;
+    }
+
+    emitter.MOV_8_Store(STATE, OFFSET_CONDITIONAL_CODE + component, RAX);
+}
+
+void Compiler::CompileReturnCheck(u32 offset, const std::array<const u8*, ShaderProgram::MAX_PROGRAM_SIZE + 1>& instruction_addresses) {
+    Emitter::Label no_return = emitter.NewLabel();
+
+    emitter.CMP_32_Mem_Imm(STATE, OFFSET_CALL_STACK_SIZE, 0);
+    emitter.Jcc(CC_E, no_return);
+
+    emitter.MOV_64(ABI_PARAM1, STATE);
+    emitter.MOV_32_Imm(ABI_PARAM2, offset);
+    CallHelper((const void*)&JitReturnFromCall);
+    emitter.CMP_32_Imm(RAX, RETURN_NONE);
+    emitter.Jcc(CC_E, no_return);
+
+    // Continue at the returned offset, which checks the call stack again
+    emitter.MOV_32(RAX, RAX);
+    emitter.MOV_64_Imm(RCX, instruction_addresses.data());
+    emitter.JMP_Table(RCX, RAX);
+
+    emitter.Bind(no_return);
+}
+
+void Compiler::CompileOp(u32 offset) {
+    const ShaderOp& op = program.ops[offset];
+
+    switch (op.type) {
+    case ShaderOp::Type::Nop:
+        break;
+
+    case ShaderOp::Type::Add:
+    case ShaderOp::Type::Mul:
+        LoadSource(XMM0, op.src[0]);
+        LoadSource(XMM1, op.src[1]);
+        if (op.type == ShaderOp::Type::Add)
+            emitter.ADDPS(XMM0, XMM1);
+        else
+            emitter.MULPS(XMM0, XMM1);
+        StoreDest(XMM0, op.dest, op.dest.mask);
+        break;
+
+    case ShaderOp::Type::Flr:
+        LoadSource(XMM0, op.src[0]);
+        emitter.ROUNDPS(XMM0, XMM0, 1); // Round towards negative infinity
+        StoreDest(XMM0, op.dest, op.dest.mask);
+        break;
+
+    case ShaderOp::Type::Max:
+        // MAXPS returns its second operand unless the first one is greater, which matches
+        // std::max(src1, src2) with the operands swapped, including for NaNs
+        LoadSource(XMM0, op.src[0]);
+        LoadSource(XMM1, op.src[1]);
+        emitter.MAXPS(XMM1, XMM0);
+        StoreDest(XMM1, op.dest, op.dest.mask);
+        break;
+
+    case ShaderOp::Type::Dp3:
+    case ShaderOp::Type::Dp4:
+    {
+        // Sums the products in the same order as the interpreter to get the same rounding
+        int num_components = (op.type == ShaderOp::Type::Dp3) ? 3 : 4;
+        LoadSource(XMM0, op.src[0]);
+        LoadSource(XMM1, op.src[1]);
+        emitter.MULPS(XMM0, XMM1);
+        emitter.XORPS(XMM2, XMM2);
+        emitter.ADDSS(XMM2, XMM0);
+        for (int i = 1; i < num_components; ++i) {
+            emitter.SHUFPS(XMM0, XMM0, 0x39); // Rotate the next product into the lowest component
+            emitter.ADDSS(XMM2, XMM0);
+        }
+        emitter.SHUFPS(XMM2, XMM2, 0);
+        StoreDest(XMM2, op.dest, op.dest.mask & ((1 << num_components) - 1));
+        break;
+    }
+
+    case ShaderOp::Type::Rcp:
+        LoadSource(XMM0, op.src[0]);
+        emitter.MOV_64_Imm(RAX, ones);
+        emitter.MOVUPS_Load(XMM1, RAX, 0);
+        emitter.DIVPS(XMM1, XMM0);
+        StoreDest(XMM1, op.dest, op.dest.mask);
+        break;
+
+    case ShaderOp::Type::Rsq:
+        // Computed in double precision like the interpreter, two components at a time, since
+        // rounding the square root to single precision first gives different results
+        LoadSource(XMM0, op.src[0]);
+        emitter.CVTPS2PD(XMM1, XMM0);
+        emitter.MOVHLPS(XMM0, XMM0);
+        emitter.CVTPS2PD(XMM0, XMM0);
+        emitter.SQRTPD(XMM1, XMM1);
+        emitter.SQRTPD(XMM0, XMM0);
+        emitter.MOV_64_Imm(RAX, double_ones);
+        emitter.MOVUPS_Load(XMM2, RAX, 0);
+        emitter.MOVUPS_Load(XMM3, RAX, 0);
+        emitter.DIVPD(XMM2, XMM1);
+        emitter.DIVPD(XMM3, XMM0);
+        emitter.CVTPD2PS(XMM2, XMM2);
+        emitter.CVTPD2PS(XMM3, XMM3);
+        emitter.MOVLHPS(XMM2, XMM3);
+        StoreDest(XMM2, op.dest, op.dest.mask);
+        break;
+
+    case ShaderOp::Type::Mova:
+        LoadSource(XMM0, op.src[0]);
+        if (op.dest.mask & 1) {
+            emitter.CVTTSS2SI(RAX, XMM0);
+            emitter.MOV_32_Store(STATE, OFFSET_ADDRESS, RAX);
+        }
+        if (op.dest.mask & 2) {
+            emitter.SHUFPS(XMM0, XMM0, 0x55);
+            emitter.CVTTSS2SI(RAX, XMM0);
+            emitter.MOV_32_Store(STATE, OFFSET_ADDRESS + 4, RAX);
+        }
+        break;
+
+    case ShaderOp::Type::Mov:
+        LoadSource(XMM0, op.src[0]);
+        StoreDest(XMM0, op.dest, op.dest.mask);
+        break;
+
+    case ShaderOp::Type::Cmp:
+        LoadSource(XMM0, op.src[0]);
+        LoadSource(XMM1, op.src[1]);
+        Compare(op.compare_op[0], 0);
+        emitter.SHUFPS(XMM0, XMM0, 0x55);
+        emitter.SHUFPS(XMM1, XMM1, 0x55);
+        Compare(op.compare_op[1], 1);
+        break;
+
+    case ShaderOp::Type::Mad:
+        LoadSource(XMM0, op.src[0]);
+        LoadSource(XMM1, op.src[1]);
+        LoadSource(XMM2, op.src[2]);
+        emitter.MULPS(XMM0, XMM1);
+        emitter.ADDPS(XMM0, XMM2);
+        StoreDest(XMM0, op.dest, op.dest.mask);
+        break;
+
+    case ShaderOp::Type::End:
+        emitter.JMP(exit_label);
+        break;
+
+    case ShaderOp::Type::Jmp:
+    {
+        Emitter::Label not_taken = emitter.NewLabel();
+        EvaluateCondition(op, not_taken);
+        emitter.JMP(GetLabel(op.dest_offset));
+        emitter.Bind(not_taken);
+        break;
+    }
+
+    case ShaderOp::Type::Call:
+    case ShaderOp::Type::If:
+    {
+        Emitter::Label not_taken = emitter.NewLabel();
+        EvaluateCondition(op, not_taken);
+        emitter.MOV_64(ABI_PARAM1, STATE);
+        emitter.MOV_64_Imm(ABI_PARAM2, &op.calls[0]);
+        CallHelper((const void*)&JitPushCall);
+        emitter.JMP(GetLabel(op.calls[0].loop_address));
+        emitter.Bind(not_taken);
+
+        if (op.type == ShaderOp::Type::If) {
+            emitter.MOV_64(ABI_PARAM1, STATE);
+            emitter.MOV_64_Imm(ABI_PARAM2, &op.calls[1]);
+            CallHelper((const void*)&JitPushCall);
+            emitter.JMP(GetLabel(op.calls[1].loop_address));
+        }
+        break;
+    }
+
+    case ShaderOp::Type::Loop:
+        emitter.MOV_64(ABI_PARAM1, STATE);
+        emitter.MOV_64_Imm(ABI_PARAM2, &op);
+        emitter.MOV_64(ABI_PARAM3, SETUP);
+        CallHelper((const void*)&JitPushLoop);
+        emitter.JMP(GetLabel(op.calls[0].loop_address));
+        break;
+    }
+}
+
+std::array<size_t, ShaderProgram::MAX_PROGRAM_SIZE + 1> Compiler::Compile(const std::array<const u8*, ShaderProgram::MAX_PROGRAM_SIZE + 1>& instruction_addresses) {
+    for (auto& label : instruction_labels)
+        label = emitter.NewLabel();
+    exit_label = emitter.NewLabel();
+
+    // Keep the callee-saved registers holding the state and setup, and align the stack for the
+    // helper calls. This also reserves the shadow space required by the Windows calling convention.
+    emitter.PUSH(STATE);
+    emitter.PUSH(SETUP);
+    emitter.SUB_RSP(40);
+    emitter.MOV_64(STATE, ABI_PARAM1);
+    emitter.MOV_64(SETUP, ABI_PARAM2);
+    emitter.JMP(GetLabel(program.main_offset));
+
+    for (u32 offset = 0; offset < ShaderProgram::MAX_PROGRAM_SIZE; ++offset) {
+        if (!program.reachable[offset] && !program.return_points[offset])
+            continue;
+
+        emitter.Bind(instruction_labels[offset]);
+        if (program.return_points[offset])
+            CompileReturnCheck(offset, instruction_addresses);
+
+        if (program.reachable[offset])
+            CompileOp(offset);
+        else
+            emitter.JMP(exit_label);
+    }
+
+    // Running past the end of the program memory ends the program
+    emitter.Bind(exit_label);
+    emitter.ADD_RSP(40);
+    emitter.POP(SETUP);
+    emitter.POP(STATE);
+    emitter.RET();
+
+    emitter.ResolveLabels();
+
+    std::array<size_t, ShaderProgram::MAX_PROGRAM_SIZE + 1> positions;
+    for (u32 offset = 0; offset <= ShaderProgram::MAX_PROGRAM_SIZE; ++offset)
+        positions[offset] = emitter.GetLabelPosition(GetLabel(offset));
+    return positions;
+}
+
+} // anonymous namespace
+
+bool JitProgram::IsSupported() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 19)) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+    return (ecx & bit_SSE4_1) != 0;
+#endif
+}
+
+JitProgram::JitProgram(const ShaderProgram& program) {
+    Compiler compiler(program);
+    auto positions = compiler.Compile(instruction_addresses);
+
+    code_size = compiler.emitter.code.size();
+    code = static_cast<u8*>(AllocateExecutableMemory(code_size));
+    std::memcpy(code, compiler.emitter.code.data(), code_size);
+
+    for (size_t i = 0; i < positions.size(); ++i)
+        instruction_addresses[i] = code + positions[i];
+    entry_point = reinterpret_cast<EntryPoint>(code);
+}
+
+JitProgram::~JitProgram() {
+    FreeMemoryPages(code, code_size);
+}
+
+} // namespace
+
+} // namespace
+
+#else
+
+namespace Pica {
+
+namespace VertexShader {
+
+bool JitProgram::IsSupported() {
+    return false;
+}
+
+JitProgram::JitProgram(const ShaderProgram& program) {
+    UNREACHABLE();
+}
+
+JitProgram::~JitProgram() {
+}
+
+} // namespace
+
+} // namespace
+
+#endif
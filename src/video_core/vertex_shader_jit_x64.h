@@ -0,0 +1,56 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+
+#include "common/common_types.h"
+
+#include "video_core/vertex_shader_program.h"
+
+namespace Pica {
+
+namespace VertexShader {
+
+/**
+ * A decoded shader program compiled to x86-64 code. Swizzles, negation and destination masks are
+ * resolved at compile time into SSE shuffles, multiplications and blends. Register values are
+ * kept in the UnitState in between instructions, and the call stack is handled by calling the
+ * same helpers as the interpreter.
+ */
+class JitProgram {
+public:
+    /// Whether programs can be compiled on this host, which requires x86-64 with SSE4.1
+    static bool IsSupported();
+
+    /// Compiles the given program, which has to outlive the compiled version
+    explicit JitProgram(const ShaderProgram& program);
+    ~JitProgram();
+
+    JitProgram(const JitProgram&) = delete;
+    JitProgram& operator=(const JitProgram&) = delete;
+
+    /// Runs the program using and updating the given state. Can be called from any thread.
+    void Run(UnitState& state, const ShaderSetup& setup) const {
+        entry_point(&state, &setup);
+    }
+
+private:
+    using EntryPoint = void (*)(UnitState* state, const ShaderSetup* setup);
+
+    u8* code = nullptr;
+    size_t code_size = 0;
+    EntryPoint entry_point = nullptr;
+
+    /**
+     * Address of the code of each instruction, used when returning from calls. The last entry is
+     * the exit of the program, where offsets past the end of the program go to.
+     */
+    std::array<const u8*, ShaderProgram::MAX_PROGRAM_SIZE + 1> instruction_addresses;
+};
+
+} // namespace
+
+} // namespace
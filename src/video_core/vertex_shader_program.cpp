@@ -0,0 +1,366 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <vector>
+
+#include <common/make_unique.h>
+
+#include <nihstro/shader_bytecode.h>
+
+#include "vertex_shader_program.h"
+
+using nihstro::OpCode;
+using nihstro::Instruction;
+using nihstro::RegisterType;
+using nihstro::SourceRegister;
+using nihstro::SwizzlePattern;
+
+namespace Pica {
+
+namespace VertexShader {
+
+static u8 DecodeSourceRegister(const SourceRegister& source_reg) {
+    switch (source_reg.GetRegisterType()) {
+    case RegisterType::Input:
+        return REGISTER_INPUT_BASE + source_reg.GetIndex();
+
+    case RegisterType::Temporary:
+        return REGISTER_TEMPORARY_BASE + source_reg.GetIndex();
+
+    case RegisterType::FloatUniform:
+        return REGISTER_FLOAT_UNIFORM_BASE + source_reg.GetIndex();
+
+    default:
+        // Read as zero
+        return REGISTER_FLOAT_UNIFORM_END;
+    }
+}
+
+template <typename DestRegister>
+static u8 DecodeDestRegister(const DestRegister& dest_reg) {
+    return (dest_reg < 0x10) ? REGISTER_OUTPUT_BASE + dest_reg.GetIndex()
+         : (dest_reg < 0x20) ? REGISTER_TEMPORARY_BASE + dest_reg.GetIndex()
+         : REGISTER_DISCARD;
+}
+
+static u8 DecodeDestMask(const SwizzlePattern& swizzle) {
+    u8 mask = 0;
+    for (int i = 0; i < 4; ++i) {
+        if (swizzle.DestComponentEnabled(i))
+            mask |= 1 << i;
+    }
+    return mask;
+}
+
+static SourceOperand DecodeSource(const SourceRegister& source_reg, bool negate,
+                                  const std::array<u8, 4>& selectors) {
+    SourceOperand operand;
+    operand.index = DecodeSourceRegister(source_reg);
+    operand.address_register = 0;
+    operand.selectors = selectors;
+    operand.negate = negate;
+    return operand;
+}
+
+template <typename CompareOpField, typename CompareOpType>
+static ShaderOp::CompareOp DecodeCompareOp(const CompareOpField& compare_op, CompareOpType op) {
+    switch (op) {
+    case compare_op.Equal:
+        return ShaderOp::CompareOp::Equal;
+    case compare_op.NotEqual:
+        return ShaderOp::CompareOp::NotEqual;
+    case compare_op.LessThan:
+        return ShaderOp::CompareOp::LessThan;
+    case compare_op.LessEqual:
+        return ShaderOp::CompareOp::LessEqual;
+    case compare_op.GreaterThan:
+        return ShaderOp::CompareOp::GreaterThan;
+    case compare_op.GreaterEqual:
+        return ShaderOp::CompareOp::GreaterEqual;
+    default:
+        LOG_ERROR(HW_GPU, "Unknown compare mode %x", static_cast<int>(op));
+        return ShaderOp::CompareOp::Unknown;
+    }
+}
+
+static void DecodeFlowCondition(const Instruction& instr, ShaderOp& op) {
+    const auto& flow_control = instr.flow_control;
+
+    op.condition = ShaderOp::Condition::ConditionCode;
+    op.refx = flow_control.refx != 0;
+    op.refy = flow_control.refy != 0;
+
+    switch (flow_control.op) {
+    case flow_control.Or:
+        op.condition_op = ShaderOp::ConditionOp::Or;
+        break;
+
+    case flow_control.And:
+        op.condition_op = ShaderOp::ConditionOp::And;
+        break;
+
+    case flow_control.JustX:
+        op.condition_op = ShaderOp::ConditionOp::JustX;
+        break;
+
+    case flow_control.JustY:
+        op.condition_op = ShaderOp::ConditionOp::JustY;
+        break;
+    }
+}
+
+/// Builds the call stack entry the interpreter pushes for the given call
+static CallStackElement MakeCall(u32 offset, u32 num_instructions, u32 return_offset) {
+    return { offset + num_instructions, return_offset, 0, 0, offset };
+}
+
+/// Decodes the instruction at the given offset, and returns the offsets it may continue at
+static std::vector<u32> DecodeInstruction(const std::array<u32, 1024>& program_code,
+                                          const std::array<u32, 1024>& swizzle_data,
+                                          u32 offset, ShaderOp& op, ShaderProgram& program) {
+    const Instruction& instr = *(const Instruction*)&program_code[offset];
+    std::vector<u32> successors;
+
+    op = ShaderOp();
+    op.type = ShaderOp::Type::Nop;
+    op.dest.index = REGISTER_DISCARD;
+    op.dest.mask = 0;
+    op.condition = ShaderOp::Condition::Always;
+
+    switch (instr.opcode.Value().GetInfo().type) {
+    case OpCode::Type::Arithmetic:
+    {
+        successors.push_back(offset + 1);
+
+        const SwizzlePattern& swizzle = *(SwizzlePattern*)&swizzle_data[instr.common.operand_desc_id];
+        program.max_opdesc_id = std::max<u32>(program.max_opdesc_id, 1 + instr.common.operand_desc_id);
+
+        bool is_inverted = 0 != (instr.opcode.Value().GetInfo().subtype & OpCode::Info::SrcInversed);
+        if (is_inverted) {
+            LOG_ERROR(HW_GPU, "Unsupported inverted arithmetic instruction: 0x%02x (%s): 0x%08x",
+                      (int)instr.opcode.Value().EffectiveOpCode(), instr.opcode.Value().GetInfo().name, instr.hex);
+            break;
+        }
+
+        op.src[0] = DecodeSource(instr.common.GetSrc1(is_inverted), swizzle.negate_src1 != 0, {{
+            (u8)swizzle.GetSelectorSrc1(0), (u8)swizzle.GetSelectorSrc1(1),
+            (u8)swizzle.GetSelectorSrc1(2), (u8)swizzle.GetSelectorSrc1(3)
+        }});
+        op.src[0].address_register = instr.common.address_register_index;
+        op.src[1] = DecodeSource(instr.common.GetSrc2(is_inverted), swizzle.negate_src2 != 0, {{
+            (u8)swizzle.GetSelectorSrc2(0), (u8)swizzle.GetSelectorSrc2(1),
+            (u8)swizzle.GetSelectorSrc2(2), (u8)swizzle.GetSelectorSrc2(3)
+        }});
+        op.dest.index = DecodeDestRegister(instr.common.dest.Value());
+        op.dest.mask = DecodeDestMask(swizzle);
+
+        switch (instr.opcode.Value().EffectiveOpCode()) {
+        case OpCode::Id::ADD:
+            op.type = ShaderOp::Type::Add;
+            break;
+
+        case OpCode::Id::MUL:
+            op.type = ShaderOp::Type::Mul;
+            break;
+
+        case OpCode::Id::FLR:
+            op.type = ShaderOp::Type::Flr;
+            break;
+
+        case OpCode::Id::MAX:
+            op.type = ShaderOp::Type::Max;
+            break;
+
+        case OpCode::Id::DP3:
+        case OpCode::Id::DP4:
+            op.type = (instr.opcode.Value() == OpCode::Id::DP3) ? ShaderOp::Type::Dp3 : ShaderOp::Type::Dp4;
+            break;
+
+        case OpCode::Id::RCP:
+            op.type = ShaderOp::Type::Rcp;
+            break;
+
+        case OpCode::Id::RSQ:
+            op.type = ShaderOp::Type::Rsq;
+            break;
+
+        case OpCode::Id::MOVA:
+            op.type = ShaderOp::Type::Mova;
+            break;
+
+        case OpCode::Id::MOV:
+            op.type = ShaderOp::Type::Mov;
+            break;
+
+        case OpCode::Id::CMP:
+        {
+            auto compare_op = instr.common.compare_op;
+            op.type = ShaderOp::Type::Cmp;
+            op.compare_op[0] = DecodeCompareOp(compare_op, compare_op.x.Value());
+            op.compare_op[1] = DecodeCompareOp(compare_op, compare_op.y.Value());
+            break;
+        }
+
+        default:
+            LOG_ERROR(HW_GPU, "Unhandled arithmetic instruction: 0x%02x (%s): 0x%08x",
+                      (int)instr.opcode.Value().EffectiveOpCode(), instr.opcode.Value().GetInfo().name, instr.hex);
+            break;
+        }
+        break;
+    }
+
+    case OpCode::Type::MultiplyAdd:
+    {
+        successors.push_back(offset + 1);
+
+        if ((instr.opcode.Value().EffectiveOpCode() != OpCode::Id::MAD) &&
+            (instr.opcode.Value().EffectiveOpCode() != OpCode::Id::MADI)) {
+            LOG_ERROR(HW_GPU, "Unhandled multiply-add instruction: 0x%02x (%s): 0x%08x",
+                      (int)instr.opcode.Value().EffectiveOpCode(), instr.opcode.Value().GetInfo().name, instr.hex);
+            break;
+        }
+
+        const SwizzlePattern& swizzle = *(SwizzlePattern*)&swizzle_data[instr.mad.operand_desc_id];
+
+        bool is_inverted = (instr.opcode.Value().EffectiveOpCode() == OpCode::Id::MADI);
+
+        op.type = ShaderOp::Type::Mad;
+        op.src[0] = DecodeSource(instr.mad.GetSrc1(is_inverted), swizzle.negate_src1 != 0, {{
+            (u8)swizzle.GetSelectorSrc1(0), (u8)swizzle.GetSelectorSrc1(1),
+            (u8)swizzle.GetSelectorSrc1(2), (u8)swizzle.GetSelectorSrc1(3)
+        }});
+        op.src[1] = DecodeSource(instr.mad.GetSrc2(is_inverted), swizzle.negate_src2 != 0, {{
+            (u8)swizzle.GetSelectorSrc2(0), (u8)swizzle.GetSelectorSrc2(1),
+            (u8)swizzle.GetSelectorSrc2(2), (u8)swizzle.GetSelectorSrc2(3)
+        }});
+        op.src[2] = DecodeSource(instr.mad.GetSrc3(is_inverted), swizzle.negate_src3 != 0, {{
+            (u8)swizzle.GetSelectorSrc3(0), (u8)swizzle.GetSelectorSrc3(1),
+            (u8)swizzle.GetSelectorSrc3(2), (u8)swizzle.GetSelectorSrc3(3)
+        }});
+        op.dest.index = DecodeDestRegister(instr.mad.dest.Value());
+        op.dest.mask = DecodeDestMask(swizzle);
+        break;
+    }
+
+    default:
+    {
+        const auto& flow_control = instr.flow_control;
+
+        switch (instr.opcode.Value()) {
+        case OpCode::Id::END:
+            op.type = ShaderOp::Type::End;
+            break;
+
+        case OpCode::Id::JMPC:
+        case OpCode::Id::JMPU:
+            op.type = ShaderOp::Type::Jmp;
+            op.dest_offset = flow_control.dest_offset;
+            if (instr.opcode.Value() == OpCode::Id::JMPC) {
+                DecodeFlowCondition(instr, op);
+            } else {
+                op.condition = ShaderOp::Condition::BoolUniform;
+                op.uniform_id = flow_control.bool_uniform_id;
+            }
+            successors.push_back(offset + 1);
+            successors.push_back(op.dest_offset);
+            break;
+
+        case OpCode::Id::CALL:
+        case OpCode::Id::CALLU:
+        case OpCode::Id::CALLC:
+            op.type = ShaderOp::Type::Call;
+            op.calls[0] = MakeCall(flow_control.dest_offset, flow_control.num_instructions, offset + 1);
+            if (instr.opcode.Value() == OpCode::Id::CALLU) {
+                op.condition = ShaderOp::Condition::BoolUniform;
+                op.uniform_id = flow_control.bool_uniform_id;
+            } else if (instr.opcode.Value() == OpCode::Id::CALLC) {
+                DecodeFlowCondition(instr, op);
+            }
+            successors.push_back(offset + 1);
+            break;
+
+        case OpCode::Id::NOP:
+            successors.push_back(offset + 1);
+            break;
+
+        case OpCode::Id::IFU:
+        case OpCode::Id::IFC:
+            op.type = ShaderOp::Type::If;
+            op.calls[0] = MakeCall(offset + 1, flow_control.dest_offset - offset - 1,
+                                   flow_control.dest_offset + flow_control.num_instructions);
+            op.calls[1] = MakeCall(flow_control.dest_offset, flow_control.num_instructions,
+                                   flow_control.dest_offset + flow_control.num_instructions);
+            if (instr.opcode.Value() == OpCode::Id::IFU) {
+                op.condition = ShaderOp::Condition::BoolUniform;
+                op.uniform_id = flow_control.bool_uniform_id;
+            } else {
+                DecodeFlowCondition(instr, op);
+            }
+            break;
+
+        case OpCode::Id::LOOP:
+            op.type = ShaderOp::Type::Loop;
+            op.uniform_id = flow_control.int_uniform_id;
+            op.calls[0] = MakeCall(offset + 1, flow_control.dest_offset - offset + 1,
+                                   flow_control.dest_offset + 1);
+            break;
+
+        default:
+            LOG_ERROR(HW_GPU, "Unhandled instruction: 0x%02x (%s): 0x%08x",
+                      (int)instr.opcode.Value().EffectiveOpCode(), instr.opcode.Value().GetInfo().name, instr.hex);
+            successors.push_back(offset + 1);
+            break;
+        }
+
+        // Calls continue at their start and, once the call stack entry ends, at its return address
+        for (int i = 0; i < 2; ++i) {
+            bool pushes_call = (op.type == ShaderOp::Type::Call && i == 0) ||
+                               op.type == ShaderOp::Type::If ||
+                               (op.type == ShaderOp::Type::Loop && i == 0);
+            if (!pushes_call)
+                continue;
+
+            successors.push_back(op.calls[i].loop_address);
+            successors.push_back(op.calls[i].return_address);
+            if (op.calls[i].final_address < ShaderProgram::MAX_PROGRAM_SIZE)
+                program.return_points.set(op.calls[i].final_address);
+        }
+        break;
+    }
+    }
+
+    return successors;
+}
+
+std::unique_ptr<ShaderProgram> DecodeShaderProgram(const std::array<u32, 1024>& program_code,
+                                                   const std::array<u32, 1024>& swizzle_data,
+                                                   u32 main_offset) {
+    auto program = Common::make_unique<ShaderProgram>();
+    program->main_offset = main_offset;
+    program->max_offset = 0;
+    program->max_opdesc_id = 0;
+
+    std::vector<u32> pending = { main_offset };
+    while (!pending.empty()) {
+        u32 offset = pending.back();
+        pending.pop_back();
+
+        if (offset >= ShaderProgram::MAX_PROGRAM_SIZE || program->reachable[offset])
+            continue;
+
+        program->reachable.set(offset);
+        program->max_offset = std::max(program->max_offset, offset + 1);
+
+        std::vector<u32> successors = DecodeInstruction(program_code, swizzle_data, offset,
+                                                             program->ops[offset], *program);
+        pending.insert(pending.end(), successors.begin(), successors.end());
+    }
+
+    return program;
+}
+
+} // namespace
+
+} // namespace
@@ -0,0 +1,267 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <memory>
+
+#include "common/common_types.h"
+#include "common/logging/log.h"
+
+#include "video_core/math.h"
+#include "video_core/pica.h"
+
+namespace Pica {
+
+namespace VertexShader {
+
+/**
+ * Raw register indices used by the decoded operands. Input and temporary registers share the
+ * range 0x00-0x1F, which matches how they are laid out in UnitState.
+ */
+enum : u8 {
+    REGISTER_INPUT_BASE = 0x00,
+    REGISTER_TEMPORARY_BASE = 0x10,
+    REGISTER_FLOAT_UNIFORM_BASE = 0x20,
+    REGISTER_FLOAT_UNIFORM_END = 0x80,
+
+    // Destination registers
+    REGISTER_OUTPUT_BASE = 0x00,
+    REGISTER_DISCARD = 0x20,
+};
+
+struct SourceOperand {
+    /// Raw register index, see REGISTER_*
+    u8 index;
+    /// When non-zero, address register (address_register - 1) is added to index when executing
+    u8 address_register;
+    /// Component of the register read for each component of the operand
+    std::array<u8, 4> selectors;
+    bool negate;
+};
+
+struct DestOperand {
+    /// Raw register index: 0x00-0x0F for outputs, 0x10-0x1F for temporaries, else discarded
+    u8 index;
+    /// Bit i is set if component i is written
+    u8 mask;
+};
+
+/// Same layout as the elements of the call stack used by the interpreter
+struct CallStackElement {
+    u32 final_address;  // Address upon which we jump to return_address
+    u32 return_address; // Where to jump when leaving scope
+    u8 repeat_counter;  // How often to repeat until this call stack element is removed
+    u8 loop_increment;  // Which value to add to the loop counter after an iteration
+    u32 loop_address;   // The address where we'll return to after each loop iteration
+};
+
+/**
+ * A shader instruction with everything the interpreter decodes at runtime resolved: register
+ * offsets, swizzle selectors, negation, destination masks and the call stack entries pushed by
+ * flow control instructions.
+ */
+struct ShaderOp {
+    enum class Type : u8 {
+        Nop,
+        Add,
+        Mul,
+        Flr,
+        Max,
+        Dp3,
+        Dp4,
+        Rcp,
+        Rsq,
+        Mova,
+        Mov,
+        Cmp,
+        Mad,
+
+        End,
+        Jmp,  ///< Jumps to dest_offset if the condition is true
+        Call, ///< Pushes calls[0] if the condition is true
+        If,   ///< Pushes calls[0] if the condition is true, calls[1] otherwise
+        Loop, ///< Pushes calls[0], repeat counter and increment are taken from int uniform uniform_id
+    };
+
+    enum class Condition : u8 {
+        Always,
+        BoolUniform,   ///< True if bool uniform uniform_id is set
+        ConditionCode, ///< Combines the conditional codes according to condition_op, refx and refy
+    };
+
+    enum class ConditionOp : u8 {
+        Or,
+        And,
+        JustX,
+        JustY,
+    };
+
+    enum class CompareOp : u8 {
+        Equal,
+        NotEqual,
+        LessThan,
+        LessEqual,
+        GreaterThan,
+        GreaterEqual,
+        Unknown, ///< Leaves the conditional code untouched
+    };
+
+    Type type;
+
+    DestOperand dest;
+    SourceOperand src[3];
+
+    /// Comparison applied to the x and y components by Cmp
+    CompareOp compare_op[2];
+
+    Condition condition;
+    ConditionOp condition_op;
+    bool refx;
+    bool refy;
+    u8 uniform_id;
+
+    u32 dest_offset;
+    CallStackElement calls[2];
+};
+
+/// Maximal depth of the call stack, deeper calls are ignored
+static const unsigned MAX_CALL_STACK_DEPTH = 16;
+
+/**
+ * Register state of a shader invocation. Laid out so that compiled programs can address it with
+ * constant offsets, and used both by the JIT and by the interpreter of decoded programs.
+ */
+struct UnitState {
+    // Input and temporary registers are adjacent, so that raw register indices 0x00-0x1F can be
+    // used to address both
+    Math::Vec4<float24> input_registers[16];
+    Math::Vec4<float24> temporary_registers[16];
+    Math::Vec4<float24> output_registers[16];
+
+    // Two Address registers and one loop counter
+    s32 address_registers[3];
+    bool conditional_code[2];
+
+    u32 call_stack_size;
+    std::array<CallStackElement, MAX_CALL_STACK_DEPTH> call_stack;
+};
+
+/**
+ * A shader program decoded from the shader memory, swizzle data and entry point. Only instructions
+ * reachable from the entry point are decoded.
+ */
+struct ShaderProgram {
+    static const unsigned MAX_PROGRAM_SIZE = 1024;
+
+    u32 main_offset;
+
+    std::array<ShaderOp, MAX_PROGRAM_SIZE> ops;
+
+    /// Instructions which may be executed
+    std::bitset<MAX_PROGRAM_SIZE> reachable;
+
+    /**
+     * Addresses at which the top of the call stack may end, i.e. where the interpreter may return
+     * from a call or repeat a loop before executing the instruction
+     */
+    std::bitset<MAX_PROGRAM_SIZE> return_points;
+
+    // Values reported to DebugUtils::DumpShader
+    u32 max_offset;
+    u32 max_opdesc_id;
+};
+
+/// Decodes the program starting at main_offset in the given shader memory
+std::unique_ptr<ShaderProgram> DecodeShaderProgram(const std::array<u32, 1024>& program_code,
+                                                   const std::array<u32, 1024>& swizzle_data,
+                                                   u32 main_offset);
+
+/// Returned by ReturnFromCall if execution continues normally
+static const u32 RETURN_NONE = 0xFFFFFFFF;
+
+// The helpers below are static, so that the copies in vertex_shader_simd_avx.cpp, which is compiled
+// with AVX enabled, are never called by other code
+
+/// Evaluates the condition of a flow control op
+static inline bool EvaluateCondition(const UnitState& state, const ShaderOp& op, const std::array<bool, 16>& bool_uniforms) {
+    switch (op.condition) {
+    case ShaderOp::Condition::Always:
+        return true;
+
+    case ShaderOp::Condition::BoolUniform:
+        return bool_uniforms[op.uniform_id];
+
+    case ShaderOp::Condition::ConditionCode:
+    {
+        bool results[2] = { op.refx == state.conditional_code[0],
+                            op.refy == state.conditional_code[1] };
+
+        switch (op.condition_op) {
+        case ShaderOp::ConditionOp::Or:
+            return results[0] || results[1];
+
+        case ShaderOp::ConditionOp::And:
+            return results[0] && results[1];
+
+        case ShaderOp::ConditionOp::JustX:
+            return results[0];
+
+        case ShaderOp::ConditionOp::JustY:
+            return results[1];
+        }
+    }
+    }
+
+    return false;
+}
+
+/// Pushes an entry to the call stack of the given state
+static inline void PushCall(UnitState& state, const CallStackElement& call) {
+    if (state.call_stack_size == MAX_CALL_STACK_DEPTH) {
+        LOG_ERROR(HW_GPU, "Shader call stack overflow");
+        return;
+    }
+
+    state.call_stack[state.call_stack_size++] = call;
+}
+
+/// Pushes the call stack entry of a Loop op, configured by the given int uniform
+static inline void PushLoop(UnitState& state, const ShaderOp& op, const Math::Vec4<u8>& int_uniform) {
+    state.address_registers[2] = int_uniform.y;
+
+    CallStackElement call = op.calls[0];
+    call.repeat_counter = int_uniform.x;
+    call.loop_increment = int_uniform.z;
+    PushCall(state, call);
+}
+
+/**
+ * Checks whether the call on top of the call stack ends at the given offset, and if so either
+ * leaves it or starts its next iteration.
+ * @return Offset to continue at, or RETURN_NONE if the call doesn't end at this offset
+ */
+static inline u32 ReturnFromCall(UnitState& state, u32 offset) {
+    if (state.call_stack_size == 0)
+        return RETURN_NONE;
+
+    CallStackElement& top = state.call_stack[state.call_stack_size - 1];
+    if (top.final_address != offset)
+        return RETURN_NONE;
+
+    state.address_registers[2] += top.loop_increment;
+
+    if (top.repeat_counter-- == 0) {
+        --state.call_stack_size;
+        return top.return_address;
+    } else {
+        return top.loop_address;
+    }
+}
+
+} // namespace
+
+} // namespace
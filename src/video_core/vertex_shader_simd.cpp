@@ -0,0 +1,193 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cmath>
+
+#include "common/assert.h"
+#include "common/platform.h"
+
+#include "video_core/vertex_shader.h"
+#include "video_core/vertex_shader_simd.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#include <emmintrin.h>
+#if _M_SSE >= 0x401
+#include <smmintrin.h>
+#endif
+
+#include "video_core/vertex_shader_simd_impl.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+namespace Pica {
+
+namespace VertexShader {
+
+namespace {
+
+/// Vector operations of the SIMD interpreter for SSE, see vertex_shader_simd_impl.h
+struct SseVector {
+    using Type = __m128;
+    static const int LANES = 4;
+
+    static __m128 Zero() { return _mm_setzero_ps(); }
+    static __m128 Broadcast(const float* value) { return _mm_load1_ps(value); }
+
+    static __m128 Add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+    static __m128 Mul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+    static __m128 Div(__m128 a, __m128 b) { return _mm_div_ps(a, b); }
+    static __m128 Max(__m128 a, __m128 b) { return _mm_max_ps(a, b); }
+
+    static __m128 Floor(__m128 value) {
+#if _M_SSE >= 0x401
+        return _mm_floor_ps(value);
+#else
+        float values[LANES];
+        _mm_storeu_ps(values, value);
+        for (int lane = 0; lane < LANES; ++lane)
+            values[lane] = std::floor(values[lane]);
+        return _mm_loadu_ps(values);
+#endif
+    }
+
+    /// Computed in double precision like the interpreter, two lanes at a time
+    static __m128 Rsq(__m128 value) {
+        __m128d low = _mm_cvtps_pd(value);
+        __m128d high = _mm_cvtps_pd(_mm_movehl_ps(value, value));
+        low = _mm_div_pd(_mm_set1_pd(1.0), _mm_sqrt_pd(low));
+        high = _mm_div_pd(_mm_set1_pd(1.0), _mm_sqrt_pd(high));
+        return _mm_movelh_ps(_mm_cvtpd_ps(low), _mm_cvtpd_ps(high));
+    }
+
+    static __m128 LaneMask(unsigned lanes) {
+        const __m128i lane_bits = _mm_set_epi32(8, 4, 2, 1);
+        return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(lanes), lane_bits), lane_bits));
+    }
+
+    static __m128 Select(__m128 mask, __m128 value, __m128 fallback) {
+        return _mm_or_ps(_mm_and_ps(mask, value), _mm_andnot_ps(mask, fallback));
+    }
+
+    static bool Compare(ShaderOp::CompareOp compare_op, __m128 src1, __m128 src2, __m128& result) {
+        switch (compare_op) {
+        case ShaderOp::CompareOp::Equal:
+            result = _mm_cmpeq_ps(src1, src2);
+            return true;
+
+        case ShaderOp::CompareOp::NotEqual:
+            result = _mm_cmpneq_ps(src1, src2);
+            return true;
+
+        case ShaderOp::CompareOp::LessThan:
+            result = _mm_cmplt_ps(src1, src2);
+            return true;
+
+        case ShaderOp::CompareOp::LessEqual:
+            result = _mm_cmple_ps(src1, src2);
+            return true;
+
+        case ShaderOp::CompareOp::GreaterThan:
+            result = _mm_cmpgt_ps(src1, src2);
+            return true;
+
+        case ShaderOp::CompareOp::GreaterEqual:
+            result = _mm_cmpge_ps(src1, src2);
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    static int MoveMask(__m128 mask) { return _mm_movemask_ps(mask); }
+
+    static void Truncate(__m128 value, s32* values) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values), _mm_cvttps_epi32(value));
+    }
+
+    static void Transpose(const float* const* lanes, __m128 (&components)[4]) {
+        __m128 rows[LANES];
+        for (int lane = 0; lane < LANES; ++lane)
+            rows[lane] = _mm_loadu_ps(lanes[lane]);
+
+        _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+        for (int comp = 0; comp < 4; ++comp)
+            components[comp] = rows[comp];
+    }
+
+    static void Transpose(const __m128 (&components)[4], float (&lanes)[LANES][4]) {
+        __m128 rows[4] = { components[0], components[1], components[2], components[3] };
+        _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+        for (int lane = 0; lane < LANES; ++lane)
+            _mm_storeu_ps(lanes[lane], rows[lane]);
+    }
+};
+
+static_assert(SseVector::LANES == SIMD_LANES, "SSE registers hold four lanes");
+
+} // namespace
+
+bool IsSimdInterpreterSupported() {
+    return true;
+}
+
+bool IsAvxInterpreterSupported() {
+    // The OS also has to preserve the upper halves of the YMM registers, as indicated by XCR0
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 28)) == 0 || (info[2] & (1 << 27)) == 0)
+        return false;
+    return (_xgetbv(0) & 6) == 6;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+    if ((ecx & bit_AVX) == 0 || (ecx & bit_OSXSAVE) == 0)
+        return false;
+
+    u32 xcr0_low, xcr0_high;
+    asm("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+    return (xcr0_low & 6) == 6;
+#endif
+}
+
+void ProcessShaderCodeSimd(const ShaderProgram& program, UnitState* states, int num_vertices,
+                           const ShaderSetup& setup) {
+    ProcessShaderCodeLanes<SseVector>(program, states, num_vertices, setup);
+}
+
+} // namespace
+
+} // namespace
+
+#else // !(defined(__x86_64__) || defined(_M_X64))
+
+namespace Pica {
+
+namespace VertexShader {
+
+bool IsSimdInterpreterSupported() {
+    return false;
+}
+
+bool IsAvxInterpreterSupported() {
+    return false;
+}
+
+void ProcessShaderCodeSimd(const ShaderProgram& program, UnitState* states, int num_vertices,
+                           const ShaderSetup& setup) {
+    UNREACHABLE();
+}
+
+} // namespace
+
+} // namespace
+
+#endif
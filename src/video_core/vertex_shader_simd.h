@@ -0,0 +1,48 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "video_core/vertex_shader_program.h"
+
+namespace Pica {
+
+namespace VertexShader {
+
+struct ShaderSetup;
+
+/// Number of vertices processed at once by the SIMD interpreter
+static const int SIMD_LANES = 4;
+
+/// Number of vertices processed at once by the AVX variant of the SIMD interpreter
+static const int AVX_LANES = 8;
+
+/// Whether the SIMD interpreter can be used on this host, which requires x86-64
+bool IsSimdInterpreterSupported();
+
+/// Whether the AVX variant can be used on this host, which requires AVX support by the CPU and OS
+bool IsAvxInterpreterSupported();
+
+/**
+ * Interprets the decoded program for up to SIMD_LANES vertices at once. Each register component
+ * is kept in an SSE register holding the values of all vertices, so that every instruction is
+ * executed for all of them together. When the control flow of the vertices diverges, the
+ * vertices at the lowest program offset are run first while the others are masked out, until
+ * they meet at the same instruction again.
+ * @param states Initial and final state of each vertex
+ * @param num_vertices Number of vertices to process, at most SIMD_LANES
+ */
+void ProcessShaderCodeSimd(const ShaderProgram& program, UnitState* states, int num_vertices,
+                           const ShaderSetup& setup);
+
+/**
+ * Same as ProcessShaderCodeSimd, for up to AVX_LANES vertices. Must only be called if
+ * IsAvxInterpreterSupported returns true.
+ */
+void ProcessShaderCodeAvx(const ShaderProgram& program, UnitState* states, int num_vertices,
+                          const ShaderSetup& setup);
+
+} // namespace
+
+} // namespace
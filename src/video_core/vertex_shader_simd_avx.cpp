@@ -0,0 +1,162 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+// This file is compiled with AVX code generation enabled (see CMakeLists.txt), so it must only be
+// called into after checking IsAvxInterpreterSupported.
+
+#include "common/assert.h"
+
+#include "video_core/vertex_shader.h"
+#include "video_core/vertex_shader_simd.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#ifndef __AVX__
+#error "vertex_shader_simd_avx.cpp has to be compiled with AVX enabled"
+#endif
+
+#include <immintrin.h>
+
+#include "video_core/vertex_shader_simd_impl.h"
+
+namespace Pica {
+
+namespace VertexShader {
+
+namespace {
+
+/// Vector operations of the SIMD interpreter for AVX, see vertex_shader_simd_impl.h
+struct AvxVector {
+    using Type = __m256;
+    static const int LANES = 8;
+
+    static __m256 Zero() { return _mm256_setzero_ps(); }
+    static __m256 Broadcast(const float* value) { return _mm256_broadcast_ss(value); }
+
+    static __m256 Add(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+    static __m256 Mul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+    static __m256 Div(__m256 a, __m256 b) { return _mm256_div_ps(a, b); }
+    static __m256 Max(__m256 a, __m256 b) { return _mm256_max_ps(a, b); }
+    static __m256 Floor(__m256 value) { return _mm256_floor_ps(value); }
+
+    /// Computed in double precision like the interpreter, four lanes at a time
+    static __m256 Rsq(__m256 value) {
+        __m256d low = _mm256_cvtps_pd(_mm256_castps256_ps128(value));
+        __m256d high = _mm256_cvtps_pd(_mm256_extractf128_ps(value, 1));
+        low = _mm256_div_pd(_mm256_set1_pd(1.0), _mm256_sqrt_pd(low));
+        high = _mm256_div_pd(_mm256_set1_pd(1.0), _mm256_sqrt_pd(high));
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(low)), _mm256_cvtpd_ps(high), 1);
+    }
+
+    /// AVX lacks integer operations on 256-bit vectors, hence each half is built with SSE2
+    static __m256 LaneMask(unsigned lanes) {
+        const __m128i low_bits = _mm_set_epi32(8, 4, 2, 1);
+        const __m128i high_bits = _mm_set_epi32(128, 64, 32, 16);
+        __m128i value = _mm_set1_epi32(lanes);
+        __m128i low = _mm_cmpeq_epi32(_mm_and_si128(value, low_bits), low_bits);
+        __m128i high = _mm_cmpeq_epi32(_mm_and_si128(value, high_bits), high_bits);
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_castsi128_ps(low)), _mm_castsi128_ps(high), 1);
+    }
+
+    static __m256 Select(__m256 mask, __m256 value, __m256 fallback) {
+        return _mm256_blendv_ps(fallback, value, mask);
+    }
+
+    /// Uses the predicates matching the SSE comparisons, i.e. only NotEqual is true for NaNs
+    static bool Compare(ShaderOp::CompareOp compare_op, __m256 src1, __m256 src2, __m256& result) {
+        switch (compare_op) {
+        case ShaderOp::CompareOp::Equal:
+            result = _mm256_cmp_ps(src1, src2, _CMP_EQ_OQ);
+            return true;
+
+        case ShaderOp::CompareOp::NotEqual:
+            result = _mm256_cmp_ps(src1, src2, _CMP_NEQ_UQ);
+            return true;
+
+        case ShaderOp::CompareOp::LessThan:
+            result = _mm256_cmp_ps(src1, src2, _CMP_LT_OS);
+            return true;
+
+        case ShaderOp::CompareOp::LessEqual:
+            result = _mm256_cmp_ps(src1, src2, _CMP_LE_OS);
+            return true;
+
+        case ShaderOp::CompareOp::GreaterThan:
+            result = _mm256_cmp_ps(src1, src2, _CMP_GT_OS);
+            return true;
+
+        case ShaderOp::CompareOp::GreaterEqual:
+            result = _mm256_cmp_ps(src1, src2, _CMP_GE_OS);
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    static int MoveMask(__m256 mask) { return _mm256_movemask_ps(mask); }
+
+    static void Truncate(__m256 value, s32* values) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(values), _mm256_cvttps_epi32(value));
+    }
+
+    /// Transposes the two groups of four lanes separately, and joins their components
+    static void Transpose(const float* const* lanes, __m256 (&components)[4]) {
+        __m128 low[4], high[4];
+        for (int i = 0; i < 4; ++i) {
+            low[i] = _mm_loadu_ps(lanes[i]);
+            high[i] = _mm_loadu_ps(lanes[4 + i]);
+        }
+
+        _MM_TRANSPOSE4_PS(low[0], low[1], low[2], low[3]);
+        _MM_TRANSPOSE4_PS(high[0], high[1], high[2], high[3]);
+        for (int comp = 0; comp < 4; ++comp)
+            components[comp] = _mm256_insertf128_ps(_mm256_castps128_ps256(low[comp]), high[comp], 1);
+    }
+
+    static void Transpose(const __m256 (&components)[4], float (&lanes)[LANES][4]) {
+        __m128 low[4], high[4];
+        for (int comp = 0; comp < 4; ++comp) {
+            low[comp] = _mm256_castps256_ps128(components[comp]);
+            high[comp] = _mm256_extractf128_ps(components[comp], 1);
+        }
+
+        _MM_TRANSPOSE4_PS(low[0], low[1], low[2], low[3]);
+        _MM_TRANSPOSE4_PS(high[0], high[1], high[2], high[3]);
+        for (int i = 0; i < 4; ++i) {
+            _mm_storeu_ps(lanes[i], low[i]);
+            _mm_storeu_ps(lanes[4 + i], high[i]);
+        }
+    }
+};
+
+static_assert(AvxVector::LANES == AVX_LANES, "AVX registers hold eight lanes");
+
+} // namespace
+
+void ProcessShaderCodeAvx(const ShaderProgram& program, UnitState* states, int num_vertices,
+                          const ShaderSetup& setup) {
+    ProcessShaderCodeLanes<AvxVector>(program, states, num_vertices, setup);
+}
+
+} // namespace
+
+} // namespace
+
+#else // !(defined(__x86_64__) || defined(_M_X64))
+
+namespace Pica {
+
+namespace VertexShader {
+
+void ProcessShaderCodeAvx(const ShaderProgram& program, UnitState* states, int num_vertices,
+                          const ShaderSetup& setup) {
+    UNREACHABLE();
+}
+
+} // namespace
+
+} // namespace
+
+#endif
@@ -0,0 +1,433 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+
+#include "common/assert.h"
+
+#include "video_core/vertex_shader.h"
+#include "video_core/vertex_shader_simd.h"
+
+// Implementation of the SIMD interpreter shared by its SSE and AVX variants, which only differ in
+// the vector type. That is described by a class providing:
+// - Type: the vector type, and LANES: the number of floats it holds
+// - Zero(), Broadcast(const float*): vectors with all lanes set to zero or the given value
+// - Add, Mul, Div, Max: lane-wise arithmetic, where Max picks its second operand for NaNs
+// - Floor, Rsq: lane-wise floor and reciprocal square root, computed as the scalar interpreter does
+// - LaneMask(lanes): vector with all bits set in the lanes enabled in the given bit mask
+// - Select(mask, value, fallback): picks the lanes of value where mask is set, fallback elsewhere
+// - Compare(compare_op, src1, src2, result): lane-wise comparison as a mask, or false if unknown
+// - MoveMask(mask): bit mask of the lanes set in the given mask
+// - Truncate(value, s32*): stores the lanes converted to integers, rounding towards zero
+// - Transpose(const float* const* lanes, Type (&components)[4]): loads a vector per component from
+//   the LANES given vectors of four floats
+// - Transpose(const Type (&components)[4], float (&lanes)[LANES][4]): reverses the above
+//
+// Everything here has internal linkage, since the AVX variant is compiled with AVX code generation
+// enabled and must not provide the definitions used by other code.
+
+namespace Pica {
+
+namespace VertexShader {
+
+namespace {
+
+static_assert(sizeof(Math::Vec4<float24>) == 4 * sizeof(float), "float24 is expected to wrap a float");
+
+/**
+ * Register values of a batch of vertices, with one vector per register component and one lane
+ * per vertex. The per-vertex parts of the state, i.e. address registers, conditional codes and
+ * the call stack, are kept in the UnitState of each vertex.
+ */
+template <typename Vector>
+struct SimdState {
+    // Input registers followed by temporaries, indexed by raw register index as in UnitState
+    typename Vector::Type registers[REGISTER_FLOAT_UNIFORM_BASE][4];
+    typename Vector::Type output_registers[16][4];
+};
+
+using RegisterFile = Math::Vec4<float24> (UnitState::*)[16];
+
+/// Loads a register of each vertex, transposed to one vector per component
+template <typename Vector>
+void LoadRegister(const UnitState* states, int num_vertices, RegisterFile file, int index,
+                  typename Vector::Type (&dest)[4]) {
+    const float* lanes[Vector::LANES];
+    for (int lane = 0; lane < Vector::LANES; ++lane) {
+        // Missing vertices repeat the last one, their lanes are never stored
+        const UnitState& state = states[std::min(lane, num_vertices - 1)];
+        lanes[lane] = reinterpret_cast<const float*>(&(state.*file)[index]);
+    }
+
+    Vector::Transpose(lanes, dest);
+}
+
+/// Stores a register to each vertex, reversing LoadRegister
+template <typename Vector>
+void StoreRegister(UnitState* states, int num_vertices, RegisterFile file, int index,
+                   const typename Vector::Type (&src)[4]) {
+    float lanes[Vector::LANES][4];
+    Vector::Transpose(src, lanes);
+
+    for (int lane = 0; lane < num_vertices; ++lane)
+        std::memcpy(&(states[lane].*file)[index], lanes[lane], sizeof(lanes[lane]));
+}
+
+/// Loads the register with the given raw index for all lanes, uniforms are broadcast to all lanes
+template <typename Vector>
+void LoadSourceRegister(const SimdState<Vector>& simd, const ShaderSetup& setup, int index,
+                        typename Vector::Type (&value)[4]) {
+    if (index >= REGISTER_INPUT_BASE && index < REGISTER_FLOAT_UNIFORM_BASE) {
+        for (int comp = 0; comp < 4; ++comp)
+            value[comp] = simd.registers[index][comp];
+    } else if (index >= REGISTER_FLOAT_UNIFORM_BASE && index < REGISTER_FLOAT_UNIFORM_END) {
+        const float* uniform = reinterpret_cast<const float*>(&setup.uniforms.f[index - REGISTER_FLOAT_UNIFORM_BASE]);
+        for (int comp = 0; comp < 4; ++comp)
+            value[comp] = Vector::Broadcast(&uniform[comp]);
+    } else {
+        for (int comp = 0; comp < 4; ++comp)
+            value[comp] = Vector::Zero();
+    }
+}
+
+/// Reads the given operand for the lanes in exec_lanes, applying its swizzle and negation
+template <typename Vector>
+void ReadSourceOperand(const SimdState<Vector>& simd, const UnitState* states, unsigned exec_lanes,
+                       const ShaderSetup& setup, const SourceOperand& operand,
+                       typename Vector::Type (&value)[4]) {
+    typename Vector::Type reg[4];
+
+    if (operand.address_register == 0) {
+        LoadSourceRegister(simd, setup, operand.index, reg);
+    } else {
+        // Offsets usually match across vertices, otherwise each lane is loaded on its own
+        int offsets[Vector::LANES];
+        bool same_offset = true;
+        int first_lane = -1;
+        for (int lane = 0; lane < Vector::LANES; ++lane) {
+            if (!(exec_lanes & (1 << lane)))
+                continue;
+
+            offsets[lane] = states[lane].address_registers[operand.address_register - 1];
+            if (first_lane == -1)
+                first_lane = lane;
+            else if (offsets[lane] != offsets[first_lane])
+                same_offset = false;
+        }
+
+        if (same_offset) {
+            LoadSourceRegister(simd, setup, operand.index + offsets[first_lane], reg);
+        } else {
+            for (int comp = 0; comp < 4; ++comp)
+                reg[comp] = Vector::Zero();
+
+            for (int lane = 0; lane < Vector::LANES; ++lane) {
+                if (!(exec_lanes & (1 << lane)))
+                    continue;
+
+                typename Vector::Type lane_reg[4];
+                LoadSourceRegister(simd, setup, operand.index + offsets[lane], lane_reg);
+
+                typename Vector::Type mask = Vector::LaneMask(1 << lane);
+                for (int comp = 0; comp < 4; ++comp)
+                    reg[comp] = Vector::Select(mask, lane_reg[comp], reg[comp]);
+            }
+        }
+    }
+
+    for (int comp = 0; comp < 4; ++comp) {
+        value[comp] = reg[operand.selectors[comp]];
+        if (operand.negate) {
+            const float minus_one = -1.0f;
+            value[comp] = Vector::Mul(value[comp], Vector::Broadcast(&minus_one));
+        }
+    }
+}
+
+/// Writes the given components of the result to the destination, in the lanes of exec_mask only
+template <typename Vector>
+void WriteDestOperand(SimdState<Vector>& simd, const DestOperand& dest, unsigned component_mask,
+                      typename Vector::Type exec_mask, const typename Vector::Type (&result)[4]) {
+    typename Vector::Type* reg = (dest.index < REGISTER_TEMPORARY_BASE) ? simd.output_registers[dest.index]
+                               : (dest.index < REGISTER_DISCARD) ? simd.registers[dest.index]
+                               : nullptr;
+    if (reg == nullptr)
+        return;
+
+    for (int comp = 0; comp < 4; ++comp) {
+        if (component_mask & (1 << comp))
+            reg[comp] = Vector::Select(exec_mask, result[comp], reg[comp]);
+    }
+}
+
+/// Calls func with the index of each lane enabled in the given bit mask
+template <typename Vector, typename Func>
+void ForEachLane(unsigned lanes, Func func) {
+    for (int lane = 0; lane < Vector::LANES; ++lane) {
+        if (lanes & (1 << lane))
+            func(lane);
+    }
+}
+
+/// Runs the SIMD interpreter for up to Vector::LANES vertices, see ProcessShaderCodeSimd
+template <typename Vector>
+void ProcessShaderCodeLanes(const ShaderProgram& program, UnitState* states, int num_vertices,
+                            const ShaderSetup& setup) {
+    using VectorType = typename Vector::Type;
+    const int LANES = Vector::LANES;
+    static_assert(LANES <= MAX_SHADER_BATCH_SIZE, "Batches have to fit into the SIMD lanes");
+
+    ASSERT(num_vertices > 0 && num_vertices <= LANES);
+
+    SimdState<Vector> simd;
+    for (int i = 0; i < 16; ++i) {
+        LoadRegister<Vector>(states, num_vertices, &UnitState::input_registers, i, simd.registers[REGISTER_INPUT_BASE + i]);
+        LoadRegister<Vector>(states, num_vertices, &UnitState::temporary_registers, i, simd.registers[REGISTER_TEMPORARY_BASE + i]);
+        LoadRegister<Vector>(states, num_vertices, &UnitState::output_registers, i, simd.output_registers[i]);
+    }
+
+    u32 offsets[LANES];
+
+    // While all active vertices are at the same offset and don't return from calls, only
+    // converged_offset is updated, which saves the bookkeeping for each lane
+    bool converged = true;
+    u32 converged_offset = program.main_offset;
+
+    unsigned active_lanes = (1 << num_vertices) - 1;
+    while (active_lanes != 0) {
+        u32 offset = ShaderProgram::MAX_PROGRAM_SIZE;
+        unsigned exec_lanes = 0;
+
+        if (converged) {
+            if (converged_offset < ShaderProgram::MAX_PROGRAM_SIZE && !program.return_points[converged_offset]) {
+                offset = converged_offset;
+                exec_lanes = active_lanes;
+            } else {
+                for (int lane = 0; lane < LANES; ++lane)
+                    offsets[lane] = converged_offset;
+                converged = false;
+            }
+        }
+
+        if (!converged) {
+            // Leave or repeat the calls ending at the offset of each vertex, and retire vertices
+            // which ran past the end of the program. The vertices at the lowest offset are run next.
+            for (int lane = 0; lane < LANES; ++lane) {
+                if (!(active_lanes & (1 << lane)))
+                    continue;
+
+                u32& lane_offset = offsets[lane];
+                while (lane_offset < ShaderProgram::MAX_PROGRAM_SIZE && program.return_points[lane_offset]) {
+                    u32 return_offset = ReturnFromCall(states[lane], lane_offset);
+                    if (return_offset == RETURN_NONE)
+                        break;
+
+                    lane_offset = return_offset;
+                }
+
+                if (lane_offset >= ShaderProgram::MAX_PROGRAM_SIZE)
+                    active_lanes &= ~(1 << lane);
+                else if (lane_offset < offset)
+                    offset = lane_offset;
+            }
+
+            if (active_lanes == 0)
+                break;
+
+            for (int lane = 0; lane < LANES; ++lane) {
+                if ((active_lanes & (1 << lane)) && offsets[lane] == offset)
+                    exec_lanes |= 1 << lane;
+            }
+
+            converged = (exec_lanes == active_lanes);
+            converged_offset = offset;
+        }
+
+        const VectorType exec_mask = Vector::LaneMask(exec_lanes);
+
+        const ShaderOp& op = program.ops[offset];
+
+        VectorType src1[4];
+        VectorType src2[4];
+        VectorType src3[4];
+        VectorType result[4];
+
+        switch (op.type) {
+        case ShaderOp::Type::Nop:
+            break;
+
+        case ShaderOp::Type::Add:
+            ReadSourceOperand(simd, states, exec_lanes, setup, op.src[0], src1);
+            ReadSourceOperand(simd, states, exec_lanes, setup, op.src[1], src2);
+            for (int comp = 0; comp < 4; ++comp)
+                result[comp] = Vector::Add(src1[comp], src2[comp]);
+            WriteDestOperand(simd, op.dest, op.dest.mask, exec_mask, result);
+            break;
+
+        case ShaderOp::Type::Mul:
+            ReadSourceOperand(simd, states, exec_lanes, setup, op.src[0], src1);
+            ReadSourceOperand(simd, states, exec_lanes, setup, op.src[1], src2);
+            for (int comp = 0; comp < 4; ++comp)
+                result[comp] = Vector::Mul(src1[comp], src2[comp]);
+            WriteDestOperand(simd, op.dest, op.dest.mask, exec_mask, result);
+            break;
+
+        case ShaderOp::Type::Flr:
+            ReadSourceOperand(simd, states, exec_lanes, setup, op.src[0], src1);
+            for (int comp = 0; comp < 4; ++comp)
+                result[comp] = Vector::Floor(src1[comp]);
+            WriteDestOperand(simd, op.dest, op.dest.mask, exec_mask, result);
+            break;
+
+        case ShaderOp::Type::Max:
+            ReadSourceOperand(simd, states, exec_lanes, setup, op.src[0], src1);
+            ReadSourceOperand(simd, states, exec_lanes, setup, op.src[1], src2);
+            // Operands swapped to pick src1 like std::max if either of them is NaN
+            for (int comp = 0; comp < 4; ++comp)
+                result[comp] = Vector::Max(src2[comp], src1[comp]);
+            WriteDestOperand(simd, op.dest, op.dest.mask, exec_mask, result);
+            break;
+
+        case ShaderOp::Type::Dp3:
+        case ShaderOp::Type::Dp4:
+        {
+            ReadSourceOperand(simd, states, exec_lanes, setup, op.src[0], src1);
+            ReadSourceOperand(simd, states, exec_lanes, setup, op.src[1], src2);
+
+            int num_components = (op.type == ShaderOp::Type::Dp3) ? 3 : 4;
+            VectorType dot = Vector::Zero();
+            for (int comp = 0; comp < num_components; ++comp)
+                dot = Vector::Add(dot, Vector::Mul(src1[comp], src2[comp]));
+
+            for (int comp = 0; comp < 4; ++comp)
+                result[comp] = dot;
+            WriteDestOperand(simd, op.dest, op.dest.mask & ((1 << num_components) - 1), exec_mask, result);
+            break;
+        }
+
+        case ShaderOp::Type::Rcp:
+        {
+            ReadSourceOperand(simd, states, exec_lanes, setup, op.src[0], src1);
+            const float one = 1.0f;
+            for (int comp = 0; comp < 4; ++comp)
+                result[comp] = Vector::Div(Vector::Broadcast(&one), src1[comp]);
+            WriteDestOperand(simd, op.dest, op.dest.mask, exec_mask, result);
+            break;
+        }
+
+        case ShaderOp::Type::Rsq:
+            ReadSourceOperand(simd, states, exec_lanes, setup, op.src[0], src1);
+            for (int comp = 0; comp < 4; ++comp)
+                result[comp] = Vector::Rsq(src1[comp]);
+            WriteDestOperand(simd, op.dest, op.dest.mask, exec_mask, result);
+            break;
+
+        case ShaderOp::Type::Mova:
+            ReadSourceOperand(simd, states, exec_lanes, setup, op.src[0], src1);
+            for (int comp = 0; comp < 2; ++comp) {
+                if (!(op.dest.mask & (1 << comp)))
+                    continue;
+
+                s32 values[LANES];
+                Vector::Truncate(src1[comp], values);
+                ForEachLane<Vector>(exec_lanes, [&](int lane) {
+                    states[lane].address_registers[comp] = values[lane];
+                });
+            }
+            break;
+
+        case ShaderOp::Type::Mov:
+            ReadSourceOperand(simd, states, exec_lanes, setup, op.src[0], src1);
+            WriteDestOperand(simd, op.dest, op.dest.mask, exec_mask, src1);
+            break;
+
+        case ShaderOp::Type::Cmp:
+            ReadSourceOperand(simd, states, exec_lanes, setup, op.src[0], src1);
+            ReadSourceOperand(simd, states, exec_lanes, setup, op.src[1], src2);
+            for (int comp = 0; comp < 2; ++comp) {
+                VectorType comparison;
+                if (!Vector::Compare(op.compare_op[comp], src1[comp], src2[comp], comparison))
+                    continue;
+
+                int lane_results = Vector::MoveMask(comparison);
+                ForEachLane<Vector>(exec_lanes, [&](int lane) {
+                    states[lane].conditional_code[comp] = (lane_results & (1 << lane)) != 0;
+                });
+            }
+            break;
+
+        case ShaderOp::Type::Mad:
+            ReadSourceOperand(simd, states, exec_lanes, setup, op.src[0], src1);
+            ReadSourceOperand(simd, states, exec_lanes, setup, op.src[1], src2);
+            ReadSourceOperand(simd, states, exec_lanes, setup, op.src[2], src3);
+            for (int comp = 0; comp < 4; ++comp)
+                result[comp] = Vector::Add(Vector::Mul(src1[comp], src2[comp]), src3[comp]);
+            WriteDestOperand(simd, op.dest, op.dest.mask, exec_mask, result);
+            break;
+
+        case ShaderOp::Type::End:
+            active_lanes &= ~exec_lanes;
+            continue;
+
+        case ShaderOp::Type::Jmp:
+            ForEachLane<Vector>(exec_lanes, [&](int lane) {
+                bool taken = EvaluateCondition(states[lane], op, setup.uniforms.b);
+                offsets[lane] = taken ? op.dest_offset : offset + 1;
+            });
+            converged = false;
+            continue;
+
+        case ShaderOp::Type::Call:
+            ForEachLane<Vector>(exec_lanes, [&](int lane) {
+                if (EvaluateCondition(states[lane], op, setup.uniforms.b)) {
+                    PushCall(states[lane], op.calls[0]);
+                    offsets[lane] = op.calls[0].loop_address;
+                } else {
+                    offsets[lane] = offset + 1;
+                }
+            });
+            converged = false;
+            continue;
+
+        case ShaderOp::Type::If:
+            ForEachLane<Vector>(exec_lanes, [&](int lane) {
+                const CallStackElement& call = op.calls[EvaluateCondition(states[lane], op, setup.uniforms.b) ? 0 : 1];
+                PushCall(states[lane], call);
+                offsets[lane] = call.loop_address;
+            });
+            converged = false;
+            continue;
+
+        case ShaderOp::Type::Loop:
+            ForEachLane<Vector>(exec_lanes, [&](int lane) {
+                PushLoop(states[lane], op, setup.uniforms.i[op.uniform_id]);
+                offsets[lane] = op.calls[0].loop_address;
+            });
+            converged = false;
+            continue;
+        }
+
+        if (converged) {
+            ++converged_offset;
+        } else {
+            ForEachLane<Vector>(exec_lanes, [&](int lane) {
+                offsets[lane] = offset + 1;
+            });
+        }
+    }
+
+    for (int i = 0; i < 16; ++i) {
+        StoreRegister<Vector>(states, num_vertices, &UnitState::temporary_registers, i, simd.registers[REGISTER_TEMPORARY_BASE + i]);
+        StoreRegister<Vector>(states, num_vertices, &UnitState::output_registers, i, simd.output_registers[i]);
+    }
+}
+
+} // namespace
+
+} // namespace
+
+} // namespace
@@ -7,6 +7,8 @@
 
 #include "core/core.h"
 
+#include "video_core/command_processor.h"
+#include "video_core/rasterizer.h"
 #include "video_core/video_core.h"
 #include "video_core/renderer_base.h"
 #include "video_core/renderer_opengl/renderer_opengl.h"
@@ -31,6 +33,8 @@ void Init(EmuWindow* emu_window) {
 
 /// Shutdown the video core
 void Shutdown() {
+    Pica::CommandProcessor::Shutdown();
+    Pica::Rasterizer::Shutdown();
     delete g_renderer;
     LOG_DEBUG(Render, "shutdown OK");
 }